@@ -0,0 +1,314 @@
+/*
+ * Smart Farming System - Minimal CBOR
+ *
+ * Just enough RFC 8949 for the CoAP resources: a writer that encodes
+ * straight into a caller's buffer (normally the outgoing packet) and a
+ * reader that looks up keys in a flat map of text keys.
+ *
+ *   cbor::Writer out(buffer, size);
+ *   out.map(2);
+ *   out.key("soil"); out.integer(41);
+ *   out.key("t");    out.number(23.5f);
+ *   if (!out.ok()) ...                        // buffer was too small
+ *
+ *   cbor::Reader in(payload, length);
+ *   char action[16];
+ *   int32_t seconds;
+ *   in.text("action", action, sizeof(action));
+ *   in.integer("seconds", seconds);
+ *
+ * Floats are written as single precision, or as half precision when that
+ * is exact (whole numbers, halves...). No heap, no Arduino dependencies.
+ */
+
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace cbor {
+
+constexpr int MAX_DEPTH = 4;        // Nesting the reader will skip over
+
+enum MajorType : uint8_t {
+  MAJOR_UNSIGNED = 0,
+  MAJOR_NEGATIVE = 1,
+  MAJOR_BYTES = 2,
+  MAJOR_TEXT = 3,
+  MAJOR_ARRAY = 4,
+  MAJOR_MAP = 5,
+  MAJOR_TAG = 6,
+  MAJOR_SIMPLE = 7
+};
+
+constexpr uint8_t SIMPLE_FALSE = 0xF4;
+constexpr uint8_t SIMPLE_TRUE = 0xF5;
+constexpr uint8_t SIMPLE_NULL = 0xF6;
+constexpr uint8_t FLOAT_HALF = 0xF9;
+constexpr uint8_t FLOAT_SINGLE = 0xFA;
+
+class Writer {
+ public:
+  Writer(uint8_t* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  void map(size_t entries) { head(MAJOR_MAP, entries); }
+  void array(size_t items) { head(MAJOR_ARRAY, items); }
+  void key(const char* name) { text(name); }
+
+  void text(const char* value) {
+    size_t length = value ? strlen(value) : 0;
+    head(MAJOR_TEXT, length);
+    bytes((const uint8_t*)value, length);
+  }
+
+  void integer(int64_t value) {
+    if (value < 0) {
+      head(MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+    } else {
+      head(MAJOR_UNSIGNED, (uint64_t)value);
+    }
+  }
+
+  void boolean(bool value) { byte(value ? SIMPLE_TRUE : SIMPLE_FALSE); }
+  void null() { byte(SIMPLE_NULL); }
+
+  void number(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t half;
+    if (toHalf(bits, half)) {
+      byte(FLOAT_HALF);
+      byte(half >> 8);
+      byte(half & 0xFF);
+      return;
+    }
+    byte(FLOAT_SINGLE);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      byte((bits >> shift) & 0xFF);
+    }
+  }
+
+  size_t length() const { return length_; }
+  bool ok() const { return !overflow_; }
+
+ private:
+  void head(MajorType major, uint64_t argument) {
+    uint8_t type = (uint8_t)(major << 5);
+    if (argument < 24) {
+      byte(type | (uint8_t)argument);
+    } else if (argument <= 0xFF) {
+      byte(type | 24);
+      byte((uint8_t)argument);
+    } else if (argument <= 0xFFFF) {
+      byte(type | 25);
+      byte(argument >> 8);
+      byte(argument & 0xFF);
+    } else if (argument <= 0xFFFFFFFFULL) {
+      byte(type | 26);
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        byte((argument >> shift) & 0xFF);
+      }
+    } else {
+      byte(type | 27);
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        byte((argument >> shift) & 0xFF);
+      }
+    }
+  }
+
+  // Half precision when it round-trips exactly (normal numbers only)
+  static bool toHalf(uint32_t bits, uint16_t& half) {
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if ((bits & 0x7FFFFFFF) == 0) {
+      half = (uint16_t)sign;
+      return true;
+    }
+    if (exponent <= 0 || exponent >= 31 || (mantissa & 0x1FFF) != 0) {
+      return false;
+    }
+    half = (uint16_t)(sign | ((uint32_t)exponent << 10) | (mantissa >> 13));
+    return true;
+  }
+
+  void byte(uint8_t value) {
+    if (length_ >= size_) {
+      overflow_ = true;
+      return;
+    }
+    buffer_[length_++] = value;
+  }
+
+  void bytes(const uint8_t* data, size_t length) {
+    if (length_ + length > size_) {
+      overflow_ = true;
+      return;
+    }
+    memcpy(buffer_ + length_, data, length);
+    length_ += length;
+  }
+
+  uint8_t* buffer_;
+  size_t size_;
+  size_t length_ = 0;
+  bool overflow_ = false;
+};
+
+// Looks values up in a top-level map with text keys; anything else in the
+// map (nested items, other key types) is skipped
+class Reader {
+ public:
+  Reader(const uint8_t* data, size_t length) : data_(data), length_(length) {}
+
+  // False when the payload is not a well-formed map
+  bool valid() const {
+    size_t position = 0;
+    uint8_t major;
+    uint64_t entries;
+    if (!readHead(position, major, entries) || major != MAJOR_MAP) {
+      return false;
+    }
+    for (uint64_t i = 0; i < entries * 2; i++) {
+      if (!skip(position, 0)) {
+        return false;
+      }
+    }
+    return position == length_;
+  }
+
+  bool text(const char* key, char* out, size_t size) const {
+    size_t position;
+    uint8_t major;
+    uint64_t length;
+    if (!find(key, position) || !readHead(position, major, length) || major != MAJOR_TEXT ||
+        length >= size || position + length > length_) {
+      return false;
+    }
+    memcpy(out, data_ + position, length);
+    out[length] = '\0';
+    return true;
+  }
+
+  bool integer(const char* key, int32_t& out) const {
+    size_t position;
+    uint8_t major;
+    uint64_t value;
+    if (!find(key, position) || !readHead(position, major, value) || value > 0x7FFFFFFF) {
+      return false;
+    }
+    if (major == MAJOR_UNSIGNED) {
+      out = (int32_t)value;
+      return true;
+    }
+    if (major == MAJOR_NEGATIVE) {
+      out = -1 - (int32_t)value;
+      return true;
+    }
+    return false;
+  }
+
+  bool boolean(const char* key, bool& out) const {
+    size_t position;
+    if (!find(key, position) || position >= length_ ||
+        (data_[position] != SIMPLE_TRUE && data_[position] != SIMPLE_FALSE)) {
+      return false;
+    }
+    out = data_[position] == SIMPLE_TRUE;
+    return true;
+  }
+
+ private:
+  // Position of the value stored under key
+  bool find(const char* key, size_t& valuePosition) const {
+    size_t position = 0;
+    uint8_t major;
+    uint64_t entries;
+    if (!readHead(position, major, entries) || major != MAJOR_MAP) {
+      return false;
+    }
+    size_t keyLength = strlen(key);
+    for (uint64_t i = 0; i < entries; i++) {
+      size_t keyStart = position;
+      uint64_t length;
+      if (readHead(position, major, length) && major == MAJOR_TEXT && length == keyLength &&
+          position + length <= length_ && memcmp(data_ + position, key, keyLength) == 0) {
+        valuePosition = position + length;
+        return true;
+      }
+      position = keyStart;
+      if (!skip(position, 0) || !skip(position, 0)) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  bool readHead(size_t& position, uint8_t& major, uint64_t& argument) const {
+    if (position >= length_) {
+      return false;
+    }
+    uint8_t initial = data_[position++];
+    major = initial >> 5;
+    uint8_t info = initial & 0x1F;
+    if (info < 24) {
+      argument = info;
+      return true;
+    }
+    if (info > 27) {
+      return false;               // Indefinite lengths are not used here
+    }
+    size_t bytes = (size_t)1 << (info - 24);
+    if (position + bytes > length_) {
+      return false;
+    }
+    argument = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      argument = (argument << 8) | data_[position++];
+    }
+    return true;
+  }
+
+  bool skip(size_t& position, int depth) const {
+    uint8_t major;
+    uint64_t argument;
+    if (depth > MAX_DEPTH || !readHead(position, major, argument)) {
+      return false;
+    }
+    switch (major) {
+      case MAJOR_BYTES:
+      case MAJOR_TEXT:
+        if (argument > length_ - position) {
+          return false;
+        }
+        position += argument;
+        return true;
+      case MAJOR_ARRAY:
+      case MAJOR_MAP: {
+        uint64_t items = major == MAJOR_MAP ? argument * 2 : argument;
+        if (items > length_ - position) {
+          return false;           // Every item takes at least one byte
+        }
+        for (uint64_t i = 0; i < items; i++) {
+          if (!skip(position, depth + 1)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      case MAJOR_TAG:
+        return skip(position, depth + 1);
+      default:
+        return true;
+    }
+  }
+
+  const uint8_t* data_;
+  size_t length_;
+};
+
+}  // namespace cbor
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * Smart Farming System - CoAP Messages
+ *
+ * RFC 7252 message parsing and building for the CoAP server, plus the
+ * RFC 7641 observer table. Transport and resources live in online.ino
+ * (COAP SERVER FUNCTIONS); this file only deals with bytes:
+ *
+ *   coap::Request request;
+ *   if (coap::parse(packet, length, request) == coap::PARSE_OK) ...
+ *
+ *   coap::Builder out(packet, sizeof(packet));
+ *   out.header(coap::TYPE_ACK, coap::CONTENT, request.messageId, request.token, request.tokenLength);
+ *   out.option(coap::OPTION_CONTENT_FORMAT, coap::FORMAT_CBOR);
+ *   size_t room;
+ *   uint8_t* payload = out.beginPayload(room);  // encode straight into the packet
+ *   out.endPayload(used);
+ *
+ * Options must be added in ascending number order. The request's Uri-Path
+ * segments are joined into one "/a/b" string; Uri-Query is kept as one
+ * "&"-joined string. No heap, no Arduino dependencies.
+ */
+
+#ifndef COAP_H
+#define COAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace coap {
+
+constexpr uint8_t VERSION = 1;
+constexpr size_t MAX_TOKEN = 8;
+constexpr size_t MAX_PATH = 40;
+constexpr size_t MAX_QUERY = 40;
+constexpr uint8_t PAYLOAD_MARKER = 0xFF;
+
+// Confirmable transmission parameters (RFC 7252 section 4.8 defaults)
+constexpr uint32_t ACK_TIMEOUT_MS = 2000;
+constexpr uint32_t ACK_RANDOM_SPAN_MS = ACK_TIMEOUT_MS / 2;   // ACK_RANDOM_FACTOR 1.5
+constexpr uint8_t MAX_RETRANSMIT = 4;
+
+enum Type : uint8_t {
+  TYPE_CON = 0,
+  TYPE_NON = 1,
+  TYPE_ACK = 2,
+  TYPE_RST = 3
+};
+
+// Codes are class << 5 | detail, so 2.05 is 0x45
+constexpr uint8_t code(uint8_t codeClass, uint8_t detail) {
+  return (uint8_t)(codeClass << 5 | detail);
+}
+
+enum Code : uint8_t {
+  EMPTY = 0,
+  GET = 1,
+  POST = 2,
+  PUT = 3,
+  DELETE = 4,
+  CHANGED = code(2, 4),
+  CONTENT = code(2, 5),
+  BAD_REQUEST = code(4, 0),
+  UNAUTHORIZED = code(4, 1),
+  BAD_OPTION = code(4, 2),
+  NOT_FOUND = code(4, 4),
+  METHOD_NOT_ALLOWED = code(4, 5),
+  NOT_ACCEPTABLE = code(4, 6),
+  CONFLICT = code(4, 9),
+  UNSUPPORTED_FORMAT = code(4, 15),
+  INTERNAL_SERVER_ERROR = code(5, 0),
+  SERVICE_UNAVAILABLE = code(5, 3)
+};
+
+enum Option : uint16_t {
+  OPTION_URI_HOST = 3,
+  OPTION_OBSERVE = 6,
+  OPTION_URI_PORT = 7,
+  OPTION_URI_PATH = 11,
+  OPTION_CONTENT_FORMAT = 12,
+  OPTION_MAX_AGE = 14,
+  OPTION_URI_QUERY = 15,
+  OPTION_ACCEPT = 17,
+  OPTION_BLOCK2 = 23
+};
+
+enum Format : uint16_t {
+  FORMAT_TEXT = 0,
+  FORMAT_LINK = 40,
+  FORMAT_CBOR = 60,
+  FORMAT_NONE = 0xFFFF
+};
+
+enum ParseResult : uint8_t {
+  PARSE_OK = 0,
+  PARSE_FORMAT_ERROR,         // Not CoAP, or broken: CON gets a reset, anything else is ignored
+  PARSE_BAD_OPTION            // Well formed, but carries a critical option we do not know
+};
+
+constexpr uint32_t OBSERVE_NONE = 0xFFFFFFFF;
+
+struct Request {
+  uint8_t type;
+  uint8_t code;
+  uint16_t messageId;
+  uint8_t token[MAX_TOKEN];
+  uint8_t tokenLength;
+  char path[MAX_PATH];
+  char query[MAX_QUERY];
+  uint32_t observe;           // OBSERVE_NONE when absent; 0 registers, 1 deregisters
+  uint16_t contentFormat;     // FORMAT_NONE when absent
+  uint16_t accept;
+  const uint8_t* payload;
+  size_t payloadLength;
+};
+
+inline uint32_t readUint(const uint8_t* value, size_t length) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < length && i < 4; i++) {
+    result = (result << 8) | value[i];
+  }
+  return result;
+}
+
+// Appends a path segment or query parameter; false if it does not fit
+inline bool appendPart(char* out, size_t size, char separator, const uint8_t* value, size_t length) {
+  size_t used = strlen(out);
+  if (used + 1 + length >= size) {
+    return false;
+  }
+  if (separator != '\0') {
+    out[used++] = separator;
+  }
+  memcpy(out + used, value, length);
+  out[used + length] = '\0';
+  return true;
+}
+
+// Option delta/length nibbles: 13 and 14 mean one or two extension bytes
+inline bool readExtended(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+  if (value == 13) {
+    if (p >= end) {
+      return false;
+    }
+    value = 13 + *p++;
+  } else if (value == 14) {
+    if (end - p < 2) {
+      return false;
+    }
+    value = 269 + ((uint32_t)p[0] << 8 | p[1]);
+    p += 2;
+  } else if (value == 15) {
+    return false;
+  }
+  return true;
+}
+
+inline ParseResult parse(const uint8_t* data, size_t length, Request& request) {
+  memset(&request, 0, sizeof(request));
+  request.observe = OBSERVE_NONE;
+  request.contentFormat = FORMAT_NONE;
+  request.accept = FORMAT_NONE;
+  request.path[0] = '/';
+  if (length < 4 || (data[0] >> 6) != VERSION) {
+    return PARSE_FORMAT_ERROR;
+  }
+  request.type = (data[0] >> 4) & 0x03;
+  request.tokenLength = data[0] & 0x0F;
+  request.code = data[1];
+  request.messageId = (uint16_t)(data[2] << 8 | data[3]);
+  if (request.tokenLength > MAX_TOKEN || 4 + (size_t)request.tokenLength > length) {
+    return PARSE_FORMAT_ERROR;
+  }
+  memcpy(request.token, data + 4, request.tokenLength);
+  if (request.code == EMPTY) {
+    // Empty messages (ping, ACK, RST) carry nothing after the header
+    return length == 4 ? PARSE_OK : PARSE_FORMAT_ERROR;
+  }
+
+  const uint8_t* p = data + 4 + request.tokenLength;
+  const uint8_t* end = data + length;
+  uint32_t number = 0;
+  bool badOption = false;
+  bool firstSegment = true;
+  while (p < end && *p != PAYLOAD_MARKER) {
+    uint32_t delta = *p >> 4;
+    uint32_t optionLength = *p & 0x0F;
+    p++;
+    if (!readExtended(p, end, delta) || !readExtended(p, end, optionLength) || optionLength > (size_t)(end - p)) {
+      return PARSE_FORMAT_ERROR;
+    }
+    number += delta;
+    const uint8_t* value = p;
+    p += optionLength;
+    switch (number) {
+      case OPTION_URI_PATH:
+        if (!appendPart(request.path, sizeof(request.path), firstSegment ? '\0' : '/', value, optionLength)) {
+          badOption = true;
+        }
+        firstSegment = false;
+        break;
+      case OPTION_URI_QUERY:
+        if (!appendPart(request.query, sizeof(request.query), request.query[0] ? '&' : '\0', value, optionLength)) {
+          badOption = true;
+        }
+        break;
+      case OPTION_OBSERVE:
+        request.observe = readUint(value, optionLength);
+        break;
+      case OPTION_CONTENT_FORMAT:
+        request.contentFormat = (uint16_t)readUint(value, optionLength);
+        break;
+      case OPTION_ACCEPT:
+        request.accept = (uint16_t)readUint(value, optionLength);
+        break;
+      case OPTION_URI_HOST:
+      case OPTION_URI_PORT:
+      case OPTION_BLOCK2:
+        // Every response fits one datagram, so a Block2 size request changes nothing
+        break;
+      default:
+        if (number & 1) {
+          badOption = true;       // Unknown critical option
+        }
+        break;
+    }
+  }
+  if (p < end) {
+    p++;                          // Marker
+    if (p == end) {
+      return PARSE_FORMAT_ERROR;  // Marker without a payload
+    }
+    request.payload = p;
+    request.payloadLength = end - p;
+  }
+  return badOption ? PARSE_BAD_OPTION : PARSE_OK;
+}
+
+class Builder {
+ public:
+  Builder(uint8_t* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  void header(uint8_t type, uint8_t responseCode, uint16_t messageId, const uint8_t* token, uint8_t tokenLength) {
+    length_ = 0;
+    lastOption_ = 0;
+    overflow_ = false;
+    byte((uint8_t)(VERSION << 6 | type << 4 | tokenLength));
+    byte(responseCode);
+    byte(messageId >> 8);
+    byte(messageId & 0xFF);
+    bytes(token, tokenLength);
+  }
+
+  void option(uint16_t number, const uint8_t* value, size_t valueLength) {
+    uint32_t delta = number - lastOption_;
+    lastOption_ = number;
+    uint8_t deltaNibble = nibble(delta);
+    uint8_t lengthNibble = nibble(valueLength);
+    byte((uint8_t)(deltaNibble << 4 | lengthNibble));
+    extended(deltaNibble, delta);
+    extended(lengthNibble, valueLength);
+    bytes(value, valueLength);
+  }
+
+  // Unsigned options use the fewest bytes; zero is the empty value
+  void option(uint16_t number, uint32_t value) {
+    uint8_t encoded[4];
+    size_t used = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      if (used > 0 || (value >> shift) != 0) {
+        encoded[used++] = (value >> shift) & 0xFF;
+      }
+    }
+    option(number, encoded, used);
+  }
+
+  void option(uint16_t number, const char* value) {
+    option(number, (const uint8_t*)value, strlen(value));
+  }
+
+  // Room after the payload marker, to encode into directly
+  uint8_t* beginPayload(size_t& room) {
+    if (overflow_ || length_ + 1 >= size_) {
+      room = 0;
+      return buffer_ + length_;
+    }
+    room = size_ - length_ - 1;
+    return buffer_ + length_ + 1;
+  }
+
+  void endPayload(size_t used) {
+    if (used == 0 || overflow_) {
+      return;
+    }
+    buffer_[length_] = PAYLOAD_MARKER;
+    length_ += 1 + used;
+  }
+
+  size_t length() const { return length_; }
+  bool ok() const { return !overflow_; }
+
+ private:
+  static uint8_t nibble(uint32_t value) {
+    return value < 13 ? (uint8_t)value : (value < 269 ? 13 : 14);
+  }
+
+  void extended(uint8_t nibbleValue, uint32_t value) {
+    if (nibbleValue == 13) {
+      byte((uint8_t)(value - 13));
+    } else if (nibbleValue == 14) {
+      byte((uint8_t)((value - 269) >> 8));
+      byte((uint8_t)((value - 269) & 0xFF));
+    }
+  }
+
+  void byte(uint8_t value) {
+    if (length_ >= size_) {
+      overflow_ = true;
+      return;
+    }
+    buffer_[length_++] = value;
+  }
+
+  void bytes(const uint8_t* data, size_t count) {
+    if (length_ + count > size_) {
+      overflow_ = true;
+      return;
+    }
+    memcpy(buffer_ + length_, data, count);
+    length_ += count;
+  }
+
+  uint8_t* buffer_;
+  size_t size_;
+  size_t length_ = 0;
+  uint16_t lastOption_ = 0;
+  bool overflow_ = false;
+};
+
+// RFC 7641 observers. A client registers with GET + Observe 0 and is
+// identified by its address, port and token, as the RFC requires.
+struct Observer {
+  bool used;
+  uint32_t address;
+  uint16_t port;
+  uint8_t token[MAX_TOKEN];
+  uint8_t tokenLength;
+  uint8_t resource;           // Caller's resource index
+  uint32_t sequence;          // Observe value of the last notification (24 bits)
+  uint32_t lastNotifyMs;
+  uint32_t version;           // Resource version the client has seen
+  uint16_t lastMessageId;     // Of the last notification, to match ACK/RST
+  uint8_t sinceConfirmable;   // Notifications since the last confirmable one
+  bool awaitingAck;           // A confirmable notification is in flight
+  uint8_t retransmits;        // Retransmissions of it so far
+  uint32_t ackTimeoutMs;      // Current timeout, doubled on each retransmission
+  uint32_t retransmitMs;      // When the next retransmission is due
+};
+
+template <size_t N>
+class ObserverTable {
+ public:
+  // Adds or refreshes a registration; nullptr when the table is full
+  Observer* add(uint32_t address, uint16_t port, const uint8_t* token, uint8_t tokenLength, uint8_t resource) {
+    Observer* observer = find(address, port, token, tokenLength);
+    if (observer == nullptr) {
+      for (size_t i = 0; i < N; i++) {
+        if (!entries[i].used) {
+          observer = &entries[i];
+          break;
+        }
+      }
+      if (observer == nullptr) {
+        return nullptr;
+      }
+      memset(observer, 0, sizeof(*observer));
+      observer->used = true;
+      observer->address = address;
+      observer->port = port;
+      memcpy(observer->token, token, tokenLength);
+      observer->tokenLength = tokenLength;
+    }
+    observer->resource = resource;
+    observer->awaitingAck = false;
+    return observer;
+  }
+
+  Observer* find(uint32_t address, uint16_t port, const uint8_t* token, uint8_t tokenLength) {
+    for (size_t i = 0; i < N; i++) {
+      Observer& observer = entries[i];
+      if (observer.used && observer.address == address && observer.port == port &&
+          observer.tokenLength == tokenLength && memcmp(observer.token, token, tokenLength) == 0) {
+        return &observer;
+      }
+    }
+    return nullptr;
+  }
+
+  Observer* findByMessageId(uint32_t address, uint16_t port, uint16_t messageId) {
+    for (size_t i = 0; i < N; i++) {
+      Observer& observer = entries[i];
+      if (observer.used && observer.address == address && observer.port == port && observer.lastMessageId == messageId) {
+        return &observer;
+      }
+    }
+    return nullptr;
+  }
+
+  void remove(Observer* observer) {
+    if (observer != nullptr) {
+      observer->used = false;
+    }
+  }
+
+  size_t count() const {
+    size_t used = 0;
+    for (size_t i = 0; i < N; i++) {
+      used += entries[i].used ? 1 : 0;
+    }
+    return used;
+  }
+
+  Observer entries[N] = {};
+};
+
+}  // namespace coap
+
+#endif
@@ -105,6 +105,21 @@
 #define ENCODER_DT_PIN 17          // Rotary encoder data
 #define ENCODER_SW_PIN 4           // Rotary encoder switch/button
 
+// Water Tank Pins (only used when TANK_SENSOR_TYPE is set below)
+#define TANK_TRIG_PIN 25           // Ultrasonic sensor trigger (HC-SR04 / JSN-SR04T)
+#define TANK_ECHO_PIN 26           // Ultrasonic sensor echo (use a divider on 5V modules!)
+#define TANK_FLOAT_PIN 27          // Float switch (to GND)
+
+// Pump Current Sensor Pin (only used when PUMP_CURRENT_SENSING is enabled)
+#define PUMP_CURRENT_PIN 35        // ACS712 / shunt amplifier output (must be an ADC1 pin)
+
+// Frequency Soil Probe Pins (only used when SOIL_PROBE_TYPE is SOIL_PROBE_FREQUENCY)
+#define SOIL_FREQUENCY_PINS {32}   // Probe outputs, first one drives irrigation (up to 4)
+#define SOIL_FREQ_GATE_PIN 33      // Internal gate signal - leave this pin unconnected
+
+// Soil Temperature Probe Pin (only used when SOIL_TEMPERATURE_PROBE is enabled)
+#define SOIL_TEMPERATURE_PIN 13    // DS18B20 data line (4.7k pull-up to 3.3V)
+
 // ===============================================================================
 // STEP 3: WIFI AND IOT SETUP (IMPORTANT!)
 // ===============================================================================
@@ -178,6 +193,13 @@
 #define IRRIGATION_COOLDOWN 300000    // Wait time between irrigations (5 minutes)
 #define MAX_DAILY_IRRIGATIONS 10     // Maximum waterings per day (safety limit)
 
+// Crop Profile (see crops.h for the crops and their growth stages)
+// When set, the current growth stage's target replaces SOIL_MOISTURE_THRESHOLD
+// and its crop coefficient scales the pump runtime. Needs the clock (NTP below).
+#define CROP_PROFILE ""                // "tomato", "lettuce", "seedlings"... or "" for none
+#define PLANTING_DATE "2024-01-01"     // Planting/transplant date (YYYY-MM-DD)
+#define CROP_STAGE_UPDATE_INTERVAL 3600000  // How often the growth stage is recomputed (ms)
+
 // ===============================================================================
 // AUTOMATIC CONFIGURATION BASED ON SETUP TYPE
 // ===============================================================================
@@ -277,6 +299,15 @@
 #define LDR_NONE 0
 #define LDR_TYPE_ENABLED 1
 
+// Soil Probe Types
+#define SOIL_PROBE_ANALOG 0        // Voltage output read by the ADC
+#define SOIL_PROBE_FREQUENCY 1     // Oscillator/frequency output counted by PCNT
+
+// Water Tank Sensor Types
+#define TANK_NONE 0
+#define TANK_ULTRASONIC 1
+#define TANK_FLOAT 2
+
 // Display Types
 #define DISPLAY_NONE 0
 #define DISPLAY_LCD_1602 1
@@ -306,6 +337,7 @@
 #define TEMPERATURE_MONITORING_ENABLED DHT_ENABLED
 #define HUMIDITY_MONITORING_ENABLED DHT_ENABLED
 #define LIGHT_MONITORING_ENABLED LDR_ENABLED
+#define TANK_ENABLED (TANK_SENSOR_TYPE != TANK_NONE)
 
 // ===============================================================================
 // DISPLAY CONFIGURATION (AUTOMATIC)
@@ -356,9 +388,14 @@
 // Rotary Encoder Settings (when CONTROL_ROTARY_ENCODER is selected)
 #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
   #define ENCODER_DEBOUNCE_TIME 50      // Button debounce time (ms)
+  #define ENCODER_EDGE_DEBOUNCE_US 1000 // Ignore encoder edges closer than this (us)
   #define ENCODER_STEP_SIZE 1           // Threshold adjustment step size
+  #define ENCODER_ACCEL_FAST_MS 40      // Detents faster than this use PARAMETER_MAX_STEP
+  #define ENCODER_ACCEL_SLOW_MS 250     // Detents slower than this use PARAMETER_MIN_STEP
+  #define ENCODER_MIN_THRESHOLD 5       // Minimum threshold setting (%)
+  #define ENCODER_MAX_THRESHOLD 50      // Maximum threshold setting (%)
   #define MENU_TIMEOUT 30000            // Menu timeout (ms)
-  #define MENU_ITEMS 5                  // Number of menu items
+  #define MENU_MAX_DEPTH 4              // Maximum nesting of submenus
 #endif
 
 // ===============================================================================
@@ -370,6 +407,39 @@
 #define WIFI_RECONNECT_INTERVAL 30000   // WiFi reconnection interval (ms)
 #define WIFI_MAX_RETRIES 3              // Maximum WiFi connection retries
 
+// Access-Point Fallback (local dashboard when the WiFi network is unreachable)
+// The unit opens its own network with a captive DNS responder, so phones show
+// the dashboard as a sign-in page, and rejoins WiFi once the network is back.
+#define SOFTAP_FALLBACK_ENABLED true    // Open an access point when WiFi cannot connect
+#define SOFTAP_SSID "SmartFarm"         // Access point name
+#define SOFTAP_PASSWORD ""              // WPA2 password (8+ characters); "" = random per-device password shown on serial and LCD
+#define SOFTAP_CHANNEL 6                // Access point channel (1-13)
+#define SOFTAP_MAX_CLIENTS 2            // Stations allowed at once (1-4) - bounds airtime and sockets
+#define SOFTAP_PROBE_INTERVAL 120000    // Scan for the WiFi network this often while in AP mode (ms)
+#define SOFTAP_LIFETIME 900000          // Close the access point after this long and retry the station (ms)
+#define SOFTAP_SCAN_TIMEOUT 8000        // Give up on a scan that has not finished (ms)
+#define SOFTAP_DNS_PORT 53              // Captive DNS responder port
+
+// Time Synchronisation (used by the crop calendar and rain forecast)
+#define NTP_SERVER "pool.ntp.org"       // NTP server
+#define TIMEZONE_OFFSET 0               // Offset from UTC (seconds), e.g. 25200 for UTC+7
+#define DAYLIGHT_OFFSET 0               // Daylight saving offset (seconds)
+
+// Rain Forecast (skip or shorten scheduled irrigation when rain is coming)
+// Any HTTP endpoint returning Open-Meteo style hourly arrays works, e.g. a
+// local test server. Requests must ask for timeformat=unixtime.
+#define FORECAST_ENABLED false          // Enable forecast-based rain skip
+#define FORECAST_URL "http://api.open-meteo.com/v1/forecast?latitude=-6.20&longitude=106.85&hourly=precipitation_probability,precipitation,temperature_2m&forecast_hours=48&timeformat=unixtime"
+#define FORECAST_REFRESH_INTERVAL 3600000  // Fetch a new forecast every hour (ms)
+#define FORECAST_RETRY_INTERVAL 300000  // Retry after a failed fetch (ms)
+#define FORECAST_MAX_AGE_HOURS 12       // Ignore a cached forecast older than this (offline fallback)
+#define FORECAST_HTTP_TIMEOUT 10000     // Forecast request timeout (ms)
+#define FORECAST_JSON_CAPACITY 6144     // Parse buffer for the filtered hourly arrays (bytes)
+#define FORECAST_LOOKAHEAD_HOURS 6      // Rain within this window counts
+#define FORECAST_MIN_MM 1.0             // Expected rain (mm) below this is ignored
+#define FORECAST_SKIP_MM 5.0            // Expected rain (mm) at which irrigation is skipped; shortened in between
+#define FORECAST_CRITICAL_MOISTURE 15   // Below this moisture (%) water anyway
+
 // Web Server Configuration
 #define WEB_SERVER_PORT 80              // Web server port (80 = standard HTTP)
 #define WEB_SERVER_TIMEOUT 5000         // Web server request timeout (ms)
@@ -409,6 +479,8 @@
   #define ADAFRUIT_IO_LIGHT_LEVEL_FEED "light-level"
   #define ADAFRUIT_IO_PUMP_STATUS_FEED "pump-status"
   #define ADAFRUIT_IO_IRRIGATION_COUNT_FEED "irrigation-count"
+  #define ADAFRUIT_IO_TANK_LEVEL_FEED "tank-level"
+  #define ADAFRUIT_IO_RAINFALL_FEED "rainfall"
 #endif
 
 // ===============================================================================
@@ -429,6 +501,76 @@
 #define SOIL_MOISTURE_DRY_VALUE 4095    // Sensor reading when completely dry
 #define SOIL_MOISTURE_WET_VALUE 0       // Sensor reading when completely wet
 
+// Soil Probe Type
+// SOIL_PROBE_FREQUENCY counts the probe's oscillation over a hardware-timed
+// window and converts it through soilFrequencyTable in soilprobe.h (edit the
+// table for your probe); the result is mapped onto the two values above.
+#define SOIL_PROBE_TYPE SOIL_PROBE_ANALOG // SOIL_PROBE_ANALOG, SOIL_PROBE_FREQUENCY
+#define SOIL_FREQ_WINDOW_US 100000      // Counting window (us); longer = finer resolution
+#define SOIL_FREQ_GLITCH_NS 100         // Ignore pulses shorter than this (ns, max ~12000)
+#define SOIL_FREQ_MIN_HZ 1000           // Below this the probe is treated as disconnected
+
+// Soil Probe Auto-Calibration (starts from the two values above and learns the
+// probe's real wet/dry endpoints from the readings it sees in the field)
+#define SOIL_AUTO_CALIBRATION true      // Adjust the wet/dry endpoints over time
+#define SOIL_CAL_SAMPLE_INTERVAL 600000 // One reading per interval feeds the 5th percentile (ms)
+#define SOIL_CAL_UPDATE_INTERVAL 3600000 // Endpoints are nudged toward the estimate this often (ms)
+#define SOIL_CAL_MAX_STEP 40            // Largest endpoint change per update (raw ADC counts)
+#define SOIL_CAL_MIN_SPAN 500           // Wet and dry endpoints are never closer than this (raw)
+#define SOIL_CAL_MIN_CONFIDENCE 30      // Confidence required before the endpoints move (%)
+#define SOIL_CAL_WET_WATCH 900000       // Search for the saturation plateau this long after watering (ms)
+#define SOIL_CAL_PLATEAU_SAMPLES 6      // Consecutive readings that make a plateau...
+#define SOIL_CAL_PLATEAU_BAND 40        // ...when they lie within this many raw counts
+#define SOIL_CAL_DRY_MIN_HOURS 24       // A dry-down this long (hours), ended by rain or a manual start, can mark the dry endpoint...
+#define SOIL_CAL_FLOOR_HOLD 7200000     // ...if its driest reading had held for this long (ms)
+
+// Soil Temperature Compensation
+// Probe readings drift with temperature, which shows up as a daily "moisture"
+// wave. The raw reading is corrected by SOIL_TC_COEFFICIENT counts per degree
+// away from SOIL_TC_REFERENCE, using a buried DS18B20 if fitted or else the
+// DHT air temperature. With SOIL_TC_LEARN the coefficient is fitted from
+// quiet nights (no watering or rain) against temperature and a time trend,
+// since the soil keeps drying while it cools. Off by default: check a few
+// nights' lastFit in /api before trusting it on a new probe.
+#define SOIL_TEMP_COMPENSATION true     // Correct soil readings for temperature
+#define SOIL_TEMPERATURE_PROBE false    // DS18B20 in the soil (needs OneWire + DallasTemperature libraries)
+#define SOIL_TC_COEFFICIENT 0.0         // Starting/configured drift (raw counts per degree C, + = reading rises when warm)
+#define SOIL_TC_REFERENCE 20.0          // Temperature the dry/wet values were calibrated at (C)
+#define SOIL_TC_LEARN false             // Learn the coefficient from night-time readings
+#define SOIL_TC_NIGHT_START 22          // Night window for learning (local hour)...
+#define SOIL_TC_NIGHT_END 6             // ...until this hour
+#define SOIL_TC_DARK_LEVEL 5            // Without a clock, darker than this light level (%) counts as night
+#define SOIL_TC_MIN_SAMPLES 360         // Readings needed for a night fit
+#define SOIL_TC_MIN_RANGE 2             // Temperature must span at least this much overnight (C)
+#define SOIL_TC_MIN_R2 60               // Fit quality (partial r² x 100, trend removed) needed to use a night
+#define SOIL_TC_MIN_INDEPENDENT 10      // Share of the temperature variance (%) the time trend must leave over
+#define SOIL_TC_MAX_COEFFICIENT 40      // Largest accepted drift (raw counts per degree C)
+
+// Rain Detection (no gauge needed: moisture that rises while the pump is off is rain)
+#define RAIN_DETECTION_ENABLED true     // Detect rain from the soil moisture response
+#define RAIN_SMOOTHING_SHIFT 2          // Moisture smoothing, averages about 2^n samples
+#define RAIN_BASELINE_SHIFT 8           // How slowly the dry-down baseline may creep upward
+#define RAIN_RISE_THRESHOLD 4           // Rise above the baseline that starts a rain event (%)
+#define RAIN_CONFIRM_SAMPLES 3          // ...held for this many consecutive readings
+#define RAIN_END_MS 1800000             // Event ends when moisture has not risen for this long (ms)
+#define RAIN_PUMP_SETTLE_MS 1800000     // Rises this long after watering belong to the pump (ms)
+#define RAIN_MM_PER_PERCENT 0.6         // Rain (mm) per 1% moisture rise: root depth (mm) x water-holding fraction / 100
+#define RAIN_HISTORY_SIZE 8             // Recent rain events kept for /api/rain
+
+// Zone Commissioning (POST /api/commission?action=start)
+// Measures how the zone's soil answers a watering: each test pulse is a quiet
+// baseline, COMMISSION_PULSE_SECONDS of pumping and a long observation with
+// moisture sampled every COMMISSION_SAMPLE_MS. With ZONE_MODEL_DOSING the
+// measured dead time, gain and time constant set the irrigation dose and the
+// shortest wait between irrigations.
+#define COMMISSION_PULSES 2             // Test pulses, results are averaged
+#define COMMISSION_PULSE_SECONDS 10     // Pump runtime of each test pulse (s)
+#define COMMISSION_SAMPLE_MS 1000       // Soil sampling interval while commissioning (ms)
+#define COMMISSION_BASELINE_SECONDS 60  // Readings before each pulse (s)
+#define COMMISSION_OBSERVE_SECONDS 1800 // Readings from each pulse start on (s)
+#define ZONE_MODEL_DOSING true          // Dose from the measured response once commissioned
+#define ZONE_REFILL_PERCENT 10          // Without a crop profile, water up to threshold + this (%)
+
 // DHT Sensor Settings
 #define DHT_READ_INTERVAL 2000          // Minimum time between DHT readings (ms)
 
@@ -439,6 +581,28 @@
 #define LDR_LOW_LIGHT_THRESHOLD 20      // Percentage threshold for low light detection (0-100%)
 #define LDR_HIGH_LIGHT_THRESHOLD 80     // Percentage threshold for high light detection (0-100%)
 
+/*
+ * WATER TANK LEVEL (dry-run protection):
+ * - TANK_NONE: water is assumed to be always available
+ * - TANK_ULTRASONIC: sensor mounted above the water, pointing down
+ * - TANK_FLOAT: switch that opens/closes when the water drops below it
+ * 
+ * For an ultrasonic sensor, measure the distance from the sensor to the
+ * water surface with the tank empty and full.
+ */
+#define TANK_SENSOR_TYPE TANK_NONE      // TANK_NONE, TANK_ULTRASONIC or TANK_FLOAT
+#define TANK_EMPTY_DISTANCE_CM 100      // Sensor to water surface when empty (cm)
+#define TANK_FULL_DISTANCE_CM 20        // Sensor to water surface when full (cm)
+#define TANK_CAPACITY_LITERS 50         // Usable tank volume (liters)
+#define TANK_FLOAT_ACTIVE_LOW true      // Float switch reads LOW while water is above it
+#define TANK_MIN_LEVEL 15               // Lock out irrigation below this level (%)
+#define TANK_LOCKOUT_HYSTERESIS 5       // Level must rise this much above the minimum to unlock (%)
+#define TANK_READ_INTERVAL 1000         // Time between level readings (ms)
+#define TANK_MEDIAN_SAMPLES 5           // Readings in the median filter
+#define TANK_ECHO_TIMEOUT_US 30000      // Longest valid ultrasonic echo (us)
+#define TANK_SENSOR_FAILURES 5          // Missed readings before the sensor is declared faulty
+#define TANK_SETTLE_TIME 5000           // Wait after the pump stops before measuring the draw (ms)
+
 // Sensor Validation Ranges (for error detection)
 #define MIN_TEMPERATURE -10.0           // Minimum valid temperature (°C)
 #define MAX_TEMPERATURE 60.0            // Maximum valid temperature (°C)
@@ -477,6 +641,38 @@
 
 // Serial Communication
 #define SERIAL_BAUD_RATE 115200         // Serial monitor baud rate
+#define CONSOLE_ENABLED true            // Command console on the serial port (type "help")
+#define CONSOLE_ECHO true               // Echo typed characters (terminal programs; the Arduino serial monitor does not need it)
+#define CONSOLE_TX_BUFFER 2048          // Serial transmit buffer, so console replies do not stall the loop (bytes)
+#define CONSOLE_DUMP_LINES 4            // Lines of a long listing ("log") written per loop pass
+
+// Remote Logging (RFC 5424 syslog over UDP)
+// Every serial log line is mirrored to the collector. To test, listen with
+// "nc -ulk 514" (or "socat -u UDP-RECV:514 -") on a PC and put its address here.
+#define SYSLOG_ENABLED false            // Mirror the serial log to a syslog collector
+#define SYSLOG_HOST "192.168.1.10"      // Collector address or hostname
+#define SYSLOG_PORT 514                 // Collector UDP port
+#define SYSLOG_FACILITY 16              // 16 = local0 ... 23 = local7
+#define SYSLOG_ERROR_RATE 60            // Messages per minute for errors and worse...
+#define SYSLOG_WARNING_RATE 30          // ...warnings and notices...
+#define SYSLOG_INFO_RATE 30             // ...and everything else; the excess is dropped and counted
+#define SYSLOG_BURST 10                 // Messages a severity may send at once before its rate applies
+#define SYSLOG_AP_BROADCAST true        // In access-point fallback, broadcast to clients of the AP instead of waiting
+#define SYSLOG_TASK_STACK 4096          // Stack of the sender task (bytes)
+#define SYSLOG_TASK_PRIORITY 1          // Sender task priority (same as the network worker)
+#define SYSLOG_TASK_CORE 0              // Core for the sender task (the loop runs on core 1)
+
+// CoAP Server (RFC 7252 over UDP, CBOR payloads)
+// Cheap polling and push for local automation: GET /sensors, /pump, /zone
+// (sensors and pump can be observed), POST /control. Try it with
+// "python3 tools/coap_poll.py <ip> get sensors" or libcoap's coap-client.
+#define COAP_ENABLED true               // Serve CoAP on UDP
+#define COAP_PORT 5683                  // Standard CoAP port
+#define COAP_PACKET_SIZE 256            // Largest request or response datagram (bytes)
+#define COAP_MAX_OBSERVERS 4            // Observe registrations kept at once
+#define COAP_NOTIFY_MIN_INTERVAL 2000   // At most one notification per observer this often (ms)
+#define COAP_MAX_AGE 60                 // Max-Age of responses; observers are refreshed before it runs out (s)
+#define COAP_CONFIRM_EVERY 10           // Every Nth notification is confirmable, to find observers that left
 
 // ===============================================================================
 // DATA LOGGING AND TRANSMISSION
@@ -490,6 +686,18 @@
 #define DATA_TRANSMISSION_INTERVAL 300000  // Data transmission interval (5 minutes)
 #define MAX_TRANSMISSION_RETRIES 3       // Maximum retries for data transmission
 
+// Network Worker (blocking HTTP/MQTT calls run here so the control loop never waits on the network)
+#define NETWORK_WORKER_STACK 8192       // Worker task stack (bytes) - TLS handshakes need ~6 KB
+#define NETWORK_WORKER_PRIORITY 1       // Worker task priority
+#define NETWORK_WORKER_CORE 0           // Core the worker is pinned to (0 = WiFi core)
+
+// Runtime Configuration File (LittleFS /config.json overrides the thresholds, intervals,
+// ThingSpeak key and WiFi credentials above without reflashing)
+#define CONFIG_FILE_ENABLED true        // Load /config.json at boot and whenever it changes
+#define CONFIG_CHECK_INTERVAL 5000      // How often the file is checked for edits (ms)
+#define CONFIG_JSON_CAPACITY 768        // Fixed parse document size (bytes) - bounds memory use
+#define CONFIG_MAX_FILE_SIZE 2048       // Larger files and request bodies are rejected (bytes)
+
 // Memory Management
 #define MEMORY_CHECK_INTERVAL 300000    // Memory usage check interval (ms)
 #define SYSTEM_STARTUP_DELAY 2000       // Startup delay for sensor stabilization (ms)
@@ -508,19 +716,77 @@
 #define WATCHDOG_ENABLED true           // Enable automatic system restart if frozen
 #define WATCHDOG_TIMEOUT 30             // Watchdog timeout in seconds
 
+// Subsystem Supervisor (each subsystem must check in before its own deadline)
+#define SUPERVISOR_CHECK_INTERVAL 1000  // How often deadlines are checked (ms)
+#define CONTROL_LIVENESS_DEADLINE 30000 // Main control loop pass required within (ms) - reboots if missed
+#define SENSOR_LIVENESS_DEADLINE 60000  // Good sensor reading required within (ms)
+#define DISPLAY_LIVENESS_DEADLINE 30000 // Display refresh required within (ms)
+#define NETWORK_LIVENESS_DEADLINE 300000 // WiFi connection required within (ms)
+#define CLOUD_LIVENESS_DEADLINE 900000  // Successful cloud upload required within (ms)
+#define SUBSYSTEM_RESTART_BACKOFF 2     // Each further restart waits this many times longer
+
 // Pump Protection (prevents pump damage)
 #define PUMP_RUNTIME_PROTECTION true    // Enable maximum pump runtime protection
 #define MAX_PUMP_RUNTIME 300000         // Maximum continuous pump runtime (5 minutes)
 
+// Pump Duty Cycle (prevents overheating from many short runs)
+#define PUMP_DUTY_PROTECTION true       // Limit pump on-time over rolling windows
+#define PUMP_DUTY_SHORT_WINDOW 600000   // Short window length (10 minutes)
+#define PUMP_DUTY_SHORT_MAX 50          // Maximum on-time within the short window (%)
+#define PUMP_DUTY_LONG_WINDOW 3600000   // Long window length (1 hour)
+#define PUMP_DUTY_LONG_MAX 25           // Maximum on-time within the long window (%)
+#define PUMP_DUTY_BUCKETS 12            // Buckets per window (resolution = window / buckets)
+#define PUMP_MIN_OFF_TIME 30000         // Minimum rest between pump runs, manual starts included (ms)
+#define PUMP_CYCLES_SAVE_EVERY 16       // Relay cycles between NVS saves of the lifetime count
+
+// Pump Current Sensing (proves the pump really runs - optional sensor)
+/*
+ * ACS712 modules run from 5V and idle at 2.5V: feed the output through a
+ * divider (e.g. 10k/20k) and scale the two values below by the same ratio.
+ */
+#define PUMP_CURRENT_SENSING false      // Enable current monitoring on PUMP_CURRENT_PIN
+#define CURRENT_SENSOR_ZERO_MV 1650     // Sensor output at 0A, at the ADC pin (mV)
+#define CURRENT_SENSOR_MV_PER_AMP 122   // Sensitivity at the ADC pin (ACS712-05B: 185 before a 2/3 divider)
+#define CURRENT_SAMPLE_RATE 20000       // ADC DMA sample rate (Hz)
+#define CURRENT_WINDOW_MS 50            // RMS window length (ms)
+#define CURRENT_FAULT_WINDOWS 2         // Consecutive bad windows before a trip (~100 ms)
+#define PUMP_INRUSH_MS 300              // Ignore the motor start-up surge for this long (ms)
+#define PUMP_MIN_CURRENT 0.3            // Less than this while running = dry run (A)
+#define PUMP_MAX_CURRENT 3.0            // More than this while running = stall (A)
+#define PUMP_IDLE_CURRENT 0.15          // More than this with the relay off = welded relay (A)
+#define CURRENT_WELD_CHECK_MS 500       // Keep sampling this long after every stop (ms)
+#define WELD_CHECK_INTERVAL 60000       // Idle check for a welded relay (ms)
+#define CURRENT_SIGNATURE_COUNT 10      // Irrigation current signatures kept in memory
+
+// Pump Failsafe (cuts the relay even if the main loop hangs)
+#define PUMP_FAILSAFE_ENABLED true      // Enable hardware timer and heartbeat relay cut-off
+#define PUMP_FAILSAFE_MARGIN 5000       // Extra time past the planned irrigation before the timer fires (ms)
+#define PUMP_HEARTBEAT_TIMEOUT 15000    // Cut the relay if the control loop is silent this long (ms)
+#define PUMP_HEARTBEAT_CHECK_INTERVAL 500 // How often the heartbeat is checked (ms)
+#define FAILSAFE_FAULT_INJECTION false  // Allow /control?action=hang to test the failsafe (bench only!)
+
 // Emergency Stop (manual system shutdown)
 #define EMERGENCY_STOP_ENABLED true     // Enable emergency stop functionality
 #define EMERGENCY_STOP_PIN 0            // GPIO pin for emergency stop button (optional)
+#define EMERGENCY_STOP_DEBOUNCE 30      // Input must stay at one level this long before the trip is acted on (ms)
+#define EMERGENCY_STOP_RESET_HOLD 3000  // Release, then hold the button this long to reset (ms)
 
 // Automatic Recovery (self-healing system)
 #define AUTO_RECOVERY_ENABLED true      // Enable automatic error recovery
 #define RECOVERY_ATTEMPTS 3             // Maximum recovery attempts
 #define RECOVERY_DELAY 5000             // Delay between recovery attempts (ms)
 
+// Fault History (reset reasons kept across reboots)
+#define FAULT_HISTORY_ENABLED true      // Record reset reason, uptime and loop stage on every boot
+#define FAULT_HISTORY_SIZE 8            // Number of boots kept in flash (NVS ring)
+#define BREADCRUMBS_ENABLED true        // Keep the last events (stage, HTTP, pump, WiFi) in RTC memory
+#define BREADCRUMB_COUNT 32             // Events kept in the ring (power of two, 8 bytes each)
+
+// Core Dump (panic snapshot written to the coredump partition, see partitions.csv)
+#define COREDUMP_ENABLED true           // Summarize crashes in the fault history and serve /api/coredump
+#define COREDUMP_BACKTRACE_DEPTH 8      // Backtrace frames kept per crash in the fault history
+#define COREDUMP_CHUNK_SIZE 1024        // Bytes read from flash per chunk when streaming the dump
+
 // Sensor Disconnection Detection
 #define DISCONNECT_DETECTION true       // Enable sensor disconnection detection
 #define SENSOR_DISCONNECT_THRESHOLD 10  // Readings before marking sensor disconnected
@@ -549,6 +815,8 @@
 // Parameter Adjustment (for rotary encoder)
 #define PARAMETER_MIN_STEP 1            // Minimum parameter adjustment step
 #define PARAMETER_MAX_STEP 10           // Maximum parameter adjustment step
+#define MIN_IRRIGATION_SECONDS 1        // Shortest irrigation selectable from the menu (s)
+#define MAX_IRRIGATION_SECONDS 120      // Longest irrigation selectable from the menu (s)
 
 // Network Performance
 #define HTTP_TIMEOUT 10000              // HTTP request timeout (ms)
@@ -588,11 +856,68 @@
   #warning "IRRIGATION_COOLDOWN is less than 1 minute. This may cause overwatering!"
 #endif
 
+#if PUMP_FAILSAFE_ENABLED && PUMP_HEARTBEAT_TIMEOUT >= WATCHDOG_TIMEOUT * 1000
+  #warning "PUMP_HEARTBEAT_TIMEOUT should be shorter than the watchdog timeout!"
+#endif
+
+#if PUMP_FAILSAFE_ENABLED && RELAY_PIN >= 32
+  #error "PUMP_FAILSAFE_ENABLED requires RELAY_PIN below GPIO32!"
+#endif
+
+#if PUMP_CYCLES_SAVE_EVERY < 1
+  #error "PUMP_CYCLES_SAVE_EVERY must be at least 1!"
+#endif
+
+#if PUMP_DUTY_PROTECTION && (MAX_IRRIGATION_SECONDS * 1000UL > PUMP_DUTY_SHORT_WINDOW / 100 * PUMP_DUTY_SHORT_MAX || \
+                             MAX_IRRIGATION_SECONDS * 1000UL > PUMP_DUTY_LONG_WINDOW / 100 * PUMP_DUTY_LONG_MAX)
+  #error "MAX_IRRIGATION_SECONDS does not fit within the pump duty-cycle limits!"
+#endif
+
+#if (COMMISSION_BASELINE_SECONDS + COMMISSION_OBSERVE_SECONDS) * 1000UL / COMMISSION_SAMPLE_MS > 4000
+  #error "Commissioning trace is limited to 4000 samples - sample less often or observe for less time!"
+#endif
+
+#if COMMISSION_PULSE_SECONDS > MAX_IRRIGATION_SECONDS
+  #error "COMMISSION_PULSE_SECONDS must not exceed MAX_IRRIGATION_SECONDS!"
+#endif
+
+#if TANK_SENSOR_TYPE == TANK_ULTRASONIC && TANK_ECHO_PIN >= 32
+  #error "TANK_ECHO_PIN must be below GPIO32 (read directly in the echo interrupt)!"
+#endif
+
+#if TANK_ENABLED && TANK_EMPTY_DISTANCE_CM <= TANK_FULL_DISTANCE_CM
+  #error "TANK_EMPTY_DISTANCE_CM must be larger than TANK_FULL_DISTANCE_CM!"
+#endif
+
+#if COAP_ENABLED && (COAP_PACKET_SIZE < 128 || COAP_MAX_OBSERVERS < 1)
+  #error "COAP_PACKET_SIZE must be at least 128 bytes and COAP_MAX_OBSERVERS at least 1!"
+#endif
+
+#if SYSLOG_ENABLED && !SERIAL_OUTPUT_ENABLED
+  #error "SYSLOG_ENABLED mirrors the serial log and needs SERIAL_OUTPUT_ENABLED!"
+#endif
+
+#if CONSOLE_ENABLED && !SERIAL_OUTPUT_ENABLED
+  #error "CONSOLE_ENABLED needs SERIAL_OUTPUT_ENABLED!"
+#endif
+
 // Validate WiFi settings
 #if !defined(WIFI_SSID) || !defined(WIFI_PASSWORD)
   #error "Please configure WIFI_SSID and WIFI_PASSWORD!"
 #endif
 
+#if SOFTAP_FALLBACK_ENABLED && (SOFTAP_MAX_CLIENTS < 1 || SOFTAP_MAX_CLIENTS > 4)
+  #error "SOFTAP_MAX_CLIENTS must be between 1 and 4!"
+#endif
+
+#if SOFTAP_FALLBACK_ENABLED && (SOFTAP_CHANNEL < 1 || SOFTAP_CHANNEL > 13)
+  #error "SOFTAP_CHANNEL must be between 1 and 13!"
+#endif
+
+#if SOFTAP_FALLBACK_ENABLED && SOFTAP_LIFETIME <= SOFTAP_PROBE_INTERVAL
+  #error "SOFTAP_LIFETIME must be longer than SOFTAP_PROBE_INTERVAL!"
+#endif
+
 // ===============================================================================
 // SETUP COMPLETE
 // ===============================================================================
@@ -0,0 +1,384 @@
+/*
+ * Smart Farming System - Serial Command Console
+ *
+ * Line-oriented console on a Stream (normally Serial) for field diagnostics
+ * with nothing but a USB cable:
+ *
+ *   constexpr console::Command commands[] = {
+ *     {"status", "", "Readings and system state", consoleStatus, nullptr},
+ *     {"set", "<key> <value>", "Change a setting", consoleSet, settingKeys},
+ *   };
+ *   console::Console serialConsole;
+ *   serialConsole.begin(Serial, commands, 2, "farm> ", true);
+ *   serialConsole.poll();                     // once per loop pass
+ *
+ * Handlers get argc/argv pointing into the line buffer, split in place - no
+ * String, no heap. The command table is constexpr, so it stays in flash.
+ * "help" is built in. Tab completes command names, and the first argument
+ * from the command's completion list.
+ *
+ * poll() never waits: it moves whatever the UART has buffered into the RX
+ * ring, then handles at most MAX_BYTES_PER_POLL bytes and at most one
+ * complete line. Handlers with more output than the transmit buffer holds
+ * call holdPrompt() and write the rest a few lines per pass themselves. A flood of pasted input is worked off over several loop
+ * passes; once the ring is full the rest waits in (or overflows) the UART
+ * driver's own buffer. Lines longer than LINE_SIZE are discarded whole.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <Arduino.h>
+
+namespace console {
+
+constexpr size_t RX_RING_SIZE = 256;        // Bytes buffered between polls (power of two)
+constexpr size_t LINE_SIZE = 96;            // Longest command line, terminator included
+constexpr int MAX_ARGS = 8;
+constexpr size_t MAX_BYTES_PER_POLL = 64;   // Input handled per loop pass
+constexpr size_t MAX_COMPLETIONS = 24;      // Candidates considered for one tab press
+
+static_assert((RX_RING_SIZE & (RX_RING_SIZE - 1)) == 0, "RX_RING_SIZE must be a power of two");
+
+typedef void (*Handler)(int argc, char** argv);
+
+struct Command {
+  const char* name;
+  const char* usage;                  // Arguments shown by help, "" if none
+  const char* help;
+  Handler handler;
+  const char* const* completions;     // Words for the first argument (nullptr-terminated), or nullptr
+};
+
+struct Stats {
+  uint32_t lines;
+  uint32_t unknown;                   // Lines whose command was not found
+  uint32_t tooLong;                   // Lines discarded for exceeding LINE_SIZE
+  uint32_t ringFull;                  // Polls that left input waiting in the UART buffer
+  uint32_t maxPollCycles;             // Longest poll, command handlers excluded
+};
+
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\t';
+}
+
+// Splits line in place on spaces; "double quotes" keep spaces inside one
+// argument. Returns argc; words beyond maxArgs stay part of the last one.
+inline int tokenize(char* line, char** argv, int maxArgs) {
+  int argc = 0;
+  char* p = line;
+  while (*p != '\0' && argc < maxArgs) {
+    while (isSpace(*p)) {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    if (*p == '"') {
+      argv[argc++] = ++p;
+      while (*p != '\0' && *p != '"') {
+        p++;
+      }
+    } else {
+      argv[argc++] = p;
+      if (argc == maxArgs) {
+        break;
+      }
+      while (*p != '\0' && !isSpace(*p)) {
+        p++;
+      }
+    }
+    if (*p != '\0') {
+      *p++ = '\0';
+    }
+  }
+  return argc;
+}
+
+class Console {
+ public:
+  void begin(Stream& port, const Command* commands, size_t count, const char* prompt, bool echo) {
+    port_ = &port;
+    commands_ = commands;
+    count_ = count;
+    prompt_ = prompt;
+    echo_ = echo;
+    showPrompt();
+  }
+
+  void poll() {
+    if (port_ == nullptr) {
+      return;
+    }
+    uint32_t startCycles = ESP.getCycleCount();
+    receive();
+
+    size_t budget = MAX_BYTES_PER_POLL;
+    bool lineReady = false;
+    while (budget-- > 0 && tail_ != head_ && !lineReady) {
+      lineReady = handleByte(ring_[tail_++ & (RX_RING_SIZE - 1)]);
+    }
+
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    if (cycles > stats.maxPollCycles) {
+      stats.maxPollCycles = cycles;
+    }
+    if (lineReady) {
+      execute();
+    }
+  }
+
+  // For handlers that leave output to be written over later passes (log):
+  // the prompt is not shown after the handler returns, the owner shows it
+  // once that output is done
+  void holdPrompt() {
+    holdPrompt_ = true;
+  }
+
+  // True once after Ctrl-C; long-running output (tail) checks this to stop
+  bool takeInterrupt() {
+    bool interrupted = interrupt_;
+    interrupt_ = false;
+    return interrupted;
+  }
+
+  void showPrompt() {
+    port_->print(prompt_);
+    port_->write((const uint8_t*)line_, length_);
+  }
+
+  Stats stats = {};
+
+ private:
+  // UART buffer -> ring, only as much as is already there and fits
+  void receive() {
+    size_t space = RX_RING_SIZE - (head_ - tail_);
+    int available = port_->available();
+    if ((size_t)available > space) {
+      stats.ringFull++;
+    }
+    while (space-- > 0 && available-- > 0) {
+      int c = port_->read();
+      if (c < 0) {
+        break;
+      }
+      ring_[head_++ & (RX_RING_SIZE - 1)] = (char)c;
+    }
+  }
+
+  // Line editing; true when a line is complete
+  bool handleByte(char c) {
+    if (escape_ > 0) {
+      // Swallow ANSI sequences (arrow keys): ESC [ letter
+      escape_ = (escape_ == 1 && c == '[') ? 2 : 0;
+      return false;
+    }
+    bool afterCr = lastWasCr_;
+    lastWasCr_ = (c == '\r');
+    switch (c) {
+      case '\r':
+      case '\n':
+        if (c == '\n' && afterCr) {
+          return false;
+        }
+        if (echo_) {
+          port_->print("\r\n");
+        }
+        if (discarding_) {
+          discarding_ = false;
+          length_ = 0;
+          stats.tooLong++;
+          port_->printf("Line too long (max %u characters)\r\n", (unsigned)(LINE_SIZE - 1));
+          showPrompt();
+          return false;
+        }
+        line_[length_] = '\0';
+        return true;
+      case '\b':
+      case 0x7F:
+        if (length_ > 0 && !discarding_) {
+          length_--;
+          if (echo_) {
+            port_->print("\b \b");
+          }
+        }
+        return false;
+      case '\t':
+        if (!discarding_) {
+          complete();
+        }
+        return false;
+      case 0x03:  // Ctrl-C
+        interrupt_ = true;
+        discarding_ = false;
+        length_ = 0;
+        port_->print("^C\r\n");
+        showPrompt();
+        return false;
+      case 0x1B:
+        escape_ = 1;
+        return false;
+      default:
+        break;
+    }
+    if ((uint8_t)c < 0x20 || discarding_) {
+      return false;
+    }
+    if (length_ + 1 >= LINE_SIZE) {
+      discarding_ = true;
+      return false;
+    }
+    line_[length_++] = c;
+    if (echo_) {
+      port_->write((uint8_t)c);
+    }
+    return false;
+  }
+
+  void execute() {
+    char* argv[MAX_ARGS];
+    int argc = tokenize(line_, argv, MAX_ARGS);
+    if (argc > 0) {
+      stats.lines++;
+      const Command* command = find(argv[0]);
+      if (strcmp(argv[0], "help") == 0) {
+        help();
+      } else if (command != nullptr) {
+        command->handler(argc, argv);
+      } else {
+        stats.unknown++;
+        port_->printf("Unknown command '%s' - type help\r\n", argv[0]);
+      }
+    }
+    length_ = 0;
+    if (!holdPrompt_) {
+      showPrompt();
+    }
+    holdPrompt_ = false;
+  }
+
+  const Command* find(const char* name) const {
+    for (size_t i = 0; i < count_; i++) {
+      if (strcmp(commands_[i].name, name) == 0) {
+        return &commands_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  void help() {
+    port_->print("help - this list; Tab completes, Ctrl-C clears the line\r\n");
+    for (size_t i = 0; i < count_; i++) {
+      const Command& command = commands_[i];
+      port_->printf("%s%s%s - %s\r\n", command.name, command.usage[0] ? " " : "", command.usage, command.help);
+    }
+  }
+
+  // Completes the word at the end of the line: a command name, or the first
+  // argument when the command has a completion list
+  void complete() {
+    const char* candidates[MAX_COMPLETIONS];
+    size_t found = 0;
+    size_t wordStart = length_;
+    while (wordStart > 0 && !isSpace(line_[wordStart - 1])) {
+      wordStart--;
+    }
+    const char* word = line_ + wordStart;
+    size_t wordLength = length_ - wordStart;
+
+    size_t commandEnd = 0;
+    while (commandEnd < length_ && !isSpace(line_[commandEnd])) {
+      commandEnd++;
+    }
+    if (wordStart == 0) {
+      if (strncmp("help", word, wordLength) == 0) {
+        candidates[found++] = "help";
+      }
+      for (size_t i = 0; i < count_ && found < MAX_COMPLETIONS; i++) {
+        if (strncmp(commands_[i].name, word, wordLength) == 0) {
+          candidates[found++] = commands_[i].name;
+        }
+      }
+    } else {
+      // Only the first argument, and only if nothing but spaces separates it from the command
+      for (size_t i = commandEnd; i < wordStart; i++) {
+        if (!isSpace(line_[i])) {
+          return;
+        }
+      }
+      char name[LINE_SIZE];
+      memcpy(name, line_, commandEnd);
+      name[commandEnd] = '\0';
+      const Command* command = find(name);
+      if (command == nullptr || command->completions == nullptr) {
+        return;
+      }
+      for (const char* const* option = command->completions; *option != nullptr && found < MAX_COMPLETIONS; option++) {
+        if (strncmp(*option, word, wordLength) == 0) {
+          candidates[found++] = *option;
+        }
+      }
+    }
+
+    if (found == 0) {
+      port_->write((uint8_t)'\a');
+      return;
+    }
+
+    // Longest prefix shared by every candidate
+    size_t common = strlen(candidates[0]);
+    for (size_t i = 1; i < found; i++) {
+      size_t same = 0;
+      while (same < common && candidates[i][same] == candidates[0][same]) {
+        same++;
+      }
+      common = same;
+    }
+
+    if (common > wordLength) {
+      appendText(candidates[0] + wordLength, common - wordLength);
+      if (found == 1) {
+        appendText(" ", 1);
+      }
+    } else if (found > 1) {
+      port_->print("\r\n");
+      for (size_t i = 0; i < found; i++) {
+        port_->print(candidates[i]);
+        port_->print("  ");
+      }
+      port_->print("\r\n");
+      showPrompt();
+    }
+  }
+
+  void appendText(const char* text, size_t length) {
+    if (length_ + length >= LINE_SIZE) {
+      return;
+    }
+    memcpy(line_ + length_, text, length);
+    length_ += length;
+    port_->write((const uint8_t*)text, length);
+  }
+
+  Stream* port_ = nullptr;
+  const Command* commands_ = nullptr;
+  size_t count_ = 0;
+  const char* prompt_ = "> ";
+  bool echo_ = true;
+
+  char ring_[RX_RING_SIZE] = {};
+  size_t head_ = 0;                   // Free-running; index is head_ & (RX_RING_SIZE - 1)
+  size_t tail_ = 0;
+
+  char line_[LINE_SIZE] = {};
+  size_t length_ = 0;
+  bool discarding_ = false;           // Line overflowed; drop input until the end of the line
+  bool lastWasCr_ = false;
+  bool interrupt_ = false;
+  bool holdPrompt_ = false;
+  uint8_t escape_ = 0;
+};
+
+}  // namespace console
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Smart Farming System - Coroutine Runtime
+ *
+ * Lets slow network flows (cloud uploads, WiFi reconnects) be written as
+ * straight-line code that suspends instead of blocking the control loop.
+ *
+ *   coro::Task                     - coroutine return type; co_await a Task to run it as a sub-flow
+ *   coro::scheduler.spawn(n, t)    - start a flow (it runs until its first suspension)
+ *   coro::scheduler.poll()         - called once per loop pass, resumes flows that are ready
+ *   co_await coro::sleepFor(ms)    - timer
+ *   co_await coro::wifiConnected(ms) - true once the station link is up, false on timeout
+ *   co_await coro::onWorker(fn)    - runs a blocking call (HTTP, MQTT) on the network worker task
+ *
+ * The scheduler itself lives in corocore.h and has no ESP32 dependencies;
+ * this header adds the clocks, the network worker and the WiFi awaitable.
+ *
+ * Flows only ever run on the loop task, so they may read and write systemState
+ * freely. Functions passed to onWorker() run on the worker task and must only
+ * touch their own captures.
+ */
+
+#ifndef CORO_H
+#define CORO_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "corocore.h"
+
+namespace coro {
+
+constexpr int WORKER_QUEUE_LENGTH = 4;
+
+inline uint32_t nowMs() { return millis(); }
+inline uint32_t cycleCount() { return ESP.getCycleCount(); }
+
+// Blocking call handed to the network worker task
+struct WorkerJob {
+  void (*run)(WorkerJob* job);
+  bool done;
+};
+
+inline QueueHandle_t workerQueue = nullptr;
+inline uint32_t workerRetries = 0;    // Enqueue attempts that found the queue full
+inline uint32_t workerRefusals = 0;   // Calls failed because the worker never started
+
+inline void workerTask(void* parameter) {
+  for (;;) {
+    WorkerJob* job = nullptr;
+    if (xQueueReceive(workerQueue, &job, portMAX_DELAY) == pdTRUE && job) {
+      job->run(job);
+      __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// Starts the network worker; until it runs, onWorker() calls fail straight away
+inline bool beginWorker(uint32_t workerStack, UBaseType_t workerPriority, BaseType_t workerCore) {
+  if (workerQueue) {
+    return true;
+  }
+  workerQueue = xQueueCreate(WORKER_QUEUE_LENGTH, sizeof(WorkerJob*));
+  if (!workerQueue) {
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(workerTask, "netWorker", workerStack, nullptr,
+                              workerPriority, nullptr, workerCore) != pdPASS) {
+    vQueueDelete(workerQueue);
+    workerQueue = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// ---- Awaitables -------------------------------------------------------------
+
+struct WiFiConnected {
+  unsigned long deadline;
+
+  static bool ready(void* self) {
+    return WiFi.status() == WL_CONNECTED ||
+           (int32_t)(millis() - static_cast<WiFiConnected*>(self)->deadline) >= 0;
+  }
+  bool await_ready() { return WiFi.status() == WL_CONNECTED; }
+  void await_suspend(std::coroutine_handle<> h) { scheduler.park(h, &WiFiConnected::ready, this); }
+  bool await_resume() { return WiFi.status() == WL_CONNECTED; }
+};
+
+inline WiFiConnected wifiConnected(uint32_t timeoutMs) {
+  return WiFiConnected{millis() + timeoutMs};
+}
+
+// Runs fn() on the worker task; the awaiting flow resumes with fn's result.
+// The blocking call never runs on the loop task: a full queue keeps the flow
+// parked and the enqueue is retried on each poll, and with no worker at all
+// the flow resumes at once with a value-initialised Result (HTTP code 0,
+// status 0), which every caller already treats as a failed call.
+template <typename F>
+struct OnWorker : WorkerJob {
+  using Result = decltype(std::declval<F&>()());
+  F fn;
+  Result result{};
+  bool queued = false;
+
+  explicit OnWorker(F f) : WorkerJob{&OnWorker::runJob, false}, fn(std::move(f)) {}
+
+  static void runJob(WorkerJob* job) {
+    OnWorker* self = static_cast<OnWorker*>(job);
+    self->result = self->fn();
+  }
+  bool enqueue() {
+    WorkerJob* job = this;
+    queued = xQueueSend(workerQueue, &job, 0) == pdTRUE;
+    if (!queued) {
+      workerRetries++;
+    }
+    return queued;
+  }
+  static bool ready(void* context) {
+    OnWorker* self = static_cast<OnWorker*>(context);
+    if (!self->queued) {
+      self->enqueue();
+      return false;
+    }
+    return __atomic_load_n(&self->done, __ATOMIC_ACQUIRE);
+  }
+
+  bool await_ready() { return false; }
+  bool await_suspend(std::coroutine_handle<> h) {
+    if (!workerQueue) {
+      workerRefusals++;
+      return false;
+    }
+    enqueue();
+    scheduler.park(h, &OnWorker::ready, this);
+    return true;
+  }
+  Result await_resume() { return std::move(result); }
+};
+
+template <typename F>
+OnWorker<F> onWorker(F fn) {
+  return OnWorker<F>(std::move(fn));
+}
+
+}  // namespace coro
+
+#endif
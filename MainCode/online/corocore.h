@@ -0,0 +1,266 @@
+/*
+ * Smart Farming System - Coroutine Scheduler Core
+ *
+ * The platform-independent half of coro.h: the Task type, the scheduler and
+ * the timer awaitable. Nothing here touches Arduino, WiFi or FreeRTOS, so it
+ * also builds on a PC (see host/coro_bench.cpp).
+ *
+ * The including platform header must define two clock functions after
+ * including this one:
+ *
+ *   inline uint32_t coro::nowMs();       - millisecond clock (millis() on the ESP32)
+ *   inline uint32_t coro::cycleCount();  - fine-grained counter used for the resume statistics
+ */
+
+#ifndef CORO_CORE_H
+#define CORO_CORE_H
+
+#include <coroutine>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__cpp_impl_coroutine)
+  #error "Coroutine support missing - the network flows need an Arduino-ESP32 3.x core (C++20)"
+#endif
+
+namespace coro {
+
+constexpr int MAX_FLOWS = 6;          // Flows that can be suspended at once
+constexpr int MAX_FLOW_STATS = 8;     // Distinct flow names tracked for statistics
+
+inline uint32_t nowMs();
+inline uint32_t cycleCount();
+
+// Per flow name: frame memory and the cost of resuming it on the loop task
+struct FlowStats {
+  const char* name;
+  uint32_t frameBytes;       // Largest frame allocated for this flow (root frame, sub-flows add their own)
+  uint32_t runs;
+  uint32_t resumes;
+  uint64_t resumeCycles;     // Total CPU cycles spent inside resume() (flow body included)
+  uint32_t maxResumeCycles;
+};
+
+// Size of the most recent frame allocation, picked up by the promise constructor
+inline uint32_t lastFrameBytes = 0;
+
+class Task {
+ public:
+  struct promise_type;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  struct promise_type {
+    std::coroutine_handle<> continuation;
+    uint32_t frameBytes = lastFrameBytes;
+
+    static void* operator new(size_t size) {
+      lastFrameBytes = size;
+      return ::operator new(size);
+    }
+    static void operator delete(void* frame) { ::operator delete(frame); }
+
+    Task get_return_object() { return Task(handle_type::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hand control back to whoever awaited this flow (nothing for a root flow)
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle_type h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_void() {}
+    void unhandled_exception() { abort(); }
+  };
+
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  // co_await on a Task runs it to completion before the caller continues
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  void await_resume() const noexcept {}
+
+  handle_type release() { return std::exchange(handle, {}); }
+
+ private:
+  explicit Task(handle_type h) : handle(h) {}
+  handle_type handle;
+};
+
+class Scheduler {
+ public:
+  // Runs the flow up to its first suspension; refused if the table is full or a
+  // flow with the same name is still running
+  bool spawn(const char* name, Task task) {
+    if (running(name)) {
+      return false;
+    }
+    for (int i = 0; i < MAX_FLOWS; i++) {
+      if (!flows[i].root) {
+        Task::handle_type root = task.release();
+        flows[i] = {name, root, root, nullptr, nullptr, statsFor(name)};
+        if (flows[i].stats) {
+          flows[i].stats->runs++;
+          if (root.promise().frameBytes > flows[i].stats->frameBytes) {
+            flows[i].stats->frameBytes = root.promise().frameBytes;
+          }
+        }
+        resume(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool running(const char* name) const {
+    for (int i = 0; i < MAX_FLOWS; i++) {
+      if (flows[i].root && strcmp(flows[i].name, name) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int active() const {
+    int count = 0;
+    for (int i = 0; i < MAX_FLOWS; i++) {
+      if (flows[i].root) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  void poll() {
+    for (int i = 0; i < MAX_FLOWS; i++) {
+      if (flows[i].root && flows[i].ready && flows[i].ready(flows[i].readyContext)) {
+        resume(i);
+      }
+    }
+  }
+
+  // Called by awaitables: park the current flow until ready(context) returns true
+  void park(std::coroutine_handle<> waiting, bool (*ready)(void*), void* context) {
+    if (current < 0) {
+      return;
+    }
+    flows[current].waiting = waiting;
+    flows[current].ready = ready;
+    flows[current].readyContext = context;
+  }
+
+  // Cost of one suspend/resume round trip with no flow body in between
+  uint32_t measureSwitchCycles(int rounds = 200) {
+    auto yieldForever = []() -> Task {
+      for (;;) {
+        co_await std::suspend_always{};
+      }
+    };
+    Task::handle_type h = yieldForever().release();
+    h.resume();
+    uint32_t start = cycleCount();
+    for (int i = 0; i < rounds; i++) {
+      h.resume();
+    }
+    uint32_t cycles = (cycleCount() - start) / rounds;
+    h.destroy();
+    return cycles;
+  }
+
+  const FlowStats* stats(int& count) const {
+    count = statCount;
+    return statTable;
+  }
+
+ private:
+  struct Flow {
+    const char* name;
+    Task::handle_type root;
+    std::coroutine_handle<> waiting;
+    bool (*ready)(void*);
+    void* readyContext;
+    FlowStats* stats;
+  };
+
+  Flow flows[MAX_FLOWS] = {};
+  FlowStats statTable[MAX_FLOW_STATS] = {};
+  int statCount = 0;
+  int current = -1;
+
+  FlowStats* statsFor(const char* name) {
+    for (int i = 0; i < statCount; i++) {
+      if (strcmp(statTable[i].name, name) == 0) {
+        return &statTable[i];
+      }
+    }
+    if (statCount >= MAX_FLOW_STATS) {
+      return nullptr;
+    }
+    statTable[statCount] = {name, 0, 0, 0, 0, 0};
+    return &statTable[statCount++];
+  }
+
+  void resume(int i) {
+    Flow& flow = flows[i];
+    std::coroutine_handle<> next = flow.waiting;
+    flow.ready = nullptr;
+    current = i;
+    uint32_t start = cycleCount();
+    next.resume();
+    uint32_t cycles = cycleCount() - start;
+    current = -1;
+
+    if (flow.stats) {
+      flow.stats->resumes++;
+      flow.stats->resumeCycles += cycles;
+      if (cycles > flow.stats->maxResumeCycles) {
+        flow.stats->maxResumeCycles = cycles;
+      }
+    }
+
+    if (flow.root.done()) {
+      flow.root.destroy();
+      flow = {};
+    }
+  }
+};
+
+inline Scheduler scheduler;
+
+// ---- Awaitables -------------------------------------------------------------
+
+struct SleepFor {
+  uint32_t until;
+
+  static bool ready(void* self) {
+    return (int32_t)(nowMs() - static_cast<SleepFor*>(self)->until) >= 0;
+  }
+  bool await_ready() { return ready(this); }
+  void await_suspend(std::coroutine_handle<> h) { scheduler.park(h, &SleepFor::ready, this); }
+  void await_resume() {}
+};
+
+inline SleepFor sleepFor(uint32_t ms) {
+  return SleepFor{nowMs() + ms};
+}
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Smart Farming System - Crop Profiles
+ *
+ * Per-crop, per-growth-stage irrigation targets (FAO-56 style stages).
+ * Add a crop by adding a row to cropProfiles[]; select it with CROP_PROFILE
+ * in config.h or "crop.profile" in config.json, together with the planting date.
+ *
+ *   days       - stage length; the last stage runs until the crop is replanted
+ *   target     - soil moisture to hold during the stage (%)
+ *   depletion  - allowable depletion before watering, as % of target (FAO "MAD");
+ *                irrigation starts below target * (100 - depletion) / 100
+ *   kc         - crop coefficient x100 reached at the end of the stage; it ramps
+ *                linearly from the previous stage's value and scales the pump runtime
+ */
+
+#ifndef CROPS_H
+#define CROPS_H
+
+#include <stdint.h>
+
+#define CROP_MAX_STAGES 4
+
+struct CropStage {
+  const char* name;
+  uint16_t days;
+  uint8_t target;
+  uint8_t depletion;
+  uint8_t kc;
+};
+
+struct CropProfile {
+  const char* name;
+  uint8_t stageCount;
+  CropStage stages[CROP_MAX_STAGES];
+};
+
+// Const data: stays in flash on the ESP32
+const CropProfile cropProfiles[] = {
+  //  name         stages  {stage,           days, target, depletion, kc}
+  {"tomato",       4,     {{"initial",        30,   70,     30,        60},
+                           {"development",    40,   70,     40,        115},
+                           {"mid-season",     45,   75,     40,        115},
+                           {"late",           30,   60,     50,        80}}},
+  {"lettuce",      4,     {{"initial",        20,   75,     25,        70},
+                           {"development",    30,   75,     30,        100},
+                           {"mid-season",     15,   75,     30,        100},
+                           {"late",           10,   70,     30,        95}}},
+  {"seedlings",    2,     {{"germination",    10,   85,     15,        50},
+                           {"establishment",  20,   80,     20,        70}}},
+};
+
+const int CROP_PROFILE_COUNT = sizeof(cropProfiles) / sizeof(cropProfiles[0]);
+
+#endif
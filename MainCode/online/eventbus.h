@@ -0,0 +1,213 @@
+/*
+ * Smart Farming System - Event Bus
+ *
+ * Typed publish/subscribe between subsystems. Each event struct is its own
+ * topic, so publishers and subscribers agree on the payload at compile time:
+ *
+ *   struct PumpStartedEvent { static constexpr const char* name = "pumpStarted"; ... };
+ *
+ *   bus::subscribe<PumpStartedEvent>("display", onPumpStarted, bus::DEFERRED);
+ *   bus::publish(PumpStartedEvent{...});     // from the control path
+ *   bus::dispatchDeferred();                 // once per loop pass, after control
+ *
+ * SYNC subscribers run inside publish(). DEFERRED subscribers get the event
+ * copied once into their own ring and are handed a reference to the ring
+ * slot later, so a slow consumer (LCD, logging) never holds up the publisher.
+ * When a deferred ring is full the newest event is dropped and counted.
+ *
+ * All storage is static: no heap, no std::function. publish() and
+ * dispatchDeferred() must both be called from the loop task.
+ *
+ * A topic takes MAX_SUBSCRIBERS subscribers. Further subscribe() calls are
+ * refused and recorded in rejected/firstRejected, which setup() checks once
+ * every subsystem has subscribed.
+ */
+
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#endif
+
+namespace bus {
+
+constexpr int MAX_SUBSCRIBERS = 4;    // Per topic
+constexpr int RING_SIZE = 8;          // Events queued per deferred subscriber (power of two)
+constexpr int MAX_TOPICS = 8;
+
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+
+enum Dispatch : uint8_t {
+  SYNC = 0,
+  DEFERRED
+};
+
+struct SubscriberStats {
+  const char* name;
+  Dispatch mode;
+  uint32_t delivered;
+  uint32_t dropped;
+  uint32_t pending;
+  uint32_t maxCycles;        // Longest single handler call
+  uint64_t totalCycles;
+};
+
+// Type-erased view of a topic for draining and statistics
+struct TopicInfo {
+  const char* name;
+  size_t bytes;              // Static memory used by the topic (rings included)
+  uint32_t (*published)();
+  void (*drain)();
+  int (*subscribers)(SubscriberStats* out, int max);
+};
+
+inline TopicInfo topicRegistry[MAX_TOPICS] = {};
+inline int topicCount = 0;
+
+// Subscriptions refused because their topic was full
+inline int rejected = 0;
+inline char firstRejected[40] = "";     // "topic/subscriber" of the first one
+
+// Handler cost counter; a host build supplies its own (see host/eventbus_bench.cpp)
+#ifdef ESP_PLATFORM
+inline uint32_t cycleCount() { return ESP.getCycleCount(); }
+#else
+inline uint32_t cycleCount();
+#endif
+
+template <typename Event>
+class Topic {
+ public:
+  using Handler = void (*)(const Event& event);
+
+  bool subscribe(const char* subscriber, Handler handler, Dispatch mode) {
+    if (count >= MAX_SUBSCRIBERS) {
+      if (rejected++ == 0) {
+        snprintf(firstRejected, sizeof(firstRejected), "%s/%s", Event::name, subscriber);
+      }
+      return false;
+    }
+    subs[count] = {};
+    subs[count].name = subscriber;
+    subs[count].handler = handler;
+    subs[count].mode = mode;
+    count++;
+    return true;
+  }
+
+  void publish(const Event& event) {
+    publishedCount++;
+    for (int i = 0; i < count; i++) {
+      Subscriber& sub = subs[i];
+      if (sub.mode == SYNC) {
+        deliver(sub, event);
+      } else if ((uint8_t)(sub.head - sub.tail) >= RING_SIZE) {
+        sub.dropped++;
+      } else {
+        sub.ring[sub.head & (RING_SIZE - 1)] = event;
+        sub.head++;
+      }
+    }
+  }
+
+  void drain() {
+    for (int i = 0; i < count; i++) {
+      Subscriber& sub = subs[i];
+      while (sub.tail != sub.head) {
+        // Handed the ring slot itself; the slot is only reused after the handler returns
+        deliver(sub, sub.ring[sub.tail & (RING_SIZE - 1)]);
+        sub.tail++;
+      }
+    }
+  }
+
+  uint32_t published() const { return publishedCount; }
+
+  int stats(SubscriberStats* out, int max) const {
+    int n = count < max ? count : max;
+    for (int i = 0; i < n; i++) {
+      const Subscriber& sub = subs[i];
+      out[i] = {sub.name, sub.mode, sub.delivered, sub.dropped, (uint8_t)(sub.head - sub.tail),
+                sub.maxCycles, sub.totalCycles};
+    }
+    return n;
+  }
+
+ private:
+  struct Subscriber {
+    const char* name;
+    Handler handler;
+    Dispatch mode;
+    uint8_t head;
+    uint8_t tail;
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    Event ring[RING_SIZE];
+  };
+
+  Subscriber subs[MAX_SUBSCRIBERS] = {};
+  int count = 0;
+  uint32_t publishedCount = 0;
+
+  static void deliver(Subscriber& sub, const Event& event) {
+    uint32_t start = cycleCount();
+    sub.handler(event);
+    uint32_t cycles = cycleCount() - start;
+    sub.delivered++;
+    sub.totalCycles += cycles;
+    if (cycles > sub.maxCycles) {
+      sub.maxCycles = cycles;
+    }
+  }
+};
+
+// One topic instance per event type, registered on first use
+template <typename Event>
+Topic<Event>& topic() {
+  static Topic<Event> instance;
+  static bool registered = false;
+  if (!registered && topicCount < MAX_TOPICS) {
+    topicRegistry[topicCount++] = {
+      Event::name,
+      sizeof(Topic<Event>),
+      []() { return topic<Event>().published(); },
+      []() { topic<Event>().drain(); },
+      [](SubscriberStats* out, int max) { return topic<Event>().stats(out, max); }
+    };
+    registered = true;
+  }
+  return instance;
+}
+
+template <typename Event>
+bool subscribe(const char* subscriber, void (*handler)(const Event&), Dispatch mode) {
+  return topic<Event>().subscribe(subscriber, handler, mode);
+}
+
+template <typename Event>
+void publish(const Event& event) {
+  topic<Event>().publish(event);
+}
+
+inline void dispatchDeferred() {
+  for (int i = 0; i < topicCount; i++) {
+    topicRegistry[i].drain();
+  }
+}
+
+inline size_t memoryBytes() {
+  size_t total = sizeof(topicRegistry);
+  for (int i = 0; i < topicCount; i++) {
+    total += topicRegistry[i].bytes;
+  }
+  return total;
+}
+
+}  // namespace bus
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ * Smart Farming System - CoAP and CBOR Test (host)
+ *
+ * Checks the byte handling in coap.h and cbor.h: requests built with
+ * coap::Builder parse back to the same fields, option deltas and lengths
+ * use the one- and two-byte extensions at 13 and 269, broken and truncated
+ * packets are rejected, and CBOR integers (negative ones included) and
+ * floats survive a Writer/Reader round trip. Exits non-zero on any failed
+ * check.
+ *
+ *   g++ -std=c++20 -O2 -I.. coap_test.cpp -o coap_test
+ *   ./coap_test
+ */
+
+#include <stdio.h>
+#include "coap.h"
+#include "cbor.h"
+
+static int checks = 0;
+static int failures = 0;
+
+static void expect(const char* what, long long got, long long want) {
+  checks++;
+  if (got != want) {
+    failures++;
+    printf("FAIL %-44s got %lld, expected %lld\n", what, got, want);
+  }
+}
+
+static void expectText(const char* what, const char* got, const char* want) {
+  checks++;
+  if (strcmp(got, want) != 0) {
+    failures++;
+    printf("FAIL %-44s got \"%s\", expected \"%s\"\n", what, got, want);
+  }
+}
+
+static void roundTrip() {
+  const uint8_t token[] = {0xDE, 0xAD, 0xBE, 0xEF};
+  uint8_t packet[128];
+  coap::Builder out(packet, sizeof(packet));
+  out.header(coap::TYPE_CON, coap::POST, 0x1234, token, sizeof(token));
+  out.option(coap::OPTION_OBSERVE, (uint32_t)0);
+  out.option(coap::OPTION_URI_PATH, "api");
+  out.option(coap::OPTION_URI_PATH, "control");
+  out.option(coap::OPTION_CONTENT_FORMAT, coap::FORMAT_CBOR);
+  out.option(coap::OPTION_URI_QUERY, "a=1");
+  out.option(coap::OPTION_URI_QUERY, "b=2");
+  out.option(coap::OPTION_ACCEPT, coap::FORMAT_CBOR);
+  size_t room;
+  uint8_t* payload = out.beginPayload(room);
+  memcpy(payload, "hi", 2);
+  out.endPayload(2);
+  expect("builder ok", out.ok(), 1);
+
+  coap::Request request;
+  expect("round trip parses", coap::parse(packet, out.length(), request), coap::PARSE_OK);
+  expect("type", request.type, coap::TYPE_CON);
+  expect("code", request.code, coap::POST);
+  expect("message id", request.messageId, 0x1234);
+  expect("token length", request.tokenLength, 4);
+  expect("token", memcmp(request.token, token, sizeof(token)), 0);
+  expectText("path", request.path, "/api/control");
+  expectText("query", request.query, "a=1&b=2");
+  expect("observe 0 is the empty value", request.observe, 0);
+  expect("content format", request.contentFormat, coap::FORMAT_CBOR);
+  expect("accept", request.accept, coap::FORMAT_CBOR);
+  expect("payload length", request.payloadLength, 2);
+  expect("payload", memcmp(request.payload, "hi", 2), 0);
+
+  // Nothing optional: fields keep their "absent" values
+  out.header(coap::TYPE_NON, coap::GET, 7, nullptr, 0);
+  out.option(coap::OPTION_URI_PATH, "status");
+  expect("minimal parses", coap::parse(packet, out.length(), request), coap::PARSE_OK);
+  expectText("minimal path", request.path, "/status");
+  expect("observe absent", request.observe, coap::OBSERVE_NONE);
+  expect("content format absent", request.contentFormat, coap::FORMAT_NONE);
+  expect("no payload", request.payloadLength, 0);
+
+  // Empty message (ping) is header only
+  out.header(coap::TYPE_CON, coap::EMPTY, 9, nullptr, 0);
+  expect("ping length", out.length(), 4);
+  expect("ping parses", coap::parse(packet, out.length(), request), coap::PARSE_OK);
+}
+
+static void optionDeltas() {
+  uint8_t packet[700];
+  coap::Builder out(packet, sizeof(packet));
+
+  // Uint options: fewest bytes, zero is empty
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(coap::OPTION_MAX_AGE, (uint32_t)0x0100);
+  expect("uint option header", packet[4], (13 << 4) | 2);   // Delta 14 takes one extension byte
+  expect("uint option extension", packet[5], 1);
+  expect("uint option high byte", packet[6], 0x01);
+  expect("uint option low byte", packet[7], 0x00);
+
+  // Delta 12 fits the nibble, 13 needs one extra byte, 269 two
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(coap::OPTION_CONTENT_FORMAT, (uint32_t)0);
+  expect("delta 12 in the nibble", packet[4], 12 << 4);
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(13, (uint32_t)0);
+  expect("delta 13 nibble", packet[4], 13 << 4);
+  expect("delta 13 extension", packet[5], 0);
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(269, (uint32_t)0);
+  expect("delta 269 nibble", packet[4], 14 << 4);
+  expect("delta 269 extension high", packet[5], 0);
+  expect("delta 269 extension low", packet[6], 0);
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(1000, (uint32_t)0);
+  expect("delta 1000 extension high", packet[5], (1000 - 269) >> 8);
+  expect("delta 1000 extension low", packet[6], (1000 - 269) & 0xFF);
+
+  // Long values use the same extensions for the length
+  char segment[300];
+  memset(segment, 'x', sizeof(segment) - 1);
+  segment[sizeof(segment) - 1] = '\0';
+  out.header(coap::TYPE_CON, coap::GET, 2, nullptr, 0);
+  out.option(coap::OPTION_URI_PATH, (const uint8_t*)segment, 20);
+  expect("length 20 nibble", packet[4] & 0x0F, 13);
+  expect("length 20 extension", packet[5], 20 - 13);
+
+  // Elective (even) options past 269 are skipped, long values and all
+  coap::Request request;
+  out.header(coap::TYPE_CON, coap::GET, 3, nullptr, 0);
+  out.option(coap::OPTION_URI_PATH, "a");
+  out.option(coap::OPTION_URI_QUERY, (const uint8_t*)segment, 20);
+  out.option(2048, (const uint8_t*)segment, 299);
+  expect("elective option with a 299-byte value", coap::parse(packet, out.length(), request), coap::PARSE_OK);
+  expectText("path before it", request.path, "/a");
+  expect("query before it", strlen(request.query), 20);
+
+  // A query longer than MAX_QUERY is a bad option, not an overrun
+  out.header(coap::TYPE_CON, coap::GET, 3, nullptr, 0);
+  out.option(coap::OPTION_URI_QUERY, (const uint8_t*)segment, coap::MAX_QUERY);
+  expect("query too long", coap::parse(packet, out.length(), request), coap::PARSE_BAD_OPTION);
+
+  // An unknown critical (odd) option is reported, not ignored
+  out.header(coap::TYPE_CON, coap::GET, 4, nullptr, 0);
+  out.option(coap::OPTION_URI_PATH, "a");
+  out.option(2049, (uint32_t)1);
+  expect("unknown critical option", coap::parse(packet, out.length(), request), coap::PARSE_BAD_OPTION);
+}
+
+static void malformed() {
+  coap::Request request;
+  const uint8_t shortHeader[] = {0x40, 0x01, 0x00};
+  expect("shorter than a header", coap::parse(shortHeader, sizeof(shortHeader), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t version2[] = {0x80, 0x01, 0x00, 0x01};
+  expect("version 2", coap::parse(version2, sizeof(version2), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t tokenTooLong[] = {0x49, 0x01, 0x00, 0x01, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  expect("token length 9", coap::parse(tokenTooLong, sizeof(tokenTooLong), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t tokenTruncated[] = {0x44, 0x01, 0x00, 0x01, 1, 2};
+  expect("token cut short", coap::parse(tokenTruncated, sizeof(tokenTruncated), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t emptyWithBody[] = {0x40, 0x00, 0x00, 0x01, 0xB1, 'a'};
+  expect("empty message with options", coap::parse(emptyWithBody, sizeof(emptyWithBody), request),
+         coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t valueTruncated[] = {0x40, 0x01, 0x00, 0x01, 0xB4, 'a', 'b'};
+  expect("option value cut short", coap::parse(valueTruncated, sizeof(valueTruncated), request),
+         coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t extensionMissing[] = {0x40, 0x01, 0x00, 0x01, 0xD0};
+  expect("delta 13 without its byte", coap::parse(extensionMissing, sizeof(extensionMissing), request),
+         coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t extensionHalf[] = {0x40, 0x01, 0x00, 0x01, 0xE0, 0x00};
+  expect("delta 14 with one byte", coap::parse(extensionHalf, sizeof(extensionHalf), request),
+         coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t reservedDelta[] = {0x40, 0x01, 0x00, 0x01, 0xF0};
+  expect("reserved delta 15", coap::parse(reservedDelta, sizeof(reservedDelta), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t reservedLength[] = {0x40, 0x01, 0x00, 0x01, 0xBF};
+  expect("reserved length 15", coap::parse(reservedLength, sizeof(reservedLength), request), coap::PARSE_FORMAT_ERROR);
+
+  const uint8_t markerOnly[] = {0x40, 0x02, 0x00, 0x01, 0xFF};
+  expect("payload marker with no payload", coap::parse(markerOnly, sizeof(markerOnly), request),
+         coap::PARSE_FORMAT_ERROR);
+
+  // Builder: a packet that does not fit is reported, and no payload is written
+  uint8_t small[8];
+  coap::Builder out(small, sizeof(small));
+  out.header(coap::TYPE_ACK, coap::CONTENT, 1, nullptr, 0);
+  out.option(coap::OPTION_URI_PATH, "toolong");
+  expect("builder overflow", out.ok(), 0);
+  size_t room;
+  out.beginPayload(room);
+  expect("no room after overflow", room, 0);
+}
+
+static void cborIntegers() {
+  const long long values[] = {0, 1, 23, 24, 255, 256, 65535, 65536, 0x7FFFFFFF,
+                              -1, -24, -25, -256, -257, -65536, -65537, -2147483647LL - 1};
+  for (long long value : values) {
+    uint8_t buffer[32];
+    cbor::Writer out(buffer, sizeof(buffer));
+    out.map(1);
+    out.key("n");
+    out.integer(value);
+    cbor::Reader in(buffer, out.length());
+    int32_t got = 0;
+    char what[48];
+    snprintf(what, sizeof(what), "integer %lld", value);
+    expect(what, in.valid() && in.integer("n", got) ? got : -999, value);
+  }
+
+  // Wire form of a few negatives (RFC 8949 appendix A)
+  uint8_t buffer[16];
+  cbor::Writer out(buffer, sizeof(buffer));
+  out.integer(-1);
+  out.integer(-10);
+  out.integer(-100);
+  out.integer(-1000);
+  const uint8_t wire[] = {0x20, 0x29, 0x38, 0x63, 0x39, 0x03, 0xE7};
+  expect("negative wire length", out.length(), sizeof(wire));
+  expect("negative wire bytes", memcmp(buffer, wire, sizeof(wire)), 0);
+
+  // Beyond int32 is refused rather than wrapped
+  cbor::Writer big(buffer, sizeof(buffer));
+  big.map(2);
+  big.key("p");
+  big.integer(0x80000000LL);
+  big.key("m");
+  big.integer(-0x80000001LL);
+  cbor::Reader in(buffer, big.length());
+  int32_t ignored;
+  expect("2^31 refused", in.integer("p", ignored), 0);
+  expect("-2^31-1 refused", in.integer("m", ignored), 0);
+}
+
+static void cborMaps() {
+  uint8_t buffer[64];
+  cbor::Writer out(buffer, sizeof(buffer));
+  out.map(5);
+  out.key("nested"); out.array(2); out.integer(1); out.map(1); out.key("x"); out.null();
+  out.key("action"); out.text("start");
+  out.key("seconds"); out.integer(-30);
+  out.key("on"); out.boolean(true);
+  out.key("t"); out.number(23.5f);
+  expect("writer ok", out.ok(), 1);
+
+  cbor::Reader in(buffer, out.length());
+  char action[16];
+  int32_t seconds = 0;
+  bool on = false;
+  expect("map valid", in.valid(), 1);
+  expect("text after a nested item", in.text("action", action, sizeof(action)), 1);
+  expectText("text value", action, "start");
+  expect("negative integer in a map", in.integer("seconds", seconds) ? seconds : 0, -30);
+  expect("boolean", in.boolean("on", on) && on, 1);
+  expect("missing key", in.integer("absent", seconds), 0);
+  expect("wrong type", in.integer("action", seconds), 0);
+  char tiny[4];
+  expect("text too long for the buffer", in.text("action", tiny, sizeof(tiny)), 0);
+
+  // 23.5 is exact in half precision, 0.1 is not
+  cbor::Writer floats(buffer, sizeof(buffer));
+  floats.number(23.5f);
+  floats.number(0.1f);
+  expect("half float", buffer[0], cbor::FLOAT_HALF);
+  expect("half float bits", buffer[1] << 8 | buffer[2], 0x4DE0);
+  expect("single float", buffer[3], cbor::FLOAT_SINGLE);
+  expect("float lengths", floats.length(), 3 + 5);
+
+  // Malformed payloads
+  const uint8_t notMap[] = {0x81, 0x01};
+  expect("array is not a map", cbor::Reader(notMap, sizeof(notMap)).valid(), 0);
+  const uint8_t truncated[] = {0xA1, 0x61, 'a', 0x19, 0x01};
+  expect("truncated value", cbor::Reader(truncated, sizeof(truncated)).valid(), 0);
+  const uint8_t trailing[] = {0xA0, 0x00};
+  expect("trailing bytes", cbor::Reader(trailing, sizeof(trailing)).valid(), 0);
+  const uint8_t indefinite[] = {0xBF, 0xFF};
+  expect("indefinite map", cbor::Reader(indefinite, sizeof(indefinite)).valid(), 0);
+  const uint8_t hugeText[] = {0xA1, 0x7A, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+  expect("text longer than the payload", cbor::Reader(hugeText, sizeof(hugeText)).valid(), 0);
+  const uint8_t deep[] = {0xA1, 0x61, 'k', 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x00};
+  expect("nesting past MAX_DEPTH", cbor::Reader(deep, sizeof(deep)).valid(), 0);
+
+  cbor::Writer overflow(buffer, 4);
+  overflow.text("longer than four");
+  expect("writer overflow", overflow.ok(), 0);
+}
+
+int main() {
+  roundTrip();
+  optionDeltas();
+  malformed();
+  cborIntegers();
+  cborMaps();
+  printf("%s: %d checks, %d failed\n", failures == 0 ? "PASS" : "FAIL", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+/*
+ * Smart Farming System - Coroutine Scheduler Benchmark (host)
+ *
+ * Builds corocore.h on a PC and reports what the network flows cost:
+ * coroutine frame size for a few flow shapes, the bare suspend/resume
+ * round trip, and a scheduler poll over a full table of parked flows.
+ * Host frames use 8-byte pointers, so they are an upper bound for the
+ * ESP32; the device reports its own numbers under /api/coroutines.
+ *
+ *   g++ -std=c++20 -O2 -I.. coro_bench.cpp -o coro_bench && ./coro_bench
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include "corocore.h"
+
+namespace coro {
+
+inline uint32_t nowMs() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Nanoseconds on the host, so the "cycles" figures below read as ns
+inline uint32_t cycleCount() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace coro
+
+// Never ready: keeps a flow parked so poll() has to look at it
+struct Parked {
+  static bool ready(void*) { return false; }
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> h) { coro::scheduler.park(h, &Parked::ready, nullptr); }
+  void await_resume() {}
+};
+
+coro::Task timerFlow() {
+  co_await coro::sleepFor(60000);
+}
+
+// Like the upload flows: a payload string kept across the suspension
+coro::Task payloadFlow() {
+  std::string data = "field1=41&field2=23.5&field3=61.0&field4=0";
+  co_await Parked{};
+  data += "&field5=1";
+}
+
+coro::Task subFlow() {
+  co_await Parked{};
+}
+
+coro::Task nestedFlow() {
+  co_await subFlow();
+}
+
+coro::Task parkedFlow() {
+  co_await Parked{};
+}
+
+int main() {
+  coro::scheduler.spawn("timer", timerFlow());
+  coro::scheduler.spawn("payload", payloadFlow());
+  coro::scheduler.spawn("nested", nestedFlow());
+  uint32_t subFrame = coro::lastFrameBytes;    // The sub-flow frame was allocated last
+
+  int count = 0;
+  const coro::FlowStats* stats = coro::scheduler.stats(count);
+  printf("Frame bytes (root frame per flow)\n");
+  for (int i = 0; i < count; i++) {
+    printf("  %-8s %4u\n", stats[i].name, stats[i].frameBytes);
+  }
+  printf("  %-8s %4u (allocated by the nested flow)\n", "sub", subFrame);
+
+  const int rounds = 1000000;
+  uint32_t switchNs = coro::scheduler.measureSwitchCycles(rounds);
+  printf("Suspend/resume round trip: %u ns (%d rounds)\n", switchNs, rounds);
+
+  // Fill the table with parked flows and time a poll that resumes nothing
+  static const char* const names[] = {"p0", "p1", "p2", "p3", "p4", "p5"};
+  for (int i = 0; coro::scheduler.active() < coro::MAX_FLOWS; i++) {
+    coro::scheduler.spawn(names[i], parkedFlow());
+  }
+  const int polls = 1000000;
+  uint32_t start = coro::cycleCount();
+  for (int i = 0; i < polls; i++) {
+    coro::scheduler.poll();
+  }
+  uint32_t pollNs = (coro::cycleCount() - start) / (polls / 1000);
+  printf("Idle poll over %d parked flows: %u.%03u ns\n", coro::MAX_FLOWS, pollNs / 1000, pollNs % 1000);
+  return 0;
+}
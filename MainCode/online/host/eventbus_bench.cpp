@@ -0,0 +1,103 @@
+/*
+ * Smart Farming System - Event Bus Benchmark (host)
+ *
+ * What moving the pump reactions onto the bus costs. It compares three
+ * ways of delivering one pump-start event to three handlers (display,
+ * rain, soil calibration):
+ *
+ *   direct    - three plain function calls, as before the bus
+ *   sync      - bus::publish() to three SYNC subscribers
+ *   deferred  - bus::publish() to three DEFERRED subscribers plus the
+ *               bus::dispatchDeferred() that later delivers them
+ *
+ * The bus times every handler call for /api/events. On the ESP32 that is
+ * two reads of the cycle counter, a single instruction each. Here the
+ * counter is a plain increment of similar cost, so the figures are not
+ * swamped by clock reads. The program also checks that a fifth subscriber
+ * is refused and recorded in bus::rejected.
+ *
+ *   g++ -std=c++20 -O2 -I.. eventbus_bench.cpp -o eventbus_bench && ./eventbus_bench
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include "eventbus.h"
+
+namespace bus {
+
+// Stand-in for the ESP32 cycle counter: as cheap, though it counts calls, not time
+inline uint32_t ticks = 0;
+inline uint32_t cycleCount() { return ++ticks; }
+
+}  // namespace bus
+
+struct DirectEvent {
+  static constexpr const char* name = "direct";
+  uint32_t timestamp;
+  uint16_t plannedSeconds;
+};
+
+struct SyncEvent : DirectEvent {
+  static constexpr const char* name = "sync";
+};
+
+struct DeferredEvent : DirectEvent {
+  static constexpr const char* name = "deferred";
+};
+
+static volatile uint32_t sink;
+
+template <typename Event>
+__attribute__((noinline)) void handlerA(const Event& event) { sink = sink + event.timestamp; }
+template <typename Event>
+__attribute__((noinline)) void handlerB(const Event& event) { sink = sink ^ event.plannedSeconds; }
+template <typename Event>
+__attribute__((noinline)) void handlerC(const Event& event) { sink = sink - event.timestamp; }
+
+template <typename F>
+static double nsPerEvent(F fn, int events) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < events; i++) {
+    fn((uint32_t)i);
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / events;
+}
+
+int main() {
+  const int events = 5000000;
+
+  double direct = nsPerEvent([](uint32_t i) {
+    DirectEvent event{i, 30};
+    handlerA(event);
+    handlerB(event);
+    handlerC(event);
+  }, events);
+
+  bus::subscribe<SyncEvent>("display", handlerA<SyncEvent>, bus::SYNC);
+  bus::subscribe<SyncEvent>("rain", handlerB<SyncEvent>, bus::SYNC);
+  bus::subscribe<SyncEvent>("soilcal", handlerC<SyncEvent>, bus::SYNC);
+  double sync = nsPerEvent([](uint32_t i) { bus::publish(SyncEvent{{i, 30}}); }, events);
+
+  bus::subscribe<DeferredEvent>("display", handlerA<DeferredEvent>, bus::DEFERRED);
+  bus::subscribe<DeferredEvent>("rain", handlerB<DeferredEvent>, bus::DEFERRED);
+  bus::subscribe<DeferredEvent>("soilcal", handlerC<DeferredEvent>, bus::DEFERRED);
+  double deferred = nsPerEvent([](uint32_t i) {
+    bus::publish(DeferredEvent{{i, 30}});
+    bus::dispatchDeferred();
+  }, events);
+
+  printf("One event to three handlers (%d events each)\n", events);
+  printf("  direct calls        %6.1f ns\n", direct);
+  printf("  bus, sync           %6.1f ns\n", sync);
+  printf("  bus, deferred+drain %6.1f ns\n", deferred);
+  printf("Static memory: %zu bytes for %d topics\n", bus::memoryBytes(), bus::topicCount);
+
+  // The fifth subscriber on a topic must be refused and recorded
+  bus::subscribe<SyncEvent>("fourth", handlerA<SyncEvent>, bus::SYNC);
+  bool refused = !bus::subscribe<SyncEvent>("fifth", handlerA<SyncEvent>, bus::SYNC);
+  bool ok = refused && bus::rejected == 1;
+  printf("Overflow: %s (rejected %d, first \"%s\")\n", ok ? "refused and recorded" : "NOT DETECTED",
+         bus::rejected, bus::firstRejected);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/*
+ * Smart Farming System - Seqlock Benchmark (host)
+ *
+ * Compares the seqlock that carries sensorSnapshot with the obvious
+ * alternative, a mutex around a plain copy, for a SensorSnapshot-sized
+ * (40-byte) value: publish and read cost on one thread, then read
+ * throughput while a writer publishes continuously.
+ *
+ *   g++ -std=c++20 -O2 -pthread -I.. seqlock_bench.cpp -o seqlock_bench && ./seqlock_bench
+ */
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include "seqlock.h"
+
+struct Snapshot {
+  uint32_t words[10];
+};
+
+class MutexBox {
+ public:
+  void publish(const Snapshot& value) {
+    std::lock_guard<std::mutex> guard(mutex);
+    data = value;
+  }
+  Snapshot read() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return data;
+  }
+
+ private:
+  mutable std::mutex mutex;
+  Snapshot data = {};
+};
+
+static volatile uint32_t sink;
+
+template <typename F>
+static double nsPerCall(F fn, int calls) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < calls; i++) {
+    fn(i);
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / calls;
+}
+
+// Reads per microsecond on one reader thread while the main thread keeps publishing
+template <typename Box>
+static double contendedReads(Box& box, int milliseconds) {
+  std::atomic<bool> stop{false};
+  uint64_t reads = 0;
+  std::thread reader([&]() {
+    while (!stop.load(std::memory_order_relaxed)) {
+      sink = box.read().words[0];
+      reads++;
+    }
+  });
+  Snapshot value = {};
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 100; i++) {
+      value.words[0]++;
+      box.publish(value);
+    }
+  }
+  stop.store(true);
+  reader.join();
+  return (double)reads / (milliseconds * 1000.0);
+}
+
+template <typename Box>
+static void run(const char* name, Box& box) {
+  const int calls = 10000000;
+  Snapshot value = {};
+  double publishNs = nsPerCall([&](int i) { value.words[0] = i; box.publish(value); }, calls);
+  double readNs = nsPerCall([&](int) { sink = box.read().words[0]; }, calls);
+  double readsPerUs = contendedReads(box, 1000);
+  printf("%-8s publish %6.1f ns   read %6.1f ns   reads under write load %7.2f /us\n", name, publishNs,
+         readNs, readsPerUs);
+}
+
+int main() {
+  Seqlock<Snapshot> seqlock;
+  MutexBox mutexBox;
+  printf("%zu-byte value, %u hardware threads\n", sizeof(Snapshot), std::thread::hardware_concurrency());
+  run("seqlock", seqlock);
+  run("mutex", mutexBox);
+  printf("seqlock read retries under load: %u\n", seqlock.collisions());
+  return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Smart Farming System - Seqlock Stress Test (host)
+ *
+ * One writer thread publishes a SensorSnapshot-shaped struct as fast as it
+ * can while several reader threads check every copy they get. Every field
+ * of a published value is derived from its timestamp, so a copy mixing two
+ * publishes shows up as a field that does not match. Readers also check
+ * that timestamps never go backwards. Exits non-zero on any torn or stale
+ * read.
+ *
+ *   g++ -std=c++20 -O2 -pthread -I.. seqlock_stress.cpp -o seqlock_stress
+ *   ./seqlock_stress [seconds] [readers]     (defaults: 5 s, 3 readers)
+ *
+ * Run it on a multi-core machine where possible: on one core the readers
+ * only overlap a publish when the scheduler preempts the writer mid-copy.
+ * (ThreadSanitizer does not model the fences the seqlock relies on.)
+ */
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "seqlock.h"
+
+// Same layout as SensorSnapshot in online.ino
+struct Snapshot {
+  uint32_t timestamp;
+  float temperature;
+  float humidity;
+  int soilMoistureRaw;
+  int soilMoisturePercent;
+  int lightLevelPercent;
+  float tankLevel;
+  int dailyIrrigations;
+  float rainTodayMm;
+  bool pumpActive;
+  bool systemOK;
+  bool wifiConnected;
+  bool emergencyStop;
+};
+
+static Snapshot make(uint32_t n) {
+  Snapshot s;
+  s.timestamp = n;
+  s.temperature = (float)(n % 1000) * 0.5f;
+  s.humidity = (float)(n % 997) * 0.25f;
+  s.soilMoistureRaw = (int)(n * 7u % 4096);
+  s.soilMoisturePercent = (int)(n % 101);
+  s.lightLevelPercent = (int)(n * 3u % 101);
+  s.tankLevel = (float)(n % 89) - 1.0f;
+  s.dailyIrrigations = (int)(n % 11);
+  s.rainTodayMm = (float)(n % 500) * 0.1f;
+  s.pumpActive = n & 1;
+  s.systemOK = n & 2;
+  s.wifiConnected = n & 4;
+  s.emergencyStop = n & 8;
+  return s;
+}
+
+static bool consistent(const Snapshot& s) {
+  Snapshot expected = make(s.timestamp);
+  return s.temperature == expected.temperature && s.humidity == expected.humidity &&
+         s.soilMoistureRaw == expected.soilMoistureRaw &&
+         s.soilMoisturePercent == expected.soilMoisturePercent &&
+         s.lightLevelPercent == expected.lightLevelPercent && s.tankLevel == expected.tankLevel &&
+         s.dailyIrrigations == expected.dailyIrrigations && s.rainTodayMm == expected.rainTodayMm &&
+         s.pumpActive == expected.pumpActive && s.systemOK == expected.systemOK &&
+         s.wifiConnected == expected.wifiConnected && s.emergencyStop == expected.emergencyStop;
+}
+
+static Seqlock<Snapshot> lock;
+static std::atomic<bool> stop{false};
+
+struct ReaderResult {
+  uint64_t reads = 0;
+  uint64_t torn = 0;
+  uint64_t backwards = 0;
+};
+
+static void reader(ReaderResult* result) {
+  uint32_t last = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    Snapshot s = lock.read();
+    result->reads++;
+    if (!consistent(s)) {
+      result->torn++;
+    }
+    if (s.timestamp < last) {
+      result->backwards++;
+    }
+    last = s.timestamp;
+  }
+}
+
+int main(int argc, char** argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 5;
+  int readers = argc > 2 ? atoi(argv[2]) : 3;
+
+  lock.publish(make(0));
+  std::vector<ReaderResult> results(readers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < readers; i++) {
+    threads.emplace_back(reader, &results[i]);
+  }
+
+  uint32_t published = 0;
+  auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 1000; i++) {
+      lock.publish(make(++published));
+    }
+  }
+  stop.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  ReaderResult total;
+  for (const ReaderResult& r : results) {
+    total.reads += r.reads;
+    total.torn += r.torn;
+    total.backwards += r.backwards;
+  }
+  bool generationOk = lock.generation() == published + 1;
+
+  printf("%d s, %d readers, %u publishes, %llu reads, %u retries\n", seconds, readers, published,
+         (unsigned long long)total.reads, lock.collisions());
+  printf("torn reads: %llu, timestamps going backwards: %llu, generation %s\n",
+         (unsigned long long)total.torn, (unsigned long long)total.backwards,
+         generationOk ? "ok" : "WRONG");
+  bool pass = total.torn == 0 && total.backwards == 0 && generationOk && total.reads > 0;
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/*
+ * Smart Farming System - Frequency Soil Probe Test (host)
+ *
+ * Checks the count-to-reading chain in soilprobe.h: gate counts to Hz,
+ * the piecewise-linear calibration lookup (both table directions, exact
+ * points, interpolation, clamping past either end, flat segments), the
+ * mapping onto the analog probe's dry..wet scale, and the split of long
+ * gate windows into RMT half-symbols. Also runs the shipped
+ * soilFrequencyTable end to end. Exits non-zero on any failed check.
+ *
+ *   g++ -std=c++20 -O2 -I.. soilprobe_test.cpp -o soilprobe_test
+ *   ./soilprobe_test
+ */
+
+#include <stdio.h>
+#include "soilprobe.h"
+
+static int checks = 0;
+static int failures = 0;
+
+static void expect(const char* what, long long got, long long want) {
+  checks++;
+  if (got != want) {
+    failures++;
+    printf("FAIL %-44s got %lld, expected %lld\n", what, got, want);
+  }
+}
+
+static void countConversion() {
+  expect("countToHz 1000 edges in 10 ms", probe::countToHz(1000, 10000), 100000);
+  expect("countToHz rounds to nearest", probe::countToHz(1, 3), 333333);
+  expect("countToHz rounds half up", probe::countToHz(1, 2000000), 1);
+  expect("countToHz zero window", probe::countToHz(500, 0), 0);
+  expect("countToHz no 32-bit overflow", probe::countToHz(4000000, 1000000), 4000000);
+}
+
+static void tableLookup() {
+  const probe::FrequencyPoint descending[] = {{150000, 0}, {120000, 3000}, {90000, 10000}};
+  const probe::FrequencyPoint ascending[] = {{40000, 0}, {60000, 5000}, {100000, 10000}};
+  const probe::FrequencyPoint flat[] = {{50000, 0}, {50000, 2000}, {30000, 8000}};
+
+  expect("descending: first point", probe::moistureFromHz(descending, 3, 150000), 0);
+  expect("descending: middle point", probe::moistureFromHz(descending, 3, 120000), 3000);
+  expect("descending: last point", probe::moistureFromHz(descending, 3, 90000), 10000);
+  expect("descending: halfway, first segment", probe::moistureFromHz(descending, 3, 135000), 1500);
+  expect("descending: halfway, second segment", probe::moistureFromHz(descending, 3, 105000), 6500);
+  expect("descending: drier than the table", probe::moistureFromHz(descending, 3, 200000), 0);
+  expect("descending: wetter than the table", probe::moistureFromHz(descending, 3, 10000), 10000);
+
+  expect("ascending: halfway", probe::moistureFromHz(ascending, 3, 50000), 2500);
+  expect("ascending: second segment", probe::moistureFromHz(ascending, 3, 80000), 7500);
+  expect("ascending: below the table", probe::moistureFromHz(ascending, 3, 1000), 0);
+  expect("ascending: above the table", probe::moistureFromHz(ascending, 3, 500000), 10000);
+
+  expect("flat segment returns its first point", probe::moistureFromHz(flat, 3, 50000), 0);
+  expect("after a flat segment", probe::moistureFromHz(flat, 3, 40000), 5000);
+  expect("empty table", probe::moistureFromHz(descending, 0, 100000), 0);
+  expect("single point table", probe::moistureFromHz(descending, 1, 100000), 0);
+}
+
+static void analogScale() {
+  // Analog capacitive probes read high when dry
+  expect("dry end", probe::rawFromMoisture(0, 3000, 1200), 3000);
+  expect("wet end", probe::rawFromMoisture(10000, 3000, 1200), 1200);
+  expect("halfway", probe::rawFromMoisture(5000, 3000, 1200), 2100);
+  expect("below 0 % clamps", probe::rawFromMoisture(-500, 3000, 1200), 3000);
+  expect("above 100 % clamps", probe::rawFromMoisture(12000, 3000, 1200), 1200);
+  expect("inverted scale", probe::rawFromMoisture(2500, 800, 3800), 1550);
+}
+
+static void gateSplit() {
+  uint16_t halves[8];
+  expect("short window: one half", probe::splitGate(1000, halves, 8), 1);
+  expect("short window: ticks", halves[0], 1000);
+  expect("exact maximum: one half", probe::splitGate(probe::MAX_GATE_TICKS, halves, 8), 1);
+  expect("just over maximum: two halves", probe::splitGate(probe::MAX_GATE_TICKS + 1, halves, 8), 2);
+  expect("just over maximum: remainder", halves[1], 1);
+
+  int count = probe::splitGate(100000, halves, 8);
+  long long total = 0;
+  for (int i = 0; i < count; i++) {
+    total += halves[i];
+  }
+  expect("100000 ticks: halves", count, 4);
+  expect("100000 ticks: sum", total, 100000);
+  expect("does not fit: 0", probe::splitGate(100000, halves, 3), 0);
+  expect("empty window: 0", probe::splitGate(0, halves, 8), 0);
+}
+
+// Shipped table: counts from a 100 ms gate through to the analog scale
+static void shippedTable() {
+  expect("shipped table descends", soilFrequencyTable[0].hz > soilFrequencyTable[SOIL_FREQUENCY_POINTS - 1].hz, 1);
+  for (size_t i = 0; i + 1 < SOIL_FREQUENCY_POINTS; i++) {
+    expect("shipped table monotonic", soilFrequencyTable[i].hz > soilFrequencyTable[i + 1].hz, 1);
+    expect("shipped moisture rises", soilFrequencyTable[i].moisture < soilFrequencyTable[i + 1].moisture, 1);
+  }
+
+  uint32_t hz = probe::countToHz(11800, 100000);   // 118 kHz, halfway 128k..108k
+  int32_t moisture = probe::moistureFromHz(soilFrequencyTable, SOIL_FREQUENCY_POINTS, hz);
+  expect("end to end: Hz", hz, 118000);
+  expect("end to end: moisture", moisture, 3250);
+  expect("end to end: raw", probe::rawFromMoisture(moisture, 3000, 1200), 2415);
+}
+
+int main() {
+  countConversion();
+  tableLookup();
+  analogScale();
+  gateSplit();
+  shippedTable();
+  printf("%s: %d checks, %d failed\n", failures == 0 ? "PASS" : "FAIL", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
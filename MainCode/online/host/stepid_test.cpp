@@ -0,0 +1,182 @@
+/*
+ * Smart Farming System - Step Response Identification Test (host)
+ *
+ * Runs stepid::identify() on first-order-plus-dead-time traces generated
+ * here (clean and with ADC-sized noise), on traces it must reject, and on
+ * CSV traces in the format GET /api/commission?trace=1 downloads. A CSV
+ * with an "# expect" line is checked against it; one without is only
+ * printed, so traces saved from a unit can be looked at the same way.
+ * Exits non-zero on any failed check.
+ *
+ *   g++ -std=c++20 -O2 -I.. stepid_test.cpp -o stepid_test
+ *   ./stepid_test [trace.csv ...]     (default: traces/commission_fopdt.csv)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "stepid.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, float got, float want) {
+  printf("  %-4s %-16s %8.3f (expected %.3f)\n", ok ? "ok" : "FAIL", what, got, want);
+  if (!ok) {
+    failures++;
+  }
+}
+
+// Within tolerance of want: the larger of a fraction of it and an absolute floor
+static void checkNear(const char* what, float got, float want, float fraction, float floor) {
+  float tolerance = fabsf(want) * fraction > floor ? fabsf(want) * fraction : floor;
+  check(fabsf(got - want) <= tolerance, what, got, want);
+}
+
+struct Fopdt {
+  float baseline;       // %
+  float deadSeconds;
+  float tauSeconds;
+  float rise;           // %
+  float decayPerHour;   // %/h
+  float noise;          // Standard deviation (%)
+};
+
+// Same shape as commissioning records: 1 s samples, 60 s baseline, 1800 s
+// from the pulse start, moisture in 0.01 %
+static std::vector<int16_t> generate(const Fopdt& model, size_t baselineSamples, size_t count) {
+  std::vector<int16_t> samples(count);
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < count; i++) {
+    float t = (float)i - (float)baselineSamples;
+    float value = model.baseline - model.decayPerHour * (t > 0 ? t : 0) / 3600.0f;
+    if (t > model.deadSeconds) {
+      value += model.rise * (1 - expf(-(t - model.deadSeconds) / model.tauSeconds));
+    }
+    // Sum of uniforms: close enough to Gaussian, and the same on every host
+    float noise = 0;
+    for (int k = 0; k < 12; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      noise += (seed >> 8) / 16777216.0f;
+    }
+    value += (noise - 6.0f) * model.noise;
+    samples[i] = (int16_t)lroundf(value * 100);
+  }
+  return samples;
+}
+
+static void expectFit(const char* name, const Fopdt& model) {
+  printf("%s\n", name);
+  std::vector<int16_t> samples = generate(model, 60, 1860);
+  stepid::Trace trace = {samples.data(), samples.size(), 1000, 60, 10.0f};
+  stepid::Result result = stepid::identify(trace);
+  check(result.ok, "ok", result.ok, 1);
+  if (!result.ok) {
+    printf("       error: %s\n", result.error);
+    return;
+  }
+  checkNear("dead time (s)", result.deadTimeSeconds, model.deadSeconds, 0.10f, 3.0f);
+  checkNear("tau (s)", result.tauSeconds, model.tauSeconds, 0.10f, 3.0f);
+  checkNear("gain (%/s)", result.gainPerSecond, model.rise / 10.0f, 0.10f, 0.01f);
+  checkNear("decay (%/h)", result.decayPerHour, model.decayPerHour, 0.25f, 0.1f);
+}
+
+static void expectError(const char* name, const stepid::Trace& trace, const char* error) {
+  printf("%s\n", name);
+  stepid::Result result = stepid::identify(trace);
+  bool ok = !result.ok && result.error != nullptr && strcmp(result.error, error) == 0;
+  printf("  %-4s rejected with \"%s\"\n", ok ? "ok" : "FAIL", result.error ? result.error : "(none)");
+  if (!ok) {
+    failures++;
+  }
+}
+
+static void rejections() {
+  Fopdt flat = {40, 30, 90, 0, 0.5f, 0.05f};
+  std::vector<int16_t> noResponse = generate(flat, 60, 1860);
+  expectError("no response", {noResponse.data(), noResponse.size(), 1000, 60, 10.0f}, "no response to the pulse");
+
+  Fopdt slow = {40, 30, 600, 5, 0, 0.02f};
+  std::vector<int16_t> cutShort = generate(slow, 60, 400);
+  expectError("observation too short", {cutShort.data(), cutShort.size(), 1000, 60, 10.0f},
+              "still rising when the trace ended - observe longer");
+
+  expectError("no baseline", {noResponse.data(), noResponse.size(), 1000, 2, 10.0f},
+              "not enough samples before the pulse");
+  expectError("no pulse length", {noResponse.data(), noResponse.size(), 1000, 60, 0.0f}, "invalid trace");
+}
+
+// Reads a /api/commission?trace=1 download; the "# key=value" comment lines
+// carry the trace parameters and, optionally, the expected result
+static bool runCsv(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    printf("%s: cannot open\n", path);
+    failures++;
+    return false;
+  }
+  printf("%s\n", path);
+
+  unsigned intervalMs = 0, pulseStart = 0;
+  float pulseSeconds = 0, deadTime = -1, tau = -1, gain = -1;
+  std::vector<int16_t> samples;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '#') {
+      for (char* token = strtok(line + 1, " \t\r\n"); token; token = strtok(nullptr, " \t\r\n")) {
+        sscanf(token, "intervalMs=%u", &intervalMs);
+        sscanf(token, "pulseStart=%u", &pulseStart);
+        sscanf(token, "pulseSeconds=%f", &pulseSeconds);
+        sscanf(token, "deadTimeSeconds=%f", &deadTime);
+        sscanf(token, "tauSeconds=%f", &tau);
+        sscanf(token, "gainPerSecond=%f", &gain);
+      }
+      continue;
+    }
+    float seconds, moisture;
+    if (sscanf(line, "%f,%f", &seconds, &moisture) == 2) {
+      samples.push_back((int16_t)lroundf(moisture * 100));
+    }
+  }
+  fclose(file);
+
+  stepid::Trace trace = {samples.data(), samples.size(), intervalMs, pulseStart, pulseSeconds};
+  stepid::Result result = stepid::identify(trace);
+  printf("  %zu samples: %s", samples.size(), result.ok ? "" : result.error);
+  if (result.ok) {
+    printf("dead time %.1f s, tau %.1f s, gain %.3f %%/s, rise %.2f %%, noise %.3f %%, decay %.2f %%/h",
+           result.deadTimeSeconds, result.tauSeconds, result.gainPerSecond, result.rise, result.noise,
+           result.decayPerHour);
+  }
+  printf("\n");
+
+  if (deadTime < 0) {
+    return true;   // Nothing to check against
+  }
+  check(result.ok, "ok", result.ok, 1);
+  if (result.ok) {
+    checkNear("dead time (s)", result.deadTimeSeconds, deadTime, 0.15f, 5.0f);
+    checkNear("tau (s)", result.tauSeconds, tau, 0.15f, 5.0f);
+    checkNear("gain (%/s)", result.gainPerSecond, gain, 0.10f, 0.01f);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  expectFit("clean: dead 30 s, tau 90 s, rise 5 %", {35, 30, 90, 5, 0, 0});
+  expectFit("noisy: dead 45 s, tau 150 s, rise 4 %, drying 0.8 %/h", {52, 45, 150, 4, 0.8f, 0.05f});
+  expectFit("fast sandy zone: dead 8 s, tau 25 s, rise 3 %", {20, 8, 25, 3, 1.5f, 0.03f});
+  rejections();
+
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      runCsv(argv[i]);
+    }
+  } else {
+    runCsv("traces/commission_fopdt.csv");
+  }
+
+  printf("%s (%d failed)\n", failures == 0 ? "PASS" : "FAIL", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -22,15 +22,54 @@
 
 #include "config.h"
 #include <WiFi.h>
+#include <WiFiUdp.h>
 #include <HTTPClient.h>
 #include <WebServer.h>
+#include <DNSServer.h>
 #include <ArduinoOTA.h>
 #include <ArduinoJson.h>
 #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
 #include <AdafruitIO_WiFi.h>
 #endif
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <soc/gpio_struct.h>
+#include <driver/gpio.h>
+#include <esp_rom_gpio.h>
+#include <Preferences.h>
 #include <Arduino.h>
+#include <esp_core_dump.h>
+#include <esp_partition.h>
+#include "coro.h"
+#include "seqlock.h"
+#include "eventbus.h"
+#include "crops.h"
+#include "soilprobe.h"
+#include "stepid.h"
+#include "console.h"
+#include "syslog.h"
+#include "cbor.h"
+#include "coap.h"
+#include <time.h>
+#if CONFIG_FILE_ENABLED
+#include <LittleFS.h>
+#endif
+#if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+#include <driver/pulse_cnt.h>
+#include <driver/rmt_tx.h>
+#endif
+#if PUMP_CURRENT_SENSING
+#include <esp_adc/adc_continuous.h>
+#include <esp_adc/adc_cali_scheme.h>
+#include <freertos/semphr.h>
+#endif
+
+#if COREDUMP_ENABLED && !(defined(CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH) && defined(CONFIG_ESP_COREDUMP_DATA_FORMAT_ELF))
+  #warning "This ESP32 core does not write ELF core dumps to flash - COREDUMP_ENABLED ignored"
+  #undef COREDUMP_ENABLED
+  #define COREDUMP_ENABLED false
+#endif
 
 // Conditional library inclusions
 #if DISPLAY_ENABLED
@@ -41,10 +80,37 @@
   #include <DHT.h>
 #endif
 
+#if SOIL_TEMPERATURE_PROBE
+  #include <OneWire.h>
+  #include <DallasTemperature.h>
+#endif
+
 // =============================================================================
 // GLOBAL VARIABLES AND OBJECTS
 // =============================================================================
 
+// Drives the relay low with a single register write. Safe to call from ISRs,
+// the panic handler and static constructors. RELAY_PIN must be below GPIO32.
+static inline void IRAM_ATTR relayForceOff() {
+  GPIO.out_w1tc = (1UL << RELAY_PIN);
+}
+
+// For the cut paths (ISRs, timer callbacks) that drop the relay behind the
+// loop's back: records when, so stopIrrigation() charges the on-time up to
+// the cut and starts the minimum off-time from it
+void IRAM_ATTR markPumpCut();
+
+// Relay Boot Guard: constructed before any other global, so the relay is
+// driven off before Arduino start-up, setup() and all sensor/LCD delays
+// (plain register/ROM calls only - the Arduino pin manager is not up yet)
+struct RelayBootGuard {
+  RelayBootGuard() {
+    esp_rom_gpio_pad_select_gpio(RELAY_PIN);
+    relayForceOff();
+    gpio_set_direction((gpio_num_t)RELAY_PIN, GPIO_MODE_OUTPUT);
+  }
+} relayBootGuard;
+
 // LCD Object (conditional)
 #if DISPLAY_ENABLED
   LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
@@ -55,12 +121,113 @@
   DHT dht(DHT_PIN, DHT_TYPE);
 #endif
 
+// Soil Temperature Probe (conditional)
+#if SOIL_TEMPERATURE_PROBE
+  OneWire soilTempWire(SOIL_TEMPERATURE_PIN);
+  DallasTemperature soilTempProbe(&soilTempWire);
+  DeviceAddress soilTempAddress;
+  bool soilTempFound = false;
+#endif
+
 // Web Server Object
 WebServer server(WEB_SERVER_PORT);
 
-// Adafruit IO Object
+// Access-Point Fallback (see ACCESS POINT FALLBACK FUNCTIONS)
+struct SoftApState {
+  bool active = false;
+  unsigned long startedAt = 0;
+  unsigned long lastProbe = 0;
+  uint32_t activations = 0;       // Times the unit fell back to its own access point
+  uint32_t probes = 0;            // Background scans for the configured network
+  uint32_t rejoinFailures = 0;    // Network seen but the station could not join it
+  uint32_t expiries = 0;          // Closed after SOFTAP_LIFETIME to let the station retry
+} softAp;
+DNSServer dnsServer;
+char softApPassword[64] = SOFTAP_PASSWORD;  // Generated once per device when SOFTAP_PASSWORD is ""
+Preferences softApPrefs;
+static_assert(sizeof(SOFTAP_PASSWORD) == 1 || (sizeof(SOFTAP_PASSWORD) > 8 && sizeof(SOFTAP_PASSWORD) <= 64),
+              "SOFTAP_PASSWORD must be empty (per-device password) or 8 to 63 characters");
+
+// Runtime Settings
+// Start from the config.h values; /config.json on LittleFS overrides them at
+// boot and whenever the file changes (see CONFIGURATION FILE FUNCTIONS)
+struct RuntimeSettings {
+  int soilThreshold;              // irrigation.soilThreshold (%)
+  int irrigationSeconds;          // irrigation.durationSeconds
+  uint32_t irrigationCooldownMs;  // irrigation.cooldownSeconds
+  int maxDailyIrrigations;        // irrigation.maxDaily
+  uint32_t sensorReadIntervalMs;  // sensors.readIntervalMs
+  uint32_t transmitIntervalMs;    // cloud.transmitIntervalMs
+  char thingSpeakApiKey[33];      // cloud.thingSpeakApiKey
+  char wifiSsid[33];              // wifi.ssid
+  char wifiPassword[65];          // wifi.password
+  char cropProfile[16];           // crop.profile ("" = none)
+  char plantingDate[11];          // crop.plantingDate (YYYY-MM-DD)
+};
+
+const RuntimeSettings defaultSettings = {
+  SOIL_MOISTURE_THRESHOLD, IRRIGATION_DURATION / 1000, IRRIGATION_COOLDOWN, MAX_DAILY_IRRIGATIONS,
+  SENSOR_READ_INTERVAL, DATA_TRANSMISSION_INTERVAL, THINGSPEAK_API_KEY, WIFI_SSID, WIFI_PASSWORD,
+  CROP_PROFILE, PLANTING_DATE
+};
+RuntimeSettings runtimeSettings = defaultSettings;
+
+// Adafruit IO Object (keeps pointers to the credentials, so a reload is picked up on reconnect)
 #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
-AdafruitIO_WiFi io(ADAFRUIT_IO_USERNAME, ADAFRUIT_IO_KEY, WIFI_SSID, WIFI_PASSWORD);
+AdafruitIO_WiFi io(ADAFRUIT_IO_USERNAME, ADAFRUIT_IO_KEY, runtimeSettings.wifiSsid, runtimeSettings.wifiPassword);
+#endif
+
+// Menu Engine Types (rotary encoder UI)
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+enum MenuItemKind : uint8_t {
+  MENU_SUBMENU,   // Opens a nested page
+  MENU_INT,       // Adjustable integer parameter
+  MENU_INFO,      // Read-only live value
+  MENU_ACTION,    // Runs a function when pressed
+  MENU_BACK,      // Returns to the parent page
+  MENU_EXIT       // Saves settings and leaves the menu
+};
+
+struct MenuPage;
+
+// One row of a menu page. Only the fields relevant to `kind` are used.
+struct MenuItem {
+  const char* label;
+  MenuItemKind kind;
+  const MenuPage* submenu;                  // MENU_SUBMENU
+  int* value;                               // MENU_INT binding
+  int16_t minValue;
+  int16_t maxValue;
+  int16_t step;
+  const char* unit;
+  void (*action)();                         // MENU_ACTION
+  void (*info)(char* buffer, size_t size);  // MENU_INFO
+};
+
+struct MenuPage {
+  const char* title;
+  const MenuItem* items;
+  uint8_t count;
+};
+
+constexpr MenuItem menuSubmenu(const char* label, const MenuPage* page) {
+  return {label, MENU_SUBMENU, page, nullptr, 0, 0, 0, "", nullptr, nullptr};
+}
+constexpr MenuItem menuInt(const char* label, int* value, int16_t minValue, int16_t maxValue, int16_t step, const char* unit) {
+  return {label, MENU_INT, nullptr, value, minValue, maxValue, step, unit, nullptr, nullptr};
+}
+constexpr MenuItem menuInfo(const char* label, void (*info)(char*, size_t)) {
+  return {label, MENU_INFO, nullptr, nullptr, 0, 0, 0, "", nullptr, info};
+}
+constexpr MenuItem menuAction(const char* label, void (*action)()) {
+  return {label, MENU_ACTION, nullptr, nullptr, 0, 0, 0, "", action, nullptr};
+}
+constexpr MenuItem menuBack() {
+  return {"Back", MENU_BACK, nullptr, nullptr, 0, 0, 0, "", nullptr, nullptr};
+}
+constexpr MenuItem menuExit() {
+  return {"Save & Exit", MENU_EXIT, nullptr, nullptr, 0, 0, 0, "", nullptr, nullptr};
+}
 #endif
 
 // System State Variables
@@ -71,6 +238,8 @@ struct SystemState {
   int soilMoisturePercent = 0;
   int lightLevelRaw = 0;
   int lightLevelPercent = 0;
+  bool soilHeld = false;          // Soil reading carried over from an earlier pass (ADC busy)
+  bool lightHeld = false;         // Same for the LDR
   bool pumpActive = false;
   bool systemOK = true;
   bool wifiConnected = false;
@@ -86,10 +255,10 @@ struct SystemState {
   int sensorErrors = 0;
   int transmissionErrors = 0;
   int adjustedThreshold = SOIL_MOISTURE_THRESHOLD;  // Adjustable soil moisture threshold
+  int irrigationSeconds = IRRIGATION_DURATION / 1000;  // Adjustable pump runtime per irrigation
   int adafruitIOErrors = 0;
   int recoveryAttempts = 0;
   unsigned long lastErrorCheck = 0;
-  unsigned long lastWatchdogFeed = 0;
   String lastTransmissionStatus = "Not attempted";
   #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
   String lastAdafruitIOStatus = "Not attempted";
@@ -97,11 +266,19 @@ struct SystemState {
   
   // Control System State
   #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
-    int currentMenu = 0;
-    int currentParameter = 0;
+    const MenuPage* menuPage = nullptr;      // Page currently shown
+    uint8_t menuCursor = 0;                  // Selected row on menuPage
+    bool menuEditing = false;                // True while a MENU_INT value is being adjusted
+    bool menuDirty = true;                   // Renderer needs to rebuild the frame
+    uint8_t menuDepth = 0;
+    const MenuPage* menuStack[MENU_MAX_DEPTH] = {nullptr};
+    uint8_t menuCursorStack[MENU_MAX_DEPTH] = {0};
     int encoderPosition = 0;
     bool encoderButtonPressed = false;
+    bool encoderButtonRaw = false;
+    unsigned long lastButtonChange = 0;
     unsigned long lastMenuActivity = 0;
+    unsigned long lastMenuRefresh = 0;
     bool inMenuMode = false;
   #elif CONTROL_TYPE == CONTROL_POTENTIOMETER
     int potentiometerValue = 0;
@@ -131,11 +308,357 @@ struct SensorValidation {
   int disconnectCount = 0;
 } sensorValidation;
 
+// P-square quantile estimator (Jain & Chlamtac): five markers, constant memory
+struct P2Quantile {
+  float p;
+  float q[5];         // Marker heights
+  float n[5];         // Marker positions
+  float np[5];        // Desired positions
+  uint32_t count;
+};
+
+// Soil Probe Auto-Calibration
+// Works in "dryness" units (raw reading flipped so that drier is always larger)
+#define SOIL_DRY_SIGN (SOIL_MOISTURE_DRY_VALUE > SOIL_MOISTURE_WET_VALUE ? 1 : -1)
+
+struct SoilCalibrationModel {
+  uint32_t version;
+  int wetRaw;                 // Endpoints currently used for the percentage
+  int dryRaw;
+  P2Quantile wetPlateaus;     // Median of the saturation plateaus seen after irrigation
+  P2Quantile dryFloors;       // Median of the driest level reached by long dry-downs
+  P2Quantile low;             // 5th percentile of all samples
+};
+
+struct SoilCalibrationState {
+  SoilCalibrationModel model;
+  int confidence = 0;                 // 0-100 %
+  int targetWetRaw = SOIL_MOISTURE_WET_VALUE;
+  int targetDryRaw = SOIL_MOISTURE_DRY_VALUE;
+  unsigned long lastSample = 0;
+  unsigned long lastUpdate = 0;
+  
+  // Saturation plateau search after an irrigation
+  unsigned long wetWatchUntil = 0;
+  int plateau[SOIL_CAL_PLATEAU_SAMPLES] = {0};
+  uint8_t plateauCount = 0;
+  
+  // Current dry-down (since the last irrigation)
+  unsigned long cycleStart = 0;
+  int cycleMax = 0;                   // Driest reading of this cycle (dryness units)
+  unsigned long cycleMaxSince = 0;    // When cycleMax last rose past the plateau band
+  bool floorRecorded = false;
+  
+  // What was last written to NVS (the model is only rewritten when it moved)
+  int savedWetRaw = 0;
+  int savedDryRaw = 0;
+  uint32_t savedEvidence = 0;         // Plateaus + floors
+  uint32_t savedSamples = 0;
+} soilCal;
+
+Preferences soilCalPrefs;
+
+// Soil Temperature Compensation
+// raw' = raw - k * (T - SOIL_TC_REFERENCE), all in fixed point: k is ADC
+// counts per degree C in Q8, temperatures are 1/16 degree C (Q4)
+struct SoilTempCompModel {
+  uint32_t version;
+  int32_t coeffQ8;            // Learned or configured k
+  uint16_t nights;            // Night-time fits that contributed to coeffQ8
+};
+
+struct SoilTempCompState {
+  SoilTempCompModel model;
+  const char* source = "none";        // Temperature used: "probe", "air" or "none"
+  int16_t temperatureQ4 = 0;          // Temperature of the last corrected sample
+  int rawUncorrected = 0;
+  int correction = 0;                 // Counts subtracted from the last sample
+  uint32_t maxCycles = 0;             // Worst per-sample cost of the correction step
+  
+  // Least-squares fit of raw against temperature and time over one quiet night
+  bool collecting = false;
+  unsigned long nightStart = 0;
+  uint32_t n = 0;
+  int64_t sumT = 0, sumM = 0, sumR = 0;             // M: minutes since nightStart
+  int64_t sumTT = 0, sumMM = 0, sumTM = 0, sumTR = 0, sumMR = 0, sumRR = 0;
+  int16_t minT = 0, maxT = 0;
+  int32_t lastFitQ8 = 0;
+  const char* lastFitResult = "none yet";
+} soilTc;
+
+Preferences soilTcPrefs;
+
+// Frequency Soil Probe
+// One PCNT unit per probe counts rising edges while the RMT gate pulse is
+// high; the gate is looped back inside the chip to every unit's control
+// input, so all channels see exactly the same window without CPU involvement.
+// Channel 0 is the probe the irrigation control uses.
+#define SOIL_FREQ_MAX_CHANNELS 4
+#define SOIL_FREQ_GATE_HALVES 16
+
+struct FrequencyProbeState {
+  bool ready = false;
+  bool measuring = false;
+  int channelCount = 0;
+  uint32_t lastHz[SOIL_FREQ_MAX_CHANNELS] = {0};
+  int32_t lastMoisture[SOIL_FREQ_MAX_CHANNELS] = {0};   // 0.01 %
+  uint32_t windows = 0;
+  uint32_t noSignal = 0;                                // Windows where channel 0 was below SOIL_FREQ_MIN_HZ
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+  pcnt_unit_handle_t units[SOIL_FREQ_MAX_CHANNELS] = {};
+  rmt_channel_handle_t gate = nullptr;
+  rmt_encoder_handle_t gateEncoder = nullptr;
+  rmt_symbol_word_t gateSymbols[SOIL_FREQ_GATE_HALVES / 2] = {};
+  int gateSymbolCount = 0;
+  #endif
+} freqProbe;
+
+// Zone Commissioning
+// Test pulses with the soil sampled every COMMISSION_SAMPLE_MS; the measured
+// response (see stepid.h) becomes the zone's parameters
+#define COMMISSION_BASELINE_SAMPLES (COMMISSION_BASELINE_SECONDS * 1000UL / COMMISSION_SAMPLE_MS)
+#define COMMISSION_MAX_SAMPLES ((COMMISSION_BASELINE_SECONDS + COMMISSION_OBSERVE_SECONDS) * 1000UL / COMMISSION_SAMPLE_MS)
+
+struct ZoneParameters {
+  uint32_t version;
+  float deadTimeSeconds;      // Pump on until the probe sees water
+  float gainPerSecond;        // Moisture gained per pump-second (%)
+  float tauSeconds;           // Infiltration time constant
+  float decayPerHour;         // Dry-down after watering (%/h)
+  uint8_t pulses;             // Test pulses averaged into these values
+  uint32_t commissionedAt;    // Unix time, or uptime seconds without a clock
+};
+
+struct CommissioningState {
+  ZoneParameters zone = {};
+  bool zoneValid = false;
+  bool active = false;
+  bool abortRequested = false;
+  const char* phase = "idle";         // idle, baseline, observe, done, failed, aborted
+  const char* error = "";
+  uint8_t pulse = 0;                  // Current test pulse, from 1
+  uint16_t sampleCount = 0;
+  uint16_t heldSamples = 0;           // Slots of this pulse with no fresh reading (interpolated)
+  int16_t trace[COMMISSION_MAX_SAMPLES];   // Current/last pulse, moisture in 0.01 %
+  stepid::Result last = {};           // Identification of the last pulse
+} commissioning;
+
+Preferences zonePrefs;
+
+// Serial Log (see syslog.h): prints to Serial and, with SYSLOG_ENABLED,
+// mirrors every line to the syslog collector
+syslog::Logger remoteLog;
+syslog::Tee Log(Serial, remoteLog);
+
+// Serial Console (see console.h; commands in the CONSOLE COMMANDS table)
+console::Console serialConsole;
+struct ConsoleTail {
+  unsigned long intervalMs = 0;       // 0 = off
+  unsigned long lastAt = 0;
+} consoleTail;
+struct ConsoleDump {
+  bool active = false;
+  uint32_t next = 0;                  // Breadcrumb sequence number to print next
+  uint32_t end = 0;                   // Head when "log" was typed
+  uint32_t shown = 0;
+} consoleDump;
+
+// Sensor/Control Snapshot
+// Published by the loop once per pass; reporting, upload, display and logging
+// code reads it instead of systemState so it always sees one consistent set
+struct SensorSnapshot {
+  uint32_t timestamp;
+  float temperature;
+  float humidity;
+  int soilMoistureRaw;
+  int soilMoisturePercent;
+  int lightLevelPercent;
+  bool soilHeld;                // Soil/light values repeat an earlier reading
+  bool lightHeld;
+  float tankLevel;              // -1 when unknown or no tank sensor
+  int dailyIrrigations;
+  float rainTodayMm;            // Effective rainfall detected since midnight
+  bool pumpActive;
+  bool systemOK;
+  bool wifiConnected;
+  bool emergencyStop;
+};
+Seqlock<SensorSnapshot> sensorSnapshot;
+
+// Crop Profile State (targets of the current growth stage, recomputed hourly)
+struct CropState {
+  const CropProfile* profile = nullptr;
+  int32_t plantingDay = -1;           // Days since 1970-01-01
+  bool active = false;                // False until a profile is set and the clock is known
+  const char* reason = "no profile";  // Why the profile is not active
+  uint8_t stage = 0;
+  int dayOfSeason = 0;
+  int threshold = SOIL_MOISTURE_THRESHOLD;  // Start irrigation below this (%)
+  int kc = 100;                       // Crop coefficient x100 for today
+  unsigned long lastUpdate = 0;
+} cropState;
+
+int pumpPlannedSeconds = 0;           // Runtime fixed when the current irrigation started
+int32_t irrigationDay = -1;           // Day the daily counters belong to
+
+// Rain Detection
+struct RainEventRecord {
+  uint32_t endedAt;         // Unix time (uptime seconds if the clock was not set)
+  uint16_t durationMin;
+  uint16_t riseCenti;       // Moisture rise, 0.01 %
+  uint16_t rainTenths;      // Estimated effective rainfall, 0.1 mm
+  uint8_t doses;
+};
+
+enum RainPhase : uint8_t {
+  RAIN_IDLE = 0,
+  RAIN_RISING
+};
+
+// Moisture is tracked in 0.01 % steps; the smoothed value carries 4 extra fraction bits
+struct RainState {
+  bool primed = false;
+  RainPhase phase = RAIN_IDLE;
+  int32_t smoothedQ4 = 0;
+  int32_t trough = 0;               // Baseline a rise is measured from
+  int32_t peak = 0;
+  uint8_t confirm = 0;              // Consecutive samples above the rise threshold
+  unsigned long startedAt = 0;
+  unsigned long lastPeakAt = 0;
+  bool pumpWatch = false;           // Pump water is still soaking in
+  unsigned long settleUntil = 0;
+  int32_t pumpStartLevel = 0;
+  int32_t pumpPeak = 0;
+  int32_t pumpRiseCenti = 0;        // Learned rise from one irrigation (0 = unknown yet)
+  uint16_t todayTenths = 0;
+  uint32_t events = 0;
+  uint32_t abandoned = 0;           // Rises cut short by the pump
+  uint32_t samples = 0;
+  uint32_t maxCycles = 0;           // Worst per-sample cost
+  RainEventRecord history[RAIN_HISTORY_SIZE] = {};
+  uint8_t historyCount = 0;
+} rainState;
+
+// Rain Forecast
+#define FORECAST_RTC_MAGIC 0x5241494EUL // "RAIN": RTC block holds a fetched forecast
+#define FORECAST_HOURS 48
+
+// Hourly forecast in compact form, kept in RTC memory so a reset does not
+// force a refetch (not power loss)
+struct RtcForecast {
+  uint32_t magic;
+  uint32_t fetchedAt;                   // Unix time of the fetch
+  uint32_t startTime;                   // Unix time of the first hour
+  uint8_t hours;                        // Valid entries
+  uint8_t rainProbability[FORECAST_HOURS];  // %
+  uint8_t rainTenths[FORECAST_HOURS];   // Precipitation, 0.1 mm (capped at 25.5 mm)
+  int8_t temperature[FORECAST_HOURS];   // Air temperature, whole degrees C
+};
+
+// What the network worker hands back to the fetch flow
+struct ForecastFetch {
+  int code;                             // HTTP status, or negative HTTPClient error
+  String error;
+  uint32_t parseMicros;
+  size_t docBytes;
+  RtcForecast forecast;
+};
+
+struct ForecastState {
+  unsigned long lastAttempt = 0;
+  bool lastFetchOk = false;
+  String lastError = "not fetched";
+  uint32_t fetches = 0;
+  uint32_t failures = 0;
+  uint32_t parseMicros = 0;
+  size_t docBytes = 0;
+  uint16_t expectedTenths = 0;          // Probability-weighted rain in the look-ahead window
+  int runPercent = 100;                 // Last decision: 100 = normal, 0 = skip
+  bool skipping = false;                // A rain skip is holding back irrigation right now
+  uint32_t skips = 0;
+  uint32_t shortened = 0;
+} forecastState;
+
+RTC_NOINIT_ATTR RtcForecast rtcForecast;
+
+// Configuration File State
+struct ConfigFileStatus {
+  const char* source = "defaults";  // "config.json", "last-known-good" or "defaults"
+  String lastError = "";
+  uint32_t fileHash = 0;            // FNV-1a of the file last looked at
+  uint32_t loads = 0;
+  uint32_t failures = 0;
+  uint32_t parseMicros = 0;
+  uint32_t maxParseMicros = 0;
+  size_t memoryUsage = 0;           // JSON pool bytes used by the last parse
+  size_t peakMemoryUsage = 0;
+  unsigned long lastCheck = 0;
+} configStatus;
+
+// CoAP Server (see coap.h; resources in COAP SERVER FUNCTIONS)
+enum CoapResource : uint8_t {
+  COAP_RESOURCE_SENSORS = 0,
+  COAP_RESOURCE_PUMP,
+  COAP_RESOURCE_ZONE,
+  COAP_RESOURCE_COUNT
+};
+
+const char* const coapResourcePaths[COAP_RESOURCE_COUNT] = {"/sensors", "/pump", "/zone"};
+const bool coapResourceObservable[COAP_RESOURCE_COUNT] = {true, true, false};
+const char coapLinks[] = "</sensors>;ct=60;obs,</pump>;ct=60;obs,</zone>;ct=60,</control>;ct=60";
+
+struct CoapStats {
+  uint32_t requests;
+  uint32_t notifications;
+  uint32_t rejected;              // Malformed, unknown critical option, or bigger than COAP_PACKET_SIZE
+  uint32_t duplicates;            // Retransmissions answered from the kept response
+  uint32_t observersDropped;      // Reset by the client, or a confirmable notification was never acknowledged
+  uint32_t retransmissions;       // Confirmable notifications sent again after an ACK timeout
+  uint32_t lastCycles;            // Last request, receive to send
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+  uint16_t lastRequestBytes;
+  uint16_t lastResponseBytes;
+};
+
+struct CoapServerState {
+  bool started = false;
+  uint8_t rx[COAP_PACKET_SIZE];       // Request; also holds notifications, built between requests
+  uint8_t tx[COAP_PACKET_SIZE];       // Last response, kept to answer a retransmission of its request
+  size_t txLength = 0;
+  uint32_t txAddress = 0;             // Exchange the kept response belongs to
+  uint16_t txPort = 0;
+  uint16_t txMessageId = 0;
+  uint16_t replyMessageId = 0;        // Of the response being built
+  uint16_t nextMessageId = 0;
+  size_t nextObserver = 0;            // Notifications go round-robin
+  coap::ObserverTable<COAP_MAX_OBSERVERS> observers;
+  CoapStats stats = {};
+} coapState;
+
+WiFiUDP coapSocket;
+
+// Cost of answering GET /api, for comparison with a CoAP poll
+struct ApiPollCost {
+  uint32_t requests;
+  uint32_t lastBytes;
+  uint32_t lastCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+} apiPollCost = {};
+
 // WiFi and Network Variables
 unsigned long wifiReconnectAttempts = 0;
 const int maxWifiReconnectAttempts = 10;
 bool otaEnabled = false;
 
+// Network Flows (coroutines resumed from the loop, blocking calls run on the worker task)
+struct HttpResult {
+  int code;
+  String body;
+};
+uint32_t coroSwitchCycles = 0;  // Measured once at boot
+
 // Adafruit IO Feed Objects
 #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
 AdafruitIO_Feed *temperatureFeed;
@@ -144,6 +667,12 @@ AdafruitIO_Feed *soilMoistureFeed;
 AdafruitIO_Feed *lightLevelFeed;
 AdafruitIO_Feed *pumpStatusFeed;
 AdafruitIO_Feed *irrigationCountFeed;
+#if TANK_ENABLED
+AdafruitIO_Feed *tankLevelFeed;
+#endif
+#if RAIN_DETECTION_ENABLED
+AdafruitIO_Feed *rainfallFeed;
+#endif
 #endif
 
 // Data Logging
@@ -154,6 +683,7 @@ struct DataLog {
   int soilMoisturePercent;
   bool pumpActive;
   int dailyIrrigations;
+  float tankLevel;          // -1 when no tank sensor is fitted
 } dataLog[LOG_BUFFER_SIZE];
 
 int logIndex = 0;
@@ -163,6 +693,365 @@ bool logBufferFull = false;
 unsigned long currentTime = 0;
 unsigned long lastHeartbeat = 0;
 
+// Pump Failsafe State
+enum PumpFailsafeReason : uint8_t {
+  FAILSAFE_NONE = 0,
+  FAILSAFE_TIMER,       // Hardware one-shot expired before the loop stopped the pump
+  FAILSAFE_HEARTBEAT    // Control loop stopped checking in while the pump was on
+};
+
+hw_timer_t* pumpFailsafeTimer = nullptr;          // One-shot armed on every pump start
+esp_timer_handle_t pumpHeartbeatTimer = nullptr;  // Periodic heartbeat supervisor
+volatile unsigned long pumpHeartbeatMs = 0;       // Last control loop check-in
+volatile bool pumpRelayEnergised = false;
+volatile unsigned long pumpCutAtMs = 0;           // When a failsafe, e-stop or current trip cut the relay (0 = none pending)
+volatile PumpFailsafeReason pumpFailsafeReason = FAILSAFE_NONE;
+int pumpFailsafeTrips = 0;
+
+// Pump Duty Protection (on-time over rolling windows, see accruePumpDuty())
+struct DutyWindow {
+  unsigned long bucketMs;                     // Window length / PUMP_DUTY_BUCKETS
+  unsigned long limitMs;                      // On-time allowed within the window
+  unsigned long buckets[PUMP_DUTY_BUCKETS];   // On-time accrued in each bucket
+  unsigned long onMs;                         // Running sum of all buckets
+  unsigned long bucketStart;                  // Start of the current bucket
+  uint8_t index;                              // Current bucket
+};
+
+DutyWindow pumpDutyShort = {PUMP_DUTY_SHORT_WINDOW / PUMP_DUTY_BUCKETS, PUMP_DUTY_SHORT_WINDOW / 100 * PUMP_DUTY_SHORT_MAX};
+DutyWindow pumpDutyLong = {PUMP_DUTY_LONG_WINDOW / PUMP_DUTY_BUCKETS, PUMP_DUTY_LONG_WINDOW / 100 * PUMP_DUTY_LONG_MAX};
+unsigned long pumpDutyAccruedAt = 0;   // On-time before this has been added to the windows
+unsigned long pumpLastStopTime = 0;
+bool pumpHasRun = false;
+uint32_t pumpRelayCycles = 0;          // Lifetime relay energisations
+uint32_t pumpCyclesSaved = 0;          // pumpRelayCycles as last written to NVS
+int pumpDutyTrips = 0;
+const char* pumpBlockReason = nullptr; // Why the last start request was refused
+Preferences pumpPrefs;
+
+// Relay cycles are saved to NVS every PUMP_CYCLES_SAVE_EVERY starts; this RTC
+// copy carries the unsaved ones across soft resets
+#define PUMP_CYCLES_RTC_MAGIC 0x43594345UL // "CYCE": RTC block holds the relay cycle count
+
+struct RtcPumpCycles {
+  uint32_t magic;
+  uint32_t cycles;
+};
+
+RTC_NOINIT_ATTR RtcPumpCycles rtcPumpCycles;
+
+// Water Tank State
+struct TankState {
+  float levelPercent = -1;        // Median-filtered level, -1 until the first good reading
+  float samples[TANK_MEDIAN_SAMPLES];
+  int sampleCount = 0;
+  int sampleIndex = 0;
+  int consecutiveFailures = 0;
+  bool sensorFault = false;
+  bool lockout = TANK_ENABLED;    // Irrigation is locked out until the level is known
+  unsigned long lastRead = 0;
+  float levelAtPumpStart = -1;
+  unsigned long drawRunMs = 0;    // Last pump run still waiting for its level drop
+  unsigned long drawStoppedAt = 0;
+  float percentPerSecond = 0;     // Average level drop per second of pumping
+} tankState;
+
+// Pump Current Sensing State
+enum PumpCurrentFault : uint8_t {
+  CURRENT_OK = 0,
+  CURRENT_DRY_RUN,      // Running with almost no load: no water reaching the pump
+  CURRENT_STALL,        // Overcurrent: jammed impeller or seized motor
+  CURRENT_WELDED,       // Current flowing with the relay released
+  CURRENT_FAULT_COUNT
+};
+
+const char* const pumpCurrentFaultNames[CURRENT_FAULT_COUNT] = {"ok", "dry-run", "stall", "relay-welded"};
+
+// Electrical fingerprint of one pump run
+struct CurrentSignature {
+  uint32_t startMs;
+  uint32_t durationMs;
+  float inrushAmps;     // Peak within PUMP_INRUSH_MS of the start
+  float meanAmps;       // Mean after the inrush
+  float minAmps;
+  float maxAmps;
+  uint8_t fault;        // PumpCurrentFault that ended the run, if any
+};
+
+#if PUMP_CURRENT_SENSING
+TaskHandle_t currentSenseTaskHandle = nullptr;
+SemaphoreHandle_t adcMutex = nullptr;            // Held by the sampler while the ADC runs in DMA mode
+adc_continuous_handle_t currentAdc = nullptr;
+adc_cali_handle_t currentAdcCali = nullptr;
+int soilAdcChannel = -1;                         // Analog soil probe sampled alongside the current, -1 if not
+int streamSoilRaw = 0;                           // Mean soil reading of the last DMA window (currentMux)
+unsigned long streamSoilAtMs = 0;                // When it was published, 0 = never
+#endif
+volatile float pumpCurrentAmps = 0;              // RMS of the last window
+volatile bool pumpCurrentSampling = false;
+volatile bool currentRunActive = false;          // A run is being recorded, keep sampling until it is filed
+volatile unsigned long currentCheckUntil = 0;    // Keep sampling with the relay off until then
+volatile PumpCurrentFault pumpCurrentFault = CURRENT_OK;
+int pumpCurrentTrips = 0;
+unsigned long lastWeldCheck = 0;
+CurrentSignature currentSignatures[CURRENT_SIGNATURE_COUNT];
+uint32_t currentSignatureTotal = 0;              // Signatures recorded since boot
+uint32_t currentSignaturePrinted = 0;
+portMUX_TYPE currentMux = portMUX_INITIALIZER_UNLOCKED;
+
+#if TANK_SENSOR_TYPE == TANK_ULTRASONIC
+volatile unsigned long tankEchoStart = 0;   // Echo rising edge (us), 0 when idle
+volatile unsigned long tankEchoWidth = 0;   // Width of the last complete echo (us)
+volatile bool tankEchoReady = false;
+#endif
+
+// Loop Stages (last stage entered is kept in RTC memory for the fault history)
+enum LoopStage : uint8_t {
+  STAGE_BOOT = 0,
+  STAGE_SAFETY,
+  STAGE_WEB_SERVER,
+  STAGE_OTA,
+  STAGE_SENSORS,
+  STAGE_DISPLAY,
+  STAGE_CONTROL_INPUT,
+  STAGE_IRRIGATION,
+  STAGE_WIFI,
+  STAGE_THINGSPEAK,
+  STAGE_ADAFRUIT_IO,
+  STAGE_STATUS,
+  STAGE_RECOVERY,
+  STAGE_HEARTBEAT,
+  STAGE_LOGGING,
+  STAGE_IDLE,
+  STAGE_FLOWS,
+  STAGE_EVENTS,
+  STAGE_CONFIG,
+  STAGE_FORECAST,
+  STAGE_CONSOLE,
+  STAGE_COAP,
+  STAGE_COUNT
+};
+
+const char* const loopStageNames[STAGE_COUNT] = {
+  "boot", "safety", "web", "ota", "sensors", "display", "control", "irrigation",
+  "wifi", "thingspeak", "adafruitio", "status", "recovery", "heartbeat", "logging", "idle",
+  "flows", "events", "config", "forecast", "console", "coap"
+};
+
+// Fault History
+#define FAULT_RTC_MAGIC 0x46415554UL    // "FAUT": RTC block holds a valid record
+#define FAULT_FLAG_OTA 0x01             // Restart requested by an OTA update
+#define FAULT_FLAG_SUPERVISOR 0x02      // Restart forced by the subsystem supervisor
+#define FAULT_FLAG_COREDUMP 0x04        // Crash summary taken from a new core dump
+#define FAULT_FLAG_RTC_VALID 0x80       // Uptime/stage/heap came from the previous run
+
+// Live state of the running firmware, kept in RTC memory so it survives
+// panics, watchdog and software resets (not power loss)
+struct RtcFaultState {
+  uint32_t magic;
+  uint32_t bootCount;
+  uint32_t uptimeMs;
+  uint32_t minFreeHeap;
+  uint8_t loopStage;
+  uint8_t pumpActive;
+  uint8_t flags;
+  uint8_t stalledSubsystem;   // Subsystem that forced a supervisor restart
+};
+
+// One boot as stored in the NVS ring
+struct FaultRecord {
+  uint32_t bootCount;
+  uint32_t uptimeMs;        // Uptime of the previous run when it reset
+  uint32_t minFreeHeap;     // Heap low-water mark of the previous run
+  uint8_t resetReason;      // esp_reset_reason_t
+  uint8_t loopStage;        // LoopStage the previous run was in
+  uint8_t pumpActive;
+  uint8_t flags;
+  uint8_t stalledSubsystem; // Valid when FAULT_FLAG_SUPERVISOR is set
+  uint8_t backtraceDepth;   // Crash fields below are valid when FAULT_FLAG_COREDUMP is set
+  char crashTask[16];       // Task that panicked
+  uint32_t crashPc;
+  uint32_t backtrace[COREDUMP_BACKTRACE_DEPTH];
+};
+
+RTC_NOINIT_ATTR RtcFaultState rtcFaultState;
+FaultRecord lastFault = {};
+Preferences faultPrefs;
+
+// Breadcrumbs
+#define BREADCRUMB_RTC_MAGIC 0x4352554DUL // "CRUM": RTC ring holds valid breadcrumbs
+static_assert((BREADCRUMB_COUNT & (BREADCRUMB_COUNT - 1)) == 0, "BREADCRUMB_COUNT must be a power of two");
+
+enum BreadcrumbEvent : uint8_t {
+  CRUMB_STAGE = 0,    // arg: LoopStage
+  CRUMB_HTTP_BEGIN,   // arg: HttpTarget
+  CRUMB_HTTP_END,     // arg: HttpTarget, detail: response code
+  CRUMB_PUMP_ON,      // detail: planned run (s)
+  CRUMB_PUMP_OFF,     // arg: PumpOffCause, detail: run time (s)
+  CRUMB_WIFI,         // arg: 1 connected / 0 lost, detail: RSSI
+  CRUMB_COUNT
+};
+
+enum HttpTarget : uint8_t {
+  HTTP_THINGSPEAK = 0,
+  HTTP_ADAFRUIT_IO,
+  HTTP_FORECAST,
+  HTTP_TARGET_COUNT
+};
+
+enum PumpOffCause : uint8_t {
+  PUMP_OFF_STOP = 0,
+  PUMP_OFF_FAILSAFE_TIMER,
+  PUMP_OFF_FAILSAFE_HEARTBEAT,
+  PUMP_OFF_ESTOP,
+  PUMP_OFF_RUNTIME,
+  PUMP_OFF_DUTY,
+  PUMP_OFF_TANK_LOW,
+  PUMP_OFF_CURRENT,
+  PUMP_OFF_CAUSE_COUNT
+};
+
+const char* const breadcrumbNames[CRUMB_COUNT] = {"stage", "http-begin", "http-end", "pump-on", "pump-off", "wifi"};
+const char* const httpTargetNames[HTTP_TARGET_COUNT] = {"thingspeak", "adafruitio", "forecast"};
+const char* const pumpOffCauseNames[PUMP_OFF_CAUSE_COUNT] = {"stop", "failsafe-timer", "failsafe-heartbeat", "e-stop", "max-runtime", "duty-limit", "tank-low", "current-fault"};
+
+// Event Bus Topics (see eventbus.h)
+// Published by the control path; display and indicator code subscribes
+// Why the pump was started (PumpStartedEvent.cause)
+enum PumpStartCause : uint8_t {
+  PUMP_START_MANUAL = 0,      // Web, menu, console or CoAP request
+  PUMP_START_THRESHOLD,       // controlIrrigation(): soil fell below the threshold
+  PUMP_START_COMMISSIONING,   // Step-test pulse; the only start allowed while commissioning runs
+};
+
+struct PumpStartedEvent {
+  static constexpr const char* name = "pumpStarted";
+  uint32_t atMs;
+  uint16_t plannedSeconds;
+  uint8_t cause;            // PumpStartCause
+};
+
+struct PumpStoppedEvent {
+  static constexpr const char* name = "pumpStopped";
+  uint32_t atMs;
+  uint32_t ranMs;
+  PumpOffCause cause;
+};
+
+struct SystemFaultEvent {
+  static constexpr const char* name = "systemFault";
+  int sensorErrors;
+};
+
+struct EmergencyStopEvent {
+  static constexpr const char* name = "emergencyStop";
+  int trips;
+};
+
+struct RainDetectedEvent {
+  static constexpr const char* name = "rainDetected";
+  uint32_t atMs;
+  uint16_t rainTenths;      // Estimated effective rainfall, 0.1 mm
+  uint16_t riseCenti;       // Moisture rise, 0.01 %
+  uint8_t doses;            // Irrigations the rain stood in for
+};
+
+struct Breadcrumb {
+  uint32_t ticks;     // esp_timer microseconds >> 10 (~1 ms)
+  uint8_t event;
+  uint8_t arg;
+  int16_t detail;
+};
+
+struct RtcBreadcrumbs {
+  uint32_t magic;
+  uint32_t head;      // Total crumbs written; ring index is head & (BREADCRUMB_COUNT - 1)
+  Breadcrumb ring[BREADCRUMB_COUNT];
+};
+
+RTC_NOINIT_ATTR RtcBreadcrumbs rtcBreadcrumbs;
+
+// Appends one event to the RTC ring: a timer read and an 8-byte store, so
+// it is safe on hot paths. Loop task only - the ring is not locked.
+static inline void breadcrumb(BreadcrumbEvent event, uint8_t arg = 0, int16_t detail = 0) {
+  #if BREADCRUMBS_ENABLED
+    uint32_t head = rtcBreadcrumbs.head;
+    rtcBreadcrumbs.ring[head & (BREADCRUMB_COUNT - 1)] = {(uint32_t)(esp_timer_get_time() >> 10), event, arg, detail};
+    rtcBreadcrumbs.head = head + 1;
+  #endif
+}
+
+// Subsystem Supervisor
+enum Subsystem : uint8_t {
+  SUBSYS_CONTROL = 0,   // Main loop
+  SUBSYS_SENSORS,
+  SUBSYS_DISPLAY,
+  SUBSYS_NETWORK,
+  SUBSYS_CLOUD,
+  SUBSYS_COUNT
+};
+
+// Static supervision policy for one subsystem (lives in flash)
+struct SubsystemPolicy {
+  const char* name;
+  unsigned long deadlineMs;     // 0 = not supervised in this configuration
+  void (*restart)();            // Runs in the loop; nullptr = cannot be restarted
+  uint8_t rebootAfter;          // Failed restarts before rebooting; 0 = never reboot for this subsystem
+};
+
+// Runtime liveness and statistics for one subsystem
+struct SubsystemHealth {
+  volatile unsigned long lastCheckIn;
+  volatile bool restartRequested;
+  bool stalled;
+  unsigned long stallSince;     // Last check-in before the stall was detected
+  unsigned long nextRestartAt;  // Backoff between restarts
+  uint8_t consecutiveRestarts;
+  uint16_t stalls;
+  uint16_t restarts;
+  unsigned long longestStallMs;
+};
+
+SubsystemHealth subsystemHealth[SUBSYS_COUNT] = {};
+TaskHandle_t supervisorTaskHandle = nullptr;
+
+// Emergency Stop State Machine
+enum EmergencyStopState : uint8_t {
+  ESTOP_IDLE = 0,     // Normal operation
+  ESTOP_PENDING,      // ISR cut the relay, waiting for the input to debounce
+  ESTOP_LATCHED       // Fault latched until an explicit reset
+};
+
+volatile EmergencyStopState estopState = ESTOP_IDLE;
+volatile unsigned long estopTripMicros = 0;     // ISR entry time of the last trip
+bool estopLevelActive = false;                  // Debounce: input level last seen while pending
+unsigned long estopLevelSince = 0;              // Debounce: when that level was first seen (us)
+volatile uint32_t estopIsrToRelayOffCycles = 0; // ISR entry to relay cleared (CPU cycles); excludes
+                                                // the input edge to ISR dispatch, which needs a scope
+volatile bool estopRemoteTrip = false;          // Tripped from the web API (no input to debounce)
+unsigned long estopLatchLatencyUs = 0;          // Trip to latched fault handled by the loop
+portMUX_TYPE relayMux = portMUX_INITIALIZER_UNLOCKED;  // E-stop check and relay switch-on are one step
+unsigned long estopHoldStart = 0;               // Reset gesture: start of the hold
+bool estopReleasedSinceLatch = false;           // Reset gesture: input seen released
+bool estopScreenDrawn = false;
+int estopTrips = 0;
+int estopGlitches = 0;
+int estopGlitchResumes = 0;                     // Glitches after which the interrupted run was resumed
+
+// Rotary Encoder ISR State
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+volatile int encoderPendingSteps = 0;            // Detents not yet consumed by the menu
+volatile unsigned long encoderStepIntervalMs = ENCODER_ACCEL_SLOW_MS;  // Time between last two detents
+volatile unsigned long encoderLastEdgeMicros = 0;
+volatile unsigned long encoderLastStepMicros = 0;
+portMUX_TYPE encoderMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// Menu Renderer Frame (last text written to each LCD row)
+#if DISPLAY_ENABLED && CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+char menuFrame[LCD_ROWS][LCD_COLS + 1];
+#endif
+
 // =============================================================================
 // FUNCTION DECLARATIONS
 // =============================================================================
@@ -178,13 +1067,16 @@ void initializeAdafruitIO();
 #endif
 void initializeOTA();
 void initializeWebServer();
+void handleNotFound();
 void initializeWatchdog();
+void initializePumpFailsafe();
+void supervisorTask(void* arg);
 
 // Sensor and Control Functions
 void readSensors();
 void controlIrrigation();
-void startIrrigation();
-void stopIrrigation();
+bool startIrrigation(int runPercent = 100, int fixedSeconds = 0, PumpStartCause cause = PUMP_START_MANUAL);
+void stopIrrigation(PumpOffCause cause = PUMP_OFF_STOP);
 
 // Display Functions
 void updateDisplay();
@@ -200,26 +1092,203 @@ void initializeControl();
 void handleHardwareControl();
 void handleRotaryEncoder();
 void handlePotentiometer();
-void displayMenu();
-void displayParameterAdjustment();
-void adjustParameter(int direction);
+void IRAM_ATTR encoderISR();
 void saveSettings();
 void loadSettings();
 
+// Menu Engine Functions
+void enterMenu();
+void exitMenu();
+void menuRotate(int steps, unsigned long intervalMs);
+void menuSelect();
+void renderMenu();
+void invalidateMenuFrame();
+void menuWriteRow(int row, const char* text);
+int menuAcceleration(unsigned long intervalMs);
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+void menuFormatValue(const MenuItem& item, char* buffer, size_t size);
+#endif
+void menuInfoSoil(char* buffer, size_t size);
+void menuInfoWiFi(char* buffer, size_t size);
+void menuInfoIP(char* buffer, size_t size);
+void menuInfoUptime(char* buffer, size_t size);
+void menuActionWaterNow();
+void menuActionResetEmergencyStop();
+
 // Network Functions
 void checkWiFiConnection();
 void transmitDataToCloud();
 #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
 void transmitDataToAdafruitIO();
 #endif
+void initializeNetworkFlows();
+coro::Task wifiReconnectFlow();
+void loadSoftApPassword();
+bool switchToSoftAp();
+bool switchToStation();
+void softApOpened(bool ok);
+void startSoftAp();
+coro::Task softApStartFlow();
+coro::Task softApStopFlow(bool expired);
+void updateSoftAp();
+IPAddress networkAddress();
+coro::Task softApProbeFlow();
+coro::Task thingSpeakUploadFlow();
+#if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
+coro::Task adafruitIOConnectFlow();
+coro::Task adafruitIOUploadFlow();
+#endif
+void handleCoroutines();
+void initializeEventBus();
+bool displayOwnedByMenu();
+void onPumpStartedDisplay(const PumpStartedEvent& event);
+void onPumpStoppedDisplay(const PumpStoppedEvent& event);
+void onSystemFaultPump(const SystemFaultEvent& event);
+void onSystemFaultDisplay(const SystemFaultEvent& event);
+void onEmergencyStopLeds(const EmergencyStopEvent& event);
+void onEmergencyStopDisplay(const EmergencyStopEvent& event);
+void onRainIrrigation(const RainDetectedEvent& event);
+void onRainLog(const RainDetectedEvent& event);
+void handleEvents();
+void initializeConfigFile();
+void buildConfigFilter(JsonDocument& filter);
+bool configInt(JsonVariant section, const char* key, long low, long high, long& target, String& error);
+bool configText(JsonVariant section, const char* key, size_t minLength, char* target, size_t size, String& error);
+bool applyConfigDocument(JsonDocument& doc, RuntimeSettings& settings, String& error);
+bool finishConfigParse(JsonDocument& doc, DeserializationError result, uint32_t startMicros,
+                       RuntimeSettings& settings, String& error);
+bool parseConfig(Stream& input, RuntimeSettings& settings, String& error);
+bool parseConfigText(const String& text, RuntimeSettings& settings, String& error);
+uint32_t configFileHash(const char* path);
+bool loadConfigFile();
+void rememberGoodConfig();
+bool saveConfigFile(const RuntimeSettings& settings);
+void applyRuntimeSettings(const RuntimeSettings& next);
+void checkConfigFile();
+void handleConfigGet();
+void handleConfigPost();
+int32_t daysFromCivil(int year, int month, int day);
+int32_t localDayNumber(time_t now);
+int32_t parsePlantingDate(const char* text);
+const CropProfile* findCropProfile(const char* name);
+void selectCropProfile();
+void updateCropStage();
+int activeSoilThreshold();
+int plannedIrrigationSeconds(int runPercent = 100);
+bool forecastValid();
+void requestForecast();
+coro::Task forecastFetchFlow();
+ForecastFetch fetchForecast(const String& url);
+int forecastRunPercent();
+void handleForecast();
 void handleWebRequests();
 void emergencyStop();
-void feedWatchdog();
+void initializeEmergencyStop();
+void IRAM_ATTR emergencyStopISR();
+void updateEmergencyStop();
+bool resumePumpAfterGlitch();
+bool resetEmergencyStop(const char* source);
+bool requireWebAuth();
+
+// Fault History Functions
+void clearRtcCachesAfterPowerOn();
+void recordBootFault();
+void setLoopStage(LoopStage stage);
+void markPlannedRestart(uint8_t flag);
+const char* resetReasonName(uint8_t reason);
+bool isUnplannedReset(const FaultRecord& record);
+void formatBreadcrumb(const Breadcrumb& crumb, char* out, size_t size);
+void recordBootBreadcrumbs();
+void handleFaults();
+const esp_partition_t* findCoreDumpPartition();
+bool summarizeCoreDump(FaultRecord& record);
+void handleCoreDump();
+void handleCoreDumpErase();
+void supervisorCheckIn(Subsystem subsystem);
+void checkSubsystemDeadlines();
+void serviceSubsystemRestarts();
+void restartSensors();
+void restartDisplay();
+void restartNetwork();
+void restartCloud();
+bool credentialSet(const char* key);
+bool cloudConfigured();
+void feedPumpFailsafe();
+void armPumpFailsafe(unsigned long runtimeMs);
+void disarmPumpFailsafe();
+void checkPumpFailsafe();
+void IRAM_ATTR pumpFailsafeTimerISR();
+void pumpHeartbeatCheck(void* arg);
+void pumpShutdownHandler();
+void pumpPanicHandler(arduino_panic_info_t* info, void* arg);
 void validateSensorReadings();
+void p2Init(P2Quantile& e, float p);
+void p2Add(P2Quantile& e, float x);
+float p2Value(const P2Quantile& e);
+void initializeSoilCalibration();
+void onPumpStartedSoilCal(const PumpStartedEvent& event);
+void onRainSoilCal(const RainDetectedEvent& event);
+void startSoilDryDown();
+void saveSoilCalibration();
+void onPumpStoppedSoilCal(const PumpStoppedEvent& event);
+void recordDryFloor();
+void updateSoilCalibration(int raw);
+void adjustSoilCalibration();
+bool initializeFrequencyProbe();
+void startFrequencyWindow();
+bool collectFrequencyWindow();
+bool readFrequencyProbe(int& raw);
+void initializeSoilTempComp();
+bool readSoilTemperature(float airTemperature, int16_t& temperatureQ4);
+int compensateSoilRaw(int raw, float airTemperature);
+bool soilTcNight();
+void learnSoilTempComp(int raw, int16_t temperatureQ4);
+void finishSoilTcNight();
+void initializeRainDetection();
+void onPumpStartedRain(const PumpStartedEvent& event);
+void onPumpStoppedRain(const PumpStoppedEvent& event);
+void updateRainDetector(int raw);
+void finishRainEvent(unsigned long now);
+void checkDayRollover();
+void handleRain();
+void initializeCommissioning();
+const char* startCommissioning();
+void finishCommissioning(const char* phase, const char* error);
+coro::Task commissioningFlow();
+bool sampleCommissioningSoil(int16_t& level);
+float zoneDoseSeconds();
+unsigned long zoneSettleMs();
+void handleCommissionGet();
+void handleCommissionPost();
 bool isSensorReadingValid(float value, float minVal, float maxVal, bool enabled);
 bool checkSensorConsistency(int readings[], int newReading);
 void attemptSystemRecovery();
 void checkPumpRuntime();
+void initializePumpProtection();
+void savePumpCycles();
+void advanceDutyWindow(DutyWindow& window, unsigned long now);
+void accruePumpDuty(unsigned long now);
+const char* pumpStartBlocked(unsigned long plannedMs);
+void checkPumpDuty();
+
+// Water Tank Functions
+void initializeTank();
+void updateTankLevel();
+void IRAM_ATTR tankEchoISR();
+bool readTankSample(float& levelPercent);
+float tankMedianLevel();
+int predictedWaterings();
+
+// Pump Current Functions
+void initializePumpCurrent();
+void currentSenseTask(void* arg);
+void evaluateCurrentWindow(float amps);
+void tripPumpCurrent(PumpCurrentFault fault);
+void checkPumpCurrent();
+bool acquireAnalogInputs();
+void releaseAnalogInputs();
+bool readStreamedSoil(int& raw);
+void handleCurrent();
 void handleRoot();
 void handleAPI();
 void handleControl();
@@ -234,33 +1303,171 @@ void performHeartbeat();
 
 // Data Management
 void logSystemData();
+void publishSensorSnapshot();
 void clearDataLog();
 String getSystemStatusJSON();
 
+// CoAP Server Functions
+void initializeCoap();
+void updateCoap();
+void handleCoapPacket(int size);
+void handleCoapRequest(const coap::Request& request, coap::Builder& out, uint32_t address, uint16_t port);
+void handleCoapControl(const coap::Request& request, coap::Builder& out);
+bool coapAuthorized(cbor::Reader& body);
+void coapHeader(coap::Builder& out, const coap::Request& request, uint8_t responseCode);
+void coapError(coap::Builder& out, const coap::Request& request, uint8_t responseCode, const char* message);
+size_t encodeCoapResource(uint8_t resource, uint8_t* buffer, size_t size);
+uint32_t coapResourceVersion(uint8_t resource);
+void notifyCoapObservers();
+void sendCoap(uint32_t address, uint16_t port, const uint8_t* data, size_t length);
+
+// Serial Console Functions
+void updateConsole();
+void consoleStatus(int argc, char** argv);
+void consoleTailCommand(int argc, char** argv);
+void consoleLog(int argc, char** argv);
+void continueConsoleDump();
+void consoleFaults(int argc, char** argv);
+void consoleGet(int argc, char** argv);
+void consoleSet(int argc, char** argv);
+void consoleWater(int argc, char** argv);
+void consoleStop(int argc, char** argv);
+void consoleEmergencyStop(int argc, char** argv);
+void consoleReset(int argc, char** argv);
+void consoleCommission(int argc, char** argv);
+void consoleSelfTest(int argc, char** argv);
+
+// =============================================================================
+// MENU DEFINITIONS
+// =============================================================================
+
+/*
+ * The encoder menu is a constant tree stored in flash. Adding an item means
+ * adding one row to the relevant page below; navigation, editing and
+ * rendering are handled generically by the menu engine.
+ */
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+constexpr MenuItem irrigationMenuItems[] = {
+  menuInt("Duration", &systemState.irrigationSeconds, MIN_IRRIGATION_SECONDS, MAX_IRRIGATION_SECONDS, 1, "s"),
+  menuAction("Water Now", menuActionWaterNow),
+  menuBack()
+};
+constexpr MenuPage irrigationMenu = {"Irrigation", irrigationMenuItems, sizeof(irrigationMenuItems) / sizeof(MenuItem)};
+
+constexpr MenuItem statusMenuItems[] = {
+  menuInfo("Soil", menuInfoSoil),
+  menuInfo("WiFi", menuInfoWiFi),
+  menuInfo("IP", menuInfoIP),
+  menuInfo("Uptime", menuInfoUptime),
+  menuBack()
+};
+constexpr MenuPage statusMenu = {"Status", statusMenuItems, sizeof(statusMenuItems) / sizeof(MenuItem)};
+
+constexpr MenuItem rootMenuItems[] = {
+  menuInt("Threshold", &systemState.adjustedThreshold, ENCODER_MIN_THRESHOLD, ENCODER_MAX_THRESHOLD, ENCODER_STEP_SIZE, "%"),
+  menuSubmenu("Irrigation", &irrigationMenu),
+  menuSubmenu("Status", &statusMenu),
+  menuAction("Reset E-Stop", menuActionResetEmergencyStop),
+  menuExit()
+};
+constexpr MenuPage rootMenu = {"Menu", rootMenuItems, sizeof(rootMenuItems) / sizeof(MenuItem)};
+#endif
+
+// =============================================================================
+// CONSOLE COMMANDS
+// =============================================================================
+
+/*
+ * Serial console commands, kept in flash like the menu. Adding a command
+ * means adding its handler and one row here; "help" lists the rows.
+ */
+constexpr const char* consoleSettingKeys[] = {
+  "irrigation.soilThreshold", "irrigation.durationSeconds", "irrigation.cooldownSeconds", "irrigation.maxDaily",
+  "sensors.readIntervalMs", "cloud.transmitIntervalMs", "cloud.thingSpeakApiKey",
+  "wifi.ssid", "wifi.password", "crop.profile", "crop.plantingDate", nullptr
+};
+constexpr const char* consoleTailOptions[] = {"off", nullptr};
+constexpr const char* consoleCommissionOptions[] = {"start", "abort", "status", nullptr};
+
+constexpr console::Command consoleCommands[] = {
+  {"status", "", "Readings, pump and system state", consoleStatus, nullptr},
+  {"tail", "[seconds|off]", "Print a reading line every few seconds (Ctrl-C stops)", consoleTailCommand, consoleTailOptions},
+  {"log", "", "Events of this run (loop stages, HTTP, pump, WiFi)", consoleLog, nullptr},
+  {"faults", "", "Reset history", consoleFaults, nullptr},
+  {"get", "", "Settings in effect", consoleGet, nullptr},
+  {"set", "<key> <value>", "Change a setting (saved like POST /api/config)", consoleSet, consoleSettingKeys},
+  {"water", "[seconds]", "Start irrigation", consoleWater, nullptr},
+  {"stop", "", "Stop irrigation", consoleStop, nullptr},
+  {"estop", "", "Trip the emergency stop", consoleEmergencyStop, nullptr},
+  {"reset", "", "Reset the emergency stop", consoleReset, nullptr},
+  {"commission", "[start|abort|status]", "Zone commissioning", consoleCommission, consoleCommissionOptions},
+  {"selftest", "", "Check sensors, pump interlocks, network and memory", consoleSelfTest, nullptr}
+};
+constexpr size_t CONSOLE_COMMAND_COUNT = sizeof(consoleCommands) / sizeof(consoleCommands[0]);
+
+// =============================================================================
+// SUBSYSTEM SUPERVISION TABLE
+// =============================================================================
+
+/*
+ * Each subsystem checks in via supervisorCheckIn() whenever it completes its
+ * periodic work. A missed deadline first restarts that subsystem (with
+ * backoff); only subsystems with rebootAfter > 0 may escalate to a reboot.
+ * The control loop cannot be restarted in place, so it reboots on the first
+ * missed deadline. Indexed by the Subsystem enum.
+ */
+constexpr SubsystemPolicy subsystemPolicies[SUBSYS_COUNT] = {
+  {"control", CONTROL_LIVENESS_DEADLINE, nullptr, 1},
+  {"sensors", SENSOR_LIVENESS_DEADLINE, restartSensors, 0},
+  {"display", DISPLAY_ENABLED ? DISPLAY_LIVENESS_DEADLINE : 0, restartDisplay, 0},
+  {"network", NETWORK_LIVENESS_DEADLINE, restartNetwork, 0},
+  {"cloud", IOT_SERVICES_ENABLED ? CLOUD_LIVENESS_DEADLINE : 0, restartCloud, 0}
+};
+
 // =============================================================================
 // SETUP FUNCTION
 // =============================================================================
 
 void setup() {
+  // Relay off before anything else (sensor and LCD start-up take several seconds)
+  pinMode(RELAY_PIN, OUTPUT);
+  digitalWrite(RELAY_PIN, LOW);
+  
   // Initialize Serial Communication
   #if SERIAL_OUTPUT_ENABLED
+    #if CONSOLE_ENABLED
+      Serial.setTxBufferSize(CONSOLE_TX_BUFFER);  // Console replies queue instead of stalling the loop
+    #endif
     Serial.begin(SERIAL_BAUD_RATE);
+    #if SYSLOG_ENABLED
+      syslog::Config syslogConfig = {
+        SYSLOG_HOST, SYSLOG_PORT, SYSLOG_FACILITY, OTA_HOSTNAME, "smartfarm",
+        {SYSLOG_ERROR_RATE, SYSLOG_ERROR_RATE, SYSLOG_ERROR_RATE, SYSLOG_ERROR_RATE,
+         SYSLOG_WARNING_RATE, SYSLOG_WARNING_RATE, SYSLOG_INFO_RATE, SYSLOG_INFO_RATE},
+        SYSLOG_BURST, SYSLOG_AP_BROADCAST, SYSLOG_TASK_STACK, SYSLOG_TASK_PRIORITY, SYSLOG_TASK_CORE
+      };
+      remoteLog.begin(syslogConfig);
+    #endif
     delay(1000);
     
-    Serial.println("========================================");
-    Serial.println("ESP32 Smart Farming System - Online");
-    Serial.println("Version: " + String(FIRMWARE_VERSION));
-    Serial.println("Build Date: " + String(BUILD_DATE) + " " + String(BUILD_TIME));
-    Serial.println("========================================");
+    Log.println("========================================");
+    Log.println("ESP32 Smart Farming System - Online");
+    Log.println("Version: " + String(FIRMWARE_VERSION));
+    Log.println("Build Date: " + String(BUILD_DATE) + " " + String(BUILD_TIME));
+    Log.println("========================================");
   #endif
   
   // Initialize System Components
   initializeSystem();
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("System initialization complete!");
-    Serial.println("Starting main loop...");
-    Serial.println("========================================");
+    Log.println("System initialization complete!");
+    Log.println("Starting main loop...");
+    Log.println("========================================");
+  #endif
+  
+  #if CONSOLE_ENABLED
+    serialConsole.begin(Serial, consoleCommands, CONSOLE_COMMAND_COUNT, "farm> ", CONSOLE_ECHO);
   #endif
 }
 
@@ -270,14 +1477,34 @@ void setup() {
 
 void loop() {
   currentTime = millis();
-  
-  // Feed watchdog timer
-  feedWatchdog();
-  
-  // Check for emergency stop
-  if (EMERGENCY_STOP_ENABLED && systemState.emergencyStop) {
-    emergencyStop();
-    return;
+  rtcFaultState.uptimeMs = currentTime;
+  setLoopStage(STAGE_SAFETY);
+  
+  // Check in with the supervisor and run any subsystem restarts it requested
+  supervisorCheckIn(SUBSYS_CONTROL);
+  serviceSubsystemRestarts();
+  
+  // Check in with the pump failsafe and pick up any trip it performed
+  feedPumpFailsafe();
+  checkPumpFailsafe();
+  
+  // Emergency stop state machine (the ISR has already cut the relay)
+  if (EMERGENCY_STOP_ENABLED) {
+    updateEmergencyStop();
+    if (systemState.emergencyStop) {
+      // Only the reset paths stay live while the fault is latched
+      server.handleClient();
+      updateSoftAp();
+      updateConsole();
+      updateCoap();
+      if (CONTROL_ENABLED) {
+        handleHardwareControl();
+      }
+      emergencyStop();
+      bus::dispatchDeferred();
+      delay(100);
+      return;
+    }
   }
   
   // Check pump runtime protection
@@ -285,50 +1512,98 @@ void loop() {
     checkPumpRuntime();
   }
   
+  // Roll the duty-cycle windows and cut the pump if a limit is reached
+  checkPumpDuty();
+  
+  // Pick up any trip from the current sampler and schedule idle relay checks
+  checkPumpCurrent();
+  
   // Handle web server requests
+  setLoopStage(STAGE_WEB_SERVER);
   server.handleClient();
+  updateSoftAp();
+  
+  // Serial console: bounded work per pass, commands run here on the loop task
+  setLoopStage(STAGE_CONSOLE);
+  updateConsole();
+  
+  // CoAP: one datagram and at most one observe notification per pass
+  setLoopStage(STAGE_COAP);
+  updateCoap();
   
   // Handle OTA updates
   if (otaEnabled) {
+    setLoopStage(STAGE_OTA);
     ArduinoOTA.handle();
   }
   
   // Read sensors at regular intervals
-  if (currentTime - systemState.lastSensorRead >= SENSOR_READ_INTERVAL) {
+  if (currentTime - systemState.lastSensorRead >= runtimeSettings.sensorReadIntervalMs) {
+    setLoopStage(STAGE_SENSORS);
     readSensors();
+    checkDayRollover();
     systemState.lastSensorRead = currentTime;
   }
   
+  // Read the water tank level (also enforces the dry-run lockout)
+  #if TANK_ENABLED
+  if (currentTime - tankState.lastRead >= TANK_READ_INTERVAL) {
+    setLoopStage(STAGE_SENSORS);
+    updateTankLevel();
+    tankState.lastRead = currentTime;
+  }
+  #endif
+  
   // Update display at regular intervals
   if (currentTime - systemState.lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL) {
+    setLoopStage(STAGE_DISPLAY);
     updateDisplay();
+    supervisorCheckIn(SUBSYS_DISPLAY);
     systemState.lastDisplayUpdate = currentTime;
   }
   
   // Handle control input
   if (CONTROL_ENABLED) {
+    setLoopStage(STAGE_CONTROL_INPUT);
     handleHardwareControl();
   }
   
   // Control irrigation based on sensor readings
+  setLoopStage(STAGE_IRRIGATION);
+  if (currentTime - cropState.lastUpdate >= CROP_STAGE_UPDATE_INTERVAL) {
+    updateCropStage();
+  }
   controlIrrigation();
   
   // Update LED status indicators
   updateLEDs();
   
+  // Publish this pass's readings and pump state for other readers
+  publishSensorSnapshot();
+  
+  // Let slow subscribers (LCD) react to what the control path published
+  setLoopStage(STAGE_EVENTS);
+  bus::dispatchDeferred();
+  
+  // Resume network flows whose timer, WiFi event or worker call has completed
+  setLoopStage(STAGE_FLOWS);
+  coro::scheduler.poll();
+  
   // Check WiFi connection
   if (currentTime - systemState.lastWiFiCheck >= WIFI_RECONNECT_INTERVAL) {
+    setLoopStage(STAGE_WIFI);
     checkWiFiConnection();
     systemState.lastWiFiCheck = currentTime;
   }
   
   // Transmit data to cloud services
   if (systemState.wifiConnected && 
-      currentTime - systemState.lastDataTransmission >= DATA_TRANSMISSION_INTERVAL) {
+      currentTime - systemState.lastDataTransmission >= runtimeSettings.transmitIntervalMs) {
     
     // Transmit to ThingSpeak
     #if IOT_SERVICES_ENABLED
     if (THINGSPEAK_ENABLED) {
+      setLoopStage(STAGE_THINGSPEAK);
       transmitDataToCloud();
     }
     #endif
@@ -336,6 +1611,7 @@ void loop() {
     // Transmit to Adafruit IO
     #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
     if (ADAFRUIT_IO_ENABLED) {
+      setLoopStage(STAGE_ADAFRUIT_IO);
       transmitDataToAdafruitIO();
     }
     #endif
@@ -345,25 +1621,49 @@ void loop() {
   
   // Check system status and handle errors
   if (currentTime - systemState.lastErrorCheck >= STATUS_CHECK_INTERVAL) {
+    setLoopStage(STAGE_STATUS);
     checkSystemStatus();
     systemState.lastErrorCheck = currentTime;
   }
   
   // Attempt system recovery if needed
   if (AUTO_RECOVERY_ENABLED && !systemState.systemOK && systemState.recoveryAttempts < RECOVERY_ATTEMPTS) {
+    setLoopStage(STAGE_RECOVERY);
     attemptSystemRecovery();
   }
   
   // Perform system heartbeat
   if (currentTime - lastHeartbeat >= HEARTBEAT_INTERVAL) {
+    setLoopStage(STAGE_HEARTBEAT);
     performHeartbeat();
     lastHeartbeat = currentTime;
   }
   
+  // Refresh the rain forecast (retry sooner after a failed fetch)
+  #if FORECAST_ENABLED
+  if (systemState.wifiConnected && (forecastState.lastAttempt == 0 ||
+      currentTime - forecastState.lastAttempt >= (forecastState.lastFetchOk ? FORECAST_REFRESH_INTERVAL : FORECAST_RETRY_INTERVAL))) {
+    setLoopStage(STAGE_FORECAST);
+    requestForecast();
+    forecastState.lastAttempt = currentTime;
+  }
+  #endif
+  
+  // Pick up edits to config.json
+  #if CONFIG_FILE_ENABLED
+  if (currentTime - configStatus.lastCheck >= CONFIG_CHECK_INTERVAL) {
+    setLoopStage(STAGE_CONFIG);
+    checkConfigFile();
+    configStatus.lastCheck = currentTime;
+  }
+  #endif
+  
   // Log system data
+  setLoopStage(STAGE_LOGGING);
   logSystemData();
   
   // Small delay to prevent overwhelming the system
+  setLoopStage(STAGE_IDLE);
   delay(100);
 }
 
@@ -373,24 +1673,62 @@ void loop() {
 
 void initializeSystem() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing system components...");
+    Log.println("Initializing system components...");
   #endif
   
+  // Record why we restarted before anything can overwrite the RTC record
+  clearRtcCachesAfterPowerOn();
+  recordBootFault();
+  
+  // Wire subscribers before any subsystem can publish
+  initializeEventBus();
+  
+  // Load config.json before anything reads the runtime settings
+  initializeConfigFile();
+  
   // Initialize sensors
   initializeSensors();
   
+  // Restore the learned soil probe endpoints
+  initializeSoilCalibration();
+  initializeSoilTempComp();
+  initializeRainDetection();
+  initializeCommissioning();
+  
   // Initialize display
   initializeDisplay();
   
   // Initialize actuators
   initializeActuators();
   
+  // Initialize pump failsafe
+  initializePumpFailsafe();
+  
+  // Initialize pump duty-cycle protection
+  initializePumpProtection();
+  
+  // Initialize water tank level sensing
+  initializeTank();
+  
+  // Initialize pump current sensing
+  initializePumpCurrent();
+  
+  // Initialize emergency stop input
+  initializeEmergencyStop();
+  
   // Initialize control system
   initializeControl();
   
   // Initialize WiFi
   initializeWiFi();
   
+  // Start the network worker before anything spawns a network flow
+  initializeNetworkFlows();
+  
+  // Wall clock for the crop calendar (syncs in the background once WiFi is up)
+  configTime(TIMEZONE_OFFSET, DAYLIGHT_OFFSET, NTP_SERVER);
+  selectCropProfile();
+  
   // Initialize Adafruit IO
   #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
   initializeAdafruitIO();
@@ -402,6 +1740,9 @@ void initializeSystem() {
   // Initialize web server
   initializeWebServer();
   
+  // CoAP server (same resources for machines, over UDP)
+  initializeCoap();
+  
   // Initialize Watchdog Timer
   initializeWatchdog();
   
@@ -416,14 +1757,27 @@ void initializeSystem() {
   // Clear data log
   clearDataLog();
   
+  // Every subsystem has subscribed by now; a refused subscriber would silently
+  // miss its events (pump interlocks included), so irrigation stays off
+  if (bus::rejected > 0) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("FATAL: event bus refused " + String(bus::rejected) + " subscription(s), first " +
+                     String(bus::firstRejected) + " - raise bus::MAX_SUBSCRIBERS. Irrigation disabled.");
+    #endif
+    systemState.systemOK = false;
+  }
+  
+  // Give readers a snapshot before the first loop pass
+  publishSensorSnapshot();
+  
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("System components initialized successfully!");
+    Log.println("System components initialized successfully!");
   #endif
 }
 
 void initializeSensors() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing sensors...");
+    Log.println("Initializing sensors...");
   #endif
   
   // Initialize DHT sensor (if enabled)
@@ -437,35 +1791,41 @@ void initializeSensors() {
     
     if (isnan(testTemp) || isnan(testHumidity)) {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("Warning: DHT sensor initialization failed!");
+        Log.println("Warning: DHT sensor initialization failed!");
       #endif
       systemState.systemOK = false;
     } else {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("DHT sensor initialized successfully");
+        Log.println("DHT sensor initialized successfully");
       #endif
     }
   #else
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("DHT sensor disabled - using default values");
+      Log.println("DHT sensor disabled - using default values");
     #endif
   #endif
   
-  // Initialize soil moisture sensor (analog)
-  pinMode(SOIL_MOISTURE_PIN, INPUT);
+  // Initialize soil moisture sensor (analog, or frequency via PCNT)
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+    if (!initializeFrequencyProbe()) {
+      systemState.systemOK = false;
+    }
+  #else
+    pinMode(SOIL_MOISTURE_PIN, INPUT);
+  #endif
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Soil moisture sensor initialized");
+    Log.println("Soil moisture sensor initialized");
   #endif
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Sensor initialization complete!");
+    Log.println("Sensor initialization complete!");
   #endif
 }
 
 void initializeDisplay() {
   #if DISPLAY_ENABLED
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Initializing LCD display...");
+      Log.println("Initializing LCD display...");
     #endif
     
     // Initialize LCD
@@ -492,18 +1852,18 @@ void initializeDisplay() {
     lcd.clear();
     
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("LCD display initialized successfully!");
+      Log.println("LCD display initialized successfully!");
     #endif
   #else
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("No display configured - using serial output only");
+      Log.println("No display configured - using serial output only");
     #endif
   #endif
 }
 
 void initializeActuators() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing actuators...");
+    Log.println("Initializing actuators...");
   #endif
   
   // Initialize relay pin
@@ -521,43 +1881,54 @@ void initializeActuators() {
   digitalWrite(LED_BLUE_PIN, LOW);
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Actuators initialized successfully!");
+    Log.println("Actuators initialized successfully!");
   #endif
 }
 
 void initializeWiFi() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing WiFi connection...");
+    Log.println("Initializing WiFi connection...");
   #endif
   
+  if (SOFTAP_FALLBACK_ENABLED) {
+    loadSoftApPassword();
+  }
+  
   // Set WiFi mode
   WiFi.mode(WIFI_STA);
   
   // Begin WiFi connection
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  WiFi.begin(runtimeSettings.wifiSsid, runtimeSettings.wifiPassword);
   
   // Wait for connection
   int attempts = 0;
   while (WiFi.status() != WL_CONNECTED && attempts < 20) {
     delay(500);
     #if SERIAL_OUTPUT_ENABLED
-      Serial.print(".");
+      Log.print(".");
     #endif
     attempts++;
   }
   
   if (WiFi.status() == WL_CONNECTED) {
     systemState.wifiConnected = true;
+    breadcrumb(CRUMB_WIFI, 1, WiFi.RSSI());
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("WiFi connected - IP: " + WiFi.localIP().toString());
+      Log.println("WiFi connected - IP: " + WiFi.localIP().toString());
     #endif
   } else {
     systemState.wifiConnected = false;
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println();
-      Serial.println("WiFi connection failed!");
-      Serial.println("System will operate in offline mode");
+      Log.println();
+      Log.println("WiFi connection failed!");
     #endif
+    if (SOFTAP_FALLBACK_ENABLED) {
+      startSoftAp();
+    } else {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("System will operate in offline mode");
+      #endif
+    }
   }
 }
 
@@ -565,13 +1936,13 @@ void initializeWiFi() {
 void initializeAdafruitIO() {
   if (!ADAFRUIT_IO_ENABLED) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Adafruit IO disabled in configuration");
+      Log.println("Adafruit IO disabled in configuration");
     #endif
     return;
   }
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing Adafruit IO connection...");
+    Log.println("Initializing Adafruit IO connection...");
   #endif
   
   // Initialize Adafruit IO feeds
@@ -581,41 +1952,36 @@ void initializeAdafruitIO() {
   lightLevelFeed = io.feed(ADAFRUIT_IO_LIGHT_LEVEL_FEED);
   pumpStatusFeed = io.feed(ADAFRUIT_IO_PUMP_STATUS_FEED);
   irrigationCountFeed = io.feed(ADAFRUIT_IO_IRRIGATION_COUNT_FEED);
-  
-  // Connect to Adafruit IO
-  #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Connecting to Adafruit IO...");
+  #if TANK_ENABLED
+  tankLevelFeed = io.feed(ADAFRUIT_IO_TANK_LEVEL_FEED);
+  #endif
+  #if RAIN_DETECTION_ENABLED
+  rainfallFeed = io.feed(ADAFRUIT_IO_RAINFALL_FEED);
   #endif
-  io.connect();
   
-  // Wait for connection
-  int attempts = 0;
-  while (io.status() < AIO_CONNECTED && attempts < 20) {
-    delay(500);
+  // Connect to Adafruit IO in the background; uploads wait until it finishes
+  coro::scheduler.spawn("aioconnect", adafruitIOConnectFlow());
+}
+#endif
+
+void initializeNetworkFlows() {
+  if (!coro::beginWorker(NETWORK_WORKER_STACK, NETWORK_WORKER_PRIORITY, NETWORK_WORKER_CORE)) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.print(".");
+      Log.println("Network worker failed to start - cloud and forecast calls will fail");
     #endif
-    attempts++;
   }
   
-  if (io.status() == AIO_CONNECTED) {
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println();
-      Serial.println("Adafruit IO connected successfully!");
-    #endif
-  } else {
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println();
-      Serial.println("Adafruit IO connection failed!");
-      Serial.println("Status: " + String(io.statusText()));
-    #endif
-  }
+  coroSwitchCycles = coro::scheduler.measureSwitchCycles();
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Network flows ready (coroutine switch " + String(coroSwitchCycles) + " cycles, " +
+                   String(coroSwitchCycles * 1000 / ESP.getCpuFreqMHz()) + " ns)");
+  #endif
 }
-#endif
 
 void initializeOTA() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing OTA updates...");
+    Log.println("Initializing OTA updates...");
   #endif
   
   // Configure OTA
@@ -625,7 +1991,7 @@ void initializeOTA() {
   ArduinoOTA.onStart([]() {
     String type = (ArduinoOTA.getCommand() == U_FLASH) ? "sketch" : "filesystem";
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Start updating " + type);
+      Log.println("Start updating " + type);
     #endif
     lcd.clear();
     lcd.setCursor(0, 0);
@@ -635,8 +2001,9 @@ void initializeOTA() {
   });
   
   ArduinoOTA.onEnd([]() {
+    markPlannedRestart(FAULT_FLAG_OTA);
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("\nEnd");
+      Log.println("\nEnd");
     #endif
     lcd.clear();
     lcd.setCursor(0, 0);
@@ -647,18 +2014,18 @@ void initializeOTA() {
   
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+      Log.printf("Progress: %u%%\r", (progress / (total / 100)));
     #endif
   });
   
   ArduinoOTA.onError([](ota_error_t error) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.printf("Error[%u]: ", error);
-      if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
-      else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
-      else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
-      else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
-      else if (error == OTA_END_ERROR) Serial.println("End Failed");
+      Log.printf("Error[%u]: ", error);
+      if (error == OTA_AUTH_ERROR) Log.println("Auth Failed");
+      else if (error == OTA_BEGIN_ERROR) Log.println("Begin Failed");
+      else if (error == OTA_CONNECT_ERROR) Log.println("Connect Failed");
+      else if (error == OTA_RECEIVE_ERROR) Log.println("Receive Failed");
+      else if (error == OTA_END_ERROR) Log.println("End Failed");
     #endif
   });
   
@@ -666,13 +2033,13 @@ void initializeOTA() {
   otaEnabled = true;
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("OTA updates initialized successfully!");
+    Log.println("OTA updates initialized successfully!");
   #endif
 }
 
 void initializeWebServer() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Initializing web server...");
+    Log.println("Initializing web server...");
   #endif
   
   // Configure web server routes
@@ -681,13 +2048,32 @@ void initializeWebServer() {
   server.on("/control", HTTP_POST, handleControl);
   server.on("/status", handleStatus);
   server.on("/ota", handleOTA);
+  server.on("/api/faults", handleFaults);
+  server.on("/api/coroutines", handleCoroutines);
+  server.on("/api/events", handleEvents);
+  server.on("/api/forecast", handleForecast);
+  server.on("/api/rain", handleRain);
+  server.on("/api/commission", HTTP_GET, handleCommissionGet);
+  server.on("/api/commission", HTTP_POST, handleCommissionPost);
+  #if CONFIG_FILE_ENABLED
+    server.on("/api/config", HTTP_GET, handleConfigGet);
+    server.on("/api/config", HTTP_POST, handleConfigPost);
+  #endif
+  #if PUMP_CURRENT_SENSING
+    server.on("/api/current", handleCurrent);
+  #endif
+  #if COREDUMP_ENABLED
+    server.on("/api/coredump", HTTP_GET, handleCoreDump);
+    server.on("/api/coredump", HTTP_DELETE, handleCoreDumpErase);
+  #endif
+  server.onNotFound(handleNotFound);
   
   // Start web server
   server.begin();
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Web server initialized successfully!");
-    Serial.println("Web interface available at: http://" + WiFi.localIP().toString());
+    Log.println("Web server initialized successfully!");
+    Log.println("Web interface available at: http://" + networkAddress().toString());
   #endif
 }
 
@@ -707,7 +2093,7 @@ void readSensors() {
     // Check for DHT sensor errors
     if (isnan(temperature) || isnan(humidity)) {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("Error: Failed to read DHT sensor!");
+        Log.println("Error: Failed to read DHT sensor!");
       #endif
       systemState.sensorErrors++;
       sensorValidation.disconnectCount++;
@@ -719,11 +2105,26 @@ void readSensors() {
     humidity = 50.0;     // Default humidity
   #endif
   
-  // Read soil moisture sensor
-  int soilMoistureRaw = analogRead(SOIL_MOISTURE_PIN);
+  // Read soil moisture sensor. While the pump current sampler owns the ADC
+  // the previous analog readings are kept and flagged as held, so nothing
+  // downstream mistakes a repeated value for a flat sensor.
+  bool analogAvailable = acquireAnalogInputs();
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+    // Counted by PCNT, independent of the ADC; converted onto the analog scale
+    int soilMoistureRaw = systemState.soilMoistureRaw;
+    bool soilSampled = readFrequencyProbe(soilMoistureRaw);
+  #else
+    int soilMoistureRaw = analogAvailable ? analogRead(SOIL_MOISTURE_PIN) : systemState.soilMoistureRaw;
+    bool soilSampled = analogAvailable;
+  #endif
+  if (soilSampled) {
+    // Remove the probe's temperature drift before anything interprets the reading
+    soilMoistureRaw = compensateSoilRaw(soilMoistureRaw, temperature);
+    updateSoilCalibration(soilMoistureRaw);
+  }
   
-  // Convert raw reading to percentage
-  int soilMoisturePercent = map(soilMoistureRaw, SOIL_MOISTURE_WET_VALUE, SOIL_MOISTURE_DRY_VALUE, 100, 0);
+  // Convert raw reading to percentage (learned endpoints when auto-calibration is on)
+  int soilMoisturePercent = map(soilMoistureRaw, soilCal.model.wetRaw, soilCal.model.dryRaw, 100, 0);
   soilMoisturePercent = constrain(soilMoisturePercent, 0, 100);
   
   // Read LDR sensor (if enabled)
@@ -731,7 +2132,7 @@ void readSensors() {
   int lightLevelPercent = 0;
   
   #if LDR_ENABLED
-    lightLevelRaw = analogRead(LDR_PIN);
+    lightLevelRaw = analogAvailable ? analogRead(LDR_PIN) : systemState.lightLevelRaw;
     
     // Convert raw reading to percentage (inverted: high value = dark, low value = bright)
     lightLevelPercent = map(lightLevelRaw, LDR_DARK_VALUE, LDR_BRIGHT_VALUE, 0, 100);
@@ -741,13 +2142,21 @@ void readSensors() {
     lightLevelRaw = 2048;  // Default middle value
     lightLevelPercent = 50; // Default 50% light level
   #endif
+  if (analogAvailable) {
+    releaseAnalogInputs();
+  }
   
   // Validate sensor readings
+  systemState.soilHeld = !soilSampled;
+  systemState.lightHeld = LDR_ENABLED && !analogAvailable;
   validateSensorReadings(temperature, humidity, soilMoisturePercent, lightLevelPercent);
   
   // Always update soil moisture (critical for irrigation), but validate others
   systemState.soilMoistureRaw = soilMoistureRaw;
   systemState.soilMoisturePercent = soilMoisturePercent;
+  if (soilSampled && sensorValidation.soilMoistureValid) {
+    updateRainDetector(soilMoistureRaw);
+  }
   systemState.lightLevelRaw = lightLevelRaw;
   systemState.lightLevelPercent = lightLevelPercent;
   
@@ -758,6 +2167,7 @@ void readSensors() {
     // Reset sensor error counter on successful reading
     systemState.sensorErrors = 0;
     sensorValidation.disconnectCount = 0;
+    supervisorCheckIn(SUBSYS_SENSORS);
   } else {
     systemState.sensorErrors++;
   }
@@ -769,6 +2179,13 @@ void readSensors() {
 // =============================================================================
 
 void updateDisplay() {
+  #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+    // The menu renderer owns the LCD while the menu is open
+    if (systemState.inMenuMode) {
+      return;
+    }
+  #endif
+  
   #if DISPLAY_ENABLED
     #if DISPLAY_TYPE == DISPLAY_LCD_2004
       // LCD 2004: Show all information on single screen
@@ -804,14 +2221,15 @@ void updateDisplay() {
 
 void displaySensorData() {
   #if DISPLAY_ENABLED
+    SensorSnapshot snapshot = sensorSnapshot.read();
     lcd.clear();
     lcd.setCursor(0, 0);
     
     // Display temperature and humidity (if DHT enabled)
     #if DHT_ENABLED
-      lcd.print("Temp: " + String(systemState.temperature, 1) + "C");
+      lcd.print("Temp: " + String(snapshot.temperature, 1) + "C");
       lcd.setCursor(0, 1);
-      lcd.print("Hum: " + String(systemState.humidity, 1) + "%");
+      lcd.print("Hum: " + String(snapshot.humidity, 1) + "%");
     #else
       lcd.print("Smart Farming");
       lcd.setCursor(0, 1);
@@ -822,27 +2240,28 @@ void displaySensorData() {
     
     lcd.clear();
     lcd.setCursor(0, 0);
-    lcd.print("Soil: " + String(systemState.soilMoisturePercent) + "%");
+    lcd.print("Soil: " + String(snapshot.soilMoisturePercent) + "%");
     lcd.setCursor(0, 1);
     
     // Only show light level if LDR is enabled
     #if LDR_ENABLED
-      lcd.print("Light: " + String(systemState.lightLevelPercent) + "%");
+      lcd.print("Light: " + String(snapshot.lightLevelPercent) + "%");
     #else
       // Show WiFi status instead of light level
-      lcd.print("WiFi: " + String(systemState.wifiConnected ? "OK" : "OFF"));
+      lcd.print("WiFi: " + String(snapshot.wifiConnected ? "OK" : "OFF"));
     #endif
   #endif
 }
 
 void displaySystemStatus() {
   #if DISPLAY_ENABLED
+    SensorSnapshot snapshot = sensorSnapshot.read();
     lcd.clear();
     lcd.setCursor(0, 0);
     lcd.print("System Status:");
     lcd.setCursor(0, 1);
     
-    if (systemState.systemOK) {
+    if (snapshot.systemOK) {
       lcd.print("OK");
     } else {
       lcd.print("ERROR");
@@ -853,9 +2272,9 @@ void displaySystemStatus() {
     lcd.clear();
     lcd.setCursor(0, 0);
     lcd.print("Pump: ");
-    lcd.print(systemState.pumpActive ? "ON" : "OFF");
+    lcd.print(snapshot.pumpActive ? "ON" : "OFF");
     lcd.setCursor(0, 1);
-    lcd.print("Daily: " + String(systemState.dailyIrrigations));
+    lcd.print("Daily: " + String(snapshot.dailyIrrigations));
   #endif
 }
 
@@ -884,6 +2303,8 @@ void displayWiFiStatus() {
     
     if (systemState.wifiConnected) {
       lcd.print("Connected");
+    } else if (softAp.active) {
+      lcd.print("AP " SOFTAP_SSID);
     } else {
       lcd.print("Disconnected");
     }
@@ -892,7 +2313,11 @@ void displayWiFiStatus() {
     
     lcd.clear();
     lcd.setCursor(0, 0);
-    lcd.print("IP: " + WiFi.localIP().toString());
+    lcd.print("IP: " + networkAddress().toString());
+    if (softAp.active) {
+      lcd.setCursor(0, 1);
+      lcd.print("Key: " + String(softApPassword));
+    }
   #endif
 }
 
@@ -901,81 +2326,168 @@ void displayWiFiStatus() {
 // =============================================================================
 
 void controlIrrigation() {
-  // Determine threshold to use
-  int threshold = SOIL_MOISTURE_THRESHOLD;
-  #if CONTROL_TYPE == CONTROL_POTENTIOMETER || CONTROL_TYPE == CONTROL_ROTARY_ENCODER
-    threshold = systemState.adjustedThreshold;
-  #endif
+  int threshold = activeSoilThreshold();
   
   // Check if irrigation is needed
   bool needsIrrigation = (systemState.soilMoisturePercent < threshold);
   
-  // Check cooldown period
-  bool cooldownExpired = (currentTime - systemState.lastIrrigation >= IRRIGATION_COOLDOWN);
+  // Check cooldown period (never shorter than the zone takes to show the last watering)
+  unsigned long cooldownMs = max((unsigned long)runtimeSettings.irrigationCooldownMs, zoneSettleMs());
+  bool cooldownExpired = (currentTime - systemState.lastIrrigation >= cooldownMs);
   
   // Check daily irrigation limit
-  bool withinDailyLimit = (systemState.dailyIrrigations < MAX_DAILY_IRRIGATIONS);
+  bool withinDailyLimit = (systemState.dailyIrrigations < runtimeSettings.maxDailyIrrigations);
   
   // Check if system is OK
   bool systemHealthy = systemState.systemOK && (systemState.sensorErrors < MAX_SENSOR_ERRORS);
   
-  
-  // Start irrigation if all conditions are met
-  if (needsIrrigation && cooldownExpired && withinDailyLimit && systemHealthy && !systemState.pumpActive) {
-    startIrrigation();
-  }
-  
-  // Stop irrigation if duration exceeded
-  if (systemState.pumpActive && (currentTime - systemState.lastIrrigation >= IRRIGATION_DURATION)) {
-    stopIrrigation();
-  }
-}
-
-void startIrrigation() {
+  // Start irrigation if all conditions are met, unless rain is on the way
+  if (needsIrrigation && cooldownExpired && withinDailyLimit && systemHealthy) {
+    int runPercent = forecastRunPercent();
+    if (runPercent == 0 && systemState.soilMoisturePercent < FORECAST_CRITICAL_MOISTURE) {
+      runPercent = 100;  // Too dry to wait for the rain
+    }
+    
+    if (runPercent == 0) {
+      if (!forecastState.skipping) {
+        forecastState.skipping = true;
+        forecastState.skips++;
+        #if SERIAL_OUTPUT_ENABLED
+          Log.println("Irrigation skipped: " + String(forecastState.expectedTenths / 10.0, 1) +
+                         " mm of rain expected in the next " + String(FORECAST_LOOKAHEAD_HOURS) + " h");
+        #endif
+      }
+    } else if (pumpStartBlocked(plannedIrrigationSeconds(runPercent) * 1000UL) == nullptr) {
+      if (startIrrigation(runPercent, 0, PUMP_START_THRESHOLD) && runPercent < 100) {
+        forecastState.shortened++;
+      }
+    }
+  } else {
+    forecastState.skipping = false;
+  }
+  
+  // Stop irrigation if duration exceeded
+  if (systemState.pumpActive && (currentTime - systemState.lastIrrigation >= pumpPlannedSeconds * 1000UL)) {
+    stopIrrigation();
+  }
+}
+
+// Every path that turns the pump on goes through here. fixedSeconds overrides
+// the planned runtime (commissioning test pulses).
+bool startIrrigation(int runPercent, int fixedSeconds, PumpStartCause cause) {
+  int plannedSeconds = fixedSeconds > 0 ? fixedSeconds : plannedIrrigationSeconds(runPercent);
+  if (commissioning.active && cause != PUMP_START_COMMISSIONING) {
+    // Any other watering would spoil the response being measured
+    pumpBlockReason = "commissioning in progress";
+  } else {
+    pumpBlockReason = pumpStartBlocked(plannedSeconds * 1000UL);
+  }
+  if (pumpBlockReason != nullptr) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Irrigation refused: " + String(pumpBlockReason));
+    #endif
+    return false;
+  }
+  
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Starting irrigation...");
+    Log.println("Starting irrigation...");
   #endif
   
-  // Activate relay (pump)
-  digitalWrite(RELAY_PIN, HIGH);
+  // Arm the hardware failsafe before energising the relay
+  pumpPlannedSeconds = plannedSeconds;
+  armPumpFailsafe(plannedSeconds * 1000UL);
+  
+  // Activate relay (pump). The e-stop can trip at any point after the check
+  // above, so it is checked again with the relay write in the same critical
+  // section: either the ISR sees the relay on and cuts it, or we see the trip.
+  accruePumpDuty(millis());
+  pumpCutAtMs = 0;
+  portENTER_CRITICAL(&relayMux);
+  bool estopTripped = (estopState != ESTOP_IDLE);
+  if (!estopTripped) {
+    digitalWrite(RELAY_PIN, HIGH);
+    pumpRelayEnergised = true;
+  }
+  portEXIT_CRITICAL(&relayMux);
+  if (estopTripped) {
+    disarmPumpFailsafe();
+    pumpBlockReason = "emergency stop active";
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Irrigation refused: " + String(pumpBlockReason));
+    #endif
+    return false;
+  }
+  pumpHasRun = true;
+  pumpRelayCycles++;
+  rtcPumpCycles.cycles = pumpRelayCycles;
+  tankState.levelAtPumpStart = tankState.levelPercent;
+  tankState.drawRunMs = 0;
+  #if PUMP_CURRENT_SENSING
+    // Wake the current sampler straight away
+    if (currentSenseTaskHandle != nullptr) {
+      xTaskNotifyGive(currentSenseTaskHandle);
+    }
+  #endif
   systemState.pumpActive = true;
+  rtcFaultState.pumpActive = true;
+  breadcrumb(CRUMB_PUMP_ON, 0, plannedSeconds);
   systemState.pumpStartTime = currentTime; // Record pump start time for runtime protection
   
   // Update irrigation tracking
   systemState.lastIrrigation = currentTime;
   systemState.dailyIrrigations++;
   
-  // Update display
-  #if DISPLAY_ENABLED
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("IRRIGATION");
-    lcd.setCursor(0, 1);
-    lcd.print("ACTIVE");
-  #endif
+  bus::publish(PumpStartedEvent{(uint32_t)currentTime, (uint16_t)plannedSeconds, (uint8_t)cause});
+  
+  if (pumpRelayCycles - pumpCyclesSaved >= PUMP_CYCLES_SAVE_EVERY) {
+    savePumpCycles();
+  }
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Irrigation started. Duration: " + String(IRRIGATION_DURATION / 1000) + " seconds");
-    Serial.println("Maximum runtime: " + String(MAX_PUMP_RUNTIME / 1000) + " seconds");
+    Log.println("Irrigation started. Duration: " + String(plannedSeconds) + " seconds");
+    Log.println("Maximum runtime: " + String(MAX_PUMP_RUNTIME / 1000) + " seconds");
   #endif
+  return true;
 }
 
-void stopIrrigation() {
+void stopIrrigation(PumpOffCause cause) {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Stopping irrigation...");
+    Log.println("Stopping irrigation...");
   #endif
   
-  // Deactivate relay (pump)
+  // Deactivate relay (pump). Failsafe and e-stop cuts record their own crumb.
+  if (pumpRelayEnergised) {
+    breadcrumb(CRUMB_PUMP_OFF, cause, (millis() - systemState.pumpStartTime) / 1000);
+  }
+  // A cut that beat us to it stopped the pump earlier than now; the duty
+  // windows and the minimum off-time count from there
   digitalWrite(RELAY_PIN, LOW);
+  unsigned long cutAt = pumpCutAtMs;
+  unsigned long stoppedAt = cutAt != 0 ? cutAt : millis();
+  accruePumpDuty(millis());
+  bool wasRunning = systemState.pumpActive;
+  if (systemState.pumpActive || cutAt != 0) {
+    pumpLastStopTime = stoppedAt;
+  }
+  if (systemState.pumpActive) {
+    if (tankState.levelAtPumpStart >= 0) {
+      // Measure how far the level fell once the surface has settled
+      tankState.drawRunMs = stoppedAt - systemState.pumpStartTime;
+      tankState.drawStoppedAt = stoppedAt;
+    }
+  }
+  pumpRelayEnergised = false;
+  pumpCutAtMs = 0;
+  disarmPumpFailsafe();
   systemState.pumpActive = false;
+  rtcFaultState.pumpActive = false;
   
-  // Clear display
-  #if DISPLAY_ENABLED
-    lcd.clear();
-  #endif
+  if (wasRunning) {
+    bus::publish(PumpStoppedEvent{(uint32_t)stoppedAt, (uint32_t)(stoppedAt - systemState.pumpStartTime), cause});
+  }
   
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Irrigation stopped.");
+    Log.println("Irrigation stopped.");
   #endif
 }
 
@@ -987,33 +2499,50 @@ void checkWiFiConnection() {
   if (WiFi.status() != WL_CONNECTED) {
     if (systemState.wifiConnected) {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("WiFi connection lost! Attempting to reconnect...");
+        Log.println("WiFi connection lost! Attempting to reconnect...");
       #endif
       systemState.wifiConnected = false;
+      breadcrumb(CRUMB_WIFI, 0, 0);
     }
     
-    // Attempt to reconnect
-    if (wifiReconnectAttempts < maxWifiReconnectAttempts) {
-      WiFi.reconnect();
-      wifiReconnectAttempts++;
-      
-      // Wait a bit for connection
-      delay(2000);
-      
-      if (WiFi.status() == WL_CONNECTED) {
-        systemState.wifiConnected = true;
-        wifiReconnectAttempts = 0;
-        #if SERIAL_OUTPUT_ENABLED
-          Serial.println("WiFi reconnected");
-        #endif
+    // A mode switch is running on the network worker
+    if (coro::scheduler.running("apmode")) {
+      return;
+    }
+    
+    if (softAp.active) {
+      // Serving the local dashboard is the network doing its job; look for the station network now and then
+      supervisorCheckIn(SUBSYS_NETWORK);
+      if (millis() - softAp.startedAt >= SOFTAP_LIFETIME) {
+        if (!coro::scheduler.running("approbe")) {
+          coro::scheduler.spawn("apmode", softApStopFlow(true));
+        }
+      } else if (millis() - softAp.lastProbe >= SOFTAP_PROBE_INTERVAL && coro::scheduler.spawn("approbe", softApProbeFlow())) {
+        softAp.lastProbe = millis();
       }
+      return;
+    }
+    
+    // Attempt to reconnect (one attempt in flight at a time)
+    if (wifiReconnectAttempts < maxWifiReconnectAttempts) {
+      coro::scheduler.spawn("wifi", wifiReconnectFlow());
+    } else if (SOFTAP_FALLBACK_ENABLED && !coro::scheduler.running("wifi")) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("WiFi still down after " + String(maxWifiReconnectAttempts) + " attempts - falling back to access point");
+      #endif
+      coro::scheduler.spawn("apmode", softApStartFlow());
     }
   } else {
+    supervisorCheckIn(SUBSYS_NETWORK);
+    if (softAp.active && !coro::scheduler.running("apmode")) {
+      coro::scheduler.spawn("apmode", softApStopFlow(false));
+    }
     if (!systemState.wifiConnected) {
       systemState.wifiConnected = true;
       wifiReconnectAttempts = 0;
+      breadcrumb(CRUMB_WIFI, 1, WiFi.RSSI());
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("WiFi connection restored!");
+        Log.println("WiFi connection restored!");
       #endif
     }
   }
@@ -1025,95 +2554,195 @@ void transmitDataToCloud() {
     return;
   }
   
-  #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Transmitting data to cloud...");
-  #endif
+  if (!coro::scheduler.spawn("thingspeak", thingSpeakUploadFlow())) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("ThingSpeak upload still in progress - skipping this interval");
+    #endif
+  }
+}
+
+#if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
+void transmitDataToAdafruitIO() {
+  if (!ADAFRUIT_IO_ENABLED) {
+    systemState.lastAdafruitIOStatus = "Disabled";
+    return;
+  }
   
-  HTTPClient http;
-  String url = "https://api.thingspeak.com/update";
+  if (!systemState.wifiConnected) {
+    systemState.lastAdafruitIOStatus = "Not connected";
+    return;
+  }
   
-  http.begin(url);
-  http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+  // The client is not thread-safe: never upload while a connect is running on the worker
+  if (coro::scheduler.running("aioconnect") || !coro::scheduler.spawn("adafruitio", adafruitIOUploadFlow())) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Adafruit IO busy - skipping this interval");
+    #endif
+  }
+}
+#endif
+
+// =============================================================================
+// NETWORK FLOWS
+// =============================================================================
+
+coro::Task wifiReconnectFlow() {
+  WiFi.reconnect();
+  wifiReconnectAttempts++;
+  
+  // Give the link a moment to come back without holding up the loop
+  if (co_await coro::wifiConnected(2000)) {
+    systemState.wifiConnected = true;
+    wifiReconnectAttempts = 0;
+    breadcrumb(CRUMB_WIFI, 1, WiFi.RSSI());
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("WiFi reconnected");
+    #endif
+  }
+}
+
+coro::Task thingSpeakUploadFlow() {
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Transmitting data to cloud...");
+  #endif
   
-  String data = "api_key=" + String(THINGSPEAK_API_KEY) +
-                "&field1=" + String(systemState.temperature) +
-                "&field2=" + String(systemState.humidity) +
-                "&field3=" + String(systemState.soilMoisturePercent) +
-                "&field4=" + String(systemState.lightLevelPercent) +
-                "&field5=" + String(systemState.pumpActive ? 1 : 0) +
-                "&field6=" + String(systemState.dailyIrrigations);
+  // The payload is built here on the loop task; only the HTTP exchange runs on the worker
+  SensorSnapshot snapshot = sensorSnapshot.read();
+  String data = "api_key=" + String(runtimeSettings.thingSpeakApiKey) +
+                "&field1=" + String(snapshot.temperature) +
+                "&field2=" + String(snapshot.humidity) +
+                "&field3=" + String(snapshot.soilMoisturePercent) +
+                "&field4=" + String(snapshot.lightLevelPercent) +
+                "&field5=" + String(snapshot.pumpActive ? 1 : 0) +
+                "&field6=" + String(snapshot.dailyIrrigations);
+  #if RAIN_DETECTION_ENABLED
+  data += "&field8=" + String(snapshot.rainTodayMm, 1);
+  #endif
+  #if TANK_ENABLED
+  if (snapshot.tankLevel >= 0) {
+    data += "&field7=" + String(snapshot.tankLevel, 1);
+  }
+  #endif
   
-  int httpResponseCode = http.POST(data);
+  breadcrumb(CRUMB_HTTP_BEGIN, HTTP_THINGSPEAK);
+  HttpResult result = co_await coro::onWorker([data]() {
+    HTTPClient http;
+    http.begin("https://api.thingspeak.com/update");
+    http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+    HttpResult response = {http.POST(data), String()};
+    if (response.code > 0) {
+      response.body = http.getString();
+    }
+    http.end();
+    return response;
+  });
+  int httpResponseCode = result.code;
+  breadcrumb(CRUMB_HTTP_END, HTTP_THINGSPEAK, httpResponseCode);
   
   if (httpResponseCode > 0) {
-    String response = http.getString();
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Data transmitted successfully!");
-      Serial.println("Response code: " + String(httpResponseCode));
-      Serial.println("Response: " + response);
+      Log.println("Data transmitted successfully!");
+      Log.println("Response code: " + String(httpResponseCode));
+      Log.println("Response: " + result.body);
     #endif
     systemState.lastTransmissionStatus = "Success";
     systemState.transmissionErrors = 0;
+    supervisorCheckIn(SUBSYS_CLOUD);
   } else {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Error transmitting data!");
-      Serial.println("Response code: " + String(httpResponseCode));
+      Log.println("Error transmitting data!");
+      Log.println("Response code: " + String(httpResponseCode));
     #endif
     systemState.lastTransmissionStatus = "Failed: " + String(httpResponseCode);
     systemState.transmissionErrors++;
   }
-  
-  http.end();
 }
 
 #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
-void transmitDataToAdafruitIO() {
-  if (!ADAFRUIT_IO_ENABLED) {
-    systemState.lastAdafruitIOStatus = "Disabled";
-    return;
-  }
+coro::Task adafruitIOConnectFlow() {
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Connecting to Adafruit IO...");
+  #endif
+  io.connect();
   
-  if (!systemState.wifiConnected || io.status() != AIO_CONNECTED) {
-    systemState.lastAdafruitIOStatus = "Not connected";
-    return;
+  // io.status() drives the MQTT handshake and can block, so poll it on the worker
+  int status = 0;
+  for (int attempts = 0; attempts < 20; attempts++) {
+    status = co_await coro::onWorker([]() { return (int)io.status(); });
+    if (status >= AIO_CONNECTED) {
+      break;
+    }
+    co_await coro::sleepFor(500);
   }
   
+  if (status == AIO_CONNECTED) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Adafruit IO connected successfully!");
+    #endif
+  } else {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Adafruit IO connection failed!");
+      Log.println("Status: " + String(io.statusText()));
+    #endif
+  }
+}
+
+coro::Task adafruitIOUploadFlow() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Transmitting data to Adafruit IO...");
+    Log.println("Transmitting data to Adafruit IO...");
   #endif
   
-  try {
-    // Send temperature data
-    temperatureFeed->save(systemState.temperature);
-    
-    // Send humidity data
-    humidityFeed->save(systemState.humidity);
-    
-    // Send soil moisture data
-    soilMoistureFeed->save(systemState.soilMoisturePercent);
-    
-    // Send light level data
-    lightLevelFeed->save(systemState.lightLevelPercent);
-    
-    // Send pump status (1 for active, 0 for inactive)
-    pumpStatusFeed->save(systemState.pumpActive ? 1 : 0);
-    
-    // Send irrigation count
-    irrigationCountFeed->save(systemState.dailyIrrigations);
+  SensorSnapshot snapshot = sensorSnapshot.read();
+  
+  breadcrumb(CRUMB_HTTP_BEGIN, HTTP_ADAFRUIT_IO);
+  HttpResult result = co_await coro::onWorker([snapshot]() {
+    if (io.status() != AIO_CONNECTED) {
+      return HttpResult{0, String("Not connected")};
+    }
     
+    try {
+      temperatureFeed->save(snapshot.temperature);
+      humidityFeed->save(snapshot.humidity);
+      soilMoistureFeed->save(snapshot.soilMoisturePercent);
+      lightLevelFeed->save(snapshot.lightLevelPercent);
+      
+      // Pump status (1 for active, 0 for inactive)
+      pumpStatusFeed->save(snapshot.pumpActive ? 1 : 0);
+      irrigationCountFeed->save(snapshot.dailyIrrigations);
+      
+      #if TANK_ENABLED
+      if (snapshot.tankLevel >= 0) {
+        tankLevelFeed->save(snapshot.tankLevel);
+      }
+      #endif
+      #if RAIN_DETECTION_ENABLED
+      rainfallFeed->save(snapshot.rainTodayMm);
+      #endif
+      return HttpResult{200, String()};
+    } catch (const std::exception& e) {
+      return HttpResult{-1, String(e.what())};
+    }
+  });
+  
+  if (result.code == 200) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Data transmitted to Adafruit IO successfully!");
+      Log.println("Data transmitted to Adafruit IO successfully!");
     #endif
     systemState.lastAdafruitIOStatus = "Success";
     systemState.adafruitIOErrors = 0;
-    
-  } catch (const std::exception& e) {
+    supervisorCheckIn(SUBSYS_CLOUD);
+    breadcrumb(CRUMB_HTTP_END, HTTP_ADAFRUIT_IO, 200);
+  } else if (result.code == 0) {
+    systemState.lastAdafruitIOStatus = result.body;
+    breadcrumb(CRUMB_HTTP_END, HTTP_ADAFRUIT_IO, 0);
+  } else {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Error transmitting data to Adafruit IO!");
-      Serial.println("Error: " + String(e.what()));
+      Log.println("Error transmitting data to Adafruit IO!");
+      Log.println("Error: " + result.body);
     #endif
-    systemState.lastAdafruitIOStatus = "Failed: " + String(e.what());
+    systemState.lastAdafruitIOStatus = "Failed: " + result.body;
     systemState.adafruitIOErrors++;
+    breadcrumb(CRUMB_HTTP_END, HTTP_ADAFRUIT_IO, -1);
   }
 }
 #endif
@@ -1148,6 +2777,9 @@ void handleRoot() {
   html += "<p>Daily Irrigations: " + String(systemState.dailyIrrigations) + "</p>";
   html += "<p>System Status: <span class='status " + String(systemState.systemOK ? "ok" : "error") + "'>" + String(systemState.systemOK ? "OK" : "ERROR") + "</span></p>";
   html += "<p>WiFi Status: <span class='status " + String(systemState.wifiConnected ? "ok" : "error") + "'>" + String(systemState.wifiConnected ? "CONNECTED" : "DISCONNECTED") + "</span></p>";
+  if (systemState.emergencyStop) {
+    html += "<p>Emergency Stop: <span class='status error'>LATCHED</span></p>";
+  }
   html += "</div>";
   
   // Cloud Services Status
@@ -1171,14 +2803,20 @@ void handleRoot() {
   html += "<h2>Control Panel</h2>";
   html += "<button class='btn-primary' onclick='startIrrigation()'>Start Irrigation</button>";
   html += "<button class='btn-danger' onclick='stopIrrigation()'>Stop Irrigation</button>";
+  html += "<button class='btn-danger' onclick='emergencyStop()'>Emergency Stop</button>";
+  html += "<button class='btn-primary' onclick='resetEmergencyStop()'>Reset E-Stop</button>";
   html += "<button class='btn-primary' onclick='refreshData()'>Refresh Data</button>";
   html += "</div>";
   
   // Network Info
   html += "<div class='card'>";
   html += "<h2>Network Information</h2>";
-  html += "<p>IP Address: " + WiFi.localIP().toString() + "</p>";
-  html += "<p>Signal Strength: " + String(WiFi.RSSI()) + " dBm</p>";
+  html += "<p>IP Address: " + networkAddress().toString() + "</p>";
+  if (softAp.active) {
+    html += "<p>Access Point: " SOFTAP_SSID " (" + String(WiFi.softAPgetStationNum()) + "/" + String(SOFTAP_MAX_CLIENTS) + " clients)</p>";
+  } else {
+    html += "<p>Signal Strength: " + String(WiFi.RSSI()) + " dBm</p>";
+  }
   html += "<p>Last Transmission: " + systemState.lastTransmissionStatus + "</p>";
   html += "</div>";
   
@@ -1188,6 +2826,8 @@ void handleRoot() {
   html += "<script>";
   html += "function startIrrigation(){fetch('/control?action=start',{method:'POST'}).then(()=>refreshData());}";
   html += "function stopIrrigation(){fetch('/control?action=stop',{method:'POST'}).then(()=>refreshData());}";
+  html += "function emergencyStop(){fetch('/control?action=estop',{method:'POST'}).then(()=>refreshData());}";
+  html += "function resetEmergencyStop(){fetch('/control?action=reset_estop',{method:'POST'}).then(()=>refreshData());}";
   html += "function refreshData(){location.reload();}";
   html += "setInterval(refreshData, 30000);"; // Auto-refresh every 30 seconds
   html += "</script>";
@@ -1198,20 +2838,61 @@ void handleRoot() {
 }
 
 void handleAPI() {
+  // Measured for comparison with a CoAP poll (see pollCost in the reply)
+  uint32_t startCycles = ESP.getCycleCount();
   String json = getSystemStatusJSON();
   server.send(200, "application/json", json);
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  
+  apiPollCost.requests++;
+  apiPollCost.lastBytes = json.length();
+  apiPollCost.lastCycles = cycles;
+  apiPollCost.totalCycles += cycles;
+  if (cycles > apiPollCost.maxCycles) {
+    apiPollCost.maxCycles = cycles;
+  }
 }
 
 void handleControl() {
+  // On the fallback access point anyone who has joined can reach this page
+  if (softAp.active && !requireWebAuth()) {
+    return;
+  }
   if (server.hasArg("action")) {
     String action = server.arg("action");
     
     if (action == "start") {
-      startIrrigation();
-      server.send(200, "text/plain", "Irrigation started");
+      if (startIrrigation()) {
+        server.send(200, "text/plain", "Irrigation started");
+      } else {
+        server.send(409, "text/plain", "Irrigation refused: " + String(pumpBlockReason));
+      }
     } else if (action == "stop") {
       stopIrrigation();
       server.send(200, "text/plain", "Irrigation stopped");
+    } else if (action == "estop") {
+      estopRemoteTrip = true;
+      emergencyStopISR();
+      server.send(200, "text/plain", "Emergency stop triggered");
+    } else if (action == "reset_estop") {
+      if (!requireWebAuth()) {
+        return;
+      }
+      if (resetEmergencyStop("web")) {
+        server.send(200, "text/plain", "Emergency stop reset");
+      } else {
+        server.send(409, "text/plain", "Emergency stop input still active");
+      }
+    #if FAILSAFE_FAULT_INJECTION
+    } else if (action == "hang") {
+      // Bench test: freeze the control loop so the pump failsafe has to act
+      server.send(200, "text/plain", "Hanging control loop");
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("FAULT INJECTION: control loop hung deliberately");
+      #endif
+      while (true) {
+      }
+    #endif
     } else {
       server.send(400, "text/plain", "Invalid action");
     }
@@ -1260,16 +2941,19 @@ void checkSystemStatus() {
   if (systemState.sensorErrors >= MAX_SENSOR_ERRORS) {
     systemState.systemOK = false;
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Warning: Too many sensor errors detected!");
+      Log.println("Warning: Too many sensor errors detected!");
     #endif
   } else if (systemState.sensorErrors == 0) {
     systemState.systemOK = true;
   }
   
+  // Track heap low-water mark for the fault history
+  rtcFaultState.minFreeHeap = esp_get_minimum_free_heap_size();
+  
   // Check memory usage
   if (currentTime % MEMORY_CHECK_INTERVAL < STATUS_CHECK_INTERVAL) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Free heap: " + String(ESP.getFreeHeap()) + " bytes");
+      Log.println("Free heap: " + String(ESP.getFreeHeap()) + " bytes");
     #endif
   }
 }
@@ -1277,43 +2961,61 @@ void checkSystemStatus() {
 void handleErrors() {
   if (!systemState.systemOK) {
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("System error detected! Check sensors and connections.");
+      Log.println("System error detected! Check sensors and connections.");
     #endif
     
-    // Turn off pump for safety
-    if (systemState.pumpActive) {
-      stopIrrigation();
-    }
-    
-    // Display error on LCD
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("SYSTEM ERROR");
-    lcd.setCursor(0, 1);
-    lcd.print("Check sensors");
+    // The pump subscriber stops irrigation, the display shows the error
+    bus::publish(SystemFaultEvent{systemState.sensorErrors});
   }
 }
 
 void performHeartbeat() {
   #if SERIAL_OUTPUT_ENABLED
-    Serial.println("System heartbeat - All systems operational");
-    Serial.println("  Temperature: " + String(systemState.temperature, 1) + "°C");
-    Serial.println("  Humidity: " + String(systemState.humidity, 1) + "%");
-    Serial.println("  Soil Moisture: " + String(systemState.soilMoisturePercent) + "%");
-    Serial.println("  Pump Status: " + String(systemState.pumpActive ? "ON" : "OFF"));
-    Serial.println("  Daily Irrigations: " + String(systemState.dailyIrrigations));
-    Serial.println("  System Status: " + String(systemState.systemOK ? "OK" : "ERROR"));
-    Serial.println("  WiFi Status: " + String(systemState.wifiConnected ? "CONNECTED" : "DISCONNECTED"));
+    Log.println("System heartbeat - All systems operational");
+    Log.println("  Temperature: " + String(systemState.temperature, 1) + "°C");
+    Log.println("  Humidity: " + String(systemState.humidity, 1) + "%");
+    Log.println("  Soil Moisture: " + String(systemState.soilMoisturePercent) + "%");
+    Log.println("  Pump Status: " + String(systemState.pumpActive ? "ON" : "OFF"));
+    Log.println("  Daily Irrigations: " + String(systemState.dailyIrrigations));
+    Log.println("  Pump Duty: " + String(pumpDutyShort.onMs * 100.0 / PUMP_DUTY_SHORT_WINDOW, 1) + "% short window, " +
+                   String(pumpDutyLong.onMs * 100.0 / PUMP_DUTY_LONG_WINDOW, 1) + "% long window, " +
+                   String(pumpRelayCycles) + " relay cycles");
+    #if TANK_ENABLED
+    Log.println("  Water Tank: " + String(tankState.levelPercent, 1) + "%" +
+                   String(tankState.lockout ? " (LOCKOUT)" : "") +
+                   ", ~" + String(predictedWaterings()) + " waterings left");
+    #endif
+    if (cropState.active) {
+      Log.println("  Crop: " + String(cropState.profile->name) + " day " + String(cropState.dayOfSeason) + " (" +
+                     String(cropState.profile->stages[cropState.stage].name) + "), water below " +
+                     String(cropState.threshold) + "%, Kc " + String(cropState.kc / 100.0, 2));
+    }
+    #if SOIL_AUTO_CALIBRATION
+    Log.println("  Soil Calibration: wet " + String(soilCal.model.wetRaw) + ", dry " + String(soilCal.model.dryRaw) +
+                   " (confidence " + String(soilCal.confidence) + "%)");
+    #endif
+    Log.println("  System Status: " + String(systemState.systemOK ? "OK" : "ERROR"));
+    Log.println("  WiFi Status: " + String(systemState.wifiConnected ? "CONNECTED" : "DISCONNECTED"));
+    Log.println("  Network Flows: " + String(coro::scheduler.active()) + " running");
+    Log.println("  Boot: #" + String(lastFault.bootCount) + " after " + String(resetReasonName(lastFault.resetReason)) +
+                   " (min heap " + String(rtcFaultState.minFreeHeap) + " bytes)");
+    for (int i = 0; i < SUBSYS_COUNT; i++) {
+      if (subsystemHealth[i].stalls > 0) {
+        Log.println("  Subsystem " + String(subsystemPolicies[i].name) + ": " + String(subsystemHealth[i].stalls) +
+                       " stalls, " + String(subsystemHealth[i].restarts) + " restarts" +
+                       String(subsystemHealth[i].stalled ? " (STALLED)" : ""));
+      }
+    }
     #if IOT_SERVICES_ENABLED
-    Serial.println("  ThingSpeak Status: " + systemState.lastTransmissionStatus);
+    Log.println("  ThingSpeak Status: " + systemState.lastTransmissionStatus);
     #else
-    Serial.println("  ThingSpeak Status: DISABLED");
+    Log.println("  ThingSpeak Status: DISABLED");
     #endif
     
     #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
-    Serial.println("  Adafruit IO Status: " + systemState.lastAdafruitIOStatus);
+    Log.println("  Adafruit IO Status: " + systemState.lastAdafruitIOStatus);
     #else
-    Serial.println("  Adafruit IO Status: DISABLED");
+    Log.println("  Adafruit IO Status: DISABLED");
     #endif
   #endif
 }
@@ -1327,12 +3029,14 @@ void logSystemData() {
   
   if (currentTime - lastLogTime >= LOG_INTERVAL) {
     // Store data in log buffer
-    dataLog[logIndex].timestamp = currentTime;
-    dataLog[logIndex].temperature = systemState.temperature;
-    dataLog[logIndex].humidity = systemState.humidity;
-    dataLog[logIndex].soilMoisturePercent = systemState.soilMoisturePercent;
-    dataLog[logIndex].pumpActive = systemState.pumpActive;
-    dataLog[logIndex].dailyIrrigations = systemState.dailyIrrigations;
+    SensorSnapshot snapshot = sensorSnapshot.read();
+    dataLog[logIndex].timestamp = snapshot.timestamp;
+    dataLog[logIndex].temperature = snapshot.temperature;
+    dataLog[logIndex].humidity = snapshot.humidity;
+    dataLog[logIndex].soilMoisturePercent = snapshot.soilMoisturePercent;
+    dataLog[logIndex].pumpActive = snapshot.pumpActive;
+    dataLog[logIndex].dailyIrrigations = snapshot.dailyIrrigations;
+    dataLog[logIndex].tankLevel = snapshot.tankLevel;
     
     logIndex = (logIndex + 1) % LOG_BUFFER_SIZE;
     if (logIndex == 0) {
@@ -1344,6 +3048,27 @@ void logSystemData() {
   }
 }
 
+// Single writer: only ever called from the loop task
+void publishSensorSnapshot() {
+  SensorSnapshot snapshot;
+  snapshot.timestamp = millis();
+  snapshot.temperature = systemState.temperature;
+  snapshot.humidity = systemState.humidity;
+  snapshot.soilMoistureRaw = systemState.soilMoistureRaw;
+  snapshot.soilMoisturePercent = systemState.soilMoisturePercent;
+  snapshot.lightLevelPercent = systemState.lightLevelPercent;
+  snapshot.soilHeld = systemState.soilHeld;
+  snapshot.lightHeld = systemState.lightHeld;
+  snapshot.tankLevel = tankState.levelPercent;
+  snapshot.dailyIrrigations = systemState.dailyIrrigations;
+  snapshot.rainTodayMm = rainState.todayTenths / 10.0;
+  snapshot.pumpActive = systemState.pumpActive;
+  snapshot.systemOK = systemState.systemOK;
+  snapshot.wifiConnected = systemState.wifiConnected;
+  snapshot.emergencyStop = systemState.emergencyStop;
+  sensorSnapshot.publish(snapshot);
+}
+
 void clearDataLog() {
   for (int i = 0; i < LOG_BUFFER_SIZE; i++) {
     dataLog[i].timestamp = 0;
@@ -1352,23 +3077,28 @@ void clearDataLog() {
     dataLog[i].soilMoisturePercent = 0;
     dataLog[i].pumpActive = false;
     dataLog[i].dailyIrrigations = 0;
+    dataLog[i].tankLevel = -1;
   }
   logIndex = 0;
   logBufferFull = false;
 }
 
 String getSystemStatusJSON() {
-  DynamicJsonDocument doc(1024);
-  
-  doc["timestamp"] = currentTime;
-  doc["temperature"] = systemState.temperature;
-  doc["humidity"] = systemState.humidity;
-  doc["soilMoisture"] = systemState.soilMoisturePercent;
-  doc["soilMoistureRaw"] = systemState.soilMoistureRaw;
-  doc["pumpActive"] = systemState.pumpActive;
-  doc["dailyIrrigations"] = systemState.dailyIrrigations;
-  doc["systemOK"] = systemState.systemOK;
-  doc["wifiConnected"] = systemState.wifiConnected;
+  DynamicJsonDocument doc(4352);
+  SensorSnapshot snapshot = sensorSnapshot.read();
+  
+  doc["timestamp"] = snapshot.timestamp;
+  doc["snapshotGeneration"] = sensorSnapshot.generation();
+  doc["temperature"] = snapshot.temperature;
+  doc["humidity"] = snapshot.humidity;
+  doc["soilMoisture"] = snapshot.soilMoisturePercent;
+  doc["soilMoistureRaw"] = snapshot.soilMoistureRaw;
+  doc["soilHeld"] = snapshot.soilHeld;
+  doc["lightHeld"] = snapshot.lightHeld;
+  doc["pumpActive"] = snapshot.pumpActive;
+  doc["dailyIrrigations"] = snapshot.dailyIrrigations;
+  doc["systemOK"] = snapshot.systemOK;
+  doc["wifiConnected"] = snapshot.wifiConnected;
   doc["sensorErrors"] = systemState.sensorErrors;
   doc["transmissionErrors"] = systemState.transmissionErrors;
   #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
@@ -1388,8 +3118,175 @@ String getSystemStatusJSON() {
   doc["lastTransmissionStatus"] = "DISABLED";
   doc["thingSpeakEnabled"] = false;
   #endif
+  doc["pumpFailsafeTrips"] = pumpFailsafeTrips;
+  JsonObject pumpProtection = doc.createNestedObject("pumpProtection");
+  accruePumpDuty(millis());
+  pumpProtection["shortWindowDuty"] = pumpDutyShort.onMs * 100.0 / PUMP_DUTY_SHORT_WINDOW;
+  pumpProtection["shortWindowLimit"] = PUMP_DUTY_SHORT_MAX;
+  pumpProtection["longWindowDuty"] = pumpDutyLong.onMs * 100.0 / PUMP_DUTY_LONG_WINDOW;
+  pumpProtection["longWindowLimit"] = PUMP_DUTY_LONG_MAX;
+  pumpProtection["relayCycles"] = pumpRelayCycles;
+  pumpProtection["dutyTrips"] = pumpDutyTrips;
+  #if FORECAST_ENABLED
+  JsonObject forecast = doc.createNestedObject("forecast");
+  forecast["valid"] = forecastValid();
+  forecast["expectedRainMm"] = forecastState.expectedTenths / 10.0;
+  forecast["runPercent"] = forecastState.runPercent;
+  forecast["skipping"] = forecastState.skipping;
+  forecast["lastError"] = forecastState.lastError;
+  #endif
+  #if RAIN_DETECTION_ENABLED
+  JsonObject rain = doc.createNestedObject("rain");
+  rain["todayMm"] = snapshot.rainTodayMm;
+  rain["rising"] = rainState.phase == RAIN_RISING;
+  rain["events"] = rainState.events;
+  #endif
+  JsonObject crop = doc.createNestedObject("crop");
+  crop["profile"] = cropState.profile ? cropState.profile->name : "";
+  crop["active"] = cropState.active;
+  if (cropState.active) {
+    crop["stage"] = cropState.profile->stages[cropState.stage].name;
+    crop["day"] = cropState.dayOfSeason;
+    crop["threshold"] = cropState.threshold;
+    crop["kc"] = cropState.kc / 100.0;
+    crop["irrigationSeconds"] = plannedIrrigationSeconds();
+  } else {
+    crop["reason"] = cropState.reason;
+  }
+  JsonObject soilCalibration = doc.createNestedObject("soilCalibration");
+  soilCalibration["enabled"] = SOIL_AUTO_CALIBRATION;
+  soilCalibration["wetRaw"] = soilCal.model.wetRaw;
+  soilCalibration["dryRaw"] = soilCal.model.dryRaw;
+  soilCalibration["targetWetRaw"] = soilCal.targetWetRaw;
+  soilCalibration["targetDryRaw"] = soilCal.targetDryRaw;
+  soilCalibration["confidence"] = soilCal.confidence;
+  soilCalibration["wetPlateaus"] = soilCal.model.wetPlateaus.count;
+  soilCalibration["dryFloors"] = soilCal.model.dryFloors.count;
+  soilCalibration["samples"] = soilCal.model.low.count;
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+  JsonObject soilProbe = doc.createNestedObject("soilProbe");
+  soilProbe["type"] = "frequency";
+  soilProbe["ready"] = freqProbe.ready;
+  soilProbe["windowUs"] = SOIL_FREQ_WINDOW_US;
+  soilProbe["windows"] = freqProbe.windows;
+  soilProbe["noSignal"] = freqProbe.noSignal;
+  JsonArray probeChannels = soilProbe.createNestedArray("channels");
+  for (int i = 0; i < freqProbe.channelCount; i++) {
+    JsonObject channel = probeChannels.createNestedObject();
+    channel["hz"] = freqProbe.lastHz[i];
+    channel["moisture"] = freqProbe.lastMoisture[i] / 100.0;
+  }
+  #endif
+  JsonObject tempComp = doc.createNestedObject("soilTempComp");
+  tempComp["enabled"] = SOIL_TEMP_COMPENSATION;
+  tempComp["source"] = soilTc.source;
+  tempComp["temperature"] = soilTc.temperatureQ4 / 16.0;
+  tempComp["countsPerDegree"] = soilTc.model.coeffQ8 / 256.0;
+  tempComp["nights"] = soilTc.model.nights;
+  tempComp["rawUncorrected"] = soilTc.rawUncorrected;
+  tempComp["correction"] = soilTc.correction;
+  tempComp["maxCycles"] = soilTc.maxCycles;
+  tempComp["lastFit"] = soilTc.lastFitResult;
+  #if SYSLOG_ENABLED
+  JsonObject remoteLogging = doc.createNestedObject("syslog");
+  remoteLogging["sent"] = remoteLog.stats.sent;
+  remoteLogging["sendFailed"] = remoteLog.stats.sendFailed;
+  remoteLogging["poolExhausted"] = remoteLog.stats.poolExhausted;
+  remoteLogging["dropped"] = remoteLog.dropped();
+  #endif
+  JsonObject pollCost = doc.createNestedObject("pollCost");
+  JsonObject httpCost = pollCost.createNestedObject("http");
+  httpCost["requests"] = apiPollCost.requests;
+  httpCost["responseBytes"] = apiPollCost.lastBytes;
+  httpCost["lastCycles"] = apiPollCost.lastCycles;
+  httpCost["avgCycles"] = apiPollCost.requests ? (uint32_t)(apiPollCost.totalCycles / apiPollCost.requests) : 0;
+  httpCost["maxCycles"] = apiPollCost.maxCycles;
+  #if COAP_ENABLED
+  JsonObject coapCost = pollCost.createNestedObject("coap");
+  coapCost["requests"] = coapState.stats.requests;
+  coapCost["requestBytes"] = coapState.stats.lastRequestBytes;
+  coapCost["responseBytes"] = coapState.stats.lastResponseBytes;
+  coapCost["lastCycles"] = coapState.stats.lastCycles;
+  coapCost["avgCycles"] = coapState.stats.requests ? (uint32_t)(coapState.stats.totalCycles / coapState.stats.requests) : 0;
+  coapCost["maxCycles"] = coapState.stats.maxCycles;
+  JsonObject coapServer = doc.createNestedObject("coap");
+  coapServer["started"] = coapState.started;
+  coapServer["observers"] = coapState.observers.count();
+  coapServer["notifications"] = coapState.stats.notifications;
+  coapServer["rejected"] = coapState.stats.rejected;
+  coapServer["duplicates"] = coapState.stats.duplicates;
+  coapServer["observersDropped"] = coapState.stats.observersDropped;
+  coapServer["retransmissions"] = coapState.stats.retransmissions;
+  #endif
+  JsonObject network = doc.createNestedObject("network");
+  network["mode"] = softAp.active ? "access-point" : "station";
+  network["ip"] = networkAddress().toString();
+  if (softAp.active) {
+    network["ssid"] = SOFTAP_SSID;
+    network["clients"] = WiFi.softAPgetStationNum();
+    network["maxClients"] = SOFTAP_MAX_CLIENTS;
+    network["accessPointSeconds"] = (millis() - softAp.startedAt) / 1000;
+  }
+  network["fallbacks"] = softAp.activations;
+  network["probes"] = softAp.probes;
+  network["rejoinFailures"] = softAp.rejoinFailures;
+  network["expiries"] = softAp.expiries;
+  JsonObject zone = doc.createNestedObject("zone");
+  zone["commissioned"] = commissioning.zoneValid;
+  zone["commissioning"] = commissioning.phase;
+  if (commissioning.zoneValid) {
+    zone["deadTimeSeconds"] = commissioning.zone.deadTimeSeconds;
+    zone["gainPerSecond"] = commissioning.zone.gainPerSecond;
+    zone["tauSeconds"] = commissioning.zone.tauSeconds;
+    zone["decayPerHour"] = commissioning.zone.decayPerHour;
+    zone["doseSeconds"] = zoneDoseSeconds();
+    float margin = snapshot.soilMoisturePercent - activeSoilThreshold();
+    if (commissioning.zone.decayPerHour > 0 && margin > 0) {
+      zone["hoursToThreshold"] = margin / commissioning.zone.decayPerHour;
+    }
+  }
+  const char* startBlocked = systemState.pumpActive ? nullptr : pumpStartBlocked(plannedIrrigationSeconds() * 1000UL);
+  if (startBlocked != nullptr) {
+    pumpProtection["startBlocked"] = startBlocked;
+  }
+  #if PUMP_CURRENT_SENSING
+  doc["pumpCurrent"] = pumpCurrentAmps;
+  doc["pumpCurrentTrips"] = pumpCurrentTrips;
+  #endif
+  #if TANK_ENABLED
+  JsonObject tank = doc.createNestedObject("tank");
+  tank["levelPercent"] = tankState.levelPercent;
+  tank["liters"] = tankState.levelPercent < 0 ? 0 : tankState.levelPercent * TANK_CAPACITY_LITERS / 100.0;
+  tank["lockout"] = tankState.lockout;
+  tank["sensorFault"] = tankState.sensorFault;
+  tank["percentPerSecond"] = tankState.percentPerSecond;
+  tank["predictedWaterings"] = predictedWaterings();
+  #endif
+  doc["emergencyStop"] = snapshot.emergencyStop;
+  doc["estopTrips"] = estopTrips;
+  doc["estopGlitches"] = estopGlitches;
+  doc["estopGlitchResumes"] = estopGlitchResumes;
+  doc["estopIsrToRelayOffUs"] = (float)estopIsrToRelayOffCycles / ESP.getCpuFreqMHz();
+  doc["estopLatchLatencyUs"] = estopLatchLatencyUs;
   doc["freeHeap"] = ESP.getFreeHeap();
+  doc["minFreeHeap"] = rtcFaultState.minFreeHeap;
   doc["uptime"] = millis();
+  doc["bootCount"] = lastFault.bootCount;
+  doc["lastResetReason"] = resetReasonName(lastFault.resetReason);
+  
+  JsonArray subsystems = doc.createNestedArray("subsystems");
+  for (int i = 0; i < SUBSYS_COUNT; i++) {
+    if (subsystemPolicies[i].deadlineMs == 0 || (i == SUBSYS_CLOUD && !cloudConfigured())) {
+      continue;
+    }
+    JsonObject entry = subsystems.createNestedObject();
+    entry["name"] = subsystemPolicies[i].name;
+    entry["stalled"] = subsystemHealth[i].stalled;
+    entry["lastCheckInAgeMs"] = millis() - subsystemHealth[i].lastCheckIn;
+    entry["stalls"] = subsystemHealth[i].stalls;
+    entry["restarts"] = subsystemHealth[i].restarts;
+    entry["longestStallMs"] = subsystemHealth[i].longestStallMs;
+  }
   
   String json;
   serializeJson(doc, json);
@@ -1401,6 +3298,11 @@ String getSystemStatusJSON() {
 // =============================================================================
 
 void initializeWatchdog() {
+  // Every subsystem starts with a fresh deadline
+  for (int i = 0; i < SUBSYS_COUNT; i++) {
+    subsystemHealth[i].lastCheckIn = millis();
+  }
+  
   if (WATCHDOG_ENABLED) {
     esp_task_wdt_config_t wdt_config = {
       .timeout_ms = WATCHDOG_TIMEOUT * 1000,
@@ -1408,51 +3310,472 @@ void initializeWatchdog() {
       .trigger_panic = true
     };
     esp_task_wdt_init(&wdt_config);
-    esp_task_wdt_add(NULL);
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Watchdog timer initialized (" + String(WATCHDOG_TIMEOUT) + " seconds)");
-    #endif
   }
+  
+  // Only the supervisor feeds the task watchdog; it in turn watches every subsystem
+  xTaskCreatePinnedToCore(supervisorTask, "supervisor", 3072, nullptr, 2, &supervisorTaskHandle, 1);
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Watchdog timer initialized (" + String(WATCHDOG_TIMEOUT) + " seconds) with subsystem supervisor");
+  #endif
 }
 
-void feedWatchdog() {
+void supervisorTask(void* arg) {
   if (WATCHDOG_ENABLED) {
-    esp_task_wdt_reset();
-    systemState.lastWatchdogFeed = currentTime;
+    esp_task_wdt_add(NULL);
+  }
+  for (;;) {
+    if (WATCHDOG_ENABLED) {
+      esp_task_wdt_reset();
+    }
+    checkSubsystemDeadlines();
+    vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_CHECK_INTERVAL));
   }
 }
 
-void emergencyStop() {
-  #if SERIAL_OUTPUT_ENABLED
-    Serial.println("EMERGENCY STOP ACTIVATED!");
-  #endif
-  
-  // Stop irrigation immediately
-  if (systemState.pumpActive) {
-    stopIrrigation();
+// Called by a subsystem whenever it completes its periodic work
+void supervisorCheckIn(Subsystem subsystem) {
+  subsystemHealth[subsystem].lastCheckIn = millis();
+}
+
+// Runs in the supervisor task: detects missed deadlines and picks the response
+void checkSubsystemDeadlines() {
+  unsigned long now = millis();
+  
+  for (int i = 0; i < SUBSYS_COUNT; i++) {
+    const SubsystemPolicy& policy = subsystemPolicies[i];
+    SubsystemHealth& health = subsystemHealth[i];
+    if (policy.deadlineMs == 0) {
+      continue;
+    }
+    // Only the control loop is expected to keep running during an emergency stop,
+    // and the uploader never checks in while it has no service to talk to
+    if ((systemState.emergencyStop && i != SUBSYS_CONTROL) || (i == SUBSYS_CLOUD && !cloudConfigured())) {
+      health.lastCheckIn = now;
+      continue;
+    }
+    
+    unsigned long lastCheckIn = health.lastCheckIn;
+    bool late = (now - lastCheckIn > policy.deadlineMs);
+    
+    if (!late) {
+      if (health.stalled) {
+        // Recovered: record how long it was out
+        health.stalled = false;
+        health.consecutiveRestarts = 0;
+        health.longestStallMs = max(health.longestStallMs, lastCheckIn - health.stallSince);
+      }
+      continue;
+    }
+    
+    if (!health.stalled) {
+      health.stalled = true;
+      health.stalls++;
+      health.stallSince = lastCheckIn;
+      health.nextRestartAt = now;
+    }
+    health.longestStallMs = max(health.longestStallMs, now - health.stallSince);
+    
+    // Graded response: restart the subsystem (with backoff), reboot only as a last resort
+    if ((long)(now - health.nextRestartAt) < 0 || health.restartRequested) {
+      continue;
+    }
+    if (policy.restart != nullptr && (policy.rebootAfter == 0 || health.consecutiveRestarts < policy.rebootAfter)) {
+      health.restartRequested = true;
+      health.consecutiveRestarts++;
+      unsigned long backoff = policy.deadlineMs;
+      for (int n = 1; n < health.consecutiveRestarts && backoff < 24UL * 3600000UL; n++) {
+        backoff *= SUBSYSTEM_RESTART_BACKOFF;
+      }
+      health.nextRestartAt = now + backoff;
+    } else if (policy.rebootAfter > 0) {
+      markPlannedRestart(FAULT_FLAG_SUPERVISOR);
+      rtcFaultState.stalledSubsystem = i;
+      esp_restart();
+    }
   }
-  
-  // Set emergency stop flag
-  systemState.emergencyStop = true;
-  systemState.systemOK = false;
-  
-  // Display emergency message
+}
+
+// Runs in the loop: performs restarts the supervisor asked for
+void serviceSubsystemRestarts() {
+  for (int i = 0; i < SUBSYS_COUNT; i++) {
+    SubsystemHealth& health = subsystemHealth[i];
+    if (!health.restartRequested) {
+      continue;
+    }
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Supervisor: '" + String(subsystemPolicies[i].name) + "' missed its deadline - restarting (" +
+                     String(health.consecutiveRestarts) + ")");
+    #endif
+    health.restarts++;
+    subsystemPolicies[i].restart();
+    health.restartRequested = false;
+  }
+}
+
+void restartSensors() {
+  sensorValidation.disconnectCount = 0;
+  #if DHT_ENABLED
+    dht.begin();
+  #endif
+  // Read again on the next pass
+  systemState.lastSensorRead = 0;
+}
+
+void restartDisplay() {
   #if DISPLAY_ENABLED
+    lcd.init();
+    lcd.backlight();
     lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("EMERGENCY STOP");
-    lcd.setCursor(0, 1);
-    lcd.print("SYSTEM HALTED");
-  #endif
-  
-  // Turn off all LEDs except red (emergency indicator)
-  digitalWrite(LED_GREEN_PIN, LOW);
-  digitalWrite(LED_BLUE_PIN, LOW);
-  digitalWrite(LED_RED_PIN, HIGH);
-  
-  #if SERIAL_OUTPUT_ENABLED
-    Serial.println("System halted due to emergency stop!");
   #endif
+  systemState.lastDisplayUpdate = 0;
+}
+
+void restartNetwork() {
+  // Non-blocking: checkWiFiConnection() picks up the result
+  WiFi.disconnect();
+  WiFi.begin(runtimeSettings.wifiSsid, runtimeSettings.wifiPassword);
+  wifiReconnectAttempts = 0;
+}
+
+// Empty keys and the "YOUR_..." examples from config.h never authenticate
+bool credentialSet(const char* key) {
+  return key[0] != '\0' && strncmp(key, "YOUR_", 5) != 0;
+}
+
+// True when at least one upload has credentials to send with; the ThingSpeak
+// key can be changed at runtime, so this is checked on every supervisor pass
+bool cloudConfigured() {
+  #if IOT_SERVICES_ENABLED
+    if (THINGSPEAK_ENABLED && credentialSet(runtimeSettings.thingSpeakApiKey)) {
+      return true;
+    }
+    #if ADAFRUIT_IO_ENABLED
+      if (credentialSet(ADAFRUIT_IO_KEY)) {
+        return true;
+      }
+    #endif
+  #endif
+  return false;
+}
+
+void restartCloud() {
+  #if IOT_SERVICES_ENABLED && ADAFRUIT_IO_ENABLED
+    // Leave the client alone while an upload still owns it on the worker
+    if (!coro::scheduler.running("adafruitio")) {
+      coro::scheduler.spawn("aioconnect", adafruitIOConnectFlow());
+    }
+  #endif
+  systemState.transmissionErrors = 0;
+  // Retry the upload on the next pass
+  systemState.lastDataTransmission = 0;
+}
+
+void initializePumpFailsafe() {
+  #if PUMP_FAILSAFE_ENABLED
+    pumpHeartbeatMs = millis();
+    
+    // Layer 1: hardware timer one-shot, re-armed on every pump start
+    pumpFailsafeTimer = timerBegin(1000000);  // 1 MHz tick
+    timerAttachInterrupt(pumpFailsafeTimer, pumpFailsafeTimerISR);
+    timerStop(pumpFailsafeTimer);
+    
+    // Layer 2: heartbeat supervisor running outside the loop task
+    const esp_timer_create_args_t heartbeatArgs = {
+      .callback = pumpHeartbeatCheck,
+      .arg = nullptr,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "pump_hb",
+      .skip_unhandled_events = true
+    };
+    esp_timer_create(&heartbeatArgs, &pumpHeartbeatTimer);
+    esp_timer_start_periodic(pumpHeartbeatTimer, PUMP_HEARTBEAT_CHECK_INTERVAL * 1000ULL);
+    
+    // Layer 3: relay off on software reset (incl. OTA) and on panic (incl. task WDT)
+    esp_register_shutdown_handler(pumpShutdownHandler);
+    set_arduino_panic_handler(pumpPanicHandler, nullptr);
+    
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Pump failsafe armed (heartbeat timeout " + String(PUMP_HEARTBEAT_TIMEOUT / 1000) + " seconds)");
+    #endif
+  #endif
+}
+
+void feedPumpFailsafe() {
+  pumpHeartbeatMs = millis();
+}
+
+void armPumpFailsafe(unsigned long runtimeMs) {
+  #if PUMP_FAILSAFE_ENABLED
+    if (pumpFailsafeTimer == nullptr) {
+      return;
+    }
+    unsigned long deadlineMs = min(runtimeMs + PUMP_FAILSAFE_MARGIN, (unsigned long)MAX_PUMP_RUNTIME);
+    pumpFailsafeReason = FAILSAFE_NONE;
+    timerStop(pumpFailsafeTimer);
+    timerWrite(pumpFailsafeTimer, 0);
+    timerAlarm(pumpFailsafeTimer, deadlineMs * 1000ULL, false, 0);
+    timerStart(pumpFailsafeTimer);
+  #endif
+}
+
+void disarmPumpFailsafe() {
+  #if PUMP_FAILSAFE_ENABLED
+    if (pumpFailsafeTimer != nullptr) {
+      timerStop(pumpFailsafeTimer);
+    }
+  #endif
+}
+
+void IRAM_ATTR markPumpCut() {
+  if (pumpRelayEnergised) {
+    pumpCutAtMs = millis() | 1;     // Never 0, which means "no cut"
+    pumpRelayEnergised = false;
+  }
+}
+
+void IRAM_ATTR pumpFailsafeTimerISR() {
+  relayForceOff();
+  if (pumpRelayEnergised) {
+    markPumpCut();
+    pumpFailsafeReason = FAILSAFE_TIMER;
+  }
+}
+
+void pumpHeartbeatCheck(void* arg) {
+  if (pumpRelayEnergised && millis() - pumpHeartbeatMs >= PUMP_HEARTBEAT_TIMEOUT) {
+    relayForceOff();
+    markPumpCut();
+    pumpFailsafeReason = FAILSAFE_HEARTBEAT;
+  }
+}
+
+void IRAM_ATTR pumpShutdownHandler() {
+  relayForceOff();
+}
+
+void IRAM_ATTR pumpPanicHandler(arduino_panic_info_t* info, void* arg) {
+  relayForceOff();
+}
+
+// Brings systemState back in line after the failsafe cut the relay behind the loop's back
+void checkPumpFailsafe() {
+  if (pumpFailsafeReason == FAILSAFE_NONE) {
+    return;
+  }
+  PumpFailsafeReason reason = pumpFailsafeReason;
+  pumpFailsafeReason = FAILSAFE_NONE;
+  pumpFailsafeTrips++;
+  breadcrumb(CRUMB_PUMP_OFF, reason == FAILSAFE_TIMER ? PUMP_OFF_FAILSAFE_TIMER : PUMP_OFF_FAILSAFE_HEARTBEAT,
+             (millis() - systemState.pumpStartTime) / 1000);
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println(reason == FAILSAFE_TIMER ? "Warning: Pump failsafe timer expired - relay was cut!"
+                                            : "Warning: Control loop heartbeat lost - relay was cut!");
+  #endif
+  
+  if (systemState.pumpActive) {
+    stopIrrigation();
+  }
+}
+
+void initializeEmergencyStop() {
+  if (EMERGENCY_STOP_ENABLED) {
+    pinMode(EMERGENCY_STOP_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(EMERGENCY_STOP_PIN), emergencyStopISR, FALLING);
+    
+    // Button already held at boot: trip straight away
+    if (digitalRead(EMERGENCY_STOP_PIN) == LOW) {
+      emergencyStopISR();
+    }
+    
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Emergency stop input armed on GPIO" + String(EMERGENCY_STOP_PIN));
+    #endif
+  }
+}
+
+// Cuts the relay first, then records the trip for the loop to latch. The cut
+// is repeated under relayMux so a startIrrigation() that checked estopState
+// just before the trip (possibly on the other core) cannot leave it energised.
+void IRAM_ATTR emergencyStopISR() {
+  uint32_t entryCycles = ESP.getCycleCount();
+  relayForceOff();
+  uint32_t relayOffCycles = ESP.getCycleCount() - entryCycles;
+  
+  portENTER_CRITICAL_ISR(&relayMux);
+  relayForceOff();
+  markPumpCut();
+  if (estopState == ESTOP_IDLE) {
+    estopState = ESTOP_PENDING;
+    estopTripMicros = micros();
+    estopIsrToRelayOffCycles = relayOffCycles;
+  }
+  portEXIT_CRITICAL_ISR(&relayMux);
+}
+
+void updateEmergencyStop() {
+  bool inputActive = (digitalRead(EMERGENCY_STOP_PIN) == LOW);
+  
+  switch (estopState) {
+    case ESTOP_IDLE:
+      break;
+      
+    case ESTOP_PENDING:
+      // Debounce on a stable level: any change restarts the window, so a
+      // bounce that happens to be low when the window ends cannot latch, and
+      // a real press that bounces early is not taken for a glitch
+      if (estopLevelSince == 0) {
+        estopLevelActive = true;        // The ISR fired on the falling edge
+        estopLevelSince = estopTripMicros;
+      }
+      if (inputActive != estopLevelActive) {
+        estopLevelActive = inputActive;
+        estopLevelSince = micros();
+      }
+      // A remote trip has no input to settle; it only waits out the window
+      if (micros() - (estopRemoteTrip ? estopTripMicros : estopLevelSince) < EMERGENCY_STOP_DEBOUNCE * 1000UL) {
+        break;
+      }
+      estopLevelSince = 0;
+      if (estopLevelActive || estopRemoteTrip) {
+        estopLatchLatencyUs = micros() - estopTripMicros;
+        estopState = ESTOP_LATCHED;
+        if (systemState.pumpActive) {
+          breadcrumb(CRUMB_PUMP_OFF, PUMP_OFF_ESTOP, (millis() - systemState.pumpStartTime) / 1000);
+        }
+        estopRemoteTrip = false;
+        estopTrips++;
+        estopReleasedSinceLatch = false;
+        estopHoldStart = 0;
+        estopScreenDrawn = false;
+        systemState.emergencyStop = true;
+        systemState.systemOK = false;
+        #if SERIAL_OUTPUT_ENABLED
+          Log.println("EMERGENCY STOP ACTIVATED!");
+          Log.println("Relay cut " + String((float)estopIsrToRelayOffCycles / ESP.getCpuFreqMHz(), 2) +
+                         " us after ISR entry, fault latched after " + String(estopLatchLatencyUs) + " us");
+        #endif
+      } else {
+        // Input settled released: not a real press. The ISR still cut the
+        // relay; a run it interrupted carries on instead of ending here.
+        estopState = ESTOP_IDLE;
+        estopGlitches++;
+        if (systemState.pumpActive && resumePumpAfterGlitch()) {
+          estopGlitchResumes++;
+          #if SERIAL_OUTPUT_ENABLED
+            Log.println("Warning: Emergency stop input glitch - pump resumed");
+          #endif
+          break;
+        }
+      }
+      // The relay was cut behind the loop's back
+      if (systemState.pumpActive) {
+        stopIrrigation();
+      }
+      break;
+      
+    case ESTOP_LATCHED:
+      // Reset gesture on the E-stop button: release it, then hold it down
+      if (!inputActive) {
+        estopReleasedSinceLatch = true;
+        estopHoldStart = 0;
+      } else if (estopReleasedSinceLatch) {
+        if (estopHoldStart == 0) {
+          estopHoldStart = currentTime;
+        } else if (currentTime - estopHoldStart >= EMERGENCY_STOP_RESET_HOLD) {
+          estopReleasedSinceLatch = false;
+          resetEmergencyStop("button");
+        }
+      }
+      break;
+  }
+}
+
+// The e-stop ISR cut the relay for what settled as a glitch: put it back on
+// for the rest of the run. Not after a failsafe cut in the meantime; the
+// failsafe timer armed at the start still bounds the run.
+bool resumePumpAfterGlitch() {
+  if (pumpFailsafeReason != FAILSAFE_NONE || pumpCurrentFault != CURRENT_OK || bus::rejected > 0) {
+    return false;
+  }
+  accruePumpDuty(millis());             // On-time up to the cut
+  portENTER_CRITICAL(&relayMux);
+  bool resumed = (estopState == ESTOP_IDLE);
+  if (resumed) {
+    digitalWrite(RELAY_PIN, HIGH);
+    pumpRelayEnergised = true;
+    pumpCutAtMs = 0;
+  }
+  portEXIT_CRITICAL(&relayMux);
+  if (resumed) {
+    pumpRelayCycles++;
+    rtcPumpCycles.cycles = pumpRelayCycles;
+    #if PUMP_CURRENT_SENSING
+      if (currentSenseTaskHandle != nullptr) {
+        xTaskNotifyGive(currentSenseTaskHandle);
+      }
+    #endif
+  }
+  return resumed;
+}
+
+bool resetEmergencyStop(const char* source) {
+  if (estopState != ESTOP_LATCHED) {
+    return true;
+  }
+  
+  // A held or latching switch must be released first (the hold gesture is the exception)
+  if (digitalRead(EMERGENCY_STOP_PIN) == LOW && strcmp(source, "button") != 0) {
+    return false;
+  }
+  
+  estopState = ESTOP_IDLE;
+  systemState.emergencyStop = false;
+  systemState.systemOK = true;
+  systemState.lastDisplayUpdate = 0;
+  
+  #if DISPLAY_ENABLED
+    lcd.clear();
+  #endif
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Emergency stop reset via " + String(source));
+  #endif
+  return true;
+}
+
+// Shows the latched fault; called every loop pass but only draws once per latch
+void emergencyStop() {
+  #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+    // The menu stays usable for the reset action; repaint once it closes
+    if (systemState.inMenuMode) {
+      estopScreenDrawn = false;
+      return;
+    }
+  #endif
+  
+  if (estopScreenDrawn) {
+    return;
+  }
+  estopScreenDrawn = true;
+  
+  // LEDs switch straight away, the halt screen is drawn by the display subscriber
+  bus::publish(EmergencyStopEvent{estopTrips});
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("System halted due to emergency stop!");
+  #endif
+}
+
+bool requireWebAuth() {
+  #if ENABLE_WEB_AUTH
+    if (!server.authenticate(WEB_USERNAME, WEB_PASSWORD)) {
+      server.requestAuthentication();
+      return false;
+    }
+  #endif
+  return true;
 }
 
 void validateSensorReadings(float temperature, float humidity, int soilMoisture, int lightLevel) {
@@ -1468,23 +3791,29 @@ void validateSensorReadings(float temperature, float humidity, int soilMoisture,
   // Validate light level
   sensorValidation.lightLevelValid = isSensorReadingValid(lightLevel, MIN_LIGHT_LEVEL, MAX_LIGHT_LEVEL, LIGHT_VALIDATION);
   
+  // Held values (ADC busy) repeat the last real reading: they neither trip the
+  // change checks nor go into the history, or the first real reading after a
+  // long pump run would be compared against copies of itself
+  bool soilHeld = systemState.soilHeld;
+  bool lightHeld = systemState.lightHeld;
+  
   // Check for sudden changes in soil moisture
-  if (SOIL_MOISTURE_VALIDATION && sensorValidation.soilMoistureValid) {
+  if (SOIL_MOISTURE_VALIDATION && sensorValidation.soilMoistureValid && !soilHeld) {
     int change = abs(soilMoisture - sensorValidation.lastSoilMoisture);
     if (change > MAX_SOIL_MOISTURE_CHANGE) {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("Warning: Sudden soil moisture change detected: " + String(change) + "%");
+        Log.println("Warning: Sudden soil moisture change detected: " + String(change) + "%");
       #endif
       sensorValidation.soilMoistureValid = false;
     }
   }
   
   // Check for sudden changes in light level
-  if (LIGHT_VALIDATION && sensorValidation.lightLevelValid) {
+  if (LIGHT_VALIDATION && sensorValidation.lightLevelValid && !lightHeld) {
     int change = abs(lightLevel - sensorValidation.lastLightLevel);
     if (change > MAX_LIGHT_CHANGE) {
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("Warning: Sudden light level change detected: " + String(change) + "%");
+        Log.println("Warning: Sudden light level change detected: " + String(change) + "%");
       #endif
       sensorValidation.lightLevelValid = false;
     }
@@ -1494,97 +3823,4141 @@ void validateSensorReadings(float temperature, float humidity, int soilMoisture,
   if (CONSISTENCY_VALIDATION) {
     sensorValidation.temperatureValid &= checkSensorConsistency(sensorValidation.temperatureReadings, (int)(temperature * 10));
     sensorValidation.humidityValid &= checkSensorConsistency(sensorValidation.humidityReadings, (int)(humidity * 10));
-    sensorValidation.soilMoistureValid &= checkSensorConsistency(sensorValidation.soilMoistureReadings, soilMoisture);
-    sensorValidation.lightLevelValid &= checkSensorConsistency(sensorValidation.lightLevelReadings, lightLevel);
+    if (!soilHeld) {
+      sensorValidation.soilMoistureValid &= checkSensorConsistency(sensorValidation.soilMoistureReadings, soilMoisture);
+    }
+    if (!lightHeld) {
+      sensorValidation.lightLevelValid &= checkSensorConsistency(sensorValidation.lightLevelReadings, lightLevel);
+    }
   }
   
   // Update last readings
   sensorValidation.lastTemperature = temperature;
   sensorValidation.lastHumidity = humidity;
-  sensorValidation.lastSoilMoisture = soilMoisture;
-  sensorValidation.lastLightLevel = lightLevel;
+  if (!soilHeld) {
+    sensorValidation.lastSoilMoisture = soilMoisture;
+  }
+  if (!lightHeld) {
+    sensorValidation.lastLightLevel = lightLevel;
+  }
+  
+  // Update reading arrays for consistency checking
+  sensorValidation.temperatureReadings[sensorValidation.readingIndex] = (int)(temperature * 10);
+  sensorValidation.humidityReadings[sensorValidation.readingIndex] = (int)(humidity * 10);
+  if (!soilHeld) {
+    sensorValidation.soilMoistureReadings[sensorValidation.readingIndex] = soilMoisture;
+  }
+  if (!lightHeld) {
+    sensorValidation.lightLevelReadings[sensorValidation.readingIndex] = lightLevel;
+  }
+  sensorValidation.readingIndex = (sensorValidation.readingIndex + 1) % SENSOR_CONSISTENCY_CHECKS;
+}
+
+bool isSensorReadingValid(float value, float minVal, float maxVal, bool enabled) {
+  if (!enabled) return true;
+  return (value >= minVal && value <= maxVal);
+}
+
+bool checkSensorConsistency(int readings[], int newReading) {
+  // Calculate average of previous readings
+  int sum = 0;
+  for (int i = 0; i < SENSOR_CONSISTENCY_CHECKS; i++) {
+    sum += readings[i];
+  }
+  int average = sum / SENSOR_CONSISTENCY_CHECKS;
+  
+  // Check if new reading is within threshold
+  int deviation = abs(newReading - average);
+  return (deviation <= SENSOR_CONSISTENCY_THRESHOLD);
+}
+
+void attemptSystemRecovery() {
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Attempting system recovery...");
+  #endif
+  
+  systemState.recoveryAttempts++;
+  
+  // Reset sensor validation
+  sensorValidation.temperatureValid = true;
+  sensorValidation.humidityValid = true;
+  sensorValidation.soilMoistureValid = true;
+  sensorValidation.lightLevelValid = true;
+  sensorValidation.disconnectCount = 0;
+  
+  // Reset error counters
+  systemState.sensorErrors = 0;
+  
+  // Reinitialize sensors
+  dht.begin();
+  delay(2000);
+  
+  // Test sensor readings
+  float testTemp = dht.readTemperature();
+  float testHumidity = dht.readHumidity();
+  
+  if (!isnan(testTemp) && !isnan(testHumidity)) {
+    systemState.systemOK = true;
+    systemState.recoveryAttempts = 0;
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("System recovery successful!");
+    #endif
+  } else {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("System recovery failed. Attempt " + String(systemState.recoveryAttempts) + "/" + String(RECOVERY_ATTEMPTS));
+    #endif
+    delay(RECOVERY_DELAY);
+  }
+}
+
+void checkPumpRuntime() {
+  if (systemState.pumpActive && (currentTime - systemState.pumpStartTime >= MAX_PUMP_RUNTIME)) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Warning: Maximum pump runtime exceeded! Stopping irrigation for safety.");
+    #endif
+    stopIrrigation(PUMP_OFF_RUNTIME);
+    
+    // Display warning on LCD
+    #if DISPLAY_ENABLED
+      lcd.clear();
+      lcd.setCursor(0, 0);
+      lcd.print("PUMP TIMEOUT");
+      lcd.setCursor(0, 1);
+      lcd.print("SAFETY STOP");
+    #endif
+  }
+}
+
+// =============================================================================
+// PUMP PROTECTION FUNCTIONS
+// =============================================================================
+
+void initializePumpProtection() {
+  pumpPrefs.begin("pump", false);
+  pumpRelayCycles = pumpPrefs.getUInt("cycles", 0);
+  pumpCyclesSaved = pumpRelayCycles;
+  
+  // A soft reset keeps the RTC copy, which includes the starts not saved yet
+  if (rtcPumpCycles.magic == PUMP_CYCLES_RTC_MAGIC && rtcPumpCycles.cycles > pumpRelayCycles &&
+      rtcPumpCycles.cycles - pumpRelayCycles < PUMP_CYCLES_SAVE_EVERY) {
+    pumpRelayCycles = rtcPumpCycles.cycles;
+  }
+  rtcPumpCycles.magic = PUMP_CYCLES_RTC_MAGIC;
+  rtcPumpCycles.cycles = pumpRelayCycles;
+  
+  unsigned long now = millis();
+  pumpDutyShort.bucketStart = now;
+  pumpDutyLong.bucketStart = now;
+  pumpDutyAccruedAt = now;
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Pump protection ready - " + String(pumpRelayCycles) + " relay cycles so far");
+  #endif
+}
+
+// Flash wear: the count reaches NVS in batches, the RTC copy covers resets in between
+void savePumpCycles() {
+  pumpPrefs.putUInt("cycles", pumpRelayCycles);
+  pumpCyclesSaved = pumpRelayCycles;
+}
+
+// Expires the buckets that have fallen out of the window. Each call does
+// at most one pass over the buckets however long the pump has been idle.
+void advanceDutyWindow(DutyWindow& window, unsigned long now) {
+  for (int expired = 0; now - window.bucketStart >= window.bucketMs; expired++) {
+    if (expired == PUMP_DUTY_BUCKETS) {
+      // Every bucket has been cleared: the whole window is idle
+      window.bucketStart = now;
+      break;
+    }
+    window.bucketStart += window.bucketMs;
+    window.index = (window.index + 1) % PUMP_DUTY_BUCKETS;
+    window.onMs -= window.buckets[window.index];
+    window.buckets[window.index] = 0;
+  }
+}
+
+// Adds the pump on-time since the last call to both windows. Called every
+// loop pass and on each relay edge, so a slice never spans more than a pass.
+void accruePumpDuty(unsigned long now) {
+  // After a cut the relay was on until pumpCutAtMs, not until now
+  unsigned long cutAt = pumpCutAtMs;
+  unsigned long onMs = 0;
+  if (pumpRelayEnergised) {
+    onMs = now - pumpDutyAccruedAt;
+  } else if (cutAt != 0 && (long)(cutAt - pumpDutyAccruedAt) > 0) {
+    onMs = cutAt - pumpDutyAccruedAt;
+  }
+  pumpDutyAccruedAt = now;
+  
+  advanceDutyWindow(pumpDutyShort, now);
+  advanceDutyWindow(pumpDutyLong, now);
+  pumpDutyShort.buckets[pumpDutyShort.index] += onMs;
+  pumpDutyShort.onMs += onMs;
+  pumpDutyLong.buckets[pumpDutyLong.index] += onMs;
+  pumpDutyLong.onMs += onMs;
+}
+
+// Returns why a run of plannedMs may not start now, or nullptr if it may
+const char* pumpStartBlocked(unsigned long plannedMs) {
+  // Never energise the relay while an emergency stop is pending or latched
+  if (estopState != ESTOP_IDLE) {
+    return "emergency stop active";
+  }
+  
+  if (bus::rejected > 0) {
+    return "event bus misconfigured";
+  }
+  
+  #if PUMP_FAILSAFE_ENABLED
+    // Relay enable is gated on a live control loop heartbeat
+    if (millis() - pumpHeartbeatMs >= PUMP_HEARTBEAT_TIMEOUT) {
+      return "control loop heartbeat is stale";
+    }
+  #endif
+  
+  if (systemState.pumpActive) {
+    return "pump already running";
+  }
+  
+  #if TANK_ENABLED
+    // Never run the pump dry
+    if (tankState.lockout) {
+      if (tankState.sensorFault) {
+        return "tank level sensor fault";
+      }
+      return tankState.levelPercent < 0 ? "tank level unknown" : "water tank low";
+    }
+  #endif
+  
+  #if PUMP_DUTY_PROTECTION
+    unsigned long now = millis();
+    if (pumpHasRun && now - pumpLastStopTime < PUMP_MIN_OFF_TIME) {
+      return "pump minimum off-time";
+    }
+    accruePumpDuty(now);
+    if (pumpDutyShort.onMs + plannedMs > pumpDutyShort.limitMs) {
+      return "short-window duty limit";
+    }
+    if (pumpDutyLong.onMs + plannedMs > pumpDutyLong.limitMs) {
+      return "long-window duty limit";
+    }
+  #endif
+  
+  return nullptr;
+}
+
+void checkPumpDuty() {
+  accruePumpDuty(millis());
+  
+  #if PUMP_DUTY_PROTECTION
+    if (systemState.pumpActive &&
+        (pumpDutyShort.onMs >= pumpDutyShort.limitMs || pumpDutyLong.onMs >= pumpDutyLong.limitMs)) {
+      pumpDutyTrips++;
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Warning: Pump duty-cycle limit reached! Stopping irrigation to let the pump cool.");
+      #endif
+      stopIrrigation(PUMP_OFF_DUTY);
+    }
+  #endif
+}
+
+// =============================================================================
+// WATER TANK FUNCTIONS
+// =============================================================================
+
+void initializeTank() {
+  #if TANK_SENSOR_TYPE == TANK_ULTRASONIC
+    pinMode(TANK_TRIG_PIN, OUTPUT);
+    digitalWrite(TANK_TRIG_PIN, LOW);
+    pinMode(TANK_ECHO_PIN, INPUT);
+    attachInterrupt(digitalPinToInterrupt(TANK_ECHO_PIN), tankEchoISR, CHANGE);
+    
+    // Learned draw rate survives reboots so predictions are available at once
+    tankState.percentPerSecond = pumpPrefs.getFloat("tankRate", 0);
+  #elif TANK_SENSOR_TYPE == TANK_FLOAT
+    pinMode(TANK_FLOAT_PIN, INPUT_PULLUP);
+  #endif
+  
+  #if SERIAL_OUTPUT_ENABLED && TANK_ENABLED
+    Log.println(TANK_SENSOR_TYPE == TANK_ULTRASONIC ? "Water tank: ultrasonic level sensor" : "Water tank: float switch");
+  #endif
+}
+
+// Times the echo pulse. The loop sends the trigger and collects the width
+// on its next pass, so nothing ever waits for the echo.
+void IRAM_ATTR tankEchoISR() {
+  #if TANK_SENSOR_TYPE == TANK_ULTRASONIC
+    unsigned long now = micros();
+    if ((GPIO.in >> TANK_ECHO_PIN) & 1) {
+      tankEchoStart = now;
+    } else if (tankEchoStart != 0) {
+      tankEchoWidth = now - tankEchoStart;
+      tankEchoStart = 0;
+      tankEchoReady = true;
+    }
+  #endif
+}
+
+// Takes one raw reading; false when the sensor did not answer
+bool readTankSample(float& levelPercent) {
+  #if TANK_SENSOR_TYPE == TANK_ULTRASONIC
+    // Collect the echo of the previous ping, then send the next one
+    bool answered = tankEchoReady && tankEchoWidth < TANK_ECHO_TIMEOUT_US;
+    float distanceCm = tankEchoWidth / 58.0;
+    
+    tankEchoReady = false;
+    tankEchoStart = 0;
+    digitalWrite(TANK_TRIG_PIN, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(TANK_TRIG_PIN, LOW);
+    
+    if (!answered) {
+      return false;
+    }
+    levelPercent = (TANK_EMPTY_DISTANCE_CM - distanceCm) * 100.0 / (TANK_EMPTY_DISTANCE_CM - TANK_FULL_DISTANCE_CM);
+    levelPercent = constrain(levelPercent, 0.0f, 100.0f);
+    return true;
+  #elif TANK_SENSOR_TYPE == TANK_FLOAT
+    bool waterAbove = (digitalRead(TANK_FLOAT_PIN) == (TANK_FLOAT_ACTIVE_LOW ? LOW : HIGH));
+    levelPercent = waterAbove ? 100 : 0;
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+// Median of the filter window: rejects ripples and stray echoes, and
+// debounces the float switch
+float tankMedianLevel() {
+  float sorted[TANK_MEDIAN_SAMPLES];
+  int count = tankState.sampleCount;
+  for (int i = 0; i < count; i++) {
+    float value = tankState.samples[i];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > value) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  return sorted[count / 2];
+}
+
+void updateTankLevel() {
+  #if TANK_ENABLED
+    float sample;
+    if (readTankSample(sample)) {
+      tankState.samples[tankState.sampleIndex] = sample;
+      tankState.sampleIndex = (tankState.sampleIndex + 1) % TANK_MEDIAN_SAMPLES;
+      if (tankState.sampleCount < TANK_MEDIAN_SAMPLES) {
+        tankState.sampleCount++;
+      }
+      tankState.levelPercent = tankMedianLevel();
+      tankState.consecutiveFailures = 0;
+      tankState.sensorFault = false;
+    } else if (++tankState.consecutiveFailures >= TANK_SENSOR_FAILURES && !tankState.sensorFault) {
+      tankState.sensorFault = true;
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Warning: Water tank level sensor not responding!");
+      #endif
+    }
+    
+    // Dry-run lockout with hysteresis so a rippling surface cannot chatter the pump
+    bool wasLocked = tankState.lockout;
+    if (tankState.sensorFault || tankState.levelPercent < 0 || tankState.levelPercent < TANK_MIN_LEVEL) {
+      tankState.lockout = true;
+    } else if (tankState.levelPercent >= TANK_MIN_LEVEL + TANK_LOCKOUT_HYSTERESIS || TANK_SENSOR_TYPE == TANK_FLOAT) {
+      tankState.lockout = false;
+    }
+    
+    if (tankState.lockout != wasLocked) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println(tankState.lockout ? "Water tank low - irrigation locked out" : "Water tank refilled - irrigation allowed");
+      #endif
+    }
+    if (tankState.lockout && systemState.pumpActive) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Warning: Water tank ran low during irrigation! Stopping pump.");
+      #endif
+      stopIrrigation(PUMP_OFF_TANK_LOW);
+    }
+    
+    // Learn how much each second of pumping draws from the tank
+    #if TANK_SENSOR_TYPE == TANK_ULTRASONIC
+      if (tankState.drawRunMs > 0 && millis() - tankState.drawStoppedAt >= TANK_SETTLE_TIME) {
+        float drop = tankState.levelAtPumpStart - tankState.levelPercent;
+        if (drop > 0) {
+          float rate = drop * 1000.0 / tankState.drawRunMs;
+          tankState.percentPerSecond = tankState.percentPerSecond > 0 ? 0.7 * tankState.percentPerSecond + 0.3 * rate : rate;
+          pumpPrefs.putFloat("tankRate", tankState.percentPerSecond);
+        }
+        tankState.drawRunMs = 0;
+      }
+    #endif
+  #endif
+}
+
+// Waterings of the current duration left above the lockout level, -1 when
+// the sensor cannot tell (float switch, or no pump run measured yet)
+int predictedWaterings() {
+  if (TANK_SENSOR_TYPE != TANK_ULTRASONIC || tankState.percentPerSecond <= 0 || tankState.levelPercent < 0) {
+    return -1;
+  }
+  float perWatering = tankState.percentPerSecond * plannedIrrigationSeconds();
+  return max(0, (int)((tankState.levelPercent - TANK_MIN_LEVEL) / perWatering));
+}
+
+// =============================================================================
+// PUMP CURRENT FUNCTIONS
+// =============================================================================
+
+/*
+ * The current sensor is sampled by the ADC DMA engine while the pump runs
+ * and for a short while after every stop. A dedicated task turns each
+ * CURRENT_WINDOW_MS window into an RMS value and cuts the relay itself on a
+ * fault, so detection does not wait for a slow loop pass; checkPumpCurrent()
+ * then does the bookkeeping, like checkPumpFailsafe().
+ */
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+  #define CURRENT_ADC_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+  #define CURRENT_ADC_DATA(sample) ((sample)->type1.data)
+  #define CURRENT_ADC_CHANNEL(sample) ((sample)->type1.channel)
+#else
+  #define CURRENT_ADC_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+  #define CURRENT_ADC_DATA(sample) ((sample)->type2.data)
+  #define CURRENT_ADC_CHANNEL(sample) ((sample)->type2.channel)
+#endif
+#define CURRENT_FRAME_SAMPLES 256
+
+void initializePumpCurrent() {
+  #if PUMP_CURRENT_SENSING
+    adc_unit_t unit;
+    adc_channel_t channel;
+    if (adc_continuous_io_to_channel(PUMP_CURRENT_PIN, &unit, &channel) != ESP_OK || unit != ADC_UNIT_1) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Error: PUMP_CURRENT_PIN is not an ADC1 pin - current sensing disabled");
+      #endif
+      return;
+    }
+    
+    adc_continuous_handle_cfg_t handleConfig = {};
+    handleConfig.max_store_buf_size = CURRENT_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES * 4;
+    handleConfig.conv_frame_size = CURRENT_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES;
+    
+    adc_digi_pattern_config_t patterns[2] = {};
+    patterns[0].atten = ADC_ATTEN_DB_12;
+    patterns[0].channel = channel;
+    patterns[0].unit = unit;
+    patterns[0].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    int patternCount = 1;
+    
+    // The analog soil probe rides along in the DMA stream, so the soil can
+    // still be read while the sampler owns the ADC (commissioning needs it)
+    #if SOIL_PROBE_TYPE == SOIL_PROBE_ANALOG
+      adc_unit_t soilUnit;
+      adc_channel_t soilChannel;
+      if (adc_continuous_io_to_channel(SOIL_MOISTURE_PIN, &soilUnit, &soilChannel) == ESP_OK && soilUnit == ADC_UNIT_1) {
+        patterns[1] = patterns[0];
+        patterns[1].channel = soilChannel;
+        soilAdcChannel = soilChannel;
+        patternCount = 2;
+      }
+    #endif
+    
+    adc_continuous_config_t adcConfig = {};
+    adcConfig.pattern_num = patternCount;
+    adcConfig.adc_pattern = patterns;
+    adcConfig.sample_freq_hz = CURRENT_SAMPLE_RATE;
+    adcConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    adcConfig.format = CURRENT_ADC_FORMAT;
+    
+    if (adc_continuous_new_handle(&handleConfig, &currentAdc) != ESP_OK ||
+        adc_continuous_config(currentAdc, &adcConfig) != ESP_OK) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Error: ADC DMA setup failed - current sensing disabled");
+      #endif
+      return;
+    }
+    
+    #if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+      adc_cali_line_fitting_config_t caliConfig = {};
+      caliConfig.unit_id = unit;
+      caliConfig.atten = ADC_ATTEN_DB_12;
+      caliConfig.bitwidth = ADC_BITWIDTH_DEFAULT;
+      if (adc_cali_create_scheme_line_fitting(&caliConfig, &currentAdcCali) != ESP_OK) {
+        currentAdcCali = nullptr;
+      }
+    #endif
+    
+    adcMutex = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(currentSenseTask, "pumpCurrent", 4096, nullptr, 3, &currentSenseTaskHandle, 0);
+    
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Pump current sensing on GPIO" + String(PUMP_CURRENT_PIN) + " at " + String(CURRENT_SAMPLE_RATE) + " Hz");
+    #endif
+  #endif
+}
+
+// Analog sensors share ADC1 with the DMA sampler; readers skip a pass
+// rather than wait while it is busy
+bool acquireAnalogInputs() {
+  #if PUMP_CURRENT_SENSING
+    return adcMutex == nullptr || xSemaphoreTake(adcMutex, 0) == pdTRUE;
+  #else
+    return true;
+  #endif
+}
+
+void releaseAnalogInputs() {
+  #if PUMP_CURRENT_SENSING
+    if (adcMutex != nullptr) {
+      xSemaphoreGive(adcMutex);
+    }
+  #endif
+}
+
+// Soil reading from the DMA stream, for use while the sampler owns the ADC;
+// false unless one was published within the last few windows
+bool readStreamedSoil(int& raw) {
+  #if PUMP_CURRENT_SENSING
+    portENTER_CRITICAL(&currentMux);
+    unsigned long at = streamSoilAtMs;
+    int value = streamSoilRaw;
+    portEXIT_CRITICAL(&currentMux);
+    if (!pumpCurrentSampling || at == 0 || millis() - at > 3 * CURRENT_WINDOW_MS) {
+      return false;
+    }
+    raw = value;
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+void currentSenseTask(void* arg) {
+  #if PUMP_CURRENT_SENSING
+    static uint8_t frame[CURRENT_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+    // The sample rate is shared between the channels in the pattern
+    const uint32_t windowSamples = (uint32_t)CURRENT_SAMPLE_RATE * CURRENT_WINDOW_MS / 1000 / (soilAdcChannel >= 0 ? 2 : 1);
+    double sumSquares = 0;
+    uint32_t samples = 0;
+    uint32_t soilSum = 0;
+    uint32_t soilSamples = 0;
+    
+    for (;;) {
+      bool wanted = pumpRelayEnergised || currentRunActive || (long)(currentCheckUntil - millis()) > 0;
+      if (!wanted) {
+        if (pumpCurrentSampling) {
+          adc_continuous_stop(currentAdc);
+          pumpCurrentSampling = false;
+          xSemaphoreGive(adcMutex);
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CURRENT_WINDOW_MS));
+        continue;
+      }
+      
+      if (!pumpCurrentSampling) {
+        xSemaphoreTake(adcMutex, portMAX_DELAY);
+        adc_continuous_start(currentAdc);
+        pumpCurrentSampling = true;
+        sumSquares = 0;
+        samples = 0;
+        soilSum = 0;
+        soilSamples = 0;
+      }
+      
+      uint32_t length = 0;
+      if (adc_continuous_read(currentAdc, frame, sizeof(frame), &length, CURRENT_WINDOW_MS) != ESP_OK) {
+        continue;
+      }
+      for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        adc_digi_output_data_t* sample = (adc_digi_output_data_t*)&frame[i];
+        int raw = CURRENT_ADC_DATA(sample);
+        if ((int)CURRENT_ADC_CHANNEL(sample) == soilAdcChannel) {
+          soilSum += raw;
+          soilSamples++;
+          continue;
+        }
+        int millivolts = raw * 3100 / 4095;
+        if (currentAdcCali != nullptr) {
+          adc_cali_raw_to_voltage(currentAdcCali, raw, &millivolts);
+        }
+        // RMS around the sensor's zero point covers both DC and AC pumps
+        double amps = (double)(millivolts - CURRENT_SENSOR_ZERO_MV) / CURRENT_SENSOR_MV_PER_AMP;
+        sumSquares += amps * amps;
+        if (++samples >= windowSamples) {
+          evaluateCurrentWindow(sqrt(sumSquares / samples));
+          sumSquares = 0;
+          samples = 0;
+          if (soilSamples > 0) {
+            portENTER_CRITICAL(&currentMux);
+            streamSoilRaw = soilSum / soilSamples;
+            streamSoilAtMs = millis();
+            portEXIT_CRITICAL(&currentMux);
+            soilSum = 0;
+            soilSamples = 0;
+          }
+        }
+      }
+    }
+  #else
+    vTaskDelete(nullptr);
+  #endif
+}
+
+// Runs in the sampler task once per window
+void evaluateCurrentWindow(float amps) {
+  static CurrentSignature run;
+  static bool skipWindow = false;   // First window after a relay edge mixes both states
+  static int lowWindows = 0;
+  static int highWindows = 0;
+  static int offWindows = 0;
+  static float sumAfterInrush = 0;
+  static int windowsAfterInrush = 0;
+  unsigned long now = millis();
+  
+  pumpCurrentAmps = amps;
+  
+  if (pumpRelayEnergised) {
+    if (!currentRunActive) {
+      run = {};
+      run.startMs = now;
+      run.minAmps = PUMP_MAX_CURRENT * 10;
+      currentRunActive = true;
+      lowWindows = 0;
+      highWindows = 0;
+      sumAfterInrush = 0;
+      windowsAfterInrush = 0;
+    }
+    
+    if (now - run.startMs < PUMP_INRUSH_MS) {
+      run.inrushAmps = max(run.inrushAmps, amps);
+      return;
+    }
+    run.minAmps = min(run.minAmps, amps);
+    run.maxAmps = max(run.maxAmps, amps);
+    sumAfterInrush += amps;
+    windowsAfterInrush++;
+    
+    lowWindows = (amps < PUMP_MIN_CURRENT) ? lowWindows + 1 : 0;
+    highWindows = (amps > PUMP_MAX_CURRENT) ? highWindows + 1 : 0;
+    if (lowWindows >= CURRENT_FAULT_WINDOWS) {
+      run.fault = CURRENT_DRY_RUN;
+      tripPumpCurrent(CURRENT_DRY_RUN);
+    } else if (highWindows >= CURRENT_FAULT_WINDOWS) {
+      run.fault = CURRENT_STALL;
+      tripPumpCurrent(CURRENT_STALL);
+    }
+    return;
+  }
+  
+  if (currentRunActive) {
+    // Relay just released: file the run and watch for current that should not be there
+    run.durationMs = now - run.startMs;
+    run.meanAmps = windowsAfterInrush > 0 ? sumAfterInrush / windowsAfterInrush : 0;
+    if (windowsAfterInrush == 0) {
+      run.minAmps = 0;
+    }
+    portENTER_CRITICAL(&currentMux);
+    currentSignatures[currentSignatureTotal % CURRENT_SIGNATURE_COUNT] = run;
+    currentSignatureTotal++;
+    portEXIT_CRITICAL(&currentMux);
+    currentRunActive = false;
+    skipWindow = true;
+    offWindows = 0;
+    currentCheckUntil = now + CURRENT_WELD_CHECK_MS;
+    return;
+  }
+  
+  if (skipWindow) {
+    skipWindow = false;
+    return;
+  }
+  offWindows = (amps > PUMP_IDLE_CURRENT) ? offWindows + 1 : 0;
+  if (offWindows >= CURRENT_FAULT_WINDOWS) {
+    offWindows = 0;
+    tripPumpCurrent(CURRENT_WELDED);
+  }
+}
+
+void tripPumpCurrent(PumpCurrentFault fault) {
+  relayForceOff();
+  markPumpCut();
+  if (pumpCurrentFault == CURRENT_OK) {
+    pumpCurrentFault = fault;
+  }
+}
+
+void checkPumpCurrent() {
+  #if PUMP_CURRENT_SENSING
+    if (currentSenseTaskHandle == nullptr) {
+      return;
+    }
+    
+    // A welded relay can only be seen while the pump is meant to be off
+    if (!pumpRelayEnergised && currentTime - lastWeldCheck >= WELD_CHECK_INTERVAL) {
+      lastWeldCheck = currentTime;
+      currentCheckUntil = millis() + CURRENT_WELD_CHECK_MS;
+      xTaskNotifyGive(currentSenseTaskHandle);
+    }
+    
+    #if SERIAL_OUTPUT_ENABLED
+      if (currentSignaturePrinted != currentSignatureTotal) {
+        CurrentSignature last;
+        portENTER_CRITICAL(&currentMux);
+        last = currentSignatures[(currentSignatureTotal - 1) % CURRENT_SIGNATURE_COUNT];
+        currentSignaturePrinted = currentSignatureTotal;
+        portEXIT_CRITICAL(&currentMux);
+        Log.println("Pump current: inrush " + String(last.inrushAmps, 2) + "A, mean " + String(last.meanAmps, 2) +
+                       "A (" + String(last.minAmps, 2) + "-" + String(last.maxAmps, 2) + "A) over " +
+                       String(last.durationMs / 1000.0, 1) + "s" +
+                       String(last.fault != CURRENT_OK ? " - " + String(pumpCurrentFaultNames[last.fault]) : ""));
+      }
+    #endif
+    
+    if (pumpCurrentFault == CURRENT_OK) {
+      return;
+    }
+    PumpCurrentFault fault = pumpCurrentFault;
+    pumpCurrentFault = CURRENT_OK;
+    pumpCurrentTrips++;
+    
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Warning: Pump current fault (" + String(pumpCurrentFaultNames[fault]) + ") - " +
+                     String(pumpCurrentAmps, 2) + "A. Latching emergency stop!");
+    #endif
+    
+    if (systemState.pumpActive) {
+      // The sampler already cut the relay, so stopIrrigation() will not log the cause
+      breadcrumb(CRUMB_PUMP_OFF, PUMP_OFF_CURRENT, (millis() - systemState.pumpStartTime) / 1000);
+      stopIrrigation(PUMP_OFF_CURRENT);
+    }
+    
+    // Dry run, stall and a welded relay all need a person to look at the pump
+    estopRemoteTrip = true;
+    emergencyStopISR();
+  #endif
+}
+
+void handleCurrent() {
+  DynamicJsonDocument doc(3072);
+  doc["amps"] = pumpCurrentAmps;
+  doc["sampling"] = (bool)pumpCurrentSampling;
+  doc["trips"] = pumpCurrentTrips;
+  
+  // Newest first
+  JsonArray runs = doc.createNestedArray("irrigations");
+  portENTER_CRITICAL(&currentMux);
+  uint32_t total = currentSignatureTotal;
+  CurrentSignature signatures[CURRENT_SIGNATURE_COUNT];
+  memcpy(signatures, currentSignatures, sizeof(signatures));
+  portEXIT_CRITICAL(&currentMux);
+  
+  for (uint32_t i = 1; i <= min(total, (uint32_t)CURRENT_SIGNATURE_COUNT); i++) {
+    const CurrentSignature& run = signatures[(total - i) % CURRENT_SIGNATURE_COUNT];
+    JsonObject entry = runs.createNestedObject();
+    entry["startMs"] = run.startMs;
+    entry["durationMs"] = run.durationMs;
+    entry["inrushAmps"] = run.inrushAmps;
+    entry["meanAmps"] = run.meanAmps;
+    entry["minAmps"] = run.minAmps;
+    entry["maxAmps"] = run.maxAmps;
+    entry["fault"] = pumpCurrentFaultNames[run.fault < CURRENT_FAULT_COUNT ? run.fault : CURRENT_OK];
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// Frame memory and resume cost per network flow
+void handleCoroutines() {
+  DynamicJsonDocument doc(1536);
+  doc["switchCycles"] = coroSwitchCycles;
+  doc["switchNs"] = coroSwitchCycles * 1000 / ESP.getCpuFreqMHz();
+  doc["running"] = coro::scheduler.active();
+  doc["workerRetries"] = coro::workerRetries;
+  doc["workerRefusals"] = coro::workerRefusals;
+  
+  int count = 0;
+  const coro::FlowStats* stats = coro::scheduler.stats(count);
+  JsonArray flows = doc.createNestedArray("flows");
+  for (int i = 0; i < count; i++) {
+    JsonObject flow = flows.createNestedObject();
+    flow["name"] = stats[i].name;
+    flow["frameBytes"] = stats[i].frameBytes;
+    flow["running"] = coro::scheduler.running(stats[i].name);
+    flow["runs"] = stats[i].runs;
+    flow["resumes"] = stats[i].resumes;
+    flow["avgResumeCycles"] = stats[i].resumes ? (uint32_t)(stats[i].resumeCycles / stats[i].resumes) : 0;
+    flow["maxResumeCycles"] = stats[i].maxResumeCycles;
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// Delivery counts, queue depth and handler cost per topic subscriber
+void handleEvents() {
+  DynamicJsonDocument doc(3072);
+  doc["memoryBytes"] = bus::memoryBytes();
+  doc["rejected"] = bus::rejected;
+  if (bus::rejected > 0) {
+    doc["firstRejected"] = bus::firstRejected;
+  }
+  
+  JsonArray topics = doc.createNestedArray("topics");
+  for (int i = 0; i < bus::topicCount; i++) {
+    const bus::TopicInfo& info = bus::topicRegistry[i];
+    JsonObject topic = topics.createNestedObject();
+    topic["name"] = info.name;
+    topic["bytes"] = info.bytes;
+    topic["published"] = info.published();
+    
+    bus::SubscriberStats stats[bus::MAX_SUBSCRIBERS];
+    int count = info.subscribers(stats, bus::MAX_SUBSCRIBERS);
+    JsonArray subscribers = topic.createNestedArray("subscribers");
+    for (int j = 0; j < count; j++) {
+      JsonObject sub = subscribers.createNestedObject();
+      sub["name"] = stats[j].name;
+      sub["mode"] = stats[j].mode == bus::SYNC ? "sync" : "deferred";
+      sub["delivered"] = stats[j].delivered;
+      sub["dropped"] = stats[j].dropped;
+      sub["pending"] = stats[j].pending;
+      sub["avgCycles"] = stats[j].delivered ? (uint32_t)(stats[j].totalCycles / stats[j].delivered) : 0;
+      sub["maxCycles"] = stats[j].maxCycles;
+    }
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// =============================================================================
+// EVENT SUBSCRIBERS
+// =============================================================================
+
+void initializeEventBus() {
+  // Safety reactions run inside publish(); screen updates wait for the loop
+  bus::subscribe<SystemFaultEvent>("pump", onSystemFaultPump, bus::SYNC);
+  bus::subscribe<EmergencyStopEvent>("leds", onEmergencyStopLeds, bus::SYNC);
+  bus::subscribe<PumpStartedEvent>("display", onPumpStartedDisplay, bus::DEFERRED);
+  bus::subscribe<PumpStoppedEvent>("display", onPumpStoppedDisplay, bus::DEFERRED);
+  bus::subscribe<SystemFaultEvent>("display", onSystemFaultDisplay, bus::DEFERRED);
+  bus::subscribe<EmergencyStopEvent>("display", onEmergencyStopDisplay, bus::DEFERRED);
+  bus::subscribe<RainDetectedEvent>("irrigation", onRainIrrigation, bus::SYNC);
+  bus::subscribe<RainDetectedEvent>("log", onRainLog, bus::DEFERRED);
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Event bus ready (" + String(bus::topicCount) + " topics, " + String(bus::memoryBytes()) + " bytes)");
+  #endif
+}
+
+// The menu renderer owns the LCD while the menu is open; the display
+// subscribers leave it alone and updateDisplay() repaints once it closes
+bool displayOwnedByMenu() {
+  #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+    return systemState.inMenuMode;
+  #else
+    return false;
+  #endif
+}
+
+void onPumpStartedDisplay(const PumpStartedEvent& event) {
+  if (displayOwnedByMenu()) {
+    return;
+  }
+  #if DISPLAY_ENABLED
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("IRRIGATION");
+    lcd.setCursor(0, 1);
+    lcd.print("ACTIVE");
+  #endif
+}
+
+void onPumpStoppedDisplay(const PumpStoppedEvent& event) {
+  if (displayOwnedByMenu()) {
+    return;
+  }
+  #if DISPLAY_ENABLED
+    lcd.clear();
+  #endif
+}
+
+// Rain counts as watering: the cooldown starts over and it uses up the
+// irrigations it replaced from today's allowance
+void onRainIrrigation(const RainDetectedEvent& event) {
+  systemState.lastIrrigation = event.atMs;
+  systemState.dailyIrrigations = min(systemState.dailyIrrigations + event.doses, (int)runtimeSettings.maxDailyIrrigations);
+}
+
+void onRainLog(const RainDetectedEvent& event) {
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Rain detected: ~" + String(event.rainTenths / 10.0, 1) + " mm (moisture +" +
+                   String(event.riseCenti / 100.0, 1) + "%), counted as " + String(event.doses) + " irrigation(s)");
+  #endif
+}
+
+void onSystemFaultPump(const SystemFaultEvent& event) {
+  // Turn off pump for safety
+  if (systemState.pumpActive) {
+    stopIrrigation();
+  }
+}
+
+void onSystemFaultDisplay(const SystemFaultEvent& event) {
+  if (displayOwnedByMenu()) {
+    return;
+  }
+  #if DISPLAY_ENABLED
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("SYSTEM ERROR");
+    lcd.setCursor(0, 1);
+    lcd.print("Check sensors");
+  #endif
+}
+
+void onEmergencyStopLeds(const EmergencyStopEvent& event) {
+  // Turn off all LEDs except red (emergency indicator)
+  digitalWrite(LED_GREEN_PIN, LOW);
+  digitalWrite(LED_BLUE_PIN, LOW);
+  digitalWrite(LED_RED_PIN, HIGH);
+}
+
+void onEmergencyStopDisplay(const EmergencyStopEvent& event) {
+  if (displayOwnedByMenu()) {
+    return;
+  }
+  #if DISPLAY_ENABLED
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("EMERGENCY STOP");
+    lcd.setCursor(0, 1);
+    lcd.print("SYSTEM HALTED");
+  #endif
+}
+
+// =============================================================================
+// CONFIGURATION FILE FUNCTIONS
+// =============================================================================
+
+#define CONFIG_FILE_PATH "/config.json"
+#define CONFIG_LKG_PATH "/config.lkg.json"      // Copy of the last file that parsed and validated
+#define CONFIG_TEMP_PATH "/config.json.tmp"
+
+void initializeConfigFile() {
+  #if CONFIG_FILE_ENABLED
+    if (!LittleFS.begin(true)) {
+      configStatus.lastError = "LittleFS mount failed";
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Config: LittleFS mount failed - using config.h values");
+      #endif
+      return;
+    }
+    
+    if (!LittleFS.exists(CONFIG_FILE_PATH)) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Config: no " CONFIG_FILE_PATH " - using config.h values");
+      #endif
+      return;
+    }
+    
+    configStatus.fileHash = configFileHash(CONFIG_FILE_PATH);
+    loadConfigFile();
+  #endif
+}
+
+// Only the keys below are kept by the parser, so unknown keys and comments
+// in the file cost no document memory
+void buildConfigFilter(JsonDocument& filter) {
+  filter["irrigation"]["soilThreshold"] = true;
+  filter["irrigation"]["durationSeconds"] = true;
+  filter["irrigation"]["cooldownSeconds"] = true;
+  filter["irrigation"]["maxDaily"] = true;
+  filter["sensors"]["readIntervalMs"] = true;
+  filter["cloud"]["transmitIntervalMs"] = true;
+  filter["cloud"]["thingSpeakApiKey"] = true;
+  filter["wifi"]["ssid"] = true;
+  filter["wifi"]["password"] = true;
+  filter["crop"]["profile"] = true;
+  filter["crop"]["plantingDate"] = true;
+}
+
+// Missing keys leave target unchanged; present keys must be in range
+bool configInt(JsonVariant section, const char* key, long low, long high, long& target, String& error) {
+  JsonVariant value = section[key];
+  if (value.isNull()) {
+    return true;
+  }
+  if (!value.is<long>() || value.as<long>() < low || value.as<long>() > high) {
+    error = String(key) + " must be a number from " + String(low) + " to " + String(high);
+    return false;
+  }
+  target = value.as<long>();
+  return true;
+}
+
+bool configText(JsonVariant section, const char* key, size_t minLength, char* target, size_t size, String& error) {
+  JsonVariant value = section[key];
+  if (value.isNull()) {
+    return true;
+  }
+  const char* text = value.as<const char*>();
+  if (!value.is<const char*>() || strlen(text) < minLength || strlen(text) >= size) {
+    error = String(key) + " must be text of " + String(minLength) + " to " + String(size - 1) + " characters";
+    return false;
+  }
+  // Placeholders copied from the examples would override working config.h
+  // credentials, so they are skipped rather than applied
+  if (strncmp(text, "YOUR_", 5) == 0) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Config: ignoring placeholder " + String(key) + " \"" + String(text) + "\"");
+    #endif
+    return true;
+  }
+  strlcpy(target, text, size);
+  return true;
+}
+
+// Applies the keys present in the document on top of settings. Nothing is
+// changed unless every key validates.
+bool applyConfigDocument(JsonDocument& doc, RuntimeSettings& settings, String& error) {
+  RuntimeSettings next = settings;
+  JsonVariant irrigation = doc["irrigation"];
+  JsonVariant sensors = doc["sensors"];
+  JsonVariant cloud = doc["cloud"];
+  JsonVariant wifi = doc["wifi"];
+  JsonVariant crop = doc["crop"];
+  
+  long threshold = next.soilThreshold;
+  long duration = next.irrigationSeconds;
+  long cooldown = next.irrigationCooldownMs / 1000;
+  long maxDaily = next.maxDailyIrrigations;
+  long readInterval = next.sensorReadIntervalMs;
+  long transmitInterval = next.transmitIntervalMs;
+  
+  bool valid = configInt(irrigation, "soilThreshold", 0, 100, threshold, error) &&
+               configInt(irrigation, "durationSeconds", MIN_IRRIGATION_SECONDS, MAX_IRRIGATION_SECONDS, duration, error) &&
+               configInt(irrigation, "cooldownSeconds", 60, 86400, cooldown, error) &&
+               configInt(irrigation, "maxDaily", 1, 100, maxDaily, error) &&
+               configInt(sensors, "readIntervalMs", 1000, 600000, readInterval, error) &&
+               configInt(cloud, "transmitIntervalMs", 15000, 86400000, transmitInterval, error) &&
+               configText(cloud, "thingSpeakApiKey", 0, next.thingSpeakApiKey, sizeof(next.thingSpeakApiKey), error) &&
+               configText(wifi, "ssid", 1, next.wifiSsid, sizeof(next.wifiSsid), error) &&
+               configText(wifi, "password", 0, next.wifiPassword, sizeof(next.wifiPassword), error) &&
+               configText(crop, "profile", 0, next.cropProfile, sizeof(next.cropProfile), error) &&
+               configText(crop, "plantingDate", 0, next.plantingDate, sizeof(next.plantingDate), error);
+  if (!valid) {
+    return false;
+  }
+  if (next.cropProfile[0] != '\0' && findCropProfile(next.cropProfile) == nullptr) {
+    error = "unknown crop profile " + String(next.cropProfile);
+    return false;
+  }
+  if (next.cropProfile[0] != '\0' && parsePlantingDate(next.plantingDate) < 0) {
+    error = "plantingDate must be YYYY-MM-DD";
+    return false;
+  }
+  
+  next.soilThreshold = threshold;
+  next.irrigationSeconds = duration;
+  next.irrigationCooldownMs = cooldown * 1000UL;
+  next.maxDailyIrrigations = maxDaily;
+  next.sensorReadIntervalMs = readInterval;
+  next.transmitIntervalMs = transmitInterval;
+  settings = next;
+  return true;
+}
+
+// Records parse time and memory, then validates the filtered document
+bool finishConfigParse(JsonDocument& doc, DeserializationError result, uint32_t startMicros,
+                       RuntimeSettings& settings, String& error) {
+  configStatus.parseMicros = micros() - startMicros;
+  configStatus.maxParseMicros = max(configStatus.maxParseMicros, configStatus.parseMicros);
+  configStatus.memoryUsage = doc.memoryUsage();
+  configStatus.peakMemoryUsage = max(configStatus.peakMemoryUsage, configStatus.memoryUsage);
+  
+  if (result) {
+    error = String("JSON ") + result.c_str();
+    return false;
+  }
+  if (doc.size() == 0) {
+    error = "no recognised settings";
+    return false;
+  }
+  return applyConfigDocument(doc, settings, error);
+}
+
+// Streams the JSON through the filter into a fixed-size document, so a
+// large or hostile file cannot use more than CONFIG_JSON_CAPACITY bytes
+bool parseConfig(Stream& input, RuntimeSettings& settings, String& error) {
+  StaticJsonDocument<256> filter;
+  buildConfigFilter(filter);
+  
+  StaticJsonDocument<CONFIG_JSON_CAPACITY> doc;
+  uint32_t start = micros();
+  DeserializationError result = deserializeJson(doc, input, DeserializationOption::Filter(filter));
+  return finishConfigParse(doc, result, start, settings, error);
+}
+
+bool parseConfigText(const String& text, RuntimeSettings& settings, String& error) {
+  StaticJsonDocument<256> filter;
+  buildConfigFilter(filter);
+  
+  StaticJsonDocument<CONFIG_JSON_CAPACITY> doc;
+  uint32_t start = micros();
+  DeserializationError result = deserializeJson(doc, text, DeserializationOption::Filter(filter));
+  return finishConfigParse(doc, result, start, settings, error);
+}
+
+// FNV-1a over the file contents; 0 when the file is missing
+uint32_t configFileHash(const char* path) {
+  #if CONFIG_FILE_ENABLED
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+      return 0;
+    }
+    uint32_t hash = 2166136261UL;
+    uint8_t buffer[64];
+    size_t count;
+    while ((count = file.read(buffer, sizeof(buffer))) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ buffer[i]) * 16777619UL;
+      }
+    }
+    file.close();
+    return hash;
+  #else
+    return 0;
+  #endif
+}
+
+// Parses config.json over the config.h defaults. A file that is malformed
+// or fails validation falls back to the last-known-good copy.
+bool loadConfigFile() {
+  #if CONFIG_FILE_ENABLED
+    configStatus.loads++;
+    String error;
+    RuntimeSettings next = defaultSettings;
+    
+    File file = LittleFS.open(CONFIG_FILE_PATH, "r");
+    bool parsed = false;
+    if (!file) {
+      error = "cannot open " CONFIG_FILE_PATH;
+    } else if (file.size() > CONFIG_MAX_FILE_SIZE) {
+      error = "file larger than " + String(CONFIG_MAX_FILE_SIZE) + " bytes";
+    } else {
+      parsed = parseConfig(file, next, error);
+    }
+    if (file) {
+      file.close();
+    }
+    
+    if (parsed) {
+      rememberGoodConfig();
+      configStatus.source = "config.json";
+      configStatus.lastError = "";
+      applyRuntimeSettings(next);
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Config: loaded " CONFIG_FILE_PATH " in " + String(configStatus.parseMicros) + " us, " +
+                       String(configStatus.memoryUsage) + "/" + String(CONFIG_JSON_CAPACITY) + " bytes");
+      #endif
+      return true;
+    }
+    
+    configStatus.failures++;
+    configStatus.lastError = error;
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Config: " CONFIG_FILE_PATH " rejected (" + error + ")");
+    #endif
+    
+    // Fall back to the last file that worked
+    next = defaultSettings;
+    File lastGood = LittleFS.open(CONFIG_LKG_PATH, "r");
+    String lkgError;
+    if (lastGood && parseConfig(lastGood, next, lkgError)) {
+      lastGood.close();
+      configStatus.source = "last-known-good";
+      applyRuntimeSettings(next);
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Config: using last-known-good settings");
+      #endif
+      return false;
+    }
+    if (lastGood) {
+      lastGood.close();
+    }
+    
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Config: no usable last-known-good copy - keeping current settings");
+    #endif
+  #endif
+  return false;
+}
+
+// Keeps a copy of config.json to fall back to if a later edit breaks it
+void rememberGoodConfig() {
+  #if CONFIG_FILE_ENABLED
+    if (configFileHash(CONFIG_LKG_PATH) == configFileHash(CONFIG_FILE_PATH)) {
+      return;
+    }
+    File source = LittleFS.open(CONFIG_FILE_PATH, "r");
+    File copy = LittleFS.open(CONFIG_LKG_PATH, "w");
+    if (source && copy) {
+      uint8_t buffer[64];
+      size_t count;
+      while ((count = source.read(buffer, sizeof(buffer))) > 0) {
+        copy.write(buffer, count);
+      }
+    }
+    source.close();
+    copy.close();
+  #endif
+}
+
+// Writes the full settings via a temp file so a reset mid-write cannot
+// leave a truncated config.json behind
+bool saveConfigFile(const RuntimeSettings& settings) {
+  #if CONFIG_FILE_ENABLED
+    StaticJsonDocument<CONFIG_JSON_CAPACITY> doc;
+    doc["irrigation"]["soilThreshold"] = settings.soilThreshold;
+    doc["irrigation"]["durationSeconds"] = settings.irrigationSeconds;
+    doc["irrigation"]["cooldownSeconds"] = settings.irrigationCooldownMs / 1000;
+    doc["irrigation"]["maxDaily"] = settings.maxDailyIrrigations;
+    doc["sensors"]["readIntervalMs"] = settings.sensorReadIntervalMs;
+    doc["cloud"]["transmitIntervalMs"] = settings.transmitIntervalMs;
+    doc["cloud"]["thingSpeakApiKey"] = settings.thingSpeakApiKey;
+    doc["wifi"]["ssid"] = settings.wifiSsid;
+    doc["wifi"]["password"] = settings.wifiPassword;
+    doc["crop"]["profile"] = settings.cropProfile;
+    doc["crop"]["plantingDate"] = settings.plantingDate;
+    
+    File file = LittleFS.open(CONFIG_TEMP_PATH, "w");
+    if (!file) {
+      return false;
+    }
+    bool written = serializeJsonPretty(doc, file) > 0;
+    file.close();
+    if (!written) {
+      LittleFS.remove(CONFIG_TEMP_PATH);
+      return false;
+    }
+    LittleFS.remove(CONFIG_FILE_PATH);
+    if (!LittleFS.rename(CONFIG_TEMP_PATH, CONFIG_FILE_PATH)) {
+      return false;
+    }
+    
+    // We wrote it ourselves: no need for the change check to parse it again
+    configStatus.fileHash = configFileHash(CONFIG_FILE_PATH);
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+// Copies the new settings in and restarts only the subsystems whose
+// settings actually changed
+void applyRuntimeSettings(const RuntimeSettings& next) {
+  RuntimeSettings previous = runtimeSettings;
+  runtimeSettings = next;
+  
+  String changed = "";
+  if (next.soilThreshold != previous.soilThreshold) {
+    systemState.adjustedThreshold = next.soilThreshold;
+    changed += " threshold";
+  }
+  if (next.irrigationSeconds != previous.irrigationSeconds) {
+    systemState.irrigationSeconds = next.irrigationSeconds;
+    changed += " duration";
+  }
+  if (next.irrigationCooldownMs != previous.irrigationCooldownMs || next.maxDailyIrrigations != previous.maxDailyIrrigations) {
+    changed += " irrigation-limits";
+  }
+  if (next.sensorReadIntervalMs != previous.sensorReadIntervalMs) {
+    changed += " sensor-interval";
+  }
+  if (next.transmitIntervalMs != previous.transmitIntervalMs ||
+      strcmp(next.thingSpeakApiKey, previous.thingSpeakApiKey) != 0) {
+    changed += " cloud";
+  }
+  if (strcmp(next.wifiSsid, previous.wifiSsid) != 0 || strcmp(next.wifiPassword, previous.wifiPassword) != 0) {
+    changed += " wifi";
+    // At boot WiFi has not been started yet; later the link must be rebuilt
+    if (systemState.lastWiFiCheck != 0 || systemState.wifiConnected) {
+      restartNetwork();
+    }
+  }
+  
+  if (strcmp(next.cropProfile, previous.cropProfile) != 0 || strcmp(next.plantingDate, previous.plantingDate) != 0) {
+    changed += " crop";
+    selectCropProfile();
+  }
+  
+  #if SERIAL_OUTPUT_ENABLED
+    if (changed.length() > 0) {
+      Log.println("Config: applied -" + changed);
+    }
+  #endif
+}
+
+void checkConfigFile() {
+  #if CONFIG_FILE_ENABLED
+    uint32_t hash = configFileHash(CONFIG_FILE_PATH);
+    if (hash == configStatus.fileHash) {
+      return;
+    }
+    configStatus.fileHash = hash;
+    if (hash != 0) {
+      loadConfigFile();
+    }
+  #endif
+}
+
+void handleConfigGet() {
+  if (!requireWebAuth()) {
+    return;
+  }
+  
+  DynamicJsonDocument doc(1024);
+  JsonObject settings = doc.createNestedObject("settings");
+  settings["irrigation"]["soilThreshold"] = runtimeSettings.soilThreshold;
+  settings["irrigation"]["durationSeconds"] = runtimeSettings.irrigationSeconds;
+  settings["irrigation"]["cooldownSeconds"] = runtimeSettings.irrigationCooldownMs / 1000;
+  settings["irrigation"]["maxDaily"] = runtimeSettings.maxDailyIrrigations;
+  settings["sensors"]["readIntervalMs"] = runtimeSettings.sensorReadIntervalMs;
+  settings["cloud"]["transmitIntervalMs"] = runtimeSettings.transmitIntervalMs;
+  settings["wifi"]["ssid"] = runtimeSettings.wifiSsid;
+  settings["crop"]["profile"] = runtimeSettings.cropProfile;
+  settings["crop"]["plantingDate"] = runtimeSettings.plantingDate;
+  
+  JsonObject status = doc.createNestedObject("status");
+  status["source"] = configStatus.source;
+  status["lastError"] = configStatus.lastError;
+  status["loads"] = configStatus.loads;
+  status["failures"] = configStatus.failures;
+  status["parseMicros"] = configStatus.parseMicros;
+  status["maxParseMicros"] = configStatus.maxParseMicros;
+  status["memoryUsage"] = configStatus.memoryUsage;
+  status["peakMemoryUsage"] = configStatus.peakMemoryUsage;
+  status["capacity"] = CONFIG_JSON_CAPACITY;
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// Partial update: only the keys in the request body change
+void handleConfigPost() {
+  if (!requireWebAuth()) {
+    return;
+  }
+  
+  String body = server.arg("plain");
+  if (body.length() == 0 || body.length() > CONFIG_MAX_FILE_SIZE) {
+    server.send(400, "text/plain", "Expected a JSON body of up to " + String(CONFIG_MAX_FILE_SIZE) + " bytes");
+    return;
+  }
+  
+  RuntimeSettings next = runtimeSettings;
+  String error;
+  if (!parseConfigText(body, next, error)) {
+    server.send(400, "text/plain", "Config rejected: " + error);
+    return;
+  }
+  
+  if (!saveConfigFile(next)) {
+    server.send(500, "text/plain", "Could not write " CONFIG_FILE_PATH);
+    return;
+  }
+  rememberGoodConfig();
+  configStatus.source = "config.json";
+  configStatus.lastError = "";
+  applyRuntimeSettings(next);
+  server.send(200, "text/plain", "Config saved");
+}
+
+// =============================================================================
+// CROP PROFILE FUNCTIONS
+// =============================================================================
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar
+int32_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yearOfEra = year - era * 400;
+  int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+// Today's local calendar date (TIMEZONE_OFFSET/DST) as days since 1970, on
+// the same scale as parsePlantingDate; UTC now / 86400 would change the crop
+// stage and the daily counters at different times away from UTC
+int32_t localDayNumber(time_t now) {
+  struct tm local;
+  localtime_r(&now, &local);
+  return daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+}
+
+// "YYYY-MM-DD" to days since 1970, or -1 if malformed
+int32_t parsePlantingDate(const char* text) {
+  int year, month, day;
+  if (text == nullptr || strlen(text) != 10 || sscanf(text, "%4d-%2d-%2d", &year, &month, &day) != 3 ||
+      year < 2000 || month < 1 || month > 12 || day < 1 || day > 31) {
+    return -1;
+  }
+  return daysFromCivil(year, month, day);
+}
+
+const CropProfile* findCropProfile(const char* name) {
+  for (int i = 0; i < CROP_PROFILE_COUNT; i++) {
+    if (strcmp(cropProfiles[i].name, name) == 0) {
+      return &cropProfiles[i];
+    }
+  }
+  return nullptr;
+}
+
+// Resolves the profile name and planting date once; the per-tick path only
+// reads the cached cropState
+void selectCropProfile() {
+  cropState.profile = runtimeSettings.cropProfile[0] != '\0' ? findCropProfile(runtimeSettings.cropProfile) : nullptr;
+  cropState.plantingDay = parsePlantingDate(runtimeSettings.plantingDate);
+  updateCropStage();
+  
+  #if SERIAL_OUTPUT_ENABLED
+    if (cropState.profile != nullptr) {
+      Log.println("Crop profile: " + String(cropState.profile->name) + " planted " + String(runtimeSettings.plantingDate));
+    }
+  #endif
+}
+
+void updateCropStage() {
+  cropState.lastUpdate = millis();
+  cropState.active = false;
+  
+  if (cropState.profile == nullptr) {
+    cropState.reason = "no profile";
+    return;
+  }
+  if (cropState.plantingDay < 0) {
+    cropState.reason = "invalid planting date";
+    return;
+  }
+  time_t now = time(nullptr);
+  if (now < 1600000000) {
+    cropState.reason = "clock not set";
+    return;
+  }
+  
+  int32_t day = localDayNumber(now) - cropState.plantingDay;
+  if (day < 0) {
+    cropState.reason = "not planted yet";
+    return;
+  }
+  
+  // Walk the (at most CROP_MAX_STAGES) stages to today's; the last one has no end
+  const CropProfile& profile = *cropState.profile;
+  uint8_t stage = 0;
+  int32_t stageStart = 0;
+  while (stage + 1 < profile.stageCount && day >= stageStart + profile.stages[stage].days) {
+    stageStart += profile.stages[stage].days;
+    stage++;
+  }
+  const CropStage& current = profile.stages[stage];
+  
+  // Kc ramps from the previous stage's value across this stage
+  int kc = current.kc;
+  if (stage > 0 && current.days > 0) {
+    int32_t into = min(day - stageStart, (int32_t)current.days);
+    kc = profile.stages[stage - 1].kc + (current.kc - profile.stages[stage - 1].kc) * into / current.days;
+  }
+  
+  if (stage != cropState.stage && cropState.dayOfSeason != 0) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Crop stage: " + String(profile.name) + " entered " + String(current.name));
+    #endif
+  }
+  
+  cropState.stage = stage;
+  cropState.dayOfSeason = day;
+  cropState.threshold = current.target * (100 - current.depletion) / 100;
+  cropState.kc = kc;
+  cropState.active = true;
+  cropState.reason = "";
+}
+
+// Threshold the controller compares against. An active crop profile wins;
+// otherwise the knob (potentiometer or encoder builds) or the configured value
+int activeSoilThreshold() {
+  if (cropState.active) {
+    return cropState.threshold;
+  }
+  #if CONTROL_TYPE == CONTROL_POTENTIOMETER || CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+    return systemState.adjustedThreshold;
+  #else
+    return runtimeSettings.soilThreshold;
+  #endif
+}
+
+// Pump runtime for the next irrigation: the dose the commissioned zone needs
+// to reach its target, otherwise the configured duration scaled by the crop
+// coefficient; runPercent (the rain forecast) shortens scheduled runs
+int plannedIrrigationSeconds(int runPercent) {
+  float dose = zoneDoseSeconds();
+  if (dose <= 0 && !cropState.active && runPercent >= 100) {
+    return systemState.irrigationSeconds;
+  }
+  int seconds = systemState.irrigationSeconds;
+  if (dose > 0) {
+    seconds = (int)ceilf(dose);
+  } else if (cropState.active) {
+    seconds = seconds * cropState.kc / 100;
+  }
+  return constrain(seconds * runPercent / 100, MIN_IRRIGATION_SECONDS, MAX_IRRIGATION_SECONDS);
+}
+
+// =============================================================================
+// RAIN FORECAST FUNCTIONS
+// =============================================================================
+
+// A forecast is usable while the clock is set and it is younger than FORECAST_MAX_AGE_HOURS
+bool forecastValid() {
+  time_t now = time(nullptr);
+  return rtcForecast.magic == FORECAST_RTC_MAGIC && rtcForecast.hours > 0 && now >= 1600000000 &&
+         now - (time_t)rtcForecast.fetchedAt < FORECAST_MAX_AGE_HOURS * 3600L;
+}
+
+void requestForecast() {
+  // A forecast that survived a reset is reused until it is due for a refresh
+  if (forecastValid() && time(nullptr) - (time_t)rtcForecast.fetchedAt < FORECAST_REFRESH_INTERVAL / 1000) {
+    forecastState.lastFetchOk = true;
+    return;
+  }
+  coro::scheduler.spawn("forecast", forecastFetchFlow());
+}
+
+coro::Task forecastFetchFlow() {
+  String url = FORECAST_URL;
+  
+  breadcrumb(CRUMB_HTTP_BEGIN, HTTP_FORECAST);
+  ForecastFetch result = co_await coro::onWorker([url]() { return fetchForecast(url); });
+  breadcrumb(CRUMB_HTTP_END, HTTP_FORECAST, result.code);
+  
+  forecastState.fetches++;
+  forecastState.parseMicros = result.parseMicros;
+  forecastState.docBytes = result.docBytes;
+  forecastState.lastFetchOk = result.error.length() == 0;
+  
+  if (!forecastState.lastFetchOk) {
+    // Keep whatever is cached; it still counts until it expires
+    forecastState.failures++;
+    forecastState.lastError = result.error;
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Forecast fetch failed: " + result.error);
+    #endif
+    co_return;
+  }
+  
+  rtcForecast = result.forecast;
+  rtcForecast.fetchedAt = time(nullptr);
+  rtcForecast.magic = FORECAST_RTC_MAGIC;
+  forecastState.lastError = "";
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Forecast updated: " + String(rtcForecast.hours) + " hours, parsed in " +
+                   String(result.parseMicros) + " us");
+  #endif
+}
+
+// Runs on the network worker: streams the response through a filter so only
+// the hourly arrays are kept, then packs them into the compact form
+ForecastFetch fetchForecast(const String& url) {
+  ForecastFetch result = {};
+  
+  StaticJsonDocument<192> filter;
+  filter["hourly"]["time"][0] = true;
+  filter["hourly"]["precipitation_probability"][0] = true;
+  filter["hourly"]["precipitation"][0] = true;
+  filter["hourly"]["temperature_2m"][0] = true;
+  
+  HTTPClient http;
+  http.useHTTP10(true);  // No chunked encoding, so the body can be parsed straight off the socket
+  http.setTimeout(FORECAST_HTTP_TIMEOUT);
+  http.begin(url);
+  result.code = http.GET();
+  if (result.code != 200) {
+    result.error = "HTTP " + String(result.code);
+    http.end();
+    return result;
+  }
+  
+  DynamicJsonDocument doc(FORECAST_JSON_CAPACITY);
+  uint32_t start = micros();
+  DeserializationError parsed = deserializeJson(doc, http.getStream(), DeserializationOption::Filter(filter));
+  result.parseMicros = micros() - start;
+  result.docBytes = doc.memoryUsage();
+  http.end();
+  
+  if (parsed) {
+    result.error = String("parse: ") + parsed.c_str();
+    return result;
+  }
+  
+  JsonArray times = doc["hourly"]["time"];
+  JsonArray probability = doc["hourly"]["precipitation_probability"];
+  JsonArray rain = doc["hourly"]["precipitation"];
+  JsonArray temperature = doc["hourly"]["temperature_2m"];
+  if (times.isNull() || times.size() == 0 || rain.isNull()) {
+    result.error = "missing hourly data (needs timeformat=unixtime)";
+    return result;
+  }
+  
+  RtcForecast& forecast = result.forecast;
+  forecast.startTime = times[0] | 0UL;
+  forecast.hours = min((size_t)FORECAST_HOURS, times.size());
+  for (int h = 0; h < forecast.hours; h++) {
+    // A missing probability means the provider only gives amounts: treat them as certain
+    forecast.rainProbability[h] = constrain(probability[h] | 100, 0, 100);
+    forecast.rainTenths[h] = constrain((int)lroundf((rain[h] | 0.0f) * 10), 0, 255);
+    forecast.temperature[h] = constrain((int)lroundf(temperature[h] | 0.0f), -128, 127);
+  }
+  if (forecast.startTime < 1600000000UL) {
+    result.error = "time is not unix seconds (needs timeformat=unixtime)";
+  }
+  return result;
+}
+
+// Share of the normal runtime a scheduled irrigation should use given the
+// probability-weighted rain in the next FORECAST_LOOKAHEAD_HOURS:
+// 100 = no rain expected, 0 = skip
+int forecastRunPercent() {
+  #if FORECAST_ENABLED
+    if (!forecastValid()) {
+      forecastState.expectedTenths = 0;
+      forecastState.runPercent = 100;
+      return 100;
+    }
+    
+    int first = max(0L, (long)(time(nullptr) - (time_t)rtcForecast.startTime) / 3600L);
+    uint32_t expected = 0;
+    for (int h = first; h < first + FORECAST_LOOKAHEAD_HOURS && h < rtcForecast.hours; h++) {
+      expected += rtcForecast.rainTenths[h] * rtcForecast.rainProbability[h];
+    }
+    expected /= 100;
+    
+    const uint32_t skipTenths = (uint32_t)(FORECAST_SKIP_MM * 10);
+    const uint32_t minTenths = (uint32_t)(FORECAST_MIN_MM * 10);
+    int percent = 100;
+    if (expected >= skipTenths) {
+      percent = 0;
+    } else if (expected >= minTenths) {
+      percent = 100 - (int)(expected * 100 / skipTenths);
+    }
+    forecastState.expectedTenths = min(expected, (uint32_t)UINT16_MAX);
+    forecastState.runPercent = percent;
+    return percent;
+  #else
+    return 100;
+  #endif
+}
+
+void handleForecast() {
+  DynamicJsonDocument doc(4096);
+  doc["enabled"] = FORECAST_ENABLED;
+  doc["valid"] = forecastValid();
+  doc["fetches"] = forecastState.fetches;
+  doc["failures"] = forecastState.failures;
+  doc["lastError"] = forecastState.lastError;
+  doc["parseMicros"] = forecastState.parseMicros;
+  doc["docBytes"] = forecastState.docBytes;
+  doc["cacheBytes"] = sizeof(rtcForecast);
+  doc["expectedRainMm"] = forecastState.expectedTenths / 10.0;
+  doc["runPercent"] = forecastState.runPercent;
+  doc["skips"] = forecastState.skips;
+  doc["shortened"] = forecastState.shortened;
+  
+  if (rtcForecast.magic == FORECAST_RTC_MAGIC) {
+    doc["fetchedAt"] = rtcForecast.fetchedAt;
+    doc["startTime"] = rtcForecast.startTime;
+    JsonArray hours = doc.createNestedArray("hours");
+    for (int h = 0; h < rtcForecast.hours && h < FORECAST_HOURS; h++) {
+      JsonArray hour = hours.createNestedArray();
+      hour.add(rtcForecast.rainProbability[h]);
+      hour.add(rtcForecast.rainTenths[h] / 10.0);
+      hour.add(rtcForecast.temperature[h]);
+    }
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// =============================================================================
+// FREQUENCY PROBE FUNCTIONS
+// =============================================================================
+
+#if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+bool initializeFrequencyProbe() {
+  const int pins[] = SOIL_FREQUENCY_PINS;
+  freqProbe.channelCount = min((int)(sizeof(pins) / sizeof(pins[0])), SOIL_FREQ_MAX_CHANNELS);
+  
+  // Counters first: the PCNT driver sets the gate pin to input, the RMT
+  // channel below then turns it into a looped-back output
+  for (int i = 0; i < freqProbe.channelCount; i++) {
+    pcnt_unit_config_t unitConfig = {};
+    unitConfig.low_limit = -1;
+    unitConfig.high_limit = 32767;
+    unitConfig.flags.accum_count = 1;  // The driver folds counter overflows into the count
+    
+    pcnt_unit_handle_t unit = nullptr;
+    pcnt_channel_handle_t channel = nullptr;
+    pcnt_chan_config_t channelConfig = {};
+    channelConfig.edge_gpio_num = pins[i];
+    channelConfig.level_gpio_num = SOIL_FREQ_GATE_PIN;
+    pcnt_glitch_filter_config_t filterConfig = {};
+    filterConfig.max_glitch_ns = SOIL_FREQ_GLITCH_NS;
+    
+    if (pcnt_new_unit(&unitConfig, &unit) != ESP_OK ||
+        pcnt_unit_set_glitch_filter(unit, &filterConfig) != ESP_OK ||
+        pcnt_new_channel(unit, &channelConfig, &channel) != ESP_OK ||
+        pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD) != ESP_OK ||
+        pcnt_channel_set_level_action(channel, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_HOLD) != ESP_OK ||
+        pcnt_unit_add_watch_point(unit, unitConfig.high_limit) != ESP_OK ||
+        pcnt_unit_enable(unit) != ESP_OK || pcnt_unit_clear_count(unit) != ESP_OK || pcnt_unit_start(unit) != ESP_OK) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Error: PCNT setup failed for soil probe on GPIO" + String(pins[i]));
+      #endif
+      return false;
+    }
+    freqProbe.units[i] = unit;
+  }
+  
+  // Gate: a single RMT pulse exactly SOIL_FREQ_WINDOW_US long (1 us ticks)
+  rmt_tx_channel_config_t gateConfig = {};
+  gateConfig.gpio_num = (gpio_num_t)SOIL_FREQ_GATE_PIN;
+  gateConfig.clk_src = RMT_CLK_SRC_DEFAULT;
+  gateConfig.resolution_hz = 1000000;
+  gateConfig.mem_block_symbols = 64;
+  gateConfig.trans_queue_depth = 1;
+  gateConfig.flags.io_loop_back = 1;
+  rmt_copy_encoder_config_t encoderConfig = {};
+  
+  uint16_t halves[SOIL_FREQ_GATE_HALVES];
+  int halfCount = probe::splitGate(SOIL_FREQ_WINDOW_US, halves, SOIL_FREQ_GATE_HALVES);
+  if (halfCount == 0 ||
+      rmt_new_tx_channel(&gateConfig, &freqProbe.gate) != ESP_OK ||
+      rmt_new_copy_encoder(&encoderConfig, &freqProbe.gateEncoder) != ESP_OK ||
+      rmt_enable(freqProbe.gate) != ESP_OK) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Error: RMT gate setup failed for the frequency soil probe");
+    #endif
+    return false;
+  }
+  for (int h = 0; h < halfCount; h += 2) {
+    rmt_symbol_word_t& symbol = freqProbe.gateSymbols[h / 2];
+    symbol.level0 = 1;
+    symbol.duration0 = halves[h];
+    symbol.level1 = h + 1 < halfCount ? 1 : 0;
+    symbol.duration1 = h + 1 < halfCount ? halves[h + 1] : 1;
+  }
+  freqProbe.gateSymbolCount = (halfCount + 1) / 2;
+  freqProbe.ready = true;
+  
+  startFrequencyWindow();
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Frequency soil probe: " + String(freqProbe.channelCount) + " channel(s), " +
+                   String(SOIL_FREQ_WINDOW_US / 1000) + " ms gate on GPIO" + String(SOIL_FREQ_GATE_PIN));
+  #endif
+  return true;
+}
+
+void startFrequencyWindow() {
+  for (int i = 0; i < freqProbe.channelCount; i++) {
+    pcnt_unit_clear_count(freqProbe.units[i]);
+  }
+  rmt_transmit_config_t transmitConfig = {};
+  transmitConfig.flags.eot_level = 0;
+  freqProbe.measuring = rmt_transmit(freqProbe.gate, freqProbe.gateEncoder, freqProbe.gateSymbols,
+                                     freqProbe.gateSymbolCount * sizeof(rmt_symbol_word_t), &transmitConfig) == ESP_OK;
+}
+
+// Picks up the counts of a finished window; false while the gate is still open
+bool collectFrequencyWindow() {
+  if (!freqProbe.measuring || rmt_tx_wait_all_done(freqProbe.gate, 0) != ESP_OK) {
+    return false;
+  }
+  for (int i = 0; i < freqProbe.channelCount; i++) {
+    int count = 0;
+    pcnt_unit_get_count(freqProbe.units[i], &count);
+    freqProbe.lastHz[i] = probe::countToHz(max(count, 0), SOIL_FREQ_WINDOW_US);
+    freqProbe.lastMoisture[i] = probe::moistureFromHz(soilFrequencyTable, SOIL_FREQUENCY_POINTS, freqProbe.lastHz[i]);
+  }
+  freqProbe.measuring = false;
+  freqProbe.windows++;
+  return true;
+}
+
+// Result of the window opened by the previous call, then opens the next one;
+// the CPU is not involved while a window is counting
+bool readFrequencyProbe(int& raw) {
+  if (!freqProbe.ready) {
+    return false;
+  }
+  bool collected = collectFrequencyWindow();
+  if (!freqProbe.measuring) {
+    startFrequencyWindow();
+  }
+  if (!collected) {
+    return false;
+  }
+  
+  if (freqProbe.lastHz[0] < SOIL_FREQ_MIN_HZ) {
+    // A stopped oscillator is a disconnected or failed probe, not dry soil
+    freqProbe.noSignal++;
+    systemState.sensorErrors++;
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Error: no signal from frequency soil probe (" + String(freqProbe.lastHz[0]) + " Hz)");
+    #endif
+    return false;
+  }
+  raw = probe::rawFromMoisture(freqProbe.lastMoisture[0], SOIL_MOISTURE_DRY_VALUE, SOIL_MOISTURE_WET_VALUE);
+  return true;
+}
+#endif
+
+// =============================================================================
+// SOIL TEMPERATURE COMPENSATION FUNCTIONS
+// =============================================================================
+
+#define SOIL_TC_MODEL_VERSION 2              // 2: fits include a time trend
+
+void initializeSoilTempComp() {
+  soilTc.model.version = SOIL_TC_MODEL_VERSION;
+  soilTc.model.coeffQ8 = (int32_t)lroundf(SOIL_TC_COEFFICIENT * 256);
+  soilTc.model.nights = 0;
+  
+  #if SOIL_TEMPERATURE_PROBE
+    soilTempProbe.begin();
+    soilTempFound = soilTempProbe.getAddress(soilTempAddress, 0);
+    soilTempProbe.setWaitForConversion(false);  // Each read collects the previous conversion
+    soilTempProbe.requestTemperatures();
+  #endif
+  
+  #if SOIL_TEMP_COMPENSATION && SOIL_TC_LEARN
+    soilTcPrefs.begin("soiltc", false);
+    SoilTempCompModel saved;
+    if (soilTcPrefs.getBytes("model", &saved, sizeof(saved)) == sizeof(saved) &&
+        saved.version == SOIL_TC_MODEL_VERSION) {
+      soilTc.model = saved;
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Soil temperature compensation restored: " + String(saved.coeffQ8 / 256.0, 2) +
+                       " counts/C from " + String(saved.nights) + " nights");
+      #endif
+    }
+  #endif
+}
+
+// Soil probe when fitted, otherwise the air temperature from the DHT
+bool readSoilTemperature(float airTemperature, int16_t& temperatureQ4) {
+  #if SOIL_TEMPERATURE_PROBE
+    int16_t raw = soilTempFound ? soilTempProbe.getTemp(soilTempAddress) : DEVICE_DISCONNECTED_RAW;  // 1/128 C
+    soilTempProbe.requestTemperatures();
+    if (raw != DEVICE_DISCONNECTED_RAW) {
+      temperatureQ4 = raw >> 3;
+      soilTc.source = "probe";
+      return true;
+    }
+  #endif
+  #if DHT_ENABLED
+    if (airTemperature > MIN_TEMPERATURE && airTemperature < MAX_TEMPERATURE) {
+      temperatureQ4 = (int16_t)lroundf(airTemperature * 16);
+      soilTc.source = "air";
+      return true;
+    }
+  #endif
+  soilTc.source = "none";
+  return false;
+}
+
+// One multiply and one shift per sample; learning adds a few integer sums at night
+int compensateSoilRaw(int raw, float airTemperature) {
+  #if SOIL_TEMP_COMPENSATION
+    uint32_t startCycles = ESP.getCycleCount();
+    soilTc.rawUncorrected = raw;
+    
+    int16_t temperatureQ4;
+    if (!readSoilTemperature(airTemperature, temperatureQ4)) {
+      soilTc.correction = 0;
+      return raw;
+    }
+    soilTc.temperatureQ4 = temperatureQ4;
+    
+    #if SOIL_TC_LEARN
+      learnSoilTempComp(raw, temperatureQ4);
+    #endif
+    
+    const int32_t referenceQ4 = (int32_t)(SOIL_TC_REFERENCE * 16);
+    soilTc.correction = (soilTc.model.coeffQ8 * (temperatureQ4 - referenceQ4)) >> 12;
+    
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    if (cycles > soilTc.maxCycles) {
+      soilTc.maxCycles = cycles;
+    }
+    return constrain(raw - soilTc.correction, 0, 4095);
+  #else
+    return raw;
+  #endif
+}
+
+// Quiet night: plants are not drawing water, so what the probe still does
+// follows temperature. Uses the clock, or darkness when there is no clock yet.
+bool soilTcNight() {
+  time_t now = time(nullptr);
+  if (now >= 1600000000) {
+    struct tm local;
+    localtime_r(&now, &local);
+    return SOIL_TC_NIGHT_START > SOIL_TC_NIGHT_END ?
+           (local.tm_hour >= SOIL_TC_NIGHT_START || local.tm_hour < SOIL_TC_NIGHT_END) :
+           (local.tm_hour >= SOIL_TC_NIGHT_START && local.tm_hour < SOIL_TC_NIGHT_END);
+  }
+  #if LDR_ENABLED
+    return systemState.lightLevelPercent < SOIL_TC_DARK_LEVEL;
+  #else
+    return false;
+  #endif
+}
+
+void learnSoilTempComp(int raw, int16_t temperatureQ4) {
+  bool quiet = soilTcNight() && !systemState.pumpActive && !rainState.pumpWatch && rainState.phase == RAIN_IDLE;
+  
+  if (!quiet) {
+    if (soilTc.collecting) {
+      // Watering or rain spoils the fit; a normal end of night evaluates it
+      if (soilTcNight()) {
+        soilTc.lastFitResult = "night disturbed";
+      } else {
+        finishSoilTcNight();
+      }
+      soilTc.collecting = false;
+    }
+    return;
+  }
+  
+  if (!soilTc.collecting) {
+    soilTc.collecting = true;
+    soilTc.nightStart = millis();
+    soilTc.n = 0;
+    soilTc.sumT = soilTc.sumM = soilTc.sumR = 0;
+    soilTc.sumTT = soilTc.sumMM = soilTc.sumTM = soilTc.sumTR = soilTc.sumMR = soilTc.sumRR = 0;
+    soilTc.minT = soilTc.maxT = temperatureQ4;
+  }
+  int32_t minutes = (millis() - soilTc.nightStart) / 60000;
+  soilTc.n++;
+  soilTc.sumT += temperatureQ4;
+  soilTc.sumM += minutes;
+  soilTc.sumR += raw;
+  soilTc.sumTT += (int32_t)temperatureQ4 * temperatureQ4;
+  soilTc.sumMM += minutes * minutes;
+  soilTc.sumTM += (int32_t)temperatureQ4 * minutes;
+  soilTc.sumTR += (int32_t)temperatureQ4 * raw;
+  soilTc.sumMR += minutes * raw;
+  soilTc.sumRR += (int32_t)raw * raw;
+  soilTc.minT = min(soilTc.minT, temperatureQ4);
+  soilTc.maxT = max(soilTc.maxT, temperatureQ4);
+}
+
+/*
+ * Once per night: fits raw = a + k*T + b*t and folds k into the model. The
+ * soil keeps drying overnight while the air cools, so raw against T alone
+ * would credit that drying to temperature (often with the wrong sign). The
+ * time term takes the steady drift; k then comes only from the part of the
+ * temperature that did not just follow the clock, and the fit quality is the
+ * partial r² of raw on T with the trend removed. Nights whose temperature
+ * fell too evenly to tell the two apart are skipped.
+ */
+void finishSoilTcNight() {
+  if (soilTc.n < SOIL_TC_MIN_SAMPLES) {
+    soilTc.lastFitResult = "too few samples";
+    return;
+  }
+  if (soilTc.maxT - soilTc.minT < SOIL_TC_MIN_RANGE * 16) {
+    soilTc.lastFitResult = "temperature range too small";
+    return;
+  }
+  
+  // n² times the (co)variances
+  int64_t n = soilTc.n;
+  int64_t varianceT = n * soilTc.sumTT - soilTc.sumT * soilTc.sumT;
+  int64_t varianceM = n * soilTc.sumMM - soilTc.sumM * soilTc.sumM;
+  int64_t varianceR = n * soilTc.sumRR - soilTc.sumR * soilTc.sumR;
+  int64_t covarianceTM = n * soilTc.sumTM - soilTc.sumT * soilTc.sumM;
+  int64_t covarianceTR = n * soilTc.sumTR - soilTc.sumT * soilTc.sumR;
+  int64_t covarianceMR = n * soilTc.sumMR - soilTc.sumM * soilTc.sumR;
+  if (varianceT <= 0 || varianceR <= 0 || varianceM <= 0) {
+    soilTc.lastFitResult = "no variation";
+    return;
+  }
+  
+  // Remove the linear time trend from T and raw
+  double detrendedTT = varianceT - (double)covarianceTM * covarianceTM / varianceM;
+  double detrendedRR = varianceR - (double)covarianceMR * covarianceMR / varianceM;
+  double detrendedTR = covarianceTR - (double)covarianceTM * covarianceMR / varianceM;
+  if (detrendedTT * 100 < (double)varianceT * SOIL_TC_MIN_INDEPENDENT || detrendedRR <= 0) {
+    soilTc.lastFitResult = "temperature followed the clock";
+    return;
+  }
+  
+  double r2 = detrendedTR * detrendedTR / (detrendedTT * detrendedRR);
+  // Counts per Q4 step -> counts per degree in Q8
+  int32_t slopeQ8 = constrain((int64_t)llround(detrendedTR * 4096 / detrendedTT), (int64_t)(-SOIL_TC_MAX_COEFFICIENT * 256),
+                              (int64_t)(SOIL_TC_MAX_COEFFICIENT * 256));
+  soilTc.lastFitQ8 = slopeQ8;
+  if (r2 * 100 < SOIL_TC_MIN_R2) {
+    soilTc.lastFitResult = "poor fit";
+    return;
+  }
+  
+  SoilTempCompModel& model = soilTc.model;
+  model.coeffQ8 = model.nights == 0 ? slopeQ8 : (model.coeffQ8 * 3 + slopeQ8) / 4;
+  model.nights++;
+  soilTcPrefs.putBytes("model", &model, sizeof(model));
+  soilTc.lastFitResult = "applied";
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Soil temperature compensation: night fit " + String(slopeQ8 / 256.0, 2) + " counts/C (r2 " +
+                   String(r2, 2) + "), now " + String(model.coeffQ8 / 256.0, 2) + " counts/C");
+  #endif
+}
+
+// =============================================================================
+// RAIN DETECTION FUNCTIONS
+// =============================================================================
+
+void initializeRainDetection() {
+  #if RAIN_DETECTION_ENABLED
+    bus::subscribe<PumpStartedEvent>("rain", onPumpStartedRain, bus::SYNC);
+    bus::subscribe<PumpStoppedEvent>("rain", onPumpStoppedRain, bus::SYNC);
+  #endif
+}
+
+void onPumpStartedRain(const PumpStartedEvent& event) {
+  if (!rainState.primed) {
+    return;
+  }
+  rainState.pumpWatch = true;
+  rainState.pumpStartLevel = rainState.smoothedQ4 >> 4;
+  rainState.pumpPeak = rainState.pumpStartLevel;
+}
+
+void onPumpStoppedRain(const PumpStoppedEvent& event) {
+  rainState.settleUntil = millis() + RAIN_PUMP_SETTLE_MS;
+}
+
+// One step per soil sample, constant work: a rise while no pump water is
+// soaking in is rain
+void updateRainDetector(int raw) {
+  #if RAIN_DETECTION_ENABLED
+    uint32_t startCycles = ESP.getCycleCount();
+    unsigned long now = millis();
+    
+    int32_t level = constrain(map(raw, soilCal.model.wetRaw, soilCal.model.dryRaw, 10000, 0), 0L, 10000L);
+    if (!rainState.primed) {
+      rainState.smoothedQ4 = level << 4;
+      rainState.trough = level;
+      rainState.primed = true;
+    }
+    rainState.smoothedQ4 += ((level << 4) - rainState.smoothedQ4) >> RAIN_SMOOTHING_SHIFT;
+    int32_t smoothed = rainState.smoothedQ4 >> 4;
+    rainState.samples++;
+    
+    // Learn how far one irrigation lifts the reading once its water has soaked in
+    if (rainState.pumpWatch && !systemState.pumpActive) {
+      rainState.pumpPeak = max(rainState.pumpPeak, smoothed);
+      if ((long)(now - rainState.settleUntil) >= 0) {
+        int32_t rise = rainState.pumpPeak - rainState.pumpStartLevel;
+        if (rise > 0) {
+          rainState.pumpRiseCenti = rainState.pumpRiseCenti ? (rainState.pumpRiseCenti * 3 + rise) / 4 : rise;
+        }
+        rainState.pumpWatch = false;
+      }
+    }
+    
+    if (systemState.pumpActive || rainState.pumpWatch) {
+      // The pump explains any rise; start over from here once it has settled
+      if (rainState.phase == RAIN_RISING) {
+        rainState.abandoned++;
+        rainState.phase = RAIN_IDLE;
+      }
+      rainState.trough = smoothed;
+      rainState.confirm = 0;
+    } else if (rainState.phase == RAIN_IDLE) {
+      // Follow the dry-down; drift upward only slowly so sensor drift is not mistaken for rain
+      if (smoothed < rainState.trough) {
+        rainState.trough = smoothed;
+      } else {
+        rainState.trough += (smoothed - rainState.trough) >> RAIN_BASELINE_SHIFT;
+      }
+      if (smoothed - rainState.trough >= RAIN_RISE_THRESHOLD * 100) {
+        if (++rainState.confirm >= RAIN_CONFIRM_SAMPLES) {
+          rainState.phase = RAIN_RISING;
+          rainState.startedAt = now;
+          rainState.peak = smoothed;
+          rainState.lastPeakAt = now;
+        }
+      } else {
+        rainState.confirm = 0;
+      }
+    } else {
+      if (smoothed > rainState.peak) {
+        rainState.peak = smoothed;
+        rainState.lastPeakAt = now;
+      }
+      if (now - rainState.lastPeakAt >= RAIN_END_MS) {
+        finishRainEvent(now);
+        rainState.trough = smoothed;
+      }
+    }
+    
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    if (cycles > rainState.maxCycles) {
+      rainState.maxCycles = cycles;
+    }
+  #endif
+}
+
+// The rise has stopped: estimate the rainfall and tell the rest of the system
+void finishRainEvent(unsigned long now) {
+  rainState.phase = RAIN_IDLE;
+  rainState.confirm = 0;
+  
+  int32_t rise = rainState.peak - rainState.trough;
+  uint16_t rainTenths = min((int32_t)(rise * RAIN_MM_PER_PERCENT / 10), (int32_t)UINT16_MAX);
+  uint8_t doses = rainState.pumpRiseCenti > 0 ?
+                  min((rise + rainState.pumpRiseCenti / 2) / rainState.pumpRiseCenti, (int32_t)UINT8_MAX) : 1;
+  
+  time_t clock = time(nullptr);
+  RainEventRecord& record = rainState.history[rainState.events % RAIN_HISTORY_SIZE];
+  record.endedAt = clock >= 1600000000 ? (uint32_t)clock : now / 1000;
+  record.durationMin = (now - rainState.startedAt) / 60000;
+  record.riseCenti = rise;
+  record.rainTenths = rainTenths;
+  record.doses = doses;
+  rainState.events++;
+  rainState.historyCount = min(rainState.historyCount + 1, RAIN_HISTORY_SIZE);
+  rainState.todayTenths = min(rainState.todayTenths + rainTenths, (int)UINT16_MAX);
+  
+  bus::publish(RainDetectedEvent{(uint32_t)now, rainTenths, (uint16_t)rise, doses});
+}
+
+// Daily counters start over at local midnight (every 24 h of uptime without a clock)
+void checkDayRollover() {
+  time_t now = time(nullptr);
+  int32_t day;
+  if (now >= 1600000000) {
+    day = localDayNumber(now);
+  } else {
+    day = millis() / 86400000UL;
+  }
+  
+  if (day == irrigationDay) {
+    return;
+  }
+  if (irrigationDay >= 0) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("New day: " + String(systemState.dailyIrrigations) + " irrigation(s), " +
+                     String(rainState.todayTenths / 10.0, 1) + " mm rain yesterday");
+    #endif
+    systemState.dailyIrrigations = 0;
+    rainState.todayTenths = 0;
+    updateCropStage();               // Crop day counts roll over at the same midnight
+  }
+  irrigationDay = day;
+}
+
+void handleRain() {
+  DynamicJsonDocument doc(2048);
+  doc["enabled"] = RAIN_DETECTION_ENABLED;
+  doc["todayMm"] = rainState.todayTenths / 10.0;
+  doc["phase"] = rainState.phase == RAIN_RISING ? "rising" : "idle";
+  doc["moisture"] = (rainState.smoothedQ4 >> 4) / 100.0;
+  doc["baseline"] = rainState.trough / 100.0;
+  doc["pumpRisePercent"] = rainState.pumpRiseCenti / 100.0;
+  doc["events"] = rainState.events;
+  doc["abandoned"] = rainState.abandoned;
+  doc["samples"] = rainState.samples;
+  doc["maxSampleCycles"] = rainState.maxCycles;
+  
+  JsonArray history = doc.createNestedArray("history");
+  for (int i = 0; i < rainState.historyCount; i++) {
+    const RainEventRecord& record = rainState.history[(rainState.events - 1 - i) % RAIN_HISTORY_SIZE];
+    JsonObject entry = history.createNestedObject();
+    entry["endedAt"] = record.endedAt;
+    entry["durationMin"] = record.durationMin;
+    entry["risePercent"] = record.riseCenti / 100.0;
+    entry["rainMm"] = record.rainTenths / 10.0;
+    entry["doses"] = record.doses;
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// =============================================================================
+// ZONE COMMISSIONING FUNCTIONS
+// =============================================================================
+
+#define ZONE_MODEL_VERSION 1
+
+void initializeCommissioning() {
+  zonePrefs.begin("zone", false);
+  ZoneParameters saved;
+  if (zonePrefs.getBytes("params", &saved, sizeof(saved)) == sizeof(saved) &&
+      saved.version == ZONE_MODEL_VERSION) {
+    commissioning.zone = saved;
+    commissioning.zoneValid = true;
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Zone parameters restored: dead time " + String(saved.deadTimeSeconds, 0) + " s, " +
+                     String(saved.gainPerSecond, 3) + " %/s, tau " + String(saved.tauSeconds, 0) + " s");
+    #endif
+  }
+}
+
+// Returns why commissioning cannot start, or nullptr once it is running
+const char* startCommissioning() {
+  if (commissioning.active) {
+    return "commissioning already running";
+  }
+  if (systemState.emergencyStop) {
+    return "emergency stop active";
+  }
+  if (systemState.pumpActive) {
+    return "pump is running";
+  }
+  #if PUMP_CURRENT_SENSING && SOIL_PROBE_TYPE == SOIL_PROBE_ANALOG
+    if (currentSenseTaskHandle != nullptr && soilAdcChannel < 0) {
+      // The soil would read as flat for the whole pulse
+      return "soil probe cannot be read while the pump runs";
+    }
+  #endif
+  
+  commissioning.active = true;
+  commissioning.abortRequested = false;
+  commissioning.error = "";
+  commissioning.pulse = 0;
+  commissioning.sampleCount = 0;
+  commissioning.last = {};
+  if (!coro::scheduler.spawn("commission", commissioningFlow())) {
+    commissioning.active = false;
+    return "no free flow slot";
+  }
+  return nullptr;
+}
+
+void finishCommissioning(const char* phase, const char* error) {
+  if (systemState.pumpActive) {
+    stopIrrigation();
+  }
+  commissioning.phase = phase;
+  commissioning.error = error;
+  commissioning.active = false;
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Commissioning " + String(phase) + (error[0] ? ": " + String(error) : String("")));
+  #endif
+}
+
+// Baseline, one test pulse, observation; repeated COMMISSION_PULSES times and
+// averaged over the pulses that gave a clean response
+coro::Task commissioningFlow() {
+  float deadTime = 0, gain = 0, tau = 0, decay = 0;
+  int good = 0;
+  
+  for (int pulse = 1; pulse <= COMMISSION_PULSES; pulse++) {
+    commissioning.pulse = pulse;
+    commissioning.sampleCount = 0;
+    commissioning.heldSamples = 0;
+    commissioning.phase = "baseline";
+    unsigned long started = millis();
+    int lastFresh = -1;
+    
+    for (uint16_t i = 0; i < COMMISSION_MAX_SAMPLES; i++) {
+      // Sample on a fixed grid so loop jitter does not stretch the time axis
+      long wait = (long)(started + i * COMMISSION_SAMPLE_MS - millis());
+      if (wait > 0) {
+        co_await coro::sleepFor(wait);
+      }
+      
+      if (commissioning.abortRequested || systemState.emergencyStop) {
+        finishCommissioning("aborted", systemState.emergencyStop ? "emergency stop" : "stopped by request");
+        co_return;
+      }
+      if (i == COMMISSION_BASELINE_SAMPLES) {
+        if (!startIrrigation(100, COMMISSION_PULSE_SECONDS, PUMP_START_COMMISSIONING)) {
+          finishCommissioning("failed", pumpBlockReason ? pumpBlockReason : "pump refused");
+          co_return;
+        }
+        commissioning.phase = "observe";
+      }
+      // A slot without a fresh reading is filled in once the next one arrives,
+      // by interpolation (slots before the first take its value), rather than
+      // repeating the last value as a flat step
+      int16_t level;
+      if (sampleCommissioningSoil(level)) {
+        for (int gap = lastFresh + 1; gap < (int)i; gap++) {
+          commissioning.trace[gap] = lastFresh < 0 ? level
+            : commissioning.trace[lastFresh] + (level - commissioning.trace[lastFresh]) * (gap - lastFresh) / ((int)i - lastFresh);
+        }
+        commissioning.trace[i] = level;
+        lastFresh = i;
+      } else {
+        commissioning.heldSamples++;
+      }
+      commissioning.sampleCount = lastFresh + 1;
+    }
+    
+    stepid::Trace trace = {commissioning.trace, commissioning.sampleCount, COMMISSION_SAMPLE_MS,
+                           COMMISSION_BASELINE_SAMPLES, (float)COMMISSION_PULSE_SECONDS};
+    commissioning.last = stepid::identify(trace);
+    const stepid::Result& result = commissioning.last;
+    
+    #if SERIAL_OUTPUT_ENABLED
+      if (result.ok) {
+        Log.println("Commissioning pulse " + String(pulse) + ": dead time " + String(result.deadTimeSeconds, 0) +
+                       " s, rise " + String(result.rise, 2) + "%, tau " + String(result.tauSeconds, 0) +
+                       " s, decay " + String(result.decayPerHour, 2) + " %/h");
+      } else {
+        Log.println("Commissioning pulse " + String(pulse) + " unusable: " + String(result.error));
+      }
+    #endif
+    if (result.ok) {
+      deadTime += result.deadTimeSeconds;
+      gain += result.gainPerSecond;
+      tau += result.tauSeconds;
+      decay += result.decayPerHour;
+      good++;
+    }
+  }
+  
+  if (good == 0) {
+    finishCommissioning("failed", commissioning.last.error);
+    co_return;
+  }
+  
+  time_t now = time(nullptr);
+  ZoneParameters zone = {};
+  zone.version = ZONE_MODEL_VERSION;
+  zone.deadTimeSeconds = deadTime / good;
+  zone.gainPerSecond = gain / good;
+  zone.tauSeconds = tau / good;
+  zone.decayPerHour = decay / good;
+  zone.pulses = good;
+  zone.commissionedAt = now >= 1600000000 ? (uint32_t)now : millis() / 1000;
+  commissioning.zone = zone;
+  commissioning.zoneValid = true;
+  zonePrefs.putBytes("params", &zone, sizeof(zone));
+  finishCommissioning("done", "");
+}
+
+// One soil reading on the calibrated scale in 0.01 %, taken outside
+// readSensors so it can run faster. While the pump current sampler owns the
+// ADC the reading comes from its DMA stream. Temperature compensation is left
+// out: it hardly moves within one commissioning run.
+bool sampleCommissioningSoil(int16_t& level) {
+  int raw;
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+    if (!freqProbe.ready) {
+      return false;
+    }
+    collectFrequencyWindow();
+    if (!freqProbe.measuring) {
+      startFrequencyWindow();
+    }
+    raw = probe::rawFromMoisture(freqProbe.lastMoisture[0], SOIL_MOISTURE_DRY_VALUE, SOIL_MOISTURE_WET_VALUE);
+  #else
+    if (acquireAnalogInputs()) {
+      raw = analogRead(SOIL_MOISTURE_PIN);
+      releaseAnalogInputs();
+    } else if (!readStreamedSoil(raw)) {
+      return false;
+    }
+  #endif
+  level = constrain(map(raw, soilCal.model.wetRaw, soilCal.model.dryRaw, 10000, 0), 0L, 10000L);
+  return true;
+}
+
+// Pump-seconds that lift the soil to the refill target at the measured gain;
+// 0 when the zone is not commissioned or the soil is already there
+float zoneDoseSeconds() {
+  if (!ZONE_MODEL_DOSING || !commissioning.zoneValid || commissioning.zone.gainPerSecond <= 0) {
+    return 0;
+  }
+  int target = cropState.active ? cropState.profile->stages[cropState.stage].target :
+                                  activeSoilThreshold() + ZONE_REFILL_PERCENT;
+  float deficit = min(target, 100) - systemState.soilMoisturePercent;
+  return deficit > 0 ? deficit / commissioning.zone.gainPerSecond : 0;
+}
+
+// Time before the probe has seen most of a watering (dead time + 3 tau)
+unsigned long zoneSettleMs() {
+  if (!ZONE_MODEL_DOSING || !commissioning.zoneValid) {
+    return 0;
+  }
+  return (unsigned long)((commissioning.zone.deadTimeSeconds + 3 * commissioning.zone.tauSeconds) * 1000);
+}
+
+// Status and zone parameters; ?trace=1 returns the last pulse's samples as
+// CSV for stepid::identify() on a PC
+void handleCommissionGet() {
+  if (server.hasArg("trace")) {
+    server.sendHeader("Content-Disposition", "attachment; filename=\"commission.csv\"");
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "text/csv", "");
+    server.sendContent("# intervalMs=" + String(COMMISSION_SAMPLE_MS) + " pulseStart=" + String(COMMISSION_BASELINE_SAMPLES) +
+                       " pulseSeconds=" + String(COMMISSION_PULSE_SECONDS) + "\nseconds,moisture\n");
+    String chunk;
+    for (uint16_t i = 0; i < commissioning.sampleCount; i++) {
+      chunk += String(i * COMMISSION_SAMPLE_MS / 1000.0, 1) + "," + String(commissioning.trace[i] / 100.0, 2) + "\n";
+      if (chunk.length() > 512 || i + 1 == commissioning.sampleCount) {
+        server.sendContent(chunk);
+        chunk = "";
+      }
+    }
+    server.sendContent("");
+    return;
+  }
+  
+  DynamicJsonDocument doc(1024);
+  doc["active"] = commissioning.active;
+  doc["phase"] = commissioning.phase;
+  doc["error"] = commissioning.error;
+  doc["pulse"] = commissioning.pulse;
+  doc["pulses"] = COMMISSION_PULSES;
+  doc["samples"] = commissioning.sampleCount;
+  doc["heldSamples"] = commissioning.heldSamples;
+  doc["maxSamples"] = COMMISSION_MAX_SAMPLES;
+  
+  if (commissioning.last.ok) {
+    JsonObject last = doc.createNestedObject("lastPulse");
+    last["baseline"] = commissioning.last.baseline;
+    last["noise"] = commissioning.last.noise;
+    last["rise"] = commissioning.last.rise;
+    last["peakSeconds"] = commissioning.last.peakSeconds;
+    last["deadTimeSeconds"] = commissioning.last.deadTimeSeconds;
+    last["tauSeconds"] = commissioning.last.tauSeconds;
+    last["decayPerHour"] = commissioning.last.decayPerHour;
+  }
+  
+  if (commissioning.zoneValid) {
+    JsonObject zone = doc.createNestedObject("zone");
+    zone["deadTimeSeconds"] = commissioning.zone.deadTimeSeconds;
+    zone["gainPerSecond"] = commissioning.zone.gainPerSecond;
+    zone["tauSeconds"] = commissioning.zone.tauSeconds;
+    zone["decayPerHour"] = commissioning.zone.decayPerHour;
+    zone["pulses"] = commissioning.zone.pulses;
+    zone["commissionedAt"] = commissioning.zone.commissionedAt;
+    zone["doseSeconds"] = zoneDoseSeconds();
+    zone["settleSeconds"] = zoneSettleMs() / 1000;
+  }
+  
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+void handleCommissionPost() {
+  if (!requireWebAuth()) {
+    return;
+  }
+  
+  String action = server.arg("action");
+  if (action == "start") {
+    const char* refused = startCommissioning();
+    if (refused == nullptr) {
+      server.send(200, "text/plain", "Commissioning started");
+    } else {
+      server.send(409, "text/plain", "Commissioning refused: " + String(refused));
+    }
+  } else if (action == "abort") {
+    commissioning.abortRequested = true;
+    server.send(200, "text/plain", "Commissioning abort requested");
+  } else if (action == "forget") {
+    if (commissioning.active) {
+      server.send(409, "text/plain", "Commissioning in progress");
+      return;
+    }
+    commissioning.zoneValid = false;
+    zonePrefs.remove("params");
+    server.send(200, "text/plain", "Zone parameters cleared");
+  } else {
+    server.send(400, "text/plain", "Invalid action");
+  }
+}
+
+// =============================================================================
+// SERIAL CONSOLE FUNCTIONS
+// =============================================================================
+
+void updateConsole() {
+  #if CONSOLE_ENABLED
+    serialConsole.poll();
+    if (serialConsole.takeInterrupt()) {
+      consoleTail.intervalMs = 0;
+      consoleDump.active = false;
+    }
+    continueConsoleDump();
+    if (consoleTail.intervalMs > 0 && millis() - consoleTail.lastAt >= consoleTail.intervalMs) {
+      consoleTail.lastAt = millis();
+      SensorSnapshot snapshot = sensorSnapshot.read();
+      Serial.printf("%lu soil=%d%% raw=%d temp=%.1f hum=%.0f light=%d%% pump=%d tank=%.0f\r\n",
+                    (unsigned long)(snapshot.timestamp / 1000), snapshot.soilMoisturePercent, snapshot.soilMoistureRaw,
+                    snapshot.temperature, snapshot.humidity, snapshot.lightLevelPercent, snapshot.pumpActive ? 1 : 0,
+                    snapshot.tankLevel);
+    }
+  #endif
+}
+
+void consoleStatus(int argc, char** argv) {
+  SensorSnapshot snapshot = sensorSnapshot.read();
+  Serial.printf("Soil %d%% (raw %d, threshold %d%%)  Temperature %.1f C  Humidity %.0f%%  Light %d%%\r\n",
+                snapshot.soilMoisturePercent, snapshot.soilMoistureRaw, activeSoilThreshold(),
+                snapshot.temperature, snapshot.humidity, snapshot.lightLevelPercent);
+  
+  char tank[12] = "none";
+  if (TANK_ENABLED) {
+    if (snapshot.tankLevel < 0) {
+      strlcpy(tank, "unknown", sizeof(tank));
+    } else {
+      snprintf(tank, sizeof(tank), "%.0f%%", snapshot.tankLevel);
+    }
+  }
+  Serial.printf("Pump %s  Irrigations today %d/%d  Rain today %.1f mm  Tank %s\r\n",
+                snapshot.pumpActive ? "ON" : "off", snapshot.dailyIrrigations, runtimeSettings.maxDailyIrrigations,
+                snapshot.rainTodayMm, tank);
+  Serial.printf("System %s  E-stop %s  WiFi %s (%d dBm)  Free heap %lu  Uptime %lu s\r\n",
+                snapshot.systemOK ? "OK" : "FAULT", snapshot.emergencyStop ? "LATCHED" : "clear",
+                snapshot.wifiConnected ? "connected" : "down", snapshot.wifiConnected ? WiFi.RSSI() : 0,
+                (unsigned long)ESP.getFreeHeap(), millis() / 1000);
+  if (softAp.active) {
+    Serial.printf("Access point %s (key %s) at %s  Clients %u/%d  Scans for %s %lu\r\n",
+                  SOFTAP_SSID, softApPassword, WiFi.softAPIP().toString().c_str(), (unsigned)WiFi.softAPgetStationNum(),
+                  SOFTAP_MAX_CLIENTS, runtimeSettings.wifiSsid, (unsigned long)softAp.probes);
+  }
+  
+  const char* blocked = snapshot.pumpActive ? nullptr : pumpStartBlocked(plannedIrrigationSeconds() * 1000UL);
+  if (blocked != nullptr) {
+    Serial.printf("Pump start blocked: %s\r\n", blocked);
+  }
+}
+
+void consoleTailCommand(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "off") == 0) {
+    consoleTail.intervalMs = 0;
+    return;
+  }
+  long seconds = argc > 1 ? atol(argv[1]) : 5;
+  if (seconds < 1 || seconds > 3600) {
+    Serial.print("Usage: tail [1-3600|off]\r\n");
+    return;
+  }
+  consoleTail.intervalMs = seconds * 1000UL;
+  consoleTail.lastAt = millis() - consoleTail.intervalMs;
+  Serial.print("uptime soil raw temp hum light pump tank - Ctrl-C or 'tail off' stops\r\n");
+}
+
+// The listing is written by continueConsoleDump, a few lines per loop pass:
+// all of it at once would block the loop on the UART for a few hundred ms
+void consoleLog(int argc, char** argv) {
+  #if BREADCRUMBS_ENABLED
+    uint32_t head = rtcBreadcrumbs.head;
+    consoleDump.end = head;
+    consoleDump.next = head - min(head, (uint32_t)BREADCRUMB_COUNT);
+    consoleDump.shown = 0;
+    consoleDump.active = true;
+    serialConsole.holdPrompt();
+  #else
+    Serial.print("Breadcrumbs are disabled (BREADCRUMBS_ENABLED)\r\n");
+  #endif
+}
+
+void continueConsoleDump() {
+  #if BREADCRUMBS_ENABLED
+    if (!consoleDump.active) {
+      return;
+    }
+    // Entries overwritten since "log" was typed are skipped, not printed twice
+    uint32_t oldest = rtcBreadcrumbs.head - min(rtcBreadcrumbs.head, (uint32_t)BREADCRUMB_COUNT);
+    if ((int32_t)(consoleDump.next - oldest) < 0) {
+      consoleDump.next = oldest;
+    }
+    char line[64];
+    for (int i = 0; i < CONSOLE_DUMP_LINES && consoleDump.next != consoleDump.end; i++) {
+      if (Serial.availableForWrite() < (int)sizeof(line)) {
+        return;                         // Transmit buffer full: continue next pass
+      }
+      formatBreadcrumb(rtcBreadcrumbs.ring[consoleDump.next & (BREADCRUMB_COUNT - 1)], line, sizeof(line));
+      Serial.printf("%s\r\n", line);
+      consoleDump.next++;
+      consoleDump.shown++;
+    }
+    if (consoleDump.next != consoleDump.end) {
+      return;
+    }
+    Serial.printf("%lu event(s) this run, last %lu shown\r\n", (unsigned long)consoleDump.end,
+                  (unsigned long)consoleDump.shown);
+    consoleDump.active = false;
+    serialConsole.showPrompt();
+  #endif
+}
+
+void consoleFaults(int argc, char** argv) {
+  #if FAULT_HISTORY_ENABLED
+    faultPrefs.begin("faults", true);
+    uint8_t head = faultPrefs.getUChar("head", 0);
+    // Newest first
+    for (int i = 1; i <= FAULT_HISTORY_SIZE; i++) {
+      char key[8];
+      snprintf(key, sizeof(key), "f%u", (head + FAULT_HISTORY_SIZE - i) % FAULT_HISTORY_SIZE);
+      FaultRecord record;
+      if (faultPrefs.getBytesLength(key) != sizeof(record) ||
+          faultPrefs.getBytes(key, &record, sizeof(record)) != sizeof(record)) {
+        continue;
+      }
+      Serial.printf("boot %lu: %s", (unsigned long)record.bootCount, resetReasonName(record.resetReason));
+      if (record.flags & FAULT_FLAG_RTC_VALID) {
+        Serial.printf(" after %lu s in %s, min heap %lu%s", (unsigned long)(record.uptimeMs / 1000),
+                      loopStageNames[record.loopStage < STAGE_COUNT ? record.loopStage : STAGE_BOOT],
+                      (unsigned long)record.minFreeHeap, record.pumpActive ? ", pump on" : "");
+      }
+      if (record.flags & FAULT_FLAG_COREDUMP) {
+        Serial.printf(", crash in %s at 0x%08lx", record.crashTask, (unsigned long)record.crashPc);
+      }
+      Serial.print("\r\n");
+    }
+    faultPrefs.end();
+  #else
+    Serial.print("Fault history is disabled (FAULT_HISTORY_ENABLED)\r\n");
+  #endif
+}
+
+void consoleGet(int argc, char** argv) {
+  Serial.printf("irrigation.soilThreshold %d\r\n", runtimeSettings.soilThreshold);
+  Serial.printf("irrigation.durationSeconds %d\r\n", runtimeSettings.irrigationSeconds);
+  Serial.printf("irrigation.cooldownSeconds %lu\r\n", (unsigned long)(runtimeSettings.irrigationCooldownMs / 1000));
+  Serial.printf("irrigation.maxDaily %d\r\n", runtimeSettings.maxDailyIrrigations);
+  Serial.printf("sensors.readIntervalMs %lu\r\n", (unsigned long)runtimeSettings.sensorReadIntervalMs);
+  Serial.printf("cloud.transmitIntervalMs %lu\r\n", (unsigned long)runtimeSettings.transmitIntervalMs);
+  Serial.printf("wifi.ssid %s\r\n", runtimeSettings.wifiSsid);
+  Serial.printf("crop.profile %s\r\n", runtimeSettings.cropProfile);
+  Serial.printf("crop.plantingDate %s\r\n", runtimeSettings.plantingDate);
+  Serial.printf("(source: %s)\r\n", configStatus.source);
+}
+
+// set section.key value - goes through the same validation as config.json
+void consoleSet(int argc, char** argv) {
+  if (argc != 3) {
+    Serial.print("Usage: set <key> <value>   (Tab lists the keys)\r\n");
+    return;
+  }
+  bool known = false;
+  for (const char* const* key = consoleSettingKeys; *key != nullptr; key++) {
+    known = known || strcmp(*key, argv[1]) == 0;
+  }
+  char* dot = strchr(argv[1], '.');
+  if (!known || dot == nullptr) {
+    Serial.printf("Unknown setting '%s'\r\n", argv[1]);
+    return;
+  }
+  *dot = '\0';
+  
+  // Numbers go in as numbers, except for the text settings
+  StaticJsonDocument<256> doc;
+  char* end = nullptr;
+  long number = strtol(argv[2], &end, 10);
+  bool text = strcmp(argv[1], "wifi") == 0 || strcmp(argv[1], "crop") == 0 || strcmp(dot + 1, "thingSpeakApiKey") == 0;
+  if (!text && argv[2][0] != '\0' && *end == '\0') {
+    doc[argv[1]][dot + 1] = number;
+  } else {
+    doc[argv[1]][dot + 1] = argv[2];
+  }
+  
+  RuntimeSettings next = runtimeSettings;
+  String error;
+  if (!applyConfigDocument(doc, next, error)) {
+    Serial.printf("Rejected: %s\r\n", error.c_str());
+    return;
+  }
+  #if CONFIG_FILE_ENABLED
+    if (!saveConfigFile(next)) {
+      Serial.print("Could not write " CONFIG_FILE_PATH "\r\n");
+      return;
+    }
+    rememberGoodConfig();
+    configStatus.source = "config.json";
+    configStatus.lastError = "";
+  #endif
+  applyRuntimeSettings(next);
+  Serial.printf("%s.%s set%s\r\n", argv[1], dot + 1, CONFIG_FILE_ENABLED ? " and saved" : " until restart");
+}
+
+void consoleWater(int argc, char** argv) {
+  long seconds = argc > 1 ? atol(argv[1]) : 0;
+  if (argc > 1 && (seconds < MIN_IRRIGATION_SECONDS || seconds > MAX_IRRIGATION_SECONDS)) {
+    Serial.printf("Usage: water [%d-%d seconds]\r\n", MIN_IRRIGATION_SECONDS, MAX_IRRIGATION_SECONDS);
+    return;
+  }
+  if (startIrrigation(100, seconds)) {
+    Serial.printf("Irrigation started for %d s\r\n", pumpPlannedSeconds);
+  } else {
+    Serial.printf("Irrigation refused: %s\r\n", pumpBlockReason);
+  }
+}
+
+void consoleStop(int argc, char** argv) {
+  stopIrrigation();
+}
+
+void consoleEmergencyStop(int argc, char** argv) {
+  estopRemoteTrip = true;
+  emergencyStopISR();
+  Serial.print("Emergency stop triggered\r\n");
+}
+
+void consoleReset(int argc, char** argv) {
+  if (resetEmergencyStop("serial")) {
+    Serial.print("Emergency stop reset\r\n");
+  } else {
+    Serial.print("Emergency stop input still active\r\n");
+  }
+}
+
+void consoleCommission(int argc, char** argv) {
+  const char* action = argc > 1 ? argv[1] : "status";
+  if (strcmp(action, "start") == 0) {
+    const char* refused = startCommissioning();
+    Serial.printf("%s%s\r\n", refused ? "Commissioning refused: " : "Commissioning started", refused ? refused : "");
+  } else if (strcmp(action, "abort") == 0) {
+    commissioning.abortRequested = true;
+  } else {
+    Serial.printf("Phase %s, pulse %u/%d, %u samples%s%s\r\n", commissioning.phase, commissioning.pulse, COMMISSION_PULSES,
+                  commissioning.sampleCount, commissioning.error[0] ? " - " : "", commissioning.error);
+    if (commissioning.zoneValid) {
+      Serial.printf("Zone: dead time %.0f s, gain %.3f %%/s, tau %.0f s, decay %.2f %%/h\r\n",
+                    commissioning.zone.deadTimeSeconds, commissioning.zone.gainPerSecond,
+                    commissioning.zone.tauSeconds, commissioning.zone.decayPerHour);
+    }
+  }
+}
+
+// Read-only checks; nothing here switches the pump
+void consoleSelfTest(int argc, char** argv) {
+  int failures = 0;
+  int warnings = 0;
+  auto report = [&](const char* item, int level, const char* detail) {
+    static const char* const levels[] = {"PASS", "WARN", "FAIL"};
+    Serial.printf("%-5s %-12s %s\r\n", levels[level], item, detail);
+    failures += level == 2;
+    warnings += level == 1;
+  };
+  char detail[64];
+  
+  #if SOIL_PROBE_TYPE == SOIL_PROBE_FREQUENCY
+    snprintf(detail, sizeof(detail), "%lu Hz, %lu windows", (unsigned long)freqProbe.lastHz[0], (unsigned long)freqProbe.windows);
+    report("soil probe", freqProbe.ready && freqProbe.lastHz[0] >= SOIL_FREQ_MIN_HZ ? 0 : 2, detail);
+  #else
+    int raw = systemState.soilMoistureRaw;
+    snprintf(detail, sizeof(detail), "raw %d", raw);
+    report("soil probe", raw <= 0 || raw >= 4095 ? 2 : (sensorValidation.soilMoistureValid ? 0 : 1), detail);
+  #endif
+  
+  if (DHT_ENABLED) {
+    snprintf(detail, sizeof(detail), "%.1f C, %.0f%%", systemState.temperature, systemState.humidity);
+    report("air sensor", sensorValidation.temperatureValid && sensorValidation.humidityValid ? 0 : 2, detail);
+  }
+  
+  if (TANK_ENABLED) {
+    snprintf(detail, sizeof(detail), "%.0f%%%s", tankState.levelPercent, tankState.lockout ? ", locked out" : "");
+    report("tank", tankState.sensorFault || tankState.levelPercent < 0 ? 2 : (tankState.lockout ? 1 : 0), detail);
+  }
+  
+  report("e-stop", systemState.emergencyStop ? 2 : 0, systemState.emergencyStop ? "latched" : "clear");
+  
+  const char* blocked = systemState.pumpActive ? nullptr : pumpStartBlocked(plannedIrrigationSeconds() * 1000UL);
+  report("pump", blocked ? 1 : 0, blocked ? blocked : (systemState.pumpActive ? "running" : "ready"));
+  
+  snprintf(detail, sizeof(detail), "%d dBm", WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+  if (softAp.active) {
+    snprintf(detail, sizeof(detail), "access point, %u client(s)", (unsigned)WiFi.softAPgetStationNum());
+  }
+  report("wifi", WiFi.status() == WL_CONNECTED ? 0 : 1,
+         WiFi.status() == WL_CONNECTED || softAp.active ? detail : "not connected");
+  
+  report("clock", time(nullptr) >= 1600000000 ? 0 : 1, time(nullptr) >= 1600000000 ? "set" : "not set (no NTP yet)");
+  
+  snprintf(detail, sizeof(detail), "%lu free, %lu lowest, %lu largest block", (unsigned long)ESP.getFreeHeap(),
+           (unsigned long)ESP.getMinFreeHeap(), (unsigned long)ESP.getMaxAllocHeap());
+  report("heap", ESP.getMaxAllocHeap() < 8192 ? 1 : 0, detail);
+  
+  report("config", configStatus.lastError.length() ? 1 : 0,
+         configStatus.lastError.length() ? configStatus.lastError.c_str() : configStatus.source);
+  
+  #if SYSLOG_ENABLED
+    snprintf(detail, sizeof(detail), "%lu sent, %lu failed, %lu dropped", (unsigned long)remoteLog.stats.sent,
+             (unsigned long)remoteLog.stats.sendFailed, (unsigned long)remoteLog.dropped());
+    report("syslog", remoteLog.stats.sendFailed > 0 || remoteLog.dropped() > 0 ? 1 : 0, detail);
+  #endif
+  
+  #if COAP_ENABLED
+    snprintf(detail, sizeof(detail), "port %d, %lu requests, %u observers", COAP_PORT,
+             (unsigned long)coapState.stats.requests, (unsigned)coapState.observers.count());
+    report("coap", coapState.started ? 0 : 2, coapState.started ? detail : "socket not open");
+  #endif
+  
+  const console::Stats& stats = serialConsole.stats;
+  snprintf(detail, sizeof(detail), "%lu lines, %lu too long, ring full %lu, poll %lu cycles",
+           (unsigned long)stats.lines, (unsigned long)stats.tooLong, (unsigned long)stats.ringFull,
+           (unsigned long)stats.maxPollCycles);
+  report("console", 0, detail);
+  
+  Serial.printf("%d failure(s), %d warning(s)\r\n", failures, warnings);
+}
+
+// =============================================================================
+// ACCESS POINT FALLBACK FUNCTIONS
+// =============================================================================
+
+/*
+ * When the station link cannot be made (at boot, or after every reconnect
+ * attempt has failed) the unit opens its own access point and answers every
+ * DNS name with its own address, so phones offer the dashboard as a sign-in
+ * page. The station side stays idle: an auto-reconnecting station scans all
+ * channels and drops the AP's clients each time. Instead softApProbeFlow()
+ * scans every SOFTAP_PROBE_INTERVAL and only joins once the configured
+ * network is visible; checkWiFiConnection() then closes the access point.
+ *
+ * The access point is not left up indefinitely: after SOFTAP_LIFETIME it
+ * closes and the station gets a full round of reconnect attempts (in case
+ * the network is back but hidden from scans); if those fail it reopens.
+ *
+ * Nothing here waits: the mode switches (which block in the WiFi driver)
+ * run on the network worker, the scan and the join run as a network flow,
+ * and the loop answers at most one DNS query and one HTTP request per pass.
+ * SOFTAP_MAX_CLIENTS bounds how much airtime and socket memory visitors get.
+ *
+ * Anyone who joins can reach the dashboard, so the network is never open and
+ * never uses a password shared between units: unless SOFTAP_PASSWORD is set,
+ * each device generates its own once, keeps it in NVS and shows it on the
+ * serial console and the LCD (not in the syslog mirror or the API). While the
+ * access point is up, /control also asks for the web login.
+ */
+
+void loadSoftApPassword() {
+  if (softApPassword[0] != '\0') {
+    return;
+  }
+  softApPrefs.begin("softap", false);
+  if (softApPrefs.getString("password", softApPassword, sizeof(softApPassword)) < 9) {
+    // No 0/O or 1/l/I: it is read off a small LCD and typed on a phone
+    static const char alphabet[] = "abcdefghijkmnpqrstuvwxyz23456789";
+    for (int i = 0; i < 10; i++) {
+      softApPassword[i] = alphabet[esp_random() % (sizeof(alphabet) - 1)];
+    }
+    softApPassword[10] = '\0';
+    softApPrefs.putString("password", softApPassword);
+  }
+  softApPrefs.end();
+}
+
+// Radio side of the switch into access point mode
+bool switchToSoftAp() {
+  WiFi.setAutoReconnect(false);
+  WiFi.disconnect();
+  WiFi.mode(WIFI_AP_STA);
+  if (softApPassword[0] == '\0' || !WiFi.softAP(SOFTAP_SSID, softApPassword, SOFTAP_CHANNEL, 0, SOFTAP_MAX_CLIENTS)) {
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    return false;
+  }
+  return true;
+}
+
+// Radio side of the switch back to a plain station
+bool switchToStation() {
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  return true;
+}
+
+// Loop side once the radio is (or failed to get) in access point mode
+void softApOpened(bool ok) {
+  if (!ok) {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Access point failed to start - staying offline");
+    #endif
+    return;
+  }
+  
+  // Captive DNS: every name resolves to us
+  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
+  dnsServer.start(SOFTAP_DNS_PORT, "*", WiFi.softAPIP());
+  
+  softAp.active = true;
+  softAp.startedAt = millis();
+  softAp.lastProbe = millis();
+  softAp.activations++;
+  wifiReconnectAttempts = 0;
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Access point '" SOFTAP_SSID "' up - dashboard at http://" + WiFi.softAPIP().toString());
+    Serial.printf("Access point password: %s\r\n", softApPassword);  // Serial only, never the syslog mirror
+  #endif
+}
+
+// At boot the worker is not running yet, and setup() may block anyway
+void startSoftAp() {
+  if (!SOFTAP_FALLBACK_ENABLED || softAp.active) {
+    return;
+  }
+  softApOpened(switchToSoftAp());
+}
+
+coro::Task softApStartFlow() {
+  if (softAp.active) {
+    co_return;
+  }
+  bool ok = co_await coro::onWorker([]() { return switchToSoftAp(); });
+  softApOpened(ok);
+}
+
+// expired: closed because SOFTAP_LIFETIME ran out, not because the station rejoined
+coro::Task softApStopFlow(bool expired) {
+  if (!softAp.active) {
+    co_return;
+  }
+  
+  // Stop answering as the access point before the radio changes under us
+  softAp.active = false;
+  dnsServer.stop();
+  if (!co_await coro::onWorker([]() { return switchToStation(); })) {
+    switchToStation();        // Worker never started: the AP must still close
+  }
+  
+  unsigned long upSeconds = (millis() - softAp.startedAt) / 1000;
+  if (expired) {
+    softAp.expiries++;
+    wifiReconnectAttempts = 0;
+    WiFi.begin(runtimeSettings.wifiSsid, runtimeSettings.wifiPassword);
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Access point closed after " + String(upSeconds) + " s - retrying '" +
+                  String(runtimeSettings.wifiSsid) + "'");
+    #endif
+  } else {
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Back on '" + String(runtimeSettings.wifiSsid) + "' - access point closed after " +
+                  String(upSeconds) + " s");
+    #endif
+  }
+}
+
+// Called every loop pass next to server.handleClient()
+void updateSoftAp() {
+  if (softAp.active) {
+    dnsServer.processNextRequest();
+  }
+}
+
+// Address the dashboard is reachable at right now
+IPAddress networkAddress() {
+  return softAp.active && WiFi.status() != WL_CONNECTED ? WiFi.softAPIP() : WiFi.localIP();
+}
+
+void handleNotFound() {
+  // Captive portal checks (generate_204, hotspot-detect.html, ...) ask for other hosts
+  if (softAp.active && server.hostHeader() != WiFi.softAPIP().toString()) {
+    server.sendHeader("Location", "http://" + WiFi.softAPIP().toString() + "/", true);
+    server.send(302, "text/plain", "");
+    return;
+  }
+  server.send(404, "text/plain", "Not found: " + server.uri());
+}
+
+coro::Task softApProbeFlow() {
+  softAp.probes++;
+  
+  // Asynchronous scan: the radio visits each channel while the loop carries on
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED) {
+    co_return;
+  }
+  int16_t found = WIFI_SCAN_RUNNING;
+  for (int waited = 0; waited < SOFTAP_SCAN_TIMEOUT; waited += 250) {
+    found = WiFi.scanComplete();
+    if (found != WIFI_SCAN_RUNNING) {
+      break;
+    }
+    co_await coro::sleepFor(250);
+  }
+  bool visible = false;
+  for (int16_t i = 0; i < found; i++) {
+    if (WiFi.SSID(i) == runtimeSettings.wifiSsid) {
+      visible = true;
+      break;
+    }
+  }
+  WiFi.scanDelete();
+  if (!visible) {
+    co_return;
+  }
+  
+  // Joining moves the access point to the network's channel, so its clients drop here
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("'" + String(runtimeSettings.wifiSsid) + "' is visible again - reconnecting");
+  #endif
+  WiFi.begin(runtimeSettings.wifiSsid, runtimeSettings.wifiPassword);
+  if (co_await coro::wifiConnected(WIFI_TIMEOUT)) {
+    // checkWiFiConnection() closes the access point on its next pass
+    systemState.wifiConnected = true;
+    wifiReconnectAttempts = 0;
+    breadcrumb(CRUMB_WIFI, 1, WiFi.RSSI());
+  } else {
+    softAp.rejoinFailures++;
+    WiFi.disconnect();
+    #if SERIAL_OUTPUT_ENABLED
+      Log.println("Could not join - staying in access point mode");
+    #endif
+  }
+}
+
+// =============================================================================
+// COAP SERVER FUNCTIONS
+// =============================================================================
+
+/*
+ * CoAP (RFC 7252) on UDP for local automation that polls: one datagram each
+ * way instead of a TCP connection and a 3 KB JSON document. Resources:
+ *
+ *   GET  /sensors  readings (observable)       GET /zone  commissioned zone model
+ *   GET  /pump     pump state (observable)     GET /.well-known/core  discovery
+ *   POST /control  {"action": "start"|"stop"|"estop"|"reset", "seconds": n}
+ *
+ * Payloads are CBOR (content format 60), encoded straight into the outgoing
+ * packet buffer - no JSON document, no String. UDP has no session and the
+ * source address is easily forged, so "start" and "reset" (anything that can
+ * energise the pump) need the web password as "auth" in the payload; "stop"
+ * and "estop" only ever make the system safer and stay open.
+ *
+ * Observers (GET with Observe: 0) get a notification when their resource
+ * changes, at most every COAP_NOTIFY_MIN_INTERVAL and at least once per
+ * Max-Age. Every COAP_CONFIRM_EVERY-th notification is confirmable and is
+ * retransmitted with exponential backoff until acknowledged (RFC 7252
+ * section 4.2); if the state changes meanwhile, the next retransmission
+ * carries the new state instead, inheriting the backoff (RFC 7641 section
+ * 4.5.2). An observer that resets a notification, or never acknowledges
+ * one after MAX_RETRANSMIT retransmissions, is dropped. Requests
+ * are answered on the loop task, one datagram and at most one notification
+ * per pass; a retransmitted confirmable request gets the kept response again
+ * instead of being run twice.
+ */
+
+void initializeCoap() {
+  #if COAP_ENABLED
+    coapState.nextMessageId = (uint16_t)esp_random();
+    coapState.started = coapSocket.begin(COAP_PORT);
+    #if SERIAL_OUTPUT_ENABLED
+      if (coapState.started) {
+        Log.println("CoAP server listening on UDP port " + String(COAP_PORT));
+      } else {
+        Log.println("CoAP server failed to open UDP port " + String(COAP_PORT));
+      }
+    #endif
+  #endif
+}
+
+void updateCoap() {
+  #if COAP_ENABLED
+    if (!coapState.started) {
+      return;
+    }
+    int size = coapSocket.parsePacket();
+    if (size > 0) {
+      handleCoapPacket(size);
+    }
+    notifyCoapObservers();
+  #endif
+}
+
+void handleCoapPacket(int size) {
+  uint32_t startCycles = ESP.getCycleCount();
+  uint32_t address = (uint32_t)coapSocket.remoteIP();
+  uint16_t port = coapSocket.remotePort();
+  
+  // No block-wise transfer: anything bigger is dropped (parsePacket() discards the rest)
+  if ((size_t)size > sizeof(coapState.rx)) {
+    coapState.stats.rejected++;
+    return;
+  }
+  int length = coapSocket.read(coapState.rx, sizeof(coapState.rx));
+  if (length <= 0) {
+    return;
+  }
+  
+  coap::Request request;
+  coap::ParseResult parsed = coap::parse(coapState.rx, length, request);
+  bool confirmable = (request.type == coap::TYPE_CON);
+  if (parsed == coap::PARSE_FORMAT_ERROR) {
+    coapState.stats.rejected++;
+    if (length >= 4 && (coapState.rx[0] >> 6) == coap::VERSION && confirmable) {
+      coap::Builder reset(coapState.rx, sizeof(coapState.rx));
+      reset.header(coap::TYPE_RST, coap::EMPTY, request.messageId, nullptr, 0);
+      sendCoap(address, port, coapState.rx, reset.length());
+    }
+    return;
+  }
+  
+  // Answers to our notifications
+  if (request.type == coap::TYPE_ACK || request.type == coap::TYPE_RST) {
+    coap::Observer* observer = coapState.observers.findByMessageId(address, port, request.messageId);
+    if (observer != nullptr && request.type == coap::TYPE_RST) {
+      coapState.observers.remove(observer);
+      coapState.stats.observersDropped++;
+    } else if (observer != nullptr) {
+      observer->awaitingAck = false;
+    }
+    return;
+  }
+  
+  // Empty confirmable message (CoAP ping) or a response where a request belongs: reset
+  if (request.code == coap::EMPTY || request.code >= coap::code(2, 0)) {
+    if (confirmable) {
+      coap::Builder reset(coapState.rx, sizeof(coapState.rx));
+      reset.header(coap::TYPE_RST, coap::EMPTY, request.messageId, nullptr, 0);
+      sendCoap(address, port, coapState.rx, reset.length());
+    }
+    return;
+  }
+  
+  // Retransmission of the request answered last: same answer, without running it again
+  if (confirmable && coapState.txLength > 0 && address == coapState.txAddress &&
+      port == coapState.txPort && request.messageId == coapState.txMessageId) {
+    coapState.stats.duplicates++;
+    sendCoap(address, port, coapState.tx, coapState.txLength);
+    return;
+  }
+  
+  coapState.stats.requests++;
+  coapState.replyMessageId = confirmable ? request.messageId : coapState.nextMessageId++;
+  coap::Builder out(coapState.tx, sizeof(coapState.tx));
+  if (parsed == coap::PARSE_BAD_OPTION) {
+    coapError(out, request, coap::BAD_OPTION, "unsupported critical option");
+  } else {
+    handleCoapRequest(request, out, address, port);
+  }
+  if (!out.ok()) {
+    coapHeader(out, request, coap::INTERNAL_SERVER_ERROR);
+  }
+  sendCoap(address, port, coapState.tx, out.length());
+  
+  coapState.txLength = confirmable ? out.length() : 0;
+  coapState.txAddress = address;
+  coapState.txPort = port;
+  coapState.txMessageId = request.messageId;
+  
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  coapState.stats.lastCycles = cycles;
+  coapState.stats.totalCycles += cycles;
+  if (cycles > coapState.stats.maxCycles) {
+    coapState.stats.maxCycles = cycles;
+  }
+  coapState.stats.lastRequestBytes = length;
+  coapState.stats.lastResponseBytes = out.length();
+}
+
+void handleCoapRequest(const coap::Request& request, coap::Builder& out, uint32_t address, uint16_t port) {
+  if (strcmp(request.path, "/.well-known/core") == 0) {
+    if (request.code != coap::GET) {
+      coapError(out, request, coap::METHOD_NOT_ALLOWED, "GET only");
+      return;
+    }
+    coapHeader(out, request, coap::CONTENT);
+    out.option(coap::OPTION_CONTENT_FORMAT, (uint32_t)coap::FORMAT_LINK);
+    size_t room;
+    uint8_t* payload = out.beginPayload(room);
+    size_t used = min(room, sizeof(coapLinks) - 1);
+    memcpy(payload, coapLinks, used);
+    out.endPayload(used);
+    return;
+  }
+  
+  if (strcmp(request.path, "/control") == 0) {
+    if (request.code != coap::POST) {
+      coapError(out, request, coap::METHOD_NOT_ALLOWED, "POST only");
+      return;
+    }
+    handleCoapControl(request, out);
+    return;
+  }
+  
+  int resource = -1;
+  for (int i = 0; i < COAP_RESOURCE_COUNT; i++) {
+    if (strcmp(request.path, coapResourcePaths[i]) == 0) {
+      resource = i;
+      break;
+    }
+  }
+  if (resource < 0) {
+    coapError(out, request, coap::NOT_FOUND, "no such resource");
+    return;
+  }
+  if (request.code != coap::GET) {
+    coapError(out, request, coap::METHOD_NOT_ALLOWED, "GET only");
+    return;
+  }
+  if (request.accept != coap::FORMAT_NONE && request.accept != coap::FORMAT_CBOR) {
+    coapError(out, request, coap::NOT_ACCEPTABLE, "CBOR only");
+    return;
+  }
+  
+  // Register (Observe 0) or deregister (Observe 1); a full table just means no notifications
+  coap::Observer* observer = nullptr;
+  if (request.observe == 0 && coapResourceObservable[resource]) {
+    observer = coapState.observers.add(address, port, request.token, request.tokenLength, resource);
+    if (observer != nullptr) {
+      observer->version = coapResourceVersion(resource);
+      observer->lastNotifyMs = millis();
+      observer->sequence = (observer->sequence + 1) & 0xFFFFFF;
+    }
+  } else if (request.observe == 1) {
+    coapState.observers.remove(coapState.observers.find(address, port, request.token, request.tokenLength));
+  }
+  
+  coapHeader(out, request, coap::CONTENT);
+  if (observer != nullptr) {
+    out.option(coap::OPTION_OBSERVE, observer->sequence);
+  }
+  out.option(coap::OPTION_CONTENT_FORMAT, (uint32_t)coap::FORMAT_CBOR);
+  out.option(coap::OPTION_MAX_AGE, (uint32_t)COAP_MAX_AGE);
+  size_t room;
+  uint8_t* payload = out.beginPayload(room);
+  size_t used = encodeCoapResource(resource, payload, room);
+  if (used == 0) {
+    coapHeader(out, request, coap::INTERNAL_SERVER_ERROR);
+    return;
+  }
+  out.endPayload(used);
+}
+
+void handleCoapControl(const coap::Request& request, coap::Builder& out) {
+  if (request.contentFormat != coap::FORMAT_NONE && request.contentFormat != coap::FORMAT_CBOR) {
+    coapError(out, request, coap::UNSUPPORTED_FORMAT, "CBOR only");
+    return;
+  }
+  cbor::Reader body(request.payload, request.payloadLength);
+  char action[16];
+  if (request.payload == nullptr || !body.valid() || !body.text("action", action, sizeof(action))) {
+    coapError(out, request, coap::BAD_REQUEST, "expected a CBOR map with \"action\"");
+    return;
+  }
+  
+  bool privileged = strcmp(action, "start") == 0 || strcmp(action, "reset") == 0;
+  if (privileged && !coapAuthorized(body)) {
+    coapError(out, request, coap::UNAUTHORIZED, "\"auth\" must carry the web password");
+    return;
+  }
+  
+  uint8_t result = coap::CHANGED;
+  const char* error = nullptr;
+  if (strcmp(action, "start") == 0) {
+    int32_t seconds = 0;
+    if (body.integer("seconds", seconds) && (seconds < MIN_IRRIGATION_SECONDS || seconds > MAX_IRRIGATION_SECONDS)) {
+      coapError(out, request, coap::BAD_REQUEST, "seconds out of range");
+      return;
+    }
+    if (!startIrrigation(100, seconds)) {
+      result = coap::CONFLICT;
+      error = pumpBlockReason;
+    }
+  } else if (strcmp(action, "stop") == 0) {
+    stopIrrigation();
+  } else if (strcmp(action, "estop") == 0) {
+    estopRemoteTrip = true;
+    emergencyStopISR();
+  } else if (strcmp(action, "reset") == 0) {
+    if (!resetEmergencyStop("coap")) {
+      result = coap::CONFLICT;
+      error = "emergency stop input still active";
+    }
+  } else {
+    coapError(out, request, coap::BAD_REQUEST, "unknown action");
+    return;
+  }
+  
+  if (error != nullptr) {
+    coapError(out, request, result, error);
+    return;
+  }
+  
+  // Success returns the pump resource, so the caller sees the effect
+  coapHeader(out, request, result);
+  out.option(coap::OPTION_CONTENT_FORMAT, (uint32_t)coap::FORMAT_CBOR);
+  size_t room;
+  uint8_t* payload = out.beginPayload(room);
+  out.endPayload(encodeCoapResource(COAP_RESOURCE_PUMP, payload, room));
+}
+
+// Same password as the web pages; always true when web auth is off
+bool coapAuthorized(cbor::Reader& body) {
+  #if ENABLE_WEB_AUTH
+    char password[48];
+    return body.text("auth", password, sizeof(password)) && strcmp(password, WEB_PASSWORD) == 0;
+  #else
+    return true;
+  #endif
+}
+
+// Piggybacked on the ACK for a confirmable request, a NON of our own otherwise
+void coapHeader(coap::Builder& out, const coap::Request& request, uint8_t responseCode) {
+  uint8_t type = request.type == coap::TYPE_CON ? coap::TYPE_ACK : coap::TYPE_NON;
+  out.header(type, responseCode, coapState.replyMessageId, request.token, request.tokenLength);
+}
+
+// Error with a diagnostic payload (RFC 7252 5.5.2)
+void coapError(coap::Builder& out, const coap::Request& request, uint8_t responseCode, const char* message) {
+  coapHeader(out, request, responseCode);
+  size_t room;
+  uint8_t* payload = out.beginPayload(room);
+  size_t used = min(room, strlen(message));
+  memcpy(payload, message, used);
+  out.endPayload(used);
+}
+
+// CBOR body of a resource; 0 if it does not fit
+size_t encodeCoapResource(uint8_t resource, uint8_t* buffer, size_t size) {
+  cbor::Writer out(buffer, size);
+  SensorSnapshot snapshot = sensorSnapshot.read();
+  
+  switch (resource) {
+    case COAP_RESOURCE_SENSORS:
+      out.map(TANK_ENABLED ? 9 : 8);
+      out.key("ts");
+      out.integer(snapshot.timestamp);
+      out.key("t");
+      out.number(snapshot.temperature);
+      out.key("h");
+      out.number(snapshot.humidity);
+      out.key("soil");
+      out.integer(snapshot.soilMoisturePercent);
+      out.key("raw");
+      out.integer(snapshot.soilMoistureRaw);
+      out.key("light");
+      out.integer(snapshot.lightLevelPercent);
+      out.key("rain");
+      out.number(snapshot.rainTodayMm);
+      out.key("ok");
+      out.boolean(snapshot.systemOK);
+      if (TANK_ENABLED) {
+        out.key("tank");
+        if (snapshot.tankLevel < 0) {
+          out.null();
+        } else {
+          out.number(snapshot.tankLevel);
+        }
+      }
+      break;
+      
+    case COAP_RESOURCE_PUMP: {
+      const char* blocked = snapshot.pumpActive ? nullptr : pumpStartBlocked(plannedIrrigationSeconds() * 1000UL);
+      out.map(6);
+      out.key("on");
+      out.boolean(snapshot.pumpActive);
+      out.key("runtime");
+      out.integer(snapshot.pumpActive ? (millis() - systemState.pumpStartTime) / 1000 : 0);
+      out.key("planned");
+      out.integer(snapshot.pumpActive ? pumpPlannedSeconds : plannedIrrigationSeconds());
+      out.key("today");
+      out.integer(snapshot.dailyIrrigations);
+      out.key("estop");
+      out.boolean(snapshot.emergencyStop);
+      out.key("blocked");
+      if (blocked != nullptr) {
+        out.text(blocked);
+      } else {
+        out.null();
+      }
+      break;
+    }
+      
+    case COAP_RESOURCE_ZONE:
+      out.map(commissioning.zoneValid ? 7 : 2);
+      out.key("commissioned");
+      out.boolean(commissioning.zoneValid);
+      out.key("phase");
+      out.text(commissioning.phase);
+      if (commissioning.zoneValid) {
+        out.key("dead");
+        out.number(commissioning.zone.deadTimeSeconds);
+        out.key("gain");
+        out.number(commissioning.zone.gainPerSecond);
+        out.key("tau");
+        out.number(commissioning.zone.tauSeconds);
+        out.key("decay");
+        out.number(commissioning.zone.decayPerHour);
+        out.key("dose");
+        out.number(zoneDoseSeconds());
+      }
+      break;
+      
+    default:
+      return 0;
+  }
+  return out.ok() ? out.length() : 0;
+}
+
+// Changes whenever an observer should hear about the resource
+uint32_t coapResourceVersion(uint8_t resource) {
+  switch (resource) {
+    case COAP_RESOURCE_SENSORS:
+      return systemState.lastSensorRead;
+    case COAP_RESOURCE_PUMP:
+      return (systemState.pumpActive ? 1 : 0) | (systemState.emergencyStop ? 2 : 0) |
+             ((uint32_t)systemState.dailyIrrigations << 2);
+    default:
+      return 0;
+  }
+}
+
+void notifyCoapObservers() {
+  unsigned long now = millis();
+  for (size_t n = 0; n < COAP_MAX_OBSERVERS; n++) {
+    size_t index = (coapState.nextObserver + n) % COAP_MAX_OBSERVERS;
+    coap::Observer& observer = coapState.observers.entries[index];
+    if (!observer.used) {
+      continue;
+    }
+    uint32_t version = coapResourceVersion(observer.resource);
+    bool confirmable;
+    bool sameMessage = false;
+    
+    if (observer.awaitingAck) {
+      // Nothing else goes to this observer until the confirmable one is acknowledged
+      if ((int32_t)(now - observer.retransmitMs) < 0) {
+        continue;
+      }
+      if (observer.retransmits >= coap::MAX_RETRANSMIT) {
+        coapState.observers.remove(&observer);
+        coapState.stats.observersDropped++;
+        continue;
+      }
+      observer.retransmits++;
+      observer.ackTimeoutMs *= 2;
+      observer.retransmitMs = now + observer.ackTimeoutMs;
+      coapState.stats.retransmissions++;
+      confirmable = true;
+      // Unchanged state: the same message again, so the client can spot the duplicate
+      sameMessage = (version == observer.version);
+    } else {
+      if (now - observer.lastNotifyMs < COAP_NOTIFY_MIN_INTERVAL) {
+        continue;
+      }
+      // On change, and before Max-Age runs out so the client's copy stays fresh
+      if (version == observer.version && now - observer.lastNotifyMs < COAP_MAX_AGE * 750UL) {
+        continue;
+      }
+      confirmable = ++observer.sinceConfirmable >= COAP_CONFIRM_EVERY;
+      if (confirmable) {
+        observer.sinceConfirmable = 0;
+        observer.awaitingAck = true;
+        observer.retransmits = 0;
+        observer.ackTimeoutMs = coap::ACK_TIMEOUT_MS + esp_random() % coap::ACK_RANDOM_SPAN_MS;
+        observer.retransmitMs = now + observer.ackTimeoutMs;
+      }
+    }
+    
+    if (!sameMessage) {
+      observer.version = version;
+      observer.sequence = (observer.sequence + 1) & 0xFFFFFF;
+      observer.lastMessageId = coapState.nextMessageId++;
+    }
+    observer.lastNotifyMs = now;
+    
+    coap::Builder out(coapState.rx, sizeof(coapState.rx));
+    out.header(confirmable ? coap::TYPE_CON : coap::TYPE_NON, coap::CONTENT, observer.lastMessageId,
+               observer.token, observer.tokenLength);
+    out.option(coap::OPTION_OBSERVE, observer.sequence);
+    out.option(coap::OPTION_CONTENT_FORMAT, (uint32_t)coap::FORMAT_CBOR);
+    out.option(coap::OPTION_MAX_AGE, (uint32_t)COAP_MAX_AGE);
+    size_t room;
+    uint8_t* payload = out.beginPayload(room);
+    out.endPayload(encodeCoapResource(observer.resource, payload, room));
+    sendCoap(observer.address, observer.port, coapState.rx, out.length());
+    
+    coapState.stats.notifications++;
+    coapState.nextObserver = index + 1;
+    return;
+  }
+}
+
+void sendCoap(uint32_t address, uint16_t port, const uint8_t* data, size_t length) {
+  coapSocket.beginPacket(IPAddress(address), port);
+  coapSocket.write(data, length);
+  coapSocket.endPacket();
+}
+
+// =============================================================================
+// SOIL CALIBRATION FUNCTIONS
+// =============================================================================
+
+void p2Init(P2Quantile& e, float p) {
+  e.p = p;
+  e.count = 0;
+  for (int i = 0; i < 5; i++) {
+    e.q[i] = 0;
+    e.n[i] = i + 1;
+  }
+  e.np[0] = 1;
+  e.np[1] = 1 + 2 * p;
+  e.np[2] = 1 + 4 * p;
+  e.np[3] = 3 + 2 * p;
+  e.np[4] = 5;
+}
+
+void p2Add(P2Quantile& e, float x) {
+  // The first five observations seed the markers
+  if (e.count < 5) {
+    int i = e.count++;
+    while (i > 0 && e.q[i - 1] > x) {
+      e.q[i] = e.q[i - 1];
+      i--;
+    }
+    e.q[i] = x;
+    return;
+  }
+  e.count++;
+  
+  // Find the cell holding x, stretching the extremes if needed
+  int k;
+  if (x < e.q[0]) {
+    e.q[0] = x;
+    k = 0;
+  } else if (x >= e.q[4]) {
+    e.q[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (k < 3 && x >= e.q[k + 1]) {
+      k++;
+    }
+  }
+  for (int i = k + 1; i < 5; i++) {
+    e.n[i]++;
+  }
+  const float dn[5] = {0, e.p / 2, e.p, (1 + e.p) / 2, 1};
+  for (int i = 0; i < 5; i++) {
+    e.np[i] += dn[i];
+  }
+  
+  // Move the middle markers toward their desired positions
+  for (int i = 1; i <= 3; i++) {
+    float d = e.np[i] - e.n[i];
+    if ((d >= 1 && e.n[i + 1] - e.n[i] > 1) || (d <= -1 && e.n[i - 1] - e.n[i] < -1)) {
+      int s = d > 0 ? 1 : -1;
+      float parabolic = e.q[i] + s / (e.n[i + 1] - e.n[i - 1]) *
+                        ((e.n[i] - e.n[i - 1] + s) * (e.q[i + 1] - e.q[i]) / (e.n[i + 1] - e.n[i]) +
+                         (e.n[i + 1] - e.n[i] - s) * (e.q[i] - e.q[i - 1]) / (e.n[i] - e.n[i - 1]));
+      if (e.q[i - 1] < parabolic && parabolic < e.q[i + 1]) {
+        e.q[i] = parabolic;
+      } else {
+        e.q[i] += s * (e.q[i + s] - e.q[i]) / (e.n[i + s] - e.n[i]);
+      }
+      e.n[i] += s;
+    }
+  }
+}
+
+// Current estimate; exact while fewer than five values have been seen
+float p2Value(const P2Quantile& e) {
+  if (e.count == 0) {
+    return NAN;
+  }
+  if (e.count < 5) {
+    return e.q[(int)(e.p * (e.count - 1) + 0.5f)];
+  }
+  return e.q[2];
+}
+
+#define SOIL_CAL_MODEL_VERSION 2             // 2: no 95th percentile, floors only from unforced dry-downs
+
+void initializeSoilCalibration() {
+  SoilCalibrationModel& model = soilCal.model;
+  model.version = SOIL_CAL_MODEL_VERSION;
+  model.wetRaw = SOIL_MOISTURE_WET_VALUE;
+  model.dryRaw = SOIL_MOISTURE_DRY_VALUE;
+  p2Init(model.wetPlateaus, 0.5);
+  p2Init(model.dryFloors, 0.5);
+  p2Init(model.low, 0.05);
+  soilCal.cycleStart = millis();
+  
+  #if SOIL_AUTO_CALIBRATION
+    soilCalPrefs.begin("soilcal", false);
+    SoilCalibrationModel saved;
+    if (soilCalPrefs.getBytes("model", &saved, sizeof(saved)) == sizeof(saved) &&
+        saved.version == SOIL_CAL_MODEL_VERSION) {
+      model = saved;
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Soil calibration restored: wet " + String(model.wetRaw) + ", dry " + String(model.dryRaw) +
+                       " from " + String(model.wetPlateaus.count) + " plateaus, " + String(model.dryFloors.count) + " dry floors");
+      #endif
+    }
+    
+    soilCal.savedWetRaw = model.wetRaw;
+    soilCal.savedDryRaw = model.dryRaw;
+    soilCal.savedEvidence = model.wetPlateaus.count + model.dryFloors.count;
+    soilCal.savedSamples = model.low.count;
+    
+    bus::subscribe<PumpStartedEvent>("soilcal", onPumpStartedSoilCal, bus::SYNC);
+    bus::subscribe<PumpStoppedEvent>("soilcal", onPumpStoppedSoilCal, bus::SYNC);
+    bus::subscribe<RainDetectedEvent>("soilcal", onRainSoilCal, bus::SYNC);
+  #endif
+}
+
+/*
+ * A dry floor is only taken from a dry-down that ended on its own terms:
+ * rain, or a start somebody asked for. An automatic start happens exactly
+ * when the reading reaches the threshold, so its "floor" is the threshold's
+ * raw value; learning from it would pull the dry endpoint toward the
+ * threshold, make the threshold read wetter and water earlier each cycle.
+ * The floor is the driest level of the whole dry-down, taken when it ends,
+ * not the first flat stretch (a cool night also reads flat for hours).
+ */
+void onPumpStartedSoilCal(const PumpStartedEvent& event) {
+  if (event.cause != PUMP_START_THRESHOLD) {
+    recordDryFloor();
+  }
+  soilCal.floorRecorded = true;   // Whatever follows is not part of this dry-down
+  soilCal.wetWatchUntil = 0;
+}
+
+void onPumpStoppedSoilCal(const PumpStoppedEvent& event) {
+  if (event.ranMs < 3000) {
+    return;
+  }
+  // Look for the saturation plateau, then start a new dry-down
+  soilCal.wetWatchUntil = millis() + SOIL_CAL_WET_WATCH;
+  soilCal.plateauCount = 0;
+  startSoilDryDown();
+}
+
+void onRainSoilCal(const RainDetectedEvent& event) {
+  recordDryFloor();
+  startSoilDryDown();
+}
+
+void startSoilDryDown() {
+  soilCal.cycleStart = millis();
+  soilCal.cycleMax = 0;
+  soilCal.cycleMaxSince = millis();
+  soilCal.floorRecorded = false;
+}
+
+// Ends the current dry-down: its driest level counts if the dry-down was long
+// enough and that level had held (the soil had stopped drying)
+void recordDryFloor() {
+  unsigned long now = millis();
+  if (soilCal.floorRecorded || soilCal.cycleMax == 0 ||
+      now - soilCal.cycleStart < SOIL_CAL_DRY_MIN_HOURS * 3600000UL ||
+      now - soilCal.cycleMaxSince < SOIL_CAL_FLOOR_HOLD) {
+    return;
+  }
+  p2Add(soilCal.model.dryFloors, soilCal.cycleMax);
+  soilCal.floorRecorded = true;
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Soil calibration: dry floor at raw " + String(SOIL_DRY_SIGN * soilCal.cycleMax));
+  #endif
+}
+
+// Called with every fresh raw reading
+void updateSoilCalibration(int raw) {
+  #if SOIL_AUTO_CALIBRATION
+    unsigned long now = millis();
+    int dryness = SOIL_DRY_SIGN * raw;
+    
+    // Wet evidence: readings settle into a flat plateau shortly after watering
+    if (soilCal.wetWatchUntil != 0) {
+      if ((long)(now - soilCal.wetWatchUntil) >= 0) {
+        soilCal.wetWatchUntil = 0;
+      } else if (!systemState.pumpActive) {
+        soilCal.plateau[soilCal.plateauCount++ % SOIL_CAL_PLATEAU_SAMPLES] = dryness;
+        if (soilCal.plateauCount >= SOIL_CAL_PLATEAU_SAMPLES) {
+          int lowest = soilCal.plateau[0];
+          int highest = soilCal.plateau[0];
+          long sum = 0;
+          for (int i = 0; i < SOIL_CAL_PLATEAU_SAMPLES; i++) {
+            lowest = min(lowest, soilCal.plateau[i]);
+            highest = max(highest, soilCal.plateau[i]);
+            sum += soilCal.plateau[i];
+          }
+          if (highest - lowest <= SOIL_CAL_PLATEAU_BAND) {
+            p2Add(soilCal.model.wetPlateaus, (float)sum / SOIL_CAL_PLATEAU_SAMPLES);
+            soilCal.wetWatchUntil = 0;
+            #if SERIAL_OUTPUT_ENABLED
+              Log.println("Soil calibration: wet plateau at raw " + String(SOIL_DRY_SIGN * sum / SOIL_CAL_PLATEAU_SAMPLES));
+            #endif
+          }
+        }
+      }
+    }
+    
+    // Dry evidence: the driest level of the dry-down, once it stops rising
+    if (dryness > soilCal.cycleMax + SOIL_CAL_PLATEAU_BAND || soilCal.cycleMax == 0) {
+      soilCal.cycleMax = dryness;
+      soilCal.cycleMaxSince = now;
+    } else if (dryness > soilCal.cycleMax) {
+      soilCal.cycleMax = dryness;
+    }
+    
+    // Long-run distribution of readings
+    if (now - soilCal.lastSample >= SOIL_CAL_SAMPLE_INTERVAL || soilCal.lastSample == 0) {
+      p2Add(soilCal.model.low, dryness);
+      soilCal.lastSample = now;
+    }
+    
+    if (now - soilCal.lastUpdate >= SOIL_CAL_UPDATE_INTERVAL) {
+      adjustSoilCalibration();
+      soilCal.lastUpdate = now;
+    }
+  #endif
+}
+
+// Nudges the endpoints toward the current estimate by at most
+// SOIL_CAL_MAX_STEP, then persists the model if it changed
+void adjustSoilCalibration() {
+  SoilCalibrationModel& model = soilCal.model;
+  
+  // Plateaus are direct wet evidence, with the 5th percentile standing in until
+  // enough are seen. The dry endpoint only moves on recorded floors: the upper
+  // percentiles of a unit that waters automatically are the threshold again.
+  float wet = model.wetPlateaus.count >= 3 ? p2Value(model.wetPlateaus) : p2Value(model.low);
+  if (isnan(wet)) {
+    return;
+  }
+  soilCal.targetWetRaw = SOIL_DRY_SIGN * (int)wet;
+  soilCal.targetDryRaw = model.dryFloors.count >= 2 ? SOIL_DRY_SIGN * (int)p2Value(model.dryFloors) : model.dryRaw;
+  
+  // Confidence: how much direct evidence there is, and for how long readings were collected
+  float days = (float)model.low.count * SOIL_CAL_SAMPLE_INTERVAL / 86400000.0;
+  soilCal.confidence = 40 * min(model.wetPlateaus.count, (uint32_t)5) / 5 +
+                       40 * min(model.dryFloors.count, (uint32_t)3) / 3 +
+                       (int)(20 * min(days, 14.0f) / 14);
+  if (abs(soilCal.targetDryRaw - soilCal.targetWetRaw) < SOIL_CAL_MIN_SPAN) {
+    // Estimates this close together mean the evidence is not trustworthy yet
+    soilCal.confidence /= 2;
+  } else if (soilCal.confidence >= SOIL_CAL_MIN_CONFIDENCE) {
+    int wetRaw = model.wetRaw + constrain(soilCal.targetWetRaw - model.wetRaw, -SOIL_CAL_MAX_STEP, SOIL_CAL_MAX_STEP);
+    int dryRaw = model.dryRaw + constrain(soilCal.targetDryRaw - model.dryRaw, -SOIL_CAL_MAX_STEP, SOIL_CAL_MAX_STEP);
+    if (abs(dryRaw - wetRaw) >= SOIL_CAL_MIN_SPAN) {
+      model.wetRaw = wetRaw;
+      model.dryRaw = dryRaw;
+    }
+  }
+  saveSoilCalibration();
+}
+
+// Writes the model when the endpoints moved or new plateau/floor evidence
+// came in; the sample percentile alone is saved about once a day
+void saveSoilCalibration() {
+  SoilCalibrationModel& model = soilCal.model;
+  uint32_t evidence = model.wetPlateaus.count + model.dryFloors.count;
+  bool changed = model.wetRaw != soilCal.savedWetRaw || model.dryRaw != soilCal.savedDryRaw ||
+                 evidence != soilCal.savedEvidence ||
+                 model.low.count - soilCal.savedSamples >= 86400000UL / SOIL_CAL_SAMPLE_INTERVAL;
+  if (!changed) {
+    return;
+  }
+  soilCalPrefs.putBytes("model", &model, sizeof(model));
+  soilCal.savedWetRaw = model.wetRaw;
+  soilCal.savedDryRaw = model.dryRaw;
+  soilCal.savedEvidence = evidence;
+  soilCal.savedSamples = model.low.count;
+}
+
+// =============================================================================
+// FAULT HISTORY FUNCTIONS
+// =============================================================================
+
+// Marks the loop stage being entered. Cheap enough to call on every pass.
+// Back-to-back stage crumbs collapse into one so a quiet loop does not
+// flush the pump, HTTP and WiFi events out of the ring.
+void setLoopStage(LoopStage stage) {
+  rtcFaultState.loopStage = stage;
+  #if BREADCRUMBS_ENABLED
+    uint32_t head = rtcBreadcrumbs.head;
+    if (head != 0 && rtcBreadcrumbs.ring[(head - 1) & (BREADCRUMB_COUNT - 1)].event == CRUMB_STAGE) {
+      rtcBreadcrumbs.head = head - 1;
+    }
+    breadcrumb(CRUMB_STAGE, stage);
+  #endif
+}
+
+// Tags the upcoming restart so it is not mistaken for a crash
+void markPlannedRestart(uint8_t flag) {
+  rtcFaultState.flags |= flag;
+}
+
+const char* resetReasonName(uint8_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:   return "power-on";
+    case ESP_RST_EXT:       return "external";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:   return "interrupt-wdt";
+    case ESP_RST_TASK_WDT:  return "task-wdt";
+    case ESP_RST_WDT:       return "other-wdt";
+    case ESP_RST_DEEPSLEEP: return "deep-sleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    case ESP_RST_SDIO:      return "sdio";
+    default:                return "unknown";
+  }
+}
+
+// After a cold start RTC_NOINIT memory holds whatever the chip powered up
+// with, and a magic number that happens to match would be trusted. Only
+// warm resets keep the RTC blocks (fault record, breadcrumbs, relay cycle
+// count, forecast).
+void clearRtcCachesAfterPowerOn() {
+  if (esp_reset_reason() != ESP_RST_POWERON) {
+    return;
+  }
+  rtcFaultState.magic = 0;
+  rtcBreadcrumbs.magic = 0;
+  rtcPumpCycles.magic = 0;
+  rtcForecast.magic = 0;
+}
+
+// Turns the previous run's RTC record plus the reset reason into a
+// FaultRecord, appends it to the NVS ring and starts a fresh RTC record
+void recordBootFault() {
+  bool rtcValid = (rtcFaultState.magic == FAULT_RTC_MAGIC);
+  
+  lastFault.resetReason = (uint8_t)esp_reset_reason();
+  if (rtcValid) {
+    lastFault.bootCount = rtcFaultState.bootCount + 1;
+    lastFault.uptimeMs = rtcFaultState.uptimeMs;
+    lastFault.minFreeHeap = rtcFaultState.minFreeHeap;
+    lastFault.loopStage = rtcFaultState.loopStage < STAGE_COUNT ? rtcFaultState.loopStage : STAGE_BOOT;
+    lastFault.pumpActive = rtcFaultState.pumpActive;
+    lastFault.flags = rtcFaultState.flags | FAULT_FLAG_RTC_VALID;
+    lastFault.stalledSubsystem = rtcFaultState.stalledSubsystem;
+  }
+  
+  #if FAULT_HISTORY_ENABLED
+    faultPrefs.begin("faults", false);
+    if (!rtcValid) {
+      // RTC memory was lost (power-on or brownout): continue the count from flash
+      lastFault.bootCount = faultPrefs.getUInt("boots", 0) + 1;
+    }
+    if (summarizeCoreDump(lastFault)) {
+      lastFault.flags |= FAULT_FLAG_COREDUMP;
+    }
+    uint8_t head = faultPrefs.getUChar("head", 0) % FAULT_HISTORY_SIZE;
+    char key[8];
+    snprintf(key, sizeof(key), "f%u", head);
+    faultPrefs.putBytes(key, &lastFault, sizeof(lastFault));
+    faultPrefs.putUChar("head", (head + 1) % FAULT_HISTORY_SIZE);
+    faultPrefs.putUInt("boots", lastFault.bootCount);
+    faultPrefs.end();
+  #endif
+  
+  rtcFaultState.magic = FAULT_RTC_MAGIC;
+  rtcFaultState.bootCount = lastFault.bootCount;
+  rtcFaultState.uptimeMs = 0;
+  rtcFaultState.minFreeHeap = esp_get_minimum_free_heap_size();
+  rtcFaultState.loopStage = STAGE_BOOT;
+  rtcFaultState.pumpActive = false;
+  rtcFaultState.flags = 0;
+  rtcFaultState.stalledSubsystem = SUBSYS_COUNT;
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Boot #" + String(lastFault.bootCount) + " - reset reason: " + String(resetReasonName(lastFault.resetReason)));
+    if (lastFault.flags & FAULT_FLAG_RTC_VALID) {
+      Log.println("  Previous run: " + String(lastFault.uptimeMs / 1000) + "s uptime, stage '" +
+                     String(loopStageNames[lastFault.loopStage]) + "', min heap " + String(lastFault.minFreeHeap) +
+                     " bytes, pump " + String(lastFault.pumpActive ? "ON" : "OFF") +
+                     String(lastFault.flags & FAULT_FLAG_OTA ? " (OTA restart)" : ""));
+    }
+    if ((lastFault.flags & FAULT_FLAG_SUPERVISOR) && lastFault.stalledSubsystem < SUBSYS_COUNT) {
+      Log.println("  Restarted by supervisor: '" + String(subsystemPolicies[lastFault.stalledSubsystem].name) + "' stalled");
+    }
+    if (lastFault.flags & FAULT_FLAG_COREDUMP) {
+      String backtrace;
+      for (int i = 0; i < lastFault.backtraceDepth; i++) {
+        backtrace += " 0x" + String(lastFault.backtrace[i], HEX);
+      }
+      Log.println("  Crashed in task '" + String(lastFault.crashTask) + "' at PC 0x" + String(lastFault.crashPc, HEX));
+      Log.println("  Backtrace:" + backtrace);
+      Log.println("  Core dump available at /api/coredump");
+    }
+  #endif
   
-  // Update reading arrays for consistency checking
-  sensorValidation.temperatureReadings[sensorValidation.readingIndex] = (int)(temperature * 10);
-  sensorValidation.humidityReadings[sensorValidation.readingIndex] = (int)(humidity * 10);
-  sensorValidation.soilMoistureReadings[sensorValidation.readingIndex] = soilMoisture;
-  sensorValidation.lightLevelReadings[sensorValidation.readingIndex] = lightLevel;
-  sensorValidation.readingIndex = (sensorValidation.readingIndex + 1) % SENSOR_CONSISTENCY_CHECKS;
+  recordBootBreadcrumbs();
 }
 
-bool isSensorReadingValid(float value, float minVal, float maxVal, bool enabled) {
-  if (!enabled) return true;
-  return (value >= minVal && value <= maxVal);
+// A reset nobody asked for: crash, watchdog, brownout or supervisor reboot
+bool isUnplannedReset(const FaultRecord& record) {
+  switch (record.resetReason) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+      return true;
+    default:
+      return (record.flags & FAULT_FLAG_SUPERVISOR) != 0;
+  }
 }
 
-bool checkSensorConsistency(int readings[], int newReading) {
-  // Calculate average of previous readings
-  int sum = 0;
-  for (int i = 0; i < SENSOR_CONSISTENCY_CHECKS; i++) {
-    sum += readings[i];
+void formatBreadcrumb(const Breadcrumb& crumb, char* out, size_t size) {
+  unsigned long ms = (unsigned long)((uint64_t)crumb.ticks * 1024 / 1000);
+  int used = snprintf(out, size, "%lu.%03lus ", ms / 1000, ms % 1000);
+  if (used < 0 || (size_t)used >= size) {
+    return;
+  }
+  out += used;
+  size -= used;
+  
+  switch (crumb.event) {
+    case CRUMB_STAGE:
+      snprintf(out, size, "stage %s", loopStageNames[crumb.arg < STAGE_COUNT ? crumb.arg : STAGE_BOOT]);
+      break;
+    case CRUMB_HTTP_BEGIN:
+    case CRUMB_HTTP_END:
+      snprintf(out, size, "%s %s", breadcrumbNames[crumb.event], crumb.arg < HTTP_TARGET_COUNT ? httpTargetNames[crumb.arg] : "?");
+      if (crumb.event == CRUMB_HTTP_END) {
+        size_t length = strlen(out);
+        snprintf(out + length, size - length, " %d", crumb.detail);
+      }
+      break;
+    case CRUMB_PUMP_ON:
+      snprintf(out, size, "pump-on %ds", crumb.detail);
+      break;
+    case CRUMB_PUMP_OFF:
+      snprintf(out, size, "pump-off %s after %ds", crumb.arg < PUMP_OFF_CAUSE_COUNT ? pumpOffCauseNames[crumb.arg] : "?", crumb.detail);
+      break;
+    case CRUMB_WIFI:
+      snprintf(out, size, "wifi %s %ddBm", crumb.arg ? "connected" : "lost", crumb.detail);
+      break;
+    default:
+      snprintf(out, size, "event %u", crumb.event);
+      break;
   }
-  int average = sum / SENSOR_CONSISTENCY_CHECKS;
-  
-  // Check if new reading is within threshold
-  int deviation = abs(newReading - average);
-  return (deviation <= SENSOR_CONSISTENCY_THRESHOLD);
 }
 
-void attemptSystemRecovery() {
-  #if SERIAL_OUTPUT_ENABLED
-    Serial.println("Attempting system recovery...");
+// Prints the previous run's breadcrumbs, keeps them in flash when that run
+// ended in an unplanned reset, then starts an empty ring
+void recordBootBreadcrumbs() {
+  #if BREADCRUMBS_ENABLED
+    if (rtcBreadcrumbs.magic == BREADCRUMB_RTC_MAGIC && rtcBreadcrumbs.head != 0) {
+      // Copy out oldest first
+      uint32_t count = min(rtcBreadcrumbs.head, (uint32_t)BREADCRUMB_COUNT);
+      Breadcrumb crumbs[BREADCRUMB_COUNT];
+      for (uint32_t i = 0; i < count; i++) {
+        crumbs[i] = rtcBreadcrumbs.ring[(rtcBreadcrumbs.head - count + i) & (BREADCRUMB_COUNT - 1)];
+      }
+      
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("  Last " + String(count) + " breadcrumbs:");
+        for (uint32_t i = 0; i < count; i++) {
+          char line[64];
+          formatBreadcrumb(crumbs[i], line, sizeof(line));
+          Log.println("    " + String(line));
+        }
+      #endif
+      
+      #if FAULT_HISTORY_ENABLED
+        if (isUnplannedReset(lastFault)) {
+          faultPrefs.begin("faults", false);
+          faultPrefs.putBytes("crumbs", crumbs, count * sizeof(Breadcrumb));
+          faultPrefs.putUInt("crumbBoot", lastFault.bootCount);
+          faultPrefs.end();
+        }
+      #endif
+    }
+    
+    rtcBreadcrumbs.magic = BREADCRUMB_RTC_MAGIC;
+    rtcBreadcrumbs.head = 0;
+  #endif
+}
+
+void handleFaults() {
+  DynamicJsonDocument doc(8192);
+  doc["bootCount"] = lastFault.bootCount;
+  #if COREDUMP_ENABLED
+    size_t coreDumpAddress = 0, coreDumpSize = 0;
+    if (esp_core_dump_image_check() == ESP_OK && esp_core_dump_image_get(&coreDumpAddress, &coreDumpSize) == ESP_OK) {
+      doc["coreDumpBytes"] = coreDumpSize;
+    } else {
+      doc["coreDumpBytes"] = 0;
+    }
+  #endif
+  JsonArray faults = doc.createNestedArray("faults");
+  
+  #if FAULT_HISTORY_ENABLED
+    faultPrefs.begin("faults", true);
+    uint8_t head = faultPrefs.getUChar("head", 0);
+    // Newest first
+    for (int i = 1; i <= FAULT_HISTORY_SIZE; i++) {
+      char key[8];
+      snprintf(key, sizeof(key), "f%u", (head + FAULT_HISTORY_SIZE - i) % FAULT_HISTORY_SIZE);
+      FaultRecord record;
+      if (faultPrefs.getBytesLength(key) != sizeof(record) ||
+          faultPrefs.getBytes(key, &record, sizeof(record)) != sizeof(record)) {
+        continue;
+      }
+      bool rtcValid = record.flags & FAULT_FLAG_RTC_VALID;
+      JsonObject entry = faults.createNestedObject();
+      entry["boot"] = record.bootCount;
+      entry["resetReason"] = resetReasonName(record.resetReason);
+      entry["ota"] = (bool)(record.flags & FAULT_FLAG_OTA);
+      if ((record.flags & FAULT_FLAG_SUPERVISOR) && record.stalledSubsystem < SUBSYS_COUNT) {
+        entry["stalledSubsystem"] = subsystemPolicies[record.stalledSubsystem].name;
+      }
+      if (rtcValid) {
+        entry["uptimeMs"] = record.uptimeMs;
+        entry["loopStage"] = loopStageNames[record.loopStage < STAGE_COUNT ? record.loopStage : STAGE_BOOT];
+        entry["minFreeHeap"] = record.minFreeHeap;
+        entry["pumpActive"] = (bool)record.pumpActive;
+      }
+      if (record.flags & FAULT_FLAG_COREDUMP) {
+        char hex[12];
+        JsonObject crash = entry.createNestedObject("crash");
+        crash["task"] = record.crashTask;
+        snprintf(hex, sizeof(hex), "0x%08lx", (unsigned long)record.crashPc);
+        crash["pc"] = hex;
+        JsonArray backtrace = crash.createNestedArray("backtrace");
+        for (int b = 0; b < record.backtraceDepth && b < COREDUMP_BACKTRACE_DEPTH; b++) {
+          snprintf(hex, sizeof(hex), "0x%08lx", (unsigned long)record.backtrace[b]);
+          backtrace.add(hex);
+        }
+      }
+    }
+    
+    #if BREADCRUMBS_ENABLED
+      // Events leading up to the most recent unplanned reset
+      Breadcrumb crumbs[BREADCRUMB_COUNT];
+      size_t crumbBytes = faultPrefs.getBytes("crumbs", crumbs, sizeof(crumbs));
+      if (crumbBytes >= sizeof(Breadcrumb)) {
+        JsonObject breadcrumbs = doc.createNestedObject("breadcrumbs");
+        breadcrumbs["boot"] = faultPrefs.getUInt("crumbBoot", 0);
+        JsonArray events = breadcrumbs.createNestedArray("events");
+        for (size_t i = 0; i < crumbBytes / sizeof(Breadcrumb); i++) {
+          char line[64];
+          formatBreadcrumb(crumbs[i], line, sizeof(line));
+          events.add(String(line));
+        }
+      }
+    #endif
+    faultPrefs.end();
   #endif
   
-  systemState.recoveryAttempts++;
-  
-  // Reset sensor validation
-  sensorValidation.temperatureValid = true;
-  sensorValidation.humidityValid = true;
-  sensorValidation.soilMoistureValid = true;
-  sensorValidation.lightLevelValid = true;
-  sensorValidation.disconnectCount = 0;
-  
-  // Reset error counters
-  systemState.sensorErrors = 0;
-  
-  // Reinitialize sensors
-  dht.begin();
-  delay(2000);
+  String json;
+  serializeJson(doc, json);
+  server.send(200, "application/json", json);
+}
+
+// =============================================================================
+// CORE DUMP FUNCTIONS
+// =============================================================================
+
+const esp_partition_t* findCoreDumpPartition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, NULL);
+}
+
+// Copies PC, task and backtrace of a stored core dump into the record.
+// A dump stays in flash until erased, so its trailing checksum is
+// remembered and each dump is only attributed to the boot that follows it.
+// Called from recordBootFault() with faultPrefs open.
+bool summarizeCoreDump(FaultRecord& record) {
+  #if COREDUMP_ENABLED
+    size_t address = 0, size = 0;
+    const esp_partition_t* partition = findCoreDumpPartition();
+    if (partition == NULL || esp_core_dump_image_check() != ESP_OK ||
+        esp_core_dump_image_get(&address, &size) != ESP_OK || size < sizeof(uint32_t)) {
+      return false;
+    }
+    
+    uint32_t checksum = 0;
+    if (esp_partition_read(partition, address - partition->address + size - sizeof(checksum), &checksum, sizeof(checksum)) != ESP_OK ||
+        checksum == faultPrefs.getUInt("dumpId", 0)) {
+      return false;
+    }
+    faultPrefs.putUInt("dumpId", checksum);
+    
+    esp_core_dump_summary_t summary;
+    if (esp_core_dump_get_summary(&summary) != ESP_OK) {
+      return false;
+    }
+    strlcpy(record.crashTask, summary.exc_task, sizeof(record.crashTask));
+    record.crashPc = summary.exc_pc;
+    record.backtraceDepth = min((uint32_t)summary.exc_bt_info.depth, (uint32_t)COREDUMP_BACKTRACE_DEPTH);
+    for (int i = 0; i < record.backtraceDepth; i++) {
+      record.backtrace[i] = summary.exc_bt_info.bt[i];
+    }
+    return true;
+  #else
+    return false;
+  #endif
+}
+
+// Streams the raw core dump image (ELF inside) straight from flash.
+// Decode it with tools/coredump.py against the matching firmware .elf.
+void handleCoreDump() {
+  if (!requireWebAuth()) {
+    return;
+  }
   
-  // Test sensor readings
-  float testTemp = dht.readTemperature();
-  float testHumidity = dht.readHumidity();
+  size_t address = 0, size = 0;
+  const esp_partition_t* partition = findCoreDumpPartition();
+  if (partition == NULL || esp_core_dump_image_check() != ESP_OK ||
+      esp_core_dump_image_get(&address, &size) != ESP_OK) {
+    server.send(404, "text/plain", "No core dump stored");
+    return;
+  }
   
-  if (!isnan(testTemp) && !isnan(testHumidity)) {
-    systemState.systemOK = true;
-    systemState.recoveryAttempts = 0;
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println("System recovery successful!");
-    #endif
-  } else {
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println("System recovery failed. Attempt " + String(systemState.recoveryAttempts) + "/" + String(RECOVERY_ATTEMPTS));
-    #endif
-    delay(RECOVERY_DELAY);
+  static uint8_t chunk[COREDUMP_CHUNK_SIZE];
+  size_t offset = address - partition->address;
+  server.sendHeader("Content-Disposition", "attachment; filename=\"coredump.bin\"");
+  server.setContentLength(size);
+  server.send(200, "application/octet-stream", "");
+  for (size_t sent = 0; sent < size; ) {
+    size_t length = min(size - sent, (size_t)COREDUMP_CHUNK_SIZE);
+    if (esp_partition_read(partition, offset + sent, chunk, length) != ESP_OK) {
+      #if SERIAL_OUTPUT_ENABLED
+        Log.println("Core dump read failed at offset " + String(sent));
+      #endif
+      break;
+    }
+    server.sendContent((const char*)chunk, length);
+    sent += length;
   }
 }
 
-void checkPumpRuntime() {
-  if (systemState.pumpActive && (currentTime - systemState.pumpStartTime >= MAX_PUMP_RUNTIME)) {
-    #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Warning: Maximum pump runtime exceeded! Stopping irrigation for safety.");
-    #endif
-    stopIrrigation();
-    
-    // Display warning on LCD
-    #if DISPLAY_ENABLED
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("PUMP TIMEOUT");
-      lcd.setCursor(0, 1);
-      lcd.print("SAFETY STOP");
-    #endif
+void handleCoreDumpErase() {
+  if (!requireWebAuth()) {
+    return;
   }
+  
+  if (esp_core_dump_image_erase() != ESP_OK) {
+    server.send(500, "text/plain", "Core dump erase failed");
+    return;
+  }
+  server.send(200, "text/plain", "Core dump erased");
 }
 
 // =============================================================================
@@ -1593,39 +7966,44 @@ void checkPumpRuntime() {
 
 void displayAllInfo() {
   #if DISPLAY_TYPE == DISPLAY_LCD_2004
+    SensorSnapshot snapshot = sensorSnapshot.read();
     lcd.clear();
     
     // Line 1: Temperature and Humidity (if DHT enabled)
     lcd.setCursor(0, 0);
     #if DHT_ENABLED
-      lcd.print("T:" + String(systemState.temperature, 1) + "C H:" + String(systemState.humidity, 1) + "%");
+      lcd.print("T:" + String(snapshot.temperature, 1) + "C H:" + String(snapshot.humidity, 1) + "%");
     #else
       lcd.print("Smart Farming Online");
     #endif
     
     // Line 2: Soil Moisture and additional info
     lcd.setCursor(0, 1);
-    lcd.print("Soil:" + String(systemState.soilMoisturePercent) + "%");
+    lcd.print("Soil:" + String(snapshot.soilMoisturePercent) + "%");
     
     #if LDR_ENABLED
       // Show light level if LDR is enabled
-      lcd.print(" Light:" + String(systemState.lightLevelPercent) + "%");
+      lcd.print(" Light:" + String(snapshot.lightLevelPercent) + "%");
     #else
       // Show pump status instead of light level
-      lcd.print(" Pump:" + String(systemState.pumpActive ? "ON" : "OFF"));
+      lcd.print(" Pump:" + String(snapshot.pumpActive ? "ON" : "OFF"));
     #endif
     
     // Line 3: System Status and WiFi
     lcd.setCursor(0, 2);
-    lcd.print("Status:" + String(systemState.systemOK ? "OK" : "ERR") + " WiFi:" + String(systemState.wifiConnected ? "ON" : "OFF"));
+    lcd.print("Status:" + String(snapshot.systemOK ? "OK" : "ERR") + " WiFi:" + String(snapshot.wifiConnected ? "ON" : "OFF"));
     
     #if CONTROL_TYPE == CONTROL_POTENTIOMETER
-      lcd.print(" Thr:" + String(systemState.adjustedThreshold) + "%");
+      lcd.print(" Thr:" + String(activeSoilThreshold()) + "%");
     #endif
     
-    // Line 4: Daily Irrigations and Cloud Status
+    // Line 4: Daily Irrigations and Cloud Status (access point key while it is up)
     lcd.setCursor(0, 3);
-    lcd.print("Daily:" + String(systemState.dailyIrrigations));
+    if (softAp.active) {
+      lcd.print("AP key:" + String(softApPassword));
+      return;
+    }
+    lcd.print("Daily:" + String(snapshot.dailyIrrigations));
     
     #if IOT_SERVICES_ENABLED
       String cloudStatus = " TS:" + String(THINGSPEAK_ENABLED ? "ON" : "OFF") + " AIO:" + String(ADAFRUIT_IO_ENABLED ? "ON" : "OFF");
@@ -1641,7 +8019,7 @@ void outputToSerial() {
     static unsigned long lastSerialOutput = 0;
     
     if (currentTime - lastSerialOutput >= DISPLAY_UPDATE_INTERVAL) {
-      Serial.println("Status: " + String(systemState.systemOK ? "OK" : "ERROR") + " | Soil: " + String(systemState.soilMoisturePercent) + "% | Pump: " + String(systemState.pumpActive ? "ON" : "OFF") + " | WiFi: " + String(systemState.wifiConnected ? "OK" : "OFF"));
+      Log.println("Status: " + String(systemState.systemOK ? "OK" : "ERROR") + " | Soil: " + String(systemState.soilMoisturePercent) + "% | Pump: " + String(systemState.pumpActive ? "ON" : "OFF") + " | WiFi: " + String(systemState.wifiConnected ? "OK" : "OFF"));
       
       lastSerialOutput = currentTime;
     }
@@ -1655,7 +8033,7 @@ void outputToSerial() {
 void initializeControl() {
   #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Initializing rotary encoder control...");
+      Log.println("Initializing rotary encoder control...");
     #endif
     
     // Set encoder pins as inputs with pullup
@@ -1664,28 +8042,34 @@ void initializeControl() {
     pinMode(ENCODER_SW_PIN, INPUT_PULLUP);
     
     // Initialize encoder state
-    systemState.currentMenu = 0;
-    systemState.currentParameter = 0;
+    systemState.menuPage = &rootMenu;
+    systemState.menuCursor = 0;
+    systemState.menuEditing = false;
+    systemState.menuDepth = 0;
     systemState.encoderPosition = 0;
     systemState.encoderButtonPressed = false;
+    systemState.encoderButtonRaw = false;
     systemState.lastMenuActivity = currentTime;
     systemState.inMenuMode = false;
     
+    // Rotation is captured by interrupt so fast turns are not lost between loop passes
+    attachInterrupt(digitalPinToInterrupt(ENCODER_CLK_PIN), encoderISR, CHANGE);
+    
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Rotary encoder control initialized");
+      Log.println("Rotary encoder control initialized");
     #endif
     
   #elif CONTROL_TYPE == CONTROL_POTENTIOMETER
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Initializing potentiometer control...");
+      Log.println("Initializing potentiometer control...");
     #endif
     
     // Initialize potentiometer state
     systemState.potentiometerValue = 0;
-    systemState.adjustedThreshold = SOIL_MOISTURE_THRESHOLD;
+    systemState.adjustedThreshold = runtimeSettings.soilThreshold;
     systemState.lastPotentiometerRead = currentTime;
     systemState.sampleIndex = 0;
-    systemState.lastStableThreshold = SOIL_MOISTURE_THRESHOLD;
+    systemState.lastStableThreshold = runtimeSettings.soilThreshold;
     systemState.thresholdChanged = false;
     
     // Initialize smoothing array with initial reading
@@ -1696,12 +8080,12 @@ void initializeControl() {
     systemState.potentiometerValue = initialReading;
     
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Potentiometer control initialized");
+      Log.println("Potentiometer control initialized");
     #endif
     
   #else
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("No manual control configured - fully automated mode");
+      Log.println("No manual control configured - fully automated mode");
     #endif
   #endif
   
@@ -1719,105 +8103,82 @@ void handleHardwareControl() {
 
 void handleRotaryEncoder() {
   #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
-    // Read encoder button
-    bool buttonState = !digitalRead(ENCODER_SW_PIN); // Inverted due to pullup
+    // Debounce encoder button (inverted due to pullup)
+    bool buttonRaw = !digitalRead(ENCODER_SW_PIN);
+    if (buttonRaw != systemState.encoderButtonRaw) {
+      systemState.encoderButtonRaw = buttonRaw;
+      systemState.lastButtonChange = currentTime;
+    }
+    bool buttonState = systemState.encoderButtonPressed;
+    if (currentTime - systemState.lastButtonChange >= ENCODER_DEBOUNCE_TIME) {
+      buttonState = systemState.encoderButtonRaw;
+    }
     
     // Detect button press
     if (buttonState && !systemState.encoderButtonPressed) {
-      systemState.encoderButtonPressed = true;
       systemState.lastMenuActivity = currentTime;
-      
       if (!systemState.inMenuMode) {
-        // Enter menu mode
-        systemState.inMenuMode = true;
-        systemState.currentMenu = 0;
-        #if SERIAL_OUTPUT_ENABLED
-          Serial.println("Entered menu mode");
-        #endif
+        enterMenu();
       } else {
-        // Process menu selection
-        if (systemState.currentMenu < MENU_ITEMS) {
-          // Enter parameter adjustment mode
-          systemState.currentParameter = systemState.currentMenu;
-          #if SERIAL_OUTPUT_ENABLED
-            Serial.println("Entered parameter adjustment mode: " + String(systemState.currentParameter));
-          #endif
-        } else {
-          // Exit menu mode
-          systemState.inMenuMode = false;
-          saveSettings();
-          #if SERIAL_OUTPUT_ENABLED
-            Serial.println("Exited menu mode");
-          #endif
-        }
+        menuSelect();
       }
-    } else if (!buttonState && systemState.encoderButtonPressed) {
-      systemState.encoderButtonPressed = false;
     }
+    systemState.encoderButtonPressed = buttonState;
     
-    // Read encoder rotation
-    static int lastCLK = HIGH;
-    int currentCLK = digitalRead(ENCODER_CLK_PIN);
+    // Consume detents counted by the ISR
+    portENTER_CRITICAL(&encoderMux);
+    int steps = encoderPendingSteps;
+    unsigned long intervalMs = encoderStepIntervalMs;
+    encoderPendingSteps = 0;
+    portEXIT_CRITICAL(&encoderMux);
     
-    if (currentCLK != lastCLK) {
-      if (digitalRead(ENCODER_DT_PIN) != currentCLK) {
-        // Clockwise rotation
-        systemState.encoderPosition++;
-        systemState.lastMenuActivity = currentTime;
-        
-        if (systemState.inMenuMode) {
-          if (systemState.currentParameter >= 0) {
-            // Adjusting parameter
-            adjustParameter(1);
-          } else {
-            // Navigating menu
-            systemState.currentMenu = (systemState.currentMenu + 1) % (MENU_ITEMS + 1);
-          }
-        }
-      } else {
-        // Counter-clockwise rotation
-        systemState.encoderPosition--;
-        systemState.lastMenuActivity = currentTime;
-        
-        if (systemState.inMenuMode) {
-          if (systemState.currentParameter >= 0) {
-            // Adjusting parameter
-            adjustParameter(-1);
-          } else {
-            // Navigating menu
-            systemState.currentMenu = (systemState.currentMenu - 1 + MENU_ITEMS + 1) % (MENU_ITEMS + 1);
-          }
-        }
+    if (steps != 0) {
+      systemState.encoderPosition += steps;
+      systemState.lastMenuActivity = currentTime;
+      if (systemState.inMenuMode) {
+        menuRotate(steps, intervalMs);
       }
     }
-    lastCLK = currentCLK;
     
     // Check for menu timeout
     if (systemState.inMenuMode && (currentTime - systemState.lastMenuActivity > MENU_TIMEOUT)) {
-      systemState.inMenuMode = false;
-      systemState.currentParameter = -1;
-      saveSettings();
+      exitMenu();
       #if SERIAL_OUTPUT_ENABLED
-        Serial.println("Menu timeout - returned to normal mode");
+        Log.println("Menu timeout - returned to normal mode");
       #endif
     }
     
     // Update display for menu
     if (systemState.inMenuMode) {
-      if (systemState.currentParameter >= 0) {
-        displayParameterAdjustment();
-      } else {
-        displayMenu();
-      }
+      renderMenu();
     }
   #endif
 }
 
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+void IRAM_ATTR encoderISR() {
+  unsigned long now = micros();
+  portENTER_CRITICAL_ISR(&encoderMux);
+  if (now - encoderLastEdgeMicros >= ENCODER_EDGE_DEBOUNCE_US) {
+    int clk = digitalRead(ENCODER_CLK_PIN);
+    // Count one step per detent on the falling CLK edge
+    if (clk == LOW) {
+      encoderPendingSteps = encoderPendingSteps + ((digitalRead(ENCODER_DT_PIN) != clk) ? 1 : -1);
+      encoderStepIntervalMs = (now - encoderLastStepMicros) / 1000;
+      encoderLastStepMicros = now;
+    }
+  }
+  encoderLastEdgeMicros = now;
+  portEXIT_CRITICAL_ISR(&encoderMux);
+}
+#endif
+
 void handlePotentiometer() {
   #if CONTROL_TYPE == CONTROL_POTENTIOMETER
-    if (currentTime - systemState.lastPotentiometerRead >= POTENTIOMETER_UPDATE_INTERVAL) {
+    if (currentTime - systemState.lastPotentiometerRead >= POTENTIOMETER_UPDATE_INTERVAL && acquireAnalogInputs()) {
       // Read raw potentiometer value (0-4095)
       int rawValue = analogRead(POTENTIOMETER_PIN);
+      releaseAnalogInputs();
       
       // Add to smoothing array
       systemState.potentiometerSamples[systemState.sampleIndex] = rawValue;
@@ -1856,8 +8217,10 @@ void handlePotentiometer() {
         lcd.setCursor(0, 1);
         lcd.print(String(systemState.adjustedThreshold) + "% ");
         
-        // Show current soil moisture for comparison
-        if (systemState.soilMoisturePercent < systemState.adjustedThreshold) {
+        // Show current soil moisture for comparison; a crop profile overrides the knob
+        if (cropState.active) {
+          lcd.print("CROP " + String(cropState.threshold) + "%");
+        } else if (systemState.soilMoisturePercent < systemState.adjustedThreshold) {
           lcd.print("DRY");
         } else {
           lcd.print("OK");
@@ -1874,14 +8237,15 @@ void handlePotentiometer() {
       // Enhanced serial output
       #if SERIAL_OUTPUT_ENABLED && DEBUG_MODE
         if (systemState.thresholdChanged) {
-          Serial.println("=== POTENTIOMETER CONTROL ===");
-          Serial.println("Raw ADC: " + String(rawValue));
-          Serial.println("Smoothed: " + String(smoothedValue));
-          Serial.println("Final Value: " + String(systemState.potentiometerValue));
-          Serial.println("Threshold: " + String(systemState.adjustedThreshold) + "%");
-          Serial.println("Current Soil: " + String(systemState.soilMoisturePercent) + "%");
-          Serial.println("Status: " + String(systemState.soilMoisturePercent < systemState.adjustedThreshold ? "NEEDS WATER" : "OK"));
-          Serial.println("=============================");
+          Log.println("=== POTENTIOMETER CONTROL ===");
+          Log.println("Raw ADC: " + String(rawValue));
+          Log.println("Smoothed: " + String(smoothedValue));
+          Log.println("Final Value: " + String(systemState.potentiometerValue));
+          Log.println("Threshold: " + String(systemState.adjustedThreshold) + "%");
+          Log.println("Current Soil: " + String(systemState.soilMoisturePercent) + "%");
+          Log.println("Status: " + String(systemState.soilMoisturePercent < activeSoilThreshold() ? "NEEDS WATER" : "OK") +
+                         (cropState.active ? " (crop profile threshold " + String(cropState.threshold) + "%)" : ""));
+          Log.println("=============================");
           systemState.thresholdChanged = false;
         }
       #endif
@@ -1889,94 +8253,235 @@ void handlePotentiometer() {
   #endif
 }
 
-void displayMenu() {
-  #if DISPLAY_ENABLED && CONTROL_TYPE == CONTROL_ROTARY_ENCODER
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("Menu:");
-    
-    String menuItems[] = {
-      "Soil Threshold",
-      "Irrigation Time", 
-      "Display Speed",
-      "WiFi Settings",
-      "Save & Exit"
-    };
-    
-    if (systemState.currentMenu < MENU_ITEMS) {
-      lcd.setCursor(0, 1);
-      lcd.print(menuItems[systemState.currentMenu]);
-    } else {
-      lcd.setCursor(0, 1);
-      lcd.print("Exit Menu");
-    }
+// =============================================================================
+// MENU ENGINE FUNCTIONS
+// =============================================================================
+
+#if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+void enterMenu() {
+  systemState.inMenuMode = true;
+  systemState.menuPage = &rootMenu;
+  systemState.menuCursor = 0;
+  systemState.menuDepth = 0;
+  systemState.menuEditing = false;
+  systemState.menuDirty = true;
+  
+  invalidateMenuFrame();
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Entered menu mode");
   #endif
 }
 
-void displayParameterAdjustment() {
-  #if DISPLAY_ENABLED && CONTROL_TYPE == CONTROL_ROTARY_ENCODER
+void exitMenu() {
+  systemState.inMenuMode = false;
+  systemState.menuEditing = false;
+  saveSettings();
+  
+  // Hand the LCD back to the normal status screens straight away
+  #if DISPLAY_ENABLED
     lcd.clear();
-    lcd.setCursor(0, 0);
-    
-    switch (systemState.currentParameter) {
-      case 0: // Soil Threshold
-        lcd.print("Soil Threshold:");
-        lcd.setCursor(0, 1);
-        lcd.print(String(systemState.adjustedThreshold) + "%");
-        break;
-        
-      case 1: // Irrigation Time
-        lcd.print("Irrigation Time:");
-        lcd.setCursor(0, 1);
-        lcd.print(String(IRRIGATION_DURATION / 1000) + "s");
-        break;
-        
-      case 2: // Display Speed
-        lcd.print("Display Speed:");
-        lcd.setCursor(0, 1);
-        lcd.print(String(DISPLAY_SCROLL_DELAY / 1000) + "s");
-        break;
-        
-      case 3: // WiFi Settings
-        lcd.print("WiFi Status:");
-        lcd.setCursor(0, 1);
-        lcd.print(systemState.wifiConnected ? "Connected" : "Disconnected");
-        break;
+  #endif
+  systemState.lastDisplayUpdate = 0;
+  
+  #if SERIAL_OUTPUT_ENABLED
+    Log.println("Exited menu mode");
+  #endif
+}
+
+// Acceleration curve: slow detents move by PARAMETER_MIN_STEP, fast spins by
+// up to PARAMETER_MAX_STEP, interpolated linearly in between.
+int menuAcceleration(unsigned long intervalMs) {
+  if (intervalMs <= ENCODER_ACCEL_FAST_MS) {
+    return PARAMETER_MAX_STEP;
+  }
+  if (intervalMs >= ENCODER_ACCEL_SLOW_MS) {
+    return PARAMETER_MIN_STEP;
+  }
+  return PARAMETER_MAX_STEP - (int)((intervalMs - ENCODER_ACCEL_FAST_MS) * (PARAMETER_MAX_STEP - PARAMETER_MIN_STEP) /
+                                    (ENCODER_ACCEL_SLOW_MS - ENCODER_ACCEL_FAST_MS));
+}
+
+void menuRotate(int steps, unsigned long intervalMs) {
+  const MenuPage* page = systemState.menuPage;
+  const MenuItem& item = page->items[systemState.menuCursor];
+  
+  if (systemState.menuEditing && item.kind == MENU_INT) {
+    int delta = steps * item.step * menuAcceleration(intervalMs);
+    *item.value = constrain(*item.value + delta, (int)item.minValue, (int)item.maxValue);
+  } else {
+    int cursor = (systemState.menuCursor + steps) % page->count;
+    if (cursor < 0) {
+      cursor += page->count;
+    }
+    systemState.menuCursor = cursor;
+  }
+  systemState.menuDirty = true;
+}
+
+void menuSelect() {
+  const MenuItem& item = systemState.menuPage->items[systemState.menuCursor];
+  
+  switch (item.kind) {
+    case MENU_SUBMENU:
+      if (systemState.menuDepth < MENU_MAX_DEPTH) {
+        systemState.menuStack[systemState.menuDepth] = systemState.menuPage;
+        systemState.menuCursorStack[systemState.menuDepth] = systemState.menuCursor;
+        systemState.menuDepth++;
+        systemState.menuPage = item.submenu;
+        systemState.menuCursor = 0;
+      }
+      break;
+      
+    case MENU_INT:
+      systemState.menuEditing = !systemState.menuEditing;
+      break;
+      
+    case MENU_ACTION:
+      item.action();
+      invalidateMenuFrame();  // Actions may write to the LCD themselves
+      break;
+      
+    case MENU_BACK:
+      if (systemState.menuDepth > 0) {
+        systemState.menuDepth--;
+        systemState.menuPage = systemState.menuStack[systemState.menuDepth];
+        systemState.menuCursor = systemState.menuCursorStack[systemState.menuDepth];
+      }
+      break;
+      
+    case MENU_EXIT:
+      exitMenu();
+      return;
+      
+    case MENU_INFO:
+      break;
+  }
+  systemState.menuDirty = true;
+}
+
+// Writes the value column of an item (empty for items without a value)
+void menuFormatValue(const MenuItem& item, char* buffer, size_t size) {
+  buffer[0] = '\0';
+  if (item.kind == MENU_INT) {
+    snprintf(buffer, size, "%d%s", *item.value, item.unit);
+  } else if (item.kind == MENU_INFO) {
+    item.info(buffer, size);
+  } else if (item.kind == MENU_SUBMENU) {
+    snprintf(buffer, size, ">");
+  }
+}
+
+// Forces the next renderMenu() call to repaint every row
+void invalidateMenuFrame() {
+  #if DISPLAY_ENABLED
+    for (int row = 0; row < LCD_ROWS; row++) {
+      menuFrame[row][0] = '\0';
     }
+    lcd.clear();
   #endif
+  systemState.menuDirty = true;
 }
 
-void adjustParameter(int direction) {
-  #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER
-    switch (systemState.currentParameter) {
-      case 0: // Soil Threshold
-        systemState.adjustedThreshold += direction * ENCODER_STEP_SIZE;
-        systemState.adjustedThreshold = constrain(systemState.adjustedThreshold, 
-                                                   POTENTIOMETER_MIN_THRESHOLD, 
-                                                   POTENTIOMETER_MAX_THRESHOLD);
-        break;
-        
-      case 1: // Irrigation Time (read-only for now)
-        // Could be made adjustable in future versions
-        break;
-        
-      case 2: // Display Speed (read-only for now)
-        // Could be made adjustable in future versions
-        break;
-        
-      case 3: // WiFi Settings (read-only)
-        break;
+#if DISPLAY_ENABLED
+// Pads the row to the LCD width and only sends it over I2C if it changed
+void menuWriteRow(int row, const char* text) {
+  char line[LCD_COLS + 1];
+  snprintf(line, sizeof(line), "%-*s", LCD_COLS, text);
+  if (strcmp(line, menuFrame[row]) != 0) {
+    lcd.setCursor(0, row);
+    lcd.print(line);
+    memcpy(menuFrame[row], line, sizeof(line));
+  }
+}
+#endif
+
+void renderMenu() {
+  #if DISPLAY_ENABLED
+    // Live values (MENU_INFO) are refreshed at the normal display rate
+    if (currentTime - systemState.lastMenuRefresh >= DISPLAY_UPDATE_INTERVAL) {
+      systemState.menuDirty = true;
+    }
+    if (!systemState.menuDirty) {
+      return;
+    }
+    systemState.menuDirty = false;
+    systemState.lastMenuRefresh = currentTime;
+    
+    const MenuPage* page = systemState.menuPage;
+    const MenuItem& selected = page->items[systemState.menuCursor];
+    char value[LCD_COLS + 1];
+    char line[LCD_COLS + 1];
+    
+    if (systemState.menuEditing) {
+      // Editing: label on the first row, value in brackets below
+      menuFormatValue(selected, value, sizeof(value));
+      menuWriteRow(0, selected.label);
+      snprintf(line, sizeof(line), "[%s]", value);
+      menuWriteRow(1, line);
+      for (int row = 2; row < LCD_ROWS; row++) {
+        menuWriteRow(row, "");
+      }
+      return;
+    }
+    
+    // Browsing: page title, then a window of items that keeps the cursor visible
+    menuWriteRow(0, page->title);
+    const int visibleRows = LCD_ROWS - 1;
+    int first = 0;
+    if (systemState.menuCursor >= visibleRows) {
+      first = systemState.menuCursor - visibleRows + 1;
+    }
+    for (int row = 0; row < visibleRows; row++) {
+      int index = first + row;
+      if (index >= page->count) {
+        menuWriteRow(row + 1, "");
+        continue;
+      }
+      const MenuItem& item = page->items[index];
+      menuFormatValue(item, value, sizeof(value));
+      int labelWidth = max(0, LCD_COLS - 1 - (int)strlen(value));
+      snprintf(line, sizeof(line), "%c%-*.*s%s", index == systemState.menuCursor ? '>' : ' ',
+               labelWidth, labelWidth, item.label, value);
+      menuWriteRow(row + 1, line);
     }
   #endif
 }
 
+void menuInfoSoil(char* buffer, size_t size) {
+  snprintf(buffer, size, "%d%%", systemState.soilMoisturePercent);
+}
+
+void menuInfoWiFi(char* buffer, size_t size) {
+  snprintf(buffer, size, "%s", systemState.wifiConnected ? "OK" : (softAp.active ? "AP" : "OFF"));
+}
+
+void menuInfoIP(char* buffer, size_t size) {
+  IPAddress ip = networkAddress();
+  snprintf(buffer, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+void menuInfoUptime(char* buffer, size_t size) {
+  unsigned long minutes = millis() / 60000;
+  snprintf(buffer, size, "%luh%02lum", minutes / 60, minutes % 60);
+}
+
+void menuActionWaterNow() {
+  startIrrigation();
+}
+
+void menuActionResetEmergencyStop() {
+  resetEmergencyStop("menu");
+}
+#endif
+
 void saveSettings() {
   #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER || CONTROL_TYPE == CONTROL_POTENTIOMETER
     // In a real implementation, this would save to EEPROM
     // For now, we'll just log the settings
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Settings saved:");
-      Serial.println("  Soil Threshold: " + String(systemState.adjustedThreshold) + "%");
+      Log.println("Settings saved:");
+      Log.println("  Soil Threshold: " + String(systemState.adjustedThreshold) + "%");
     #endif
   #endif
 }
@@ -1985,9 +8490,9 @@ void loadSettings() {
   #if CONTROL_TYPE == CONTROL_ROTARY_ENCODER || CONTROL_TYPE == CONTROL_POTENTIOMETER
     // In a real implementation, this would load from EEPROM
     // For now, we'll use default values
-    systemState.adjustedThreshold = SOIL_MOISTURE_THRESHOLD;
+    systemState.adjustedThreshold = runtimeSettings.soilThreshold;
     #if SERIAL_OUTPUT_ENABLED
-      Serial.println("Settings loaded with defaults");
+      Log.println("Settings loaded with defaults");
     #endif
   #endif
 }
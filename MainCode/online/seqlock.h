@@ -0,0 +1,99 @@
+/*
+ * Smart Farming System - Seqlock
+ *
+ * Publishes a small trivially-copyable struct from one writer to any number
+ * of readers on other tasks or cores. The writer never blocks or waits;
+ * a reader copies the value and retries only if a publish overlapped it,
+ * so it always sees one complete, consistent set of fields.
+ *
+ *   Seqlock<Snapshot> lock;
+ *   lock.publish(value);                  // single writer only
+ *   Snapshot s = lock.read();             // any task
+ *   uint32_t g = lock.generation();       // bumps once per publish, 0 = never published
+ *
+ * A reader that preempted the writer on the same core cannot win by
+ * spinning, so after a few failed attempts it sleeps one tick and lets the
+ * writer finish.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock values are copied word by word");
+
+ public:
+  static constexpr int SPINS_BEFORE_SLEEP = 8;
+
+  void publish(const T& value) {
+    uint32_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+
+    // Odd sequence marks a publish in progress
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) {
+      data[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  T read() const {
+    uint32_t words[WORDS];
+    for (int attempt = 1;; attempt++) {
+      uint32_t before = sequence.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        for (size_t i = 0; i < WORDS; i++) {
+          words[i] = data[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+          break;
+        }
+      }
+      retries.fetch_add(1, std::memory_order_relaxed);
+      if (attempt % SPINS_BEFORE_SLEEP == 0) {
+        backoff();
+      }
+    }
+
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+  uint32_t generation() const { return sequence.load(std::memory_order_acquire) >> 1; }
+
+  // Reads that had to retry because a publish overlapped them
+  uint32_t collisions() const { return retries.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+  std::atomic<uint32_t> sequence{0};
+  std::atomic<uint32_t> data[WORDS] = {};
+  mutable std::atomic<uint32_t> retries{0};
+
+  static void backoff() {
+    #ifdef ESP_PLATFORM
+      vTaskDelay(1);
+    #else
+      std::this_thread::yield();
+    #endif
+  }
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Smart Farming System - Frequency Soil Probe
+ *
+ * Capacitive probes built as oscillators (or with a frequency output) are read
+ * by counting edges with the PCNT peripheral over a gate window. Everything
+ * between the count and the reading the rest of the system uses lives here,
+ * with no Arduino or IDF dependencies, so it can be compiled and checked on a PC:
+ *
+ *   uint32_t hz = probe::countToHz(count, windowUs);
+ *   int32_t moisture = probe::moistureFromHz(soilFrequencyTable, SOIL_FREQUENCY_POINTS, hz);  // 0.01 %
+ *   int raw = probe::rawFromMoisture(moisture, SOIL_MOISTURE_DRY_VALUE, SOIL_MOISTURE_WET_VALUE);
+ *
+ * rawFromMoisture() puts the result on the analog probe's scale, so temperature
+ * compensation, auto-calibration, validation and rain detection treat both
+ * probe types the same way.
+ */
+
+#ifndef SOILPROBE_H
+#define SOILPROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace probe {
+
+constexpr int32_t FULL_SCALE = 10000;        // 100.00 % moisture
+constexpr uint16_t MAX_GATE_TICKS = 32767;   // Longest RMT half-symbol (15-bit duration)
+
+// One calibration point: the probe's frequency at a known moisture
+struct FrequencyPoint {
+  uint32_t hz;
+  uint16_t moisture;        // 0.01 %
+};
+
+// Edges counted over the gate window -> frequency, rounded to the nearest Hz
+inline uint32_t countToHz(uint32_t count, uint32_t windowUs) {
+  if (windowUs == 0) {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)count * 1000000ULL + windowUs / 2) / windowUs);
+}
+
+// Piecewise-linear lookup. The table must be monotonic in hz (either
+// direction); frequencies beyond either end clamp to that end's moisture.
+inline int32_t moistureFromHz(const FrequencyPoint* table, size_t points, uint32_t hz) {
+  if (points == 0) {
+    return 0;
+  }
+  for (size_t i = 0; i + 1 < points; i++) {
+    uint32_t a = table[i].hz;
+    uint32_t b = table[i + 1].hz;
+    uint32_t low = a < b ? a : b;
+    uint32_t high = a < b ? b : a;
+    if (hz < low || hz > high) {
+      continue;
+    }
+    if (a == b) {
+      return table[i].moisture;
+    }
+    int64_t span = (int64_t)table[i + 1].moisture - table[i].moisture;
+    return table[i].moisture + (int32_t)(span * ((int64_t)hz - a) / ((int64_t)b - a));
+  }
+
+  bool descending = table[0].hz > table[points - 1].hz;
+  bool beforeFirst = descending ? hz > table[0].hz : hz < table[0].hz;
+  return beforeFirst ? table[0].moisture : table[points - 1].moisture;
+}
+
+// Moisture (0.01 %) -> reading on the analog probe's dry..wet scale
+inline int rawFromMoisture(int32_t moisture, int dryRaw, int wetRaw) {
+  if (moisture < 0) {
+    moisture = 0;
+  } else if (moisture > FULL_SCALE) {
+    moisture = FULL_SCALE;
+  }
+  return dryRaw + (int)((int64_t)(wetRaw - dryRaw) * moisture / FULL_SCALE);
+}
+
+// Splits a gate window into RMT half-symbol durations of at most
+// MAX_GATE_TICKS; returns how many halves were written (0 if it does not fit)
+inline int splitGate(uint32_t windowTicks, uint16_t* halves, int maxHalves) {
+  int count = 0;
+  while (windowTicks > 0) {
+    if (count >= maxHalves) {
+      return 0;
+    }
+    uint16_t ticks = windowTicks > MAX_GATE_TICKS ? MAX_GATE_TICKS : (uint16_t)windowTicks;
+    halves[count++] = ticks;
+    windowTicks -= ticks;
+  }
+  return count;
+}
+
+}  // namespace probe
+
+// Calibration table for the frequency probe. Replace the points with readings
+// from your own probe: note the frequency (GET /api, "soilProbe") in dry soil,
+// at field capacity and a few points in between. More points follow a
+// non-linear probe more closely.
+const probe::FrequencyPoint soilFrequencyTable[] = {
+  //   hz      moisture (0.01 %)
+  {150000,     0},
+  {128000,  2000},
+  {108000,  4500},
+  { 92000,  7000},
+  { 80000, 10000},
+};
+
+const size_t SOIL_FREQUENCY_POINTS = sizeof(soilFrequencyTable) / sizeof(soilFrequencyTable[0]);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Smart Farming System - Step Response Identification
+ *
+ * Works out how the soil answers a watering pulse from a moisture trace:
+ *
+ *   stepid::Trace trace = {samples, count, intervalMs, pulseStartIndex, pulseSeconds};
+ *   stepid::Result r = stepid::identify(trace);
+ *
+ *   deadTimeSeconds - pump on until the water reaches the probe
+ *   gainPerSecond   - moisture gained per second of pumping (%)
+ *   tauSeconds      - infiltration time constant (first-order rise)
+ *   decayPerHour    - how fast the soil dries again after the peak (%/h)
+ *
+ * The rise is fitted as first order plus dead time with the two-point
+ * (Smith) method: tau = 1.5 * (t63 - t28), dead time = t63 - tau. Samples
+ * are moisture in 0.01 % at a fixed interval, as recorded by commissioning
+ * (GET /api/commission?trace=1). No Arduino dependencies, so recorded
+ * traces can be analysed on a PC with the same code.
+ */
+
+#ifndef STEPID_H
+#define STEPID_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace stepid {
+
+constexpr size_t MIN_BASELINE = 5;     // Samples needed before the pulse
+constexpr size_t MIN_TAIL = 10;        // Samples needed after the peak for the decay fit
+constexpr int SMOOTH_HALF_WIDTH = 2;   // Centred moving average over 5 samples
+constexpr float MIN_RISE = 0.2f;       // Smallest rise accepted as a response (%)
+constexpr float NOISE_SIGMAS = 4.0f;   // ...and it must also clear the baseline noise by this much
+
+struct Trace {
+  const int16_t* moisture;   // 0.01 %, one sample per interval
+  size_t count;
+  uint32_t intervalMs;
+  size_t pulseStart;         // Index of the first sample taken with the pump on
+  float pulseSeconds;
+};
+
+struct Result {
+  bool ok;
+  const char* error;
+  float baseline;            // Mean before the pulse (%)
+  float noise;               // Standard deviation before the pulse (%)
+  float rise;                // Peak above baseline (%)
+  float peakSeconds;         // Pulse start to peak
+  float deadTimeSeconds;
+  float gainPerSecond;
+  float tauSeconds;
+  float decayPerHour;
+};
+
+inline float smoothedAt(const Trace& trace, size_t index) {
+  size_t first = index >= (size_t)SMOOTH_HALF_WIDTH ? index - SMOOTH_HALF_WIDTH : 0;
+  size_t last = index + SMOOTH_HALF_WIDTH < trace.count ? index + SMOOTH_HALF_WIDTH : trace.count - 1;
+  int32_t sum = 0;
+  for (size_t i = first; i <= last; i++) {
+    sum += trace.moisture[i];
+  }
+  return sum / 100.0f / (float)(last - first + 1);
+}
+
+// Time from the pulse start to where the smoothed trace first reaches level,
+// interpolated between samples; negative if it never does
+inline float crossingSeconds(const Trace& trace, size_t from, size_t to, float level) {
+  float previous = smoothedAt(trace, from);
+  for (size_t i = from; i <= to; i++) {
+    float value = smoothedAt(trace, i);
+    if (value >= level) {
+      float fraction = (i > from && value > previous) ? (level - previous) / (value - previous) : 1.0f;
+      float index = (float)i - 1.0f + fraction;
+      return (index - (float)trace.pulseStart) * trace.intervalMs / 1000.0f;
+    }
+    previous = value;
+  }
+  return -1.0f;
+}
+
+inline Result identify(const Trace& trace) {
+  Result result = {};
+  if (trace.moisture == nullptr || trace.intervalMs == 0 || trace.pulseSeconds <= 0) {
+    result.error = "invalid trace";
+    return result;
+  }
+  if (trace.pulseStart < MIN_BASELINE || trace.pulseStart >= trace.count) {
+    result.error = "not enough samples before the pulse";
+    return result;
+  }
+
+  // Baseline level and noise from the quiet period before the pump
+  float sum = 0;
+  float sumSquares = 0;
+  for (size_t i = 0; i < trace.pulseStart; i++) {
+    float value = trace.moisture[i] / 100.0f;
+    sum += value;
+    sumSquares += value * value;
+  }
+  float n = (float)trace.pulseStart;
+  result.baseline = sum / n;
+  float variance = sumSquares / n - result.baseline * result.baseline;
+  result.noise = variance > 0 ? sqrtf(variance) : 0;
+
+  // Peak of the response
+  size_t peakIndex = trace.pulseStart;
+  float peak = smoothedAt(trace, peakIndex);
+  for (size_t i = trace.pulseStart; i < trace.count; i++) {
+    float value = smoothedAt(trace, i);
+    if (value > peak) {
+      peak = value;
+      peakIndex = i;
+    }
+  }
+  result.rise = peak - result.baseline;
+  float minimum = NOISE_SIGMAS * result.noise > MIN_RISE ? NOISE_SIGMAS * result.noise : MIN_RISE;
+  if (result.rise < minimum) {
+    result.error = "no response to the pulse";
+    return result;
+  }
+  if (peakIndex + MIN_TAIL >= trace.count) {
+    result.error = "still rising when the trace ended - observe longer";
+    return result;
+  }
+  result.peakSeconds = (float)(peakIndex - trace.pulseStart) * trace.intervalMs / 1000.0f;
+  result.gainPerSecond = result.rise / trace.pulseSeconds;
+
+  // Two-point first-order fit on the rise
+  float t28 = crossingSeconds(trace, trace.pulseStart, peakIndex, result.baseline + 0.283f * result.rise);
+  float t63 = crossingSeconds(trace, trace.pulseStart, peakIndex, result.baseline + 0.632f * result.rise);
+  if (t28 < 0 || t63 < t28) {
+    result.error = "rise too irregular to fit";
+    return result;
+  }
+  result.tauSeconds = 1.5f * (t63 - t28);
+  result.deadTimeSeconds = t63 - result.tauSeconds > 0 ? t63 - result.tauSeconds : 0;
+
+  // Least-squares slope of the dry-down after the peak
+  float sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  size_t points = trace.count - peakIndex;
+  for (size_t i = peakIndex; i < trace.count; i++) {
+    float x = (float)(i - peakIndex);
+    float y = trace.moisture[i] / 100.0f;
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+  float denominator = points * sumXX - sumX * sumX;
+  float slopePerSample = denominator > 0 ? (points * sumXY - sumX * sumY) / denominator : 0;
+  float decay = -slopePerSample * 3600000.0f / trace.intervalMs;
+  result.decayPerHour = decay > 0 ? decay : 0;
+
+  result.ok = true;
+  result.error = "";
+  return result;
+}
+
+}  // namespace stepid
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * Smart Farming System - Remote Syslog
+ *
+ * Sends log messages as RFC 5424 syslog over UDP, so units on a pole can be
+ * followed from a collector instead of a serial cable:
+ *
+ *   syslog::Logger remoteLog;
+ *   remoteLog.begin(config);                                  // once, from setup()
+ *   remoteLog.log(syslog::SEV_WARNING, "tank", "level %d%%", 12);  // any task, not ISRs
+ *
+ *   syslog::Tee Log(Serial, remoteLog);                       // Print that mirrors
+ *   Log.println("Error: sensor timeout");                     // whole lines to syslog
+ *
+ * Messages are formatted straight into one of POOL_SIZE fixed packet buffers
+ * and queued for the sender task, which owns the UDP socket. The caller
+ * never waits and never allocates: if its severity has no token left, or
+ * every buffer is in flight, the message is dropped and counted, and the
+ * sender reports the drops in a notice of its own. While WiFi is down,
+ * queued messages wait and newer ones are dropped. In access-point fallback
+ * (station link down, the unit's own AP up with a client on it) messages go
+ * to the AP's broadcast address instead when apBroadcast is set: the
+ * collector on the home network is out of reach, a laptop on the AP is not.
+ *
+ * Each severity has a token bucket (refilled per minute, capped at burst),
+ * so a fault that logs in a tight loop cannot flood the link or starve the
+ * messages around it.
+ */
+
+#ifndef SYSLOG_H
+#define SYSLOG_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <stdarg.h>
+#include <sys/time.h>
+#include <time.h>
+
+namespace syslog {
+
+constexpr int POOL_SIZE = 8;              // Packets formatted but not yet sent
+constexpr size_t PACKET_SIZE = 256;       // Longer messages are cut
+constexpr size_t TEE_LINE_SIZE = 160;     // Longest line Tee collects before sending it on
+constexpr uint32_t DROP_REPORT_MS = 10000;
+
+// RFC 5424 severities
+enum Severity : uint8_t {
+  SEV_EMERGENCY = 0,
+  SEV_ALERT,
+  SEV_CRITICAL,
+  SEV_ERROR,
+  SEV_WARNING,
+  SEV_NOTICE,
+  SEV_INFO,
+  SEV_DEBUG,
+  SEVERITY_COUNT
+};
+
+struct Config {
+  const char* host;
+  uint16_t port;
+  uint8_t facility;                       // 16 = local0
+  const char* hostname;
+  const char* appName;
+  uint16_t perMinute[SEVERITY_COUNT];     // Token refill per severity
+  uint16_t burst;                         // Bucket size
+  bool apBroadcast;                       // In AP fallback, broadcast on the AP subnet
+  uint32_t taskStack;
+  UBaseType_t taskPriority;
+  BaseType_t taskCore;
+};
+
+struct Stats {
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t sendFailed;
+  uint32_t poolExhausted;
+  uint32_t rateLimited[SEVERITY_COUNT];
+  uint32_t reports;                       // Drop notices sent
+};
+
+inline bool startsWithNoCase(const char* text, const char* prefix) {
+  for (; *prefix != '\0'; text++, prefix++) {
+    if (tolower((unsigned char)*text) != *prefix) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Severity of a free-form log line, from how the firmware words its messages
+inline Severity classify(const char* line) {
+  while (*line == ' ') {
+    line++;
+  }
+  if (startsWithNoCase(line, "emergency") || startsWithNoCase(line, "fault")) {
+    return SEV_CRITICAL;
+  }
+  if (startsWithNoCase(line, "error") || strstr(line, "FAILSAFE") != nullptr) {
+    return SEV_ERROR;
+  }
+  if (startsWithNoCase(line, "warning") || strstr(line, "failed") != nullptr || strstr(line, "refused") != nullptr) {
+    return SEV_WARNING;
+  }
+  return SEV_INFO;
+}
+
+class Logger {
+ public:
+  bool begin(const Config& config) {
+    if (freeQueue_ != nullptr) {
+      return true;
+    }
+    config_ = config;
+    for (int i = 0; i < SEVERITY_COUNT; i++) {
+      tokens_[i] = (int32_t)config_.burst * 1000;
+    }
+    refilledAt_ = millis();
+    freeQueue_ = xQueueCreate(POOL_SIZE, sizeof(uint8_t));
+    readyQueue_ = xQueueCreate(POOL_SIZE, sizeof(uint8_t));
+    if (freeQueue_ == nullptr || readyQueue_ == nullptr) {
+      return false;
+    }
+    for (uint8_t i = 0; i < POOL_SIZE; i++) {
+      xQueueSend(freeQueue_, &i, 0);
+    }
+    return xTaskCreatePinnedToCore(senderTask, "syslog", config_.taskStack, this,
+                                   config_.taskPriority, nullptr, config_.taskCore) == pdPASS;
+  }
+
+  // printf-style; false when the message was dropped
+  bool log(Severity severity, const char* msgid, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool queued = vlog(severity, msgid, format, args);
+    va_end(args);
+    return queued;
+  }
+
+  bool post(Severity severity, const char* msgid, const char* text) {
+    return log(severity, msgid, "%s", text);
+  }
+
+  bool vlog(Severity severity, const char* msgid, const char* format, va_list args) {
+    if (freeQueue_ == nullptr || severity >= SEVERITY_COUNT) {
+      return false;
+    }
+    if (!takeToken(severity)) {
+      __atomic_fetch_add(&stats.rateLimited[severity], 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    uint8_t index;
+    if (xQueueReceive(freeQueue_, &index, 0) != pdTRUE) {
+      __atomic_fetch_add(&stats.poolExhausted, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    size_t length = header(packets_[index], severity, msgid);
+    int body = vsnprintf(packets_[index] + length, PACKET_SIZE - length, format, args);
+    if (body > 0) {
+      length = min(length + (size_t)body, PACKET_SIZE - 1);
+    }
+    lengths_[index] = length;
+    xQueueSend(readyQueue_, &index, 0);   // Never full: it holds at most POOL_SIZE indices
+    __atomic_fetch_add(&stats.queued, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  uint32_t dropped() const {
+    uint32_t total = __atomic_load_n(&stats.poolExhausted, __ATOMIC_RELAXED);
+    for (int i = 0; i < SEVERITY_COUNT; i++) {
+      total += __atomic_load_n(&stats.rateLimited[i], __ATOMIC_RELAXED);
+    }
+    return total;
+  }
+
+  bool started() const {
+    return freeQueue_ != nullptr;
+  }
+
+  Stats stats = {};
+
+ private:
+  // "<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA "
+  size_t header(char* out, Severity severity, const char* msgid) const {
+    char timestamp[32] = "-";
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    if (now.tv_sec >= 1600000000) {
+      struct tm utc;
+      gmtime_r(&now.tv_sec, &utc);
+      size_t used = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+      snprintf(timestamp + used, sizeof(timestamp) - used, ".%03dZ", (int)(now.tv_usec / 1000));
+    }
+    int length = snprintf(out, PACKET_SIZE, "<%u>1 %s %s %s - %s - ", config_.facility * 8 + severity, timestamp,
+                          config_.hostname, config_.appName, msgid && msgid[0] ? msgid : "-");
+    return length > 0 ? min((size_t)length, PACKET_SIZE - 1) : 0;
+  }
+
+  bool takeToken(Severity severity) {
+    portENTER_CRITICAL(&lock_);
+    uint32_t now = millis();
+    uint32_t elapsed = now - refilledAt_;
+    if (elapsed >= 60) {
+      refilledAt_ = now;
+      int32_t cap = (int32_t)config_.burst * 1000;
+      for (int i = 0; i < SEVERITY_COUNT; i++) {
+        // 1000 units per token, perMinute tokens per 60000 ms; the part of a
+        // thousandth left over is carried to the next refill, not dropped
+        int64_t sixtieths = (int64_t)config_.perMinute[i] * elapsed + refillRemainder_[i];
+        int64_t refilled = tokens_[i] + sixtieths / 60;
+        refillRemainder_[i] = refilled < cap ? (uint8_t)(sixtieths % 60) : 0;
+        tokens_[i] = (int32_t)min((int64_t)cap, refilled);
+      }
+    }
+    bool allowed = tokens_[severity] >= 1000;
+    if (allowed) {
+      tokens_[severity] -= 1000;
+    }
+    portEXIT_CRITICAL(&lock_);
+    return allowed;
+  }
+
+  static void senderTask(void* arg) {
+    Logger* logger = static_cast<Logger*>(arg);
+    for (;;) {
+      Link link = logger->link();
+      if (link == LINK_DOWN) {
+        vTaskDelay(pdMS_TO_TICKS(500));   // Queued messages wait for the link
+        continue;
+      }
+      uint8_t index;
+      if (xQueueReceive(logger->readyQueue_, &index, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        logger->send(logger->packets_[index], logger->lengths_[index], link);
+        xQueueSend(logger->freeQueue_, &index, 0);
+      }
+      logger->reportDrops(link);
+    }
+  }
+
+  enum Link : uint8_t {
+    LINK_DOWN,
+    LINK_STATION,                         // Joined to the configured network: send to host
+    LINK_ACCESS_POINT                     // Own AP with a client on it: broadcast there
+  };
+
+  Link link() const {
+    if (WiFi.status() == WL_CONNECTED) {
+      return LINK_STATION;
+    }
+    if (config_.apBroadcast && (WiFi.getMode() & WIFI_AP) && WiFi.softAPgetStationNum() > 0) {
+      return LINK_ACCESS_POINT;
+    }
+    return LINK_DOWN;
+  }
+
+  void send(const char* packet, size_t length, Link link) {
+    int begun = link == LINK_ACCESS_POINT ? udp_.beginPacket(WiFi.softAPBroadcastIP(), config_.port)
+                                          : udp_.beginPacket(config_.host, config_.port);
+    if (begun == 1 &&
+        udp_.write((const uint8_t*)packet, length) == length && udp_.endPacket() == 1) {
+      __atomic_fetch_add(&stats.sent, 1, __ATOMIC_RELAXED);
+    } else {
+      __atomic_fetch_add(&stats.sendFailed, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  // Sender task only: says how much was lost, from its own buffer, at most
+  // once per DROP_REPORT_MS
+  void reportDrops(Link link) {
+    uint32_t dropped = this->dropped();
+    if (dropped == reportedDrops_ || millis() - reportedAt_ < DROP_REPORT_MS) {
+      return;
+    }
+    uint32_t rateLimited = dropped - __atomic_load_n(&stats.poolExhausted, __ATOMIC_RELAXED);
+    size_t length = header(reportPacket_, SEV_NOTICE, "syslog");
+    int body = snprintf(reportPacket_ + length, PACKET_SIZE - length, "%lu message(s) dropped (%lu rate-limited, %lu pool full)",
+                        (unsigned long)(dropped - reportedDrops_), (unsigned long)rateLimited,
+                        (unsigned long)__atomic_load_n(&stats.poolExhausted, __ATOMIC_RELAXED));
+    if (body > 0) {
+      length = min(length + (size_t)body, PACKET_SIZE - 1);
+    }
+    send(reportPacket_, length, link);
+    reportedDrops_ = dropped;
+    reportedAt_ = millis();
+    stats.reports++;
+  }
+
+  Config config_ = {};
+  QueueHandle_t freeQueue_ = nullptr;     // Indices of idle buffers
+  QueueHandle_t readyQueue_ = nullptr;    // Indices of formatted packets, oldest first
+  char packets_[POOL_SIZE][PACKET_SIZE] = {};
+  size_t lengths_[POOL_SIZE] = {};
+  char reportPacket_[PACKET_SIZE] = {};
+  uint32_t reportedDrops_ = 0;
+  uint32_t reportedAt_ = 0;
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+  int32_t tokens_[SEVERITY_COUNT] = {};   // Thousandths of a message
+  uint8_t refillRemainder_[SEVERITY_COUNT] = {};  // Sixtieths of a thousandth not yet credited
+  uint32_t refilledAt_ = 0;
+  WiFiUDP udp_;
+};
+
+// Print that writes through to out and hands every complete line to the
+// logger, with the severity taken from its wording (see classify())
+class Tee : public Print {
+ public:
+  Tee(Print& out, Logger& logger) : out_(out), logger_(logger) {}
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t written = out_.write(buffer, size);
+    if (!logger_.started()) {
+      return written;
+    }
+    for (size_t i = 0; i < size; i++) {
+      char line[TEE_LINE_SIZE];
+      bool complete = false;
+      portENTER_CRITICAL(&lock_);
+      char c = (char)buffer[i];
+      bool endOfLine = c == '\n' || c == '\r';
+      if (endOfLine || length_ + 1 >= TEE_LINE_SIZE) {
+        memcpy(line, line_, length_);
+        line[length_] = '\0';
+        complete = length_ > 0;
+        length_ = 0;
+      }
+      if (!endOfLine) {
+        line_[length_++] = c;
+      }
+      portEXIT_CRITICAL(&lock_);
+      if (complete) {
+        logger_.post(classify(line), "-", line);
+      }
+    }
+    return written;
+  }
+
+ private:
+  Print& out_;
+  Logger& logger_;
+  char line_[TEE_LINE_SIZE] = {};
+  size_t length_ = 0;
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+}  // namespace syslog
+
+#endif
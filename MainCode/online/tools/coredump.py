@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Smart Farming System - Core Dump Helper
+
+Downloads the core dump stored on a running controller and symbolises it
+against the firmware ELF that was running when it crashed.
+
+Usage:
+  python3 coredump.py <device-ip> <firmware.elf> [--user admin --password smartfarm123]
+  python3 coredump.py --file coredump.bin <firmware.elf>
+  python3 coredump.py <device-ip> --erase
+
+The firmware ELF is written next to the .bin by Arduino IDE "Sketch > Export
+Compiled Binary" (online.ino.elf). It must be the exact build that crashed.
+
+Requires esp-coredump (pip install esp-coredump), which ships with ESP-IDF.
+"""
+
+import argparse
+import base64
+import shutil
+import subprocess
+import sys
+import urllib.error
+import urllib.request
+
+
+def request(ip, method, user, password):
+    req = urllib.request.Request("http://%s/api/coredump" % ip, method=method)
+    if user:
+        token = base64.b64encode(("%s:%s" % (user, password)).encode()).decode()
+        req.add_header("Authorization", "Basic " + token)
+    return urllib.request.urlopen(req, timeout=30)
+
+
+def download(ip, path, user, password):
+    try:
+        with request(ip, "GET", user, password) as response, open(path, "wb") as out:
+            expected = int(response.headers.get("Content-Length", 0))
+            shutil.copyfileobj(response, out)
+            size = out.tell()
+    except urllib.error.HTTPError as error:
+        if error.code == 404:
+            sys.exit("No core dump stored on %s" % ip)
+        sys.exit("Download failed: HTTP %d" % error.code)
+    if expected and size != expected:
+        sys.exit("Download truncated: got %d of %d bytes" % (size, expected))
+    print("Saved %d bytes to %s" % (size, path))
+
+
+def symbolise(path, elf):
+    tool = shutil.which("esp-coredump") or shutil.which("espcoredump.py")
+    if tool is None:
+        sys.exit("esp-coredump not found - install it with: pip install esp-coredump")
+    command = [tool, "info_corefile", "--core", path, "--core-format", "raw", elf]
+    print(" ".join(command))
+    return subprocess.call(command)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fetch and decode Smart Farming core dumps")
+    parser.add_argument("device", nargs="?", help="Controller IP address")
+    parser.add_argument("elf", nargs="?", help="Firmware ELF of the build that crashed")
+    parser.add_argument("--file", help="Decode an already downloaded dump instead")
+    parser.add_argument("--output", default="coredump.bin", help="Where to save the download")
+    parser.add_argument("--user", help="Web username (when ENABLE_WEB_AUTH is set)")
+    parser.add_argument("--password", default="", help="Web password")
+    parser.add_argument("--erase", action="store_true", help="Erase the stored dump on the device")
+    args = parser.parse_args()
+
+    if args.erase:
+        if not args.device:
+            parser.error("--erase needs the device address")
+        with request(args.device, "DELETE", args.user, args.password) as response:
+            print(response.read().decode())
+        return 0
+
+    if args.file:
+        # With --file the only positional argument is the ELF
+        elf = args.elf or args.device
+        path = args.file
+    else:
+        if not args.device:
+            parser.error("device address or --file is required")
+        elf = args.elf
+        path = args.output
+        download(args.device, path, args.user, args.password)
+
+    if not elf:
+        print("No firmware ELF given - dump saved but not decoded")
+        return 0
+    return symbolise(path, elf)
+
+
+if __name__ == "__main__":
+    sys.exit(main())